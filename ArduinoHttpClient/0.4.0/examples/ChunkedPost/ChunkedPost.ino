@@ -0,0 +1,89 @@
+/*
+  Chunked POST client for ArduinoHttpClient library
+  Connects to server once a minute and uploads a log file from an SD
+  card.  The file is sent straight from the card in small chunks, so it
+  can be any size and its length doesn't need to be known up front.
+
+  Use with the /chunked route of the node_test_server example, which
+  checks the upload arrived chunked and reports its length and speed
+
+  this example is in the public domain
+ */
+#include <ArduinoHttpClient.h>
+#include <WiFi101.h>
+#include <SD.h>
+#include "arduino_secrets.h"
+
+///////please enter your sensitive data in the Secret tab/arduino_secrets.h
+/////// Wifi Settings ///////
+char ssid[] = SECRET_SSID;
+char pass[] = SECRET_PASS;
+
+char serverAddress[] = "192.168.0.3";  // server address
+int port = 8080;
+
+const int chipSelect = 4;              // SD card chip select pin
+const char logFile[] = "datalog.csv";  // file to upload
+
+WiFiClient wifi;
+HttpClient client = HttpClient(wifi, serverAddress, port);
+int status = WL_IDLE_STATUS;
+
+void setup() {
+  Serial.begin(9600);
+  while ( status != WL_CONNECTED) {
+    Serial.print("Attempting to connect to Network named: ");
+    Serial.println(ssid);                   // print the network name (SSID);
+
+    // Connect to WPA/WPA2 network:
+    status = WiFi.begin(ssid, pass);
+  }
+
+  // print the SSID of the network you're attached to:
+  Serial.print("SSID: ");
+  Serial.println(WiFi.SSID());
+
+  // print your WiFi shield's IP address:
+  IPAddress ip = WiFi.localIP();
+  Serial.print("IP Address: ");
+  Serial.println(ip);
+
+  if (!SD.begin(chipSelect)) {
+    Serial.println("SD card failed, or not present");
+    while (true);
+  }
+}
+
+void loop() {
+  File dataFile = SD.open(logFile);
+  if (dataFile) {
+    Serial.println("making chunked POST request");
+    unsigned long start = millis();
+
+    int err = client.post("/chunked", "text/csv", dataFile);
+    dataFile.close();
+
+    if (err == 0) {
+      // read the status code and body of the response
+      int statusCode = client.responseStatusCode();
+      String response = client.responseBody();
+
+      Serial.print("Status code: ");
+      Serial.println(statusCode);
+      Serial.print("Response: ");
+      Serial.println(response);
+      Serial.print("Took ");
+      Serial.print(millis() - start);
+      Serial.println(" ms");
+    } else {
+      Serial.print("Upload failed: ");
+      Serial.println(err);
+    }
+  } else {
+    Serial.print("Couldn't open ");
+    Serial.println(logFile);
+  }
+
+  Serial.println("Wait a minute");
+  delay(60000);
+}
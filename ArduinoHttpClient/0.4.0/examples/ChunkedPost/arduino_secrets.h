@@ -0,0 +1,6 @@
+#define SECRET_SSID ""
+#define SECRET_PASS ""
+
+
+//Added by Sloeber 
+#pragma once
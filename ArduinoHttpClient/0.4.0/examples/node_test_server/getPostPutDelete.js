@@ -66,6 +66,31 @@ app.get('/chunked', function(request, response) {
 	response.end();
 });
 
+// chunked upload handler, for the ChunkedPost example.  Node's parser
+// rejects a body whose chunk framing is broken, so getting this far means
+// it was good; reply with what arrived and how fast:
+app.post('/chunked', function (request, response) {
+	var start = Date.now();
+	var length = 0;
+	var chunked = (request.headers['transfer-encoding'] == 'chunked');
+
+	request.on('data', function (data) {
+		length += data.length;
+	});
+	request.on('end', function () {
+		var ms = Math.max(Date.now() - start, 1);
+		var result = {
+			chunked: chunked,
+			length: length,
+			ms: ms,
+			bytesPerSecond: Math.round(length * 1000 / ms)
+		};
+		console.log('Got a chunked upload', result);
+		response.send(JSON.stringify(result));
+		response.end();
+	});
+});
+
 // this is the POST handler:
 app.all('/*', function (request, response) {
 	console.log('Got a ' + request.method + ' request');
@@ -9,10 +9,13 @@
 const char* HttpClient::kUserAgent = "Arduino/2.2.0";
 const char* HttpClient::kContentLengthPrefix = HTTP_HEADER_CONTENT_LENGTH ": ";
 const char* HttpClient::kTransferEncodingChunked = HTTP_HEADER_TRANSFER_ENCODING ": " HTTP_HEADER_VALUE_CHUNKED;
+const char* HttpClient::kConnectionClose = HTTP_HEADER_CONNECTION ": close";
 
 HttpClient::HttpClient(Client& aClient, const char* aServerName, uint16_t aServerPort)
  : iClient(&aClient), iServerName(aServerName), iServerAddress(), iServerPort(aServerPort),
-   iConnectionClose(true), iSendDefaultRequestHeaders(true)
+   iConnectionClose(true), iSendDefaultRequestHeaders(true),
+   iConnectionsOpened(0), iConnectionsReused(0),
+   iCaptures(NULL), iCaptureCount(0)
 {
   resetState();
 }
@@ -24,7 +27,9 @@ HttpClient::HttpClient(Client& aClient, const String& aServerName, uint16_t aSer
 
 HttpClient::HttpClient(Client& aClient, const IPAddress& aServerAddress, uint16_t aServerPort)
  : iClient(&aClient), iServerName(NULL), iServerAddress(aServerAddress), iServerPort(aServerPort),
-   iConnectionClose(true), iSendDefaultRequestHeaders(true)
+   iConnectionClose(true), iSendDefaultRequestHeaders(true),
+   iConnectionsOpened(0), iConnectionsReused(0),
+   iCaptures(NULL), iCaptureCount(0)
 {
   resetState();
 }
@@ -32,14 +37,39 @@ HttpClient::HttpClient(Client& aClient, const IPAddress& aServerAddress, uint16_
 void HttpClient::resetState()
 {
   iState = eIdle;
+  resetResponseState();
+  iServerClosing = false;
+  iQueuedRequests = 0;
+  iHttpResponseTimeout = kHttpResponseTimeout;
+}
+
+void HttpClient::resetResponseState()
+{
   iStatusCode = 0;
   iContentLength = kNoContentLengthHeader;
   iBodyLengthConsumed = 0;
-  iContentLengthPtr = kContentLengthPrefix;
-  iTransferEncodingChunkedPtr = kTransferEncodingChunked;
   iIsChunked = false;
   iChunkLength = 0;
-  iHttpResponseTimeout = kHttpResponseTimeout;
+  iChunkLineLength = 0;
+  for (uint8_t i = 0; i < iCaptureCount; i++)
+  {
+    iCaptures[i].iLength = -1;
+    if (iCaptures[i].iValueSize)
+    {
+      iCaptures[i].iValue[0] = '\0';
+    }
+  }
+  startHeaderLine();
+}
+
+void HttpClient::startHeaderLine()
+{
+  iContentLengthPtr = kContentLengthPrefix;
+  iTransferEncodingChunkedPtr = kTransferEncodingChunked;
+  iConnectionClosePtr = kConnectionClose;
+  iCapture = NULL;
+  iCaptureCandidates = (1 << iCaptureCount) - 1;
+  iHeaderNamePos = 0;
 }
 
 void HttpClient::stop()
@@ -64,9 +94,26 @@ void HttpClient::beginRequest()
 }
 
 int HttpClient::startRequest(const char* aURLPath, const char* aHttpMethod, 
-                                const char* aContentType, int aContentLength, const byte aBody[])
+                                const char* aContentType, int aContentLength, const byte aBody[],
+                                Stream* aBodyStream)
 {
-    if (iState == eReadingBody || iState == eReadingChunkLength || iState == eReadingBodyChunk)
+    bool keepAlive = !iConnectionClose && !iServerClosing && iClient->connected();
+    // The server said it would close the connection after the last response
+    bool serverClosing = iServerClosing;
+
+    if (keepAlive && iQueuedRequests == 0 && endOfBodyReached())
+    {
+        // The response has been read, the connection is ready for the next
+        iState = eIdle;
+        resetResponseState();
+    }
+
+    // With keep-alive, a request made before the response to the last one
+    // has been read is sent straight away; its response is read after that
+    tHttpState responseState = iState;
+    bool pipelined = keepAlive && (iState >= eRequestSent);
+
+    if (!pipelined && endOfHeadersReached())
     {
         flushClientRx();
 
@@ -75,13 +122,19 @@ int HttpClient::startRequest(const char* aURLPath, const char* aHttpMethod,
 
     tHttpState initialState = iState;
 
-    if ((eIdle != iState) && (eRequestStarted != iState))
+    if (!pipelined && (eIdle != iState) && (eRequestStarted != iState))
     {
         return HTTP_ERROR_API;
     }
 
-    if (iConnectionClose || !iClient->connected())
+    if (iConnectionClose || serverClosing || !iClient->connected())
     {
+        if (serverClosing)
+        {
+            iClient->stop();
+            iServerClosing = false;
+        }
+        iConnectionsOpened++;
         if (iServerName)
         {
             if (!iClient->connect(iServerName, iServerPort) > 0)
@@ -105,6 +158,7 @@ int HttpClient::startRequest(const char* aURLPath, const char* aHttpMethod,
     }
     else
     {
+        iConnectionsReused++;
 #ifdef LOGGING
         Serial.println("Connection already open");
 #endif
@@ -125,21 +179,37 @@ int HttpClient::startRequest(const char* aURLPath, const char* aHttpMethod,
             sendHeader(HTTP_HEADER_CONTENT_LENGTH, aContentLength);
         }
 
-        bool hasBody = (aBody && aContentLength > 0);
+        if (aBodyStream)
+        {
+            sendHeader(HTTP_HEADER_TRANSFER_ENCODING, HTTP_HEADER_VALUE_CHUNKED);
+        }
+
+        bool hasBody = (aBody && aContentLength > 0) || aBodyStream;
 
-        if (initialState == eIdle || hasBody)
+        if (initialState == eIdle || hasBody || pipelined)
         {
             // This was a simple version of the API, so terminate the headers now
             finishHeaders();
         }
         // else we'll call it in endRequest or in the first call to print, etc.
 
-        if (hasBody)
+        if (aBodyStream)
+        {
+            ret = writeChunkedBody(*aBodyStream);
+        }
+        else if (hasBody)
         {
                 write(aBody, aContentLength);
         }
     }
 
+    if (pipelined && (HTTP_SUCCESS == ret))
+    {
+        // Carry on reading the earlier response
+        iState = responseState;
+        iQueuedRequests++;
+    }
+
     return ret;
 }
 
@@ -281,6 +351,88 @@ void HttpClient::beginBody()
     // else the end of headers has already been sent, so nothing to do here
 }
 
+int HttpClient::sendChunkedBody(Stream& aBody)
+{
+    if (iState != eRequestStarted)
+    {
+        // The headers have to be open to say the body is chunked
+        return HTTP_ERROR_API;
+    }
+    sendHeader(HTTP_HEADER_TRANSFER_ENCODING, HTTP_HEADER_VALUE_CHUNKED);
+    finishHeaders();
+
+    return writeChunkedBody(aBody);
+}
+
+int HttpClient::writeChunkedBody(Stream& aBody)
+{
+    // Each chunk is read in after room for its size line, and sent with
+    // that and its trailing CRLF in a single write
+    uint8_t chunk[kHttpChunkHeaderSize + kHttpChunkSize + 2];
+    uint8_t* data = chunk + kHttpChunkHeaderSize;
+    int len;
+
+    while ((len = aBody.available()) > 0)
+    {
+        len = aBody.readBytes((char*)data, (len < kHttpChunkSize) ? len : kHttpChunkSize);
+        if (len <= 0)
+        {
+            break;
+        }
+
+        uint8_t* start = data;
+        *--start = '\n';
+        *--start = '\r';
+        for (int n = len; n; n >>= 4)
+        {
+            *--start = "0123456789abcdef"[n & 0xf];
+        }
+        data[len] = '\r';
+        data[len + 1] = '\n';
+
+        if (!writeAll(start, (data + len + 2) - start))
+        {
+            stop();
+            return HTTP_ERROR_TIMED_OUT;
+        }
+    }
+
+    // The last chunk, with no trailer
+    if (!writeAll((const uint8_t*)"0\r\n\r\n", 5))
+    {
+        stop();
+        return HTTP_ERROR_TIMED_OUT;
+    }
+    return HTTP_SUCCESS;
+}
+
+bool HttpClient::writeAll(const uint8_t* aBuffer, size_t aSize)
+{
+    unsigned long timeoutStart = millis();
+    while (aSize > 0)
+    {
+        size_t written = iClient->write(aBuffer, aSize);
+        if (written > 0)
+        {
+            aBuffer += written;
+            aSize -= written;
+            // Progress, reset the timeout counter
+            timeoutStart = millis();
+        }
+        else if (!iClient->connected() ||
+                 ( (millis() - timeoutStart) >= iHttpResponseTimeout ))
+        {
+            return false;
+        }
+        else
+        {
+            // The Client's transmit buffer is full, give it time to drain
+            delay(kHttpWaitForBodyDelay);
+        }
+    }
+    return true;
+}
+
 int HttpClient::get(const char* aURLPath)
 {
     return startRequest(aURLPath, HTTP_METHOD_GET);
@@ -316,6 +468,11 @@ int HttpClient::post(const char* aURLPath, const char* aContentType, int aConten
     return startRequest(aURLPath, HTTP_METHOD_POST, aContentType, aContentLength, aBody);
 }
 
+int HttpClient::post(const char* aURLPath, const char* aContentType, Stream& aBody)
+{
+    return startRequest(aURLPath, HTTP_METHOD_POST, aContentType, -1, NULL, &aBody);
+}
+
 int HttpClient::put(const char* aURLPath)
 {
     return startRequest(aURLPath, HTTP_METHOD_PUT);
@@ -341,6 +498,11 @@ int HttpClient::put(const char* aURLPath, const char* aContentType, int aContent
     return startRequest(aURLPath, HTTP_METHOD_PUT, aContentType, aContentLength, aBody);
 }
 
+int HttpClient::put(const char* aURLPath, const char* aContentType, Stream& aBody)
+{
+    return startRequest(aURLPath, HTTP_METHOD_PUT, aContentType, -1, NULL, &aBody);
+}
+
 int HttpClient::patch(const char* aURLPath)
 {
     return startRequest(aURLPath, HTTP_METHOD_PATCH);
@@ -397,6 +559,24 @@ int HttpClient::responseStatusCode()
     {
         return HTTP_ERROR_API;
     }
+    if (iState > eRequestSent && iQueuedRequests > 0)
+    {
+        // Move on to the response to the next request
+        int ret = skipResponseBody();
+        if (ret != HTTP_SUCCESS)
+        {
+            return ret;
+        }
+        if (iServerClosing)
+        {
+            // The requests queued behind this response will not be answered
+            stop();
+            return HTTP_ERROR_CONNECTION_FAILED;
+        }
+        resetResponseState();
+        iState = eRequestSent;
+        iQueuedRequests--;
+    }
     // The first line will be of the form Status-Line:
     //   HTTP-Version SP Status-Code SP Reason-Phrase CRLF
     // Where HTTP-Version is of the form:
@@ -514,7 +694,25 @@ int HttpClient::skipResponseHeaders()
     {
         if (available())
         {
-            (void)readHeader();
+            if (iState == eSkipToEndOfHeader && !iCapture)
+            {
+                // Nothing more is wanted from this line, so read to the end
+                // of it without going through readHeader() for each character
+                int c;
+                while ((c = iClient->read()) >= 0)
+                {
+                    if (c == '\n')
+                    {
+                        iState = eStatusCodeRead;
+                        startHeaderLine();
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                (void)readHeader();
+            }
             // We read something, reset the timeout counter
             timeoutStart = millis();
         }
@@ -539,9 +737,83 @@ int HttpClient::skipResponseHeaders()
 
 bool HttpClient::endOfHeadersReached()
 {
-    return (iState == eReadingBody || iState == eReadingChunkLength || iState == eReadingBodyChunk);
+    return (iState == eReadingBody || iState == eReadingChunkLength || iState == eReadingBodyChunk ||
+            iState == eReadingChunkTrailer || iState == eBodyComplete);
 };
 
+int HttpClient::skipResponseBody()
+{
+    if (iState < eRequestSent)
+    {
+        return HTTP_ERROR_API;
+    }
+    if (iState == eRequestSent)
+    {
+        int ret = responseStatusCode();
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    int ret = skipResponseHeaders();
+    if (ret != HTTP_SUCCESS)
+    {
+        return ret;
+    }
+
+    bool unframed = !iIsChunked && (bodyBytesLeft() < 0);
+    if (unframed)
+    {
+        // The body runs until the server closes the connection
+        iServerClosing = true;
+    }
+    uint8_t buf[32];
+    unsigned long timeoutStart = millis();
+    while (!endOfBodyReached() &&
+           ( (millis() - timeoutStart) < iHttpResponseTimeout ))
+    {
+        int len = available();
+        if (len > 0)
+        {
+            read(buf, min(len, (int)sizeof(buf)));
+            // We read something, reset the timeout counter
+            timeoutStart = millis();
+        }
+        else if (unframed && !iClient->connected())
+        {
+            return HTTP_SUCCESS;
+        }
+        else
+        {
+            delay(kHttpWaitForBodyDelay);
+        }
+    }
+    if (endOfBodyReached())
+    {
+        return HTTP_SUCCESS;
+    }
+    else
+    {
+        // The connection is out of step with the responses now
+        stop();
+        return HTTP_ERROR_TIMED_OUT;
+    }
+}
+
+int HttpClient::bodyBytesLeft()
+{
+    if (iStatusCode == 204 || iStatusCode == 304)
+    {
+        // These never have a body
+        return 0;
+    }
+    if (iContentLength == kNoContentLengthHeader)
+    {
+        return -1;
+    }
+    return (iBodyLengthConsumed < iContentLength) ? iContentLength - iBodyLengthConsumed : 0;
+}
+
 int HttpClient::contentLength()
 {
     // skip the response headers, if they haven't been read already 
@@ -596,10 +868,15 @@ String HttpClient::responseBody()
 
 bool HttpClient::endOfBodyReached()
 {
-    if (endOfHeadersReached() && (contentLength() != kNoContentLengthHeader))
+    if (endOfHeadersReached())
     {
-        // We've got to the body and we know how long it will be
-        return (iBodyLengthConsumed >= contentLength());
+        if (iIsChunked)
+        {
+            // The last chunk and the trailer have been read
+            return (iState == eBodyComplete);
+        }
+        // We've got to the body, have we read as much as it is long
+        return (bodyBytesLeft() == 0);
     }
     return false;
 }
@@ -614,7 +891,21 @@ int HttpClient::available()
 
             if (c == '\n')
             {
-                iState = eReadingBodyChunk;
+                if (iChunkLineLength == 0)
+                {
+                    // The end of the line after the previous chunk's data
+                    continue;
+                }
+                iChunkLineLength = 0;
+                if (iChunkLength == 0)
+                {
+                    // The last chunk, only the trailer follows
+                    iState = eReadingChunkTrailer;
+                }
+                else
+                {
+                    iState = eReadingBodyChunk;
+                }
                 break;
             }
             else if (c == '\r')
@@ -626,16 +917,35 @@ int HttpClient::available()
                 char digit[2] = {c, '\0'};
 
                 iChunkLength = (iChunkLength * 16) + strtol(digit, NULL, 16);
+                iChunkLineLength++;
             }
         }
     }
 
-    if (iState == eReadingBodyChunk && iChunkLength == 0)
+    if (iState == eReadingChunkTrailer)
     {
-        iState = eReadingChunkLength;
+        // Skip trailer headers up to the empty line that ends the body
+        while (iClient->available())
+        {
+            char c = iClient->read();
+
+            if (c == '\n')
+            {
+                if (iChunkLineLength == 0)
+                {
+                    iState = eBodyComplete;
+                    break;
+                }
+                iChunkLineLength = 0;
+            }
+            else if (c != '\r')
+            {
+                iChunkLineLength++;
+            }
+        }
     }
-    
-    if (iState == eReadingChunkLength)
+
+    if (iState == eReadingChunkLength || iState == eReadingChunkTrailer || iState == eBodyComplete)
     {
         return 0;
     }
@@ -646,6 +956,11 @@ int HttpClient::available()
     {
         return min(clientAvailable, iChunkLength);
     }
+    else if (iState == eReadingBody && bodyBytesLeft() >= 0)
+    {
+        // Leave the next response alone
+        return min(clientAvailable, bodyBytesLeft());
+    }
     else
     {
         return clientAvailable;
@@ -660,6 +975,12 @@ int HttpClient::read()
         return -1;
     }
 
+    if (iState == eReadingBody && bodyBytesLeft() == 0)
+    {
+        // Anything after this belongs to the next response
+        return -1;
+    }
+
     int ret = iClient->read();
     if (ret >= 0)
     {
@@ -683,6 +1004,29 @@ int HttpClient::read()
     return ret;
 }
 
+void HttpClient::captureHeaders(HttpHeaderCapture* aCaptures, uint8_t aCount)
+{
+    iCaptures = aCaptures;
+    iCaptureCount = aCaptures ? aCount : 0;
+    if (iCaptureCount > kMaxHeaderCaptures)
+    {
+        iCaptureCount = kMaxHeaderCaptures;
+    }
+    for (uint8_t i = 0; i < iCaptureCount; i++)
+    {
+        iCaptures[i].iLength = -1;
+        if (iCaptures[i].iValueSize)
+        {
+            iCaptures[i].iValue[0] = '\0';
+        }
+    }
+    if (iState <= eStatusCodeRead)
+    {
+        // The headers haven't been started, so they can all be matched
+        startHeaderLine();
+    }
+}
+
 bool HttpClient::headerAvailable()
 {
     // clear the currently store header line
@@ -747,6 +1091,24 @@ String HttpClient::readHeaderValue()
 
 int HttpClient::read(uint8_t *buf, size_t size)
 {
+    if (endOfHeadersReached())
+    {
+        if (endOfBodyReached())
+        {
+            return -1;
+        }
+        // Stop at the end of the chunk or body, the chunk framing or the
+        // next response follows
+        int left = iIsChunked ? available() : bodyBytesLeft();
+        if (left >= 0 && size > (size_t)left)
+        {
+            size = left;
+        }
+        if (size == 0)
+        {
+            return 0;
+        }
+    }
     int ret =iClient->read(buf, size);
     if (endOfHeadersReached() && iContentLength > 0)
     {
@@ -757,6 +1119,15 @@ int HttpClient::read(uint8_t *buf, size_t size)
             iBodyLengthConsumed += ret;
         }
     }
+    if (ret > 0 && iState == eReadingBodyChunk)
+    {
+        iChunkLength -= ret;
+
+        if (iChunkLength == 0)
+        {
+            iState = eReadingChunkLength;
+        }
+    }
     return ret;
 }
 
@@ -771,17 +1142,63 @@ int HttpClient::readHeader()
         return c;
     }
 
+    if (iCapture && (c != '\r') && (c != '\n'))
+    {
+        // Copy the value of a header being captured, less leading whitespace
+        if ( ((iCapture->iLength > 0) || !isSpace(c)) &&
+             ((size_t)iCapture->iLength + 1 < iCapture->iValueSize) )
+        {
+            iCapture->iValue[iCapture->iLength++] = c;
+            iCapture->iValue[iCapture->iLength] = '\0';
+        }
+    }
+
     // Whilst reading out the headers to whoever wants them, we'll keep an
     // eye out for the "Content-Length" header
     switch(iState)
     {
     case eStatusCodeRead:
+    {
         // We're at the start of a line, or somewhere in the middle of reading
-        // the Content-Length prefix
-        if (*iContentLengthPtr == c)
+        // one of the prefixes we look out for, or the names of headers to
+        // capture.  Each is matched on its own, as they can share leading
+        // characters; one that stops matching is set to NULL (or its
+        // candidate bit cleared) until the next line
+        bool lineStart = (iHeaderNamePos == 0);
+        bool matching = false;
+        if (iCaptureCandidates)
+        {
+            // Match the header names to capture, ignoring case
+            for (uint8_t i = 0; i < iCaptureCount; i++)
+            {
+                if (iCaptureCandidates & (1 << i))
+                {
+                    char n = pgm_read_byte(iCaptures[i].iName + iHeaderNamePos);
+                    if ((n == '\0') && (c == ':'))
+                    {
+                        // The whole name matched, the value follows
+                        iCapture = &iCaptures[i];
+                        iCapture->iLength = 0;
+                        iCaptureCandidates = 0;
+                        break;
+                    }
+                    else if ((n == '\0') || (tolower(n) != tolower(c)))
+                    {
+                        iCaptureCandidates &= ~(1 << i);
+                    }
+                }
+            }
+            matching = (iCaptureCandidates != 0);
+        }
+        if (iHeaderNamePos < 255)
+        {
+            iHeaderNamePos++;
+        }
+        if (iContentLengthPtr && (*iContentLengthPtr == c))
         {
             // This character matches, just move along
             iContentLengthPtr++;
+            matching = true;
             if (*iContentLengthPtr == '\0')
             {
                 // We've reached the end of the prefix
@@ -792,10 +1209,15 @@ int HttpClient::readHeader()
                 iBodyLengthConsumed = 0;
             }
         }
-        else if (*iTransferEncodingChunkedPtr == c)
+        else
+        {
+            iContentLengthPtr = NULL;
+        }
+        if (iTransferEncodingChunkedPtr && (*iTransferEncodingChunkedPtr == c))
         {
             // This character matches, just move along
             iTransferEncodingChunkedPtr++;
+            matching = true;
             if (*iTransferEncodingChunkedPtr == '\0')
             {
                 // We've reached the end of the Transfer Encoding: chunked header
@@ -803,18 +1225,42 @@ int HttpClient::readHeader()
                 iState = eSkipToEndOfHeader;
             }
         }
-        else if (((iContentLengthPtr == kContentLengthPrefix) && (iTransferEncodingChunkedPtr == kTransferEncodingChunked)) && (c == '\r'))
+        else
+        {
+            iTransferEncodingChunkedPtr = NULL;
+        }
+        if (iConnectionClosePtr && (*iConnectionClosePtr == c))
         {
-            // We've found a '\r' at the start of a line, so this is probably
-            // the end of the headers
-            iState = eLineStartingCRFound;
+            // This character matches, just move along
+            iConnectionClosePtr++;
+            matching = true;
+            if (*iConnectionClosePtr == '\0')
+            {
+                // The server will close the connection after this response
+                iServerClosing = true;
+                iState = eSkipToEndOfHeader;
+            }
         }
         else
         {
-            // This isn't the Content-Length or Transfer Encoding chunked header, skip to the end of the line
-            iState = eSkipToEndOfHeader;
+            iConnectionClosePtr = NULL;
+        }
+        if (!matching)
+        {
+            if (lineStart && (c == '\r'))
+            {
+                // We've found a '\r' at the start of a line, so this is probably
+                // the end of the headers
+                iState = eLineStartingCRFound;
+            }
+            else
+            {
+                // This isn't a header we look out for, skip to the end of the line
+                iState = eSkipToEndOfHeader;
+            }
         }
         break;
+    }
     case eReadingContentLength:
         if (isdigit(c))
         {
@@ -835,6 +1281,7 @@ int HttpClient::readHeader()
             {
                 iState = eReadingChunkLength;
                 iChunkLength = 0;
+                iChunkLineLength = 0;
             }
             else
             {
@@ -851,8 +1298,7 @@ int HttpClient::readHeader()
     {
         // We've got to the end of this line, start processing again
         iState = eStatusCodeRead;
-        iContentLengthPtr = kContentLengthPrefix;
-        iTransferEncodingChunkedPtr = kTransferEncodingChunked;
+        startHeaderLine();
     }
     // And return the character read to whoever wants it
     return c;
@@ -38,11 +38,27 @@ static const int HTTP_ERROR_INVALID_RESPONSE =-4;
 #define HTTP_HEADER_USER_AGENT     "User-Agent"
 #define HTTP_HEADER_VALUE_CHUNKED  "chunked"
 
+// A response header whose value is wanted, see HttpClient::captureHeaders()
+struct HttpHeaderCapture
+{
+    // Name of the header, in PROGMEM.  It is matched ignoring case
+    const char* iName;
+    // Buffer the value is copied into, less any leading whitespace.  It is
+    // always NUL terminated
+    char* iValue;
+    // Size of iValue, longer values are cut short
+    size_t iValueSize;
+    // Length of the value copied into iValue, or -1 if the header wasn't in
+    // the response
+    int iLength;
+};
+
 class HttpClient : public Client
 {
 public:
     static const int kNoContentLengthHeader =-1;
     static const int kHttpPort =80;
+    static const uint8_t kMaxHeaderCaptures =8;
     static const char* kUserAgent;
 
 // FIXME Write longer API request, using port and user-agent, example
@@ -96,6 +112,17 @@ public:
     int post(const String& aURLPath, const String& aContentType, const String& aBody);
     int post(const char* aURLPath, const char* aContentType, int aContentLength, const byte aBody[]);
 
+    /** Connect to the server and send a POST request with the body read
+        from a Stream, such as a File, whose length need not be known.
+        The body is sent with chunked Transfer-Encoding
+      @param aURLPath     Url to request
+      @param aContentType Content type of request body
+      @param aBody        Stream to read the body from, until it has
+                          nothing available
+      @return 0 if successful, else error
+    */
+    int post(const char* aURLPath, const char* aContentType, Stream& aBody);
+
     /** Connect to the server and start to send a PUT request.
       @param aURLPath     Url to request
       @return 0 if successful, else error
@@ -114,6 +141,16 @@ public:
     int put(const String& aURLPath, const String& aContentType, const String& aBody);
     int put(const char* aURLPath, const char* aContentType, int aContentLength, const byte aBody[]);
 
+    /** Connect to the server and send a PUT request with the body read
+        from a Stream, sent with chunked Transfer-Encoding
+      @param aURLPath     Url to request
+      @param aContentType Content type of request body
+      @param aBody        Stream to read the body from, until it has
+                          nothing available
+      @return 0 if successful, else error
+    */
+    int put(const char* aURLPath, const char* aContentType, Stream& aBody);
+
     /** Connect to the server and start to send a PATCH request.
       @param aURLPath     Url to request
       @return 0 if successful, else error
@@ -157,13 +194,26 @@ public:
       @param aContentType    Content type of request body (optional)
       @param aContentLength  Length of request body (optional)
       @param aBody           Body of request (optional)
+      @param aBodyStream     Stream to read the body from, sent chunked as its
+                             length isn't known (optional)
       @return 0 if successful, else error
     */
     int startRequest(const char* aURLPath,
                      const char* aHttpMethod,
                      const char* aContentType = NULL,
                      int aContentLength = -1,
-                     const byte aBody[] = NULL);
+                     const byte aBody[] = NULL,
+                     Stream* aBodyStream = NULL);
+
+    /** Send the body of a more complex request from a Stream, with chunked
+        Transfer-Encoding.  Use this in place of beginBody(), after any
+        additional headers.  The body is sent kHttpChunkSize bytes at a time
+        until aBody has nothing available, waiting for the Client to accept
+        each chunk
+      @param aBody  Stream to read the body from
+      @return 0 if successful, else error
+    */
+    int sendChunkedBody(Stream& aBody);
 
     /** Send an additional header line.  This can only be called in between the
       calls to beginRequest and endRequest.
@@ -223,6 +273,24 @@ public:
     */
     bool headerAvailable();
 
+    /** Capture the values of just the response headers of interest, straight
+      into the caller's buffers, rather than looping over every header with
+      headerAvailable().  Other headers are skipped without being stored.
+      For example:
+        const char kETag[] PROGMEM = "ETag";
+        char etag[40];
+        HttpHeaderCapture captures[] = { { kETag, etag, sizeof(etag) } };
+        client.captureHeaders(captures, 1);
+      The values are filled in as the headers are read, by
+      skipResponseHeaders(), contentLength(), responseBody(), readHeader(),
+      etc., and cleared for each response.  The list is kept until the next
+      call; pass NULL to stop capturing
+      @param aCaptures Headers to capture
+      @param aCount    Number of entries in aCaptures, at most
+                       kMaxHeaderCaptures
+    */
+    void captureHeaders(HttpHeaderCapture* aCaptures, uint8_t aCount);
+
     /** Read the name of the current response header.
       Returns empty string if a header is not available.
     */
@@ -259,7 +327,8 @@ public:
     bool endOfHeadersReached();
 
     /** Test whether the end of the body has been reached.
-      Only works if the Content-Length header was returned by the server
+      Only works if the Content-Length header was returned by the server, or
+      if the body is chunked
       @return true if we are now at the end of the body, else false
     */
     bool endOfBodyReached();
@@ -287,9 +356,39 @@ public:
     String responseBody();
 
     /** Enables connection keep-alive mode
+      The connection is kept open between requests, and reused as long as
+      the server keeps it open too.  In this mode a request made while an
+      earlier response has not been read is sent straight away (pipelined),
+      as long as it is sent in one call (get(), post() with a body, etc.).
+      responseStatusCode() then skips what is left of the current response
+      and moves on to the next one, so responses are read in the order the
+      requests were made.  If the server closes the connection after a
+      response, the requests queued behind it are lost and
+      responseStatusCode() returns HTTP_ERROR_CONNECTION_FAILED.
     */
     void connectionKeepAlive();
 
+    /** Read and discard the rest of the current response, headers and body,
+      using the Content-Length or chunked framing to find its end
+      MUST be called after responseStatusCode()
+      @return HTTP_SUCCESS if successful, else an error code.  If the end of
+      the body cannot be told (no Content-Length and not chunked) the
+      connection is closed
+    */
+    int skipResponseBody();
+
+    /** Number of requests sent whose responses come after the current one
+    */
+    int queuedRequests() { return iQueuedRequests; }
+
+    /** Number of connections opened to the server
+    */
+    uint32_t connectionsOpened() { return iConnectionsOpened; }
+
+    /** Number of requests sent on a connection that was already open
+    */
+    uint32_t connectionsReused() { return iConnectionsReused; }
+
     /** Disables sending the default request headers (Host and User Agent)
     */
     void noDefaultRequestHeaders();
@@ -322,6 +421,29 @@ protected:
     */
     void resetState();
 
+    /** Reset the state kept for the response being read, ready for the next
+    */
+    void resetResponseState();
+
+    /** Remaining body bytes that can be read without running into the
+      next response, or -1 if the body runs to the end of the connection
+    */
+    int bodyBytesLeft();
+
+    /** Write all of aBuffer, waiting while the Client can't take any more
+      @return true if it was all written, false if the connection closed or
+      the Client stopped taking data for longer than the response timeout
+    */
+    bool writeAll(const uint8_t* aBuffer, size_t aSize);
+
+    /** Send aBody as chunks, then the last chunk
+    */
+    int writeChunkedBody(Stream& aBody);
+
+    /** Get ready to match the start of a new header line
+    */
+    void startHeaderLine();
+
     /** Send the first part of the request and the initial headers.
       @param aURLPath	Url to request
       @param aHttpMethod  Type of HTTP request to make, e.g. "GET", "POST", etc.
@@ -341,12 +463,20 @@ protected:
     // Number of milliseconds that we wait each time there isn't any data
     // available to be read (during status code and header processing)
     static const int kHttpWaitForDataDelay = 1000;
+    // Number of milliseconds that we wait each time there isn't any data
+    // available while skipping a response body
+    static const int kHttpWaitForBodyDelay = 10;
+    // Largest chunk sent by sendChunkedBody(), it is buffered on the stack
+    static const int kHttpChunkSize = 64;
+    // Room for the chunk size, in hex, and its CRLF
+    static const int kHttpChunkHeaderSize = 6;
     // Number of milliseconds that we'll wait in total without receiveing any
     // data before returning HTTP_ERROR_TIMED_OUT (during status code and header
     // processing)
     static const int kHttpResponseTimeout = 30*1000;
     static const char* kContentLengthPrefix;
     static const char* kTransferEncodingChunked;
+    static const char* kConnectionClose;
     typedef enum {
         eIdle,
         eRequestStarted,
@@ -358,7 +488,9 @@ protected:
         eLineStartingCRFound,
         eReadingBody,
         eReadingChunkLength,
-        eReadingBodyChunk
+        eReadingBodyChunk,
+        eReadingChunkTrailer,
+        eBodyComplete
     } tHttpState;
     // Client we're using
     Client* iClient;
@@ -381,11 +513,30 @@ protected:
     const char* iTransferEncodingChunkedPtr;
     // Stores if the response body is chunked
     bool iIsChunked;
+    // How far through a Connection: close header we are
+    const char* iConnectionClosePtr;
     // Stores the value of the current chunk length, if present
     int iChunkLength;
+    // Characters seen on the current chunk size or trailer line
+    int iChunkLineLength;
+    // Set when the server will close the connection after this response
+    bool iServerClosing;
+    // Requests sent whose responses come after the current one
+    int iQueuedRequests;
     uint32_t iHttpResponseTimeout;
     bool iConnectionClose;
     bool iSendDefaultRequestHeaders;
+    // Connections made, and requests sent on one already open
+    uint32_t iConnectionsOpened;
+    uint32_t iConnectionsReused;
+    // Response headers to capture, and the one being captured on this line
+    HttpHeaderCapture* iCaptures;
+    uint8_t iCaptureCount;
+    HttpHeaderCapture* iCapture;
+    // Bit for each capture whose name still matches this line so far, and
+    // how far through the line's header name we are
+    uint8_t iCaptureCandidates;
+    uint8_t iHeaderNamePos;
     String iHeaderLine;
 };
 
@@ -1,6 +1,8 @@
 // (c) Copyright Arduino. 2016
 // Released under Apache License, version 2.0
 
+#include <limits.h>
+
 #include "b64.h"
 
 #include "WebSocketClient.h"
@@ -8,21 +10,30 @@
 WebSocketClient::WebSocketClient(Client& aClient, const char* aServerName, uint16_t aServerPort)
  : HttpClient(aClient, aServerName, aServerPort),
    iTxStarted(false),
-   iRxSize(0)
+   iRxSize(0),
+   iRxMasked(false),
+   iRxHeaderLength(0),
+   iPingInterval(0)
 {
 }
 
 WebSocketClient::WebSocketClient(Client& aClient, const String& aServerName, uint16_t aServerPort) 
  : HttpClient(aClient, aServerName, aServerPort),
    iTxStarted(false),
-   iRxSize(0)
+   iRxSize(0),
+   iRxMasked(false),
+   iRxHeaderLength(0),
+   iPingInterval(0)
 {
 }
 
 WebSocketClient::WebSocketClient(Client& aClient, const IPAddress& aServerAddress, uint16_t aServerPort)
  : HttpClient(aClient, aServerAddress, aServerPort),
    iTxStarted(false),
-   iRxSize(0)
+   iRxSize(0),
+   iRxMasked(false),
+   iRxHeaderLength(0),
+   iPingInterval(0)
 {
 }
 
@@ -62,6 +73,9 @@ int WebSocketClient::begin(const char* aPath)
     }
 
     iRxSize = 0;
+    iRxHeaderLength = 0;
+    iLastRxTime = millis();
+    iPingSent = false;
 
     // status code of 101 means success
     return (status == 101) ? 0 : status;
@@ -81,6 +95,7 @@ int WebSocketClient::beginMessage(int aType)
     }
 
     iTxStarted = true;
+    iTxFragmented = false;
     iTxMessageType = (aType & 0xf);
     iTxSize = 0;
 
@@ -95,54 +110,106 @@ int WebSocketClient::endMessage()
         return 1;
     }
 
-    // send FIN + the message type (opcode)
-    HttpClient::write(0x80 | iTxMessageType);
+    // send FIN + the message type (opcode), or a continuation if the start
+    // of the message has already gone
+    uint8_t opCode = 0x80 | (iTxFragmented ? TYPE_CONTINUATION : iTxMessageType);
+
+    size_t txSize = iTxSize;
+
+    iTxStarted = false;
+    iTxSize = 0;
+
+    return sendFrame(opCode, iTxBuffer, txSize);
+}
+
+int WebSocketClient::beginFrame(uint8_t aOpCode, uint64_t aLength, uint8_t aMaskKey[4])
+{
+    // Opcode, length (up to 9 bytes) and mask key, sent together
+    uint8_t header[14];
+    int headerSize = 0;
+
+    header[headerSize++] = aOpCode;
 
     // the message is masked (0x80)
     // send the length
-    if (iTxSize < 126)
+    if (aLength < 126)
     {
-        HttpClient::write(0x80 | (uint8_t)iTxSize);
+        header[headerSize++] = 0x80 | (uint8_t)aLength;
     }
-    else if (iTxSize < 0xffff)
+    else if (aLength <= 0xffff)
     {
-        HttpClient::write(0x80 | 126);
-        HttpClient::write((iTxSize >> 8) & 0xff);
-        HttpClient::write((iTxSize >> 0) & 0xff);
+        header[headerSize++] = 0x80 | 126;
+        header[headerSize++] = (aLength >> 8) & 0xff;
+        header[headerSize++] = (aLength >> 0) & 0xff;
     }
     else
     {
-        HttpClient::write(0x80 | 127);
-        HttpClient::write((iTxSize >> 56) & 0xff);
-        HttpClient::write((iTxSize >> 48) & 0xff);
-        HttpClient::write((iTxSize >> 40) & 0xff);
-        HttpClient::write((iTxSize >> 32) & 0xff);
-        HttpClient::write((iTxSize >> 24) & 0xff);
-        HttpClient::write((iTxSize >> 16) & 0xff);
-        HttpClient::write((iTxSize >> 8) & 0xff);
-        HttpClient::write((iTxSize >> 0) & 0xff);
+        header[headerSize++] = 0x80 | 127;
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            header[headerSize++] = (aLength >> shift) & 0xff;
+        }
+    }
+
+    // create a random mask for the frame
+    for (int i = 0; i < 4; i++)
+    {
+        aMaskKey[i] = random(0xff);
+        header[headerSize++] = aMaskKey[i];
     }
 
+    return (HttpClient::write(header, headerSize) == (size_t)headerSize) ? 0 : 1;
+}
+
+int WebSocketClient::sendFrame(uint8_t aOpCode, uint8_t* aData, size_t aLength)
+{
     uint8_t maskKey[4];
 
-    // create a random mask for the data and send
-    for (int i = 0; i < (int)sizeof(maskKey); i++)
+    if (beginFrame(aOpCode, aLength, maskKey))
     {
-        maskKey[i] = random(0xff);
+        return 1;
     }
-    HttpClient::write(maskKey, sizeof(maskKey));
 
     // mask the data and send
-    for (int i = 0; i < (int)iTxSize; i++) {
-        iTxBuffer[i] ^= maskKey[i % sizeof(maskKey)];
+    mask(aData, aLength, maskKey, 0);
+
+    return (HttpClient::write(aData, aLength) == aLength) ? 0 : 1;
+}
+
+void WebSocketClient::mask(uint8_t* aData, size_t aLength, const uint8_t aMaskKey[4], uint64_t aOffset)
+{
+    // Bring the data up to a word boundary a byte at a time
+    while (aLength && ((uintptr_t)aData & 3))
+    {
+        *aData++ ^= aMaskKey[aOffset++ & 3];
+        aLength--;
     }
 
-    size_t txSize = iTxSize;
+    if (aLength >= 4)
+    {
+        // The key, turned to line up with the words of data
+        uint8_t keyBytes[4];
+        uint32_t key;
+        uint32_t word;
 
-    iTxStarted = false;
-    iTxSize = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            keyBytes[i] = aMaskKey[(aOffset + i) & 3];
+        }
+        memcpy(&key, keyBytes, sizeof(key));
+
+        for (; aLength >= 4; aLength -= 4, aData += 4)
+        {
+            memcpy(&word, aData, sizeof(word));
+            word ^= key;
+            memcpy(aData, &word, sizeof(word));
+        }
+    }
 
-    return (HttpClient::write(iTxBuffer, txSize) == txSize) ? 0 : 1;
+    while (aLength--)
+    {
+        *aData++ ^= aMaskKey[aOffset++ & 3];
+    }
 }
 
 size_t WebSocketClient::write(uint8_t aByte)
@@ -164,104 +231,201 @@ size_t WebSocketClient::write(const uint8_t *aBuffer, size_t aSize)
         return 0;
     }
 
-    // check if the write size, fits in the buffer
-    if ((iTxSize + aSize) > sizeof(iTxBuffer))
+    size_t written = 0;
+
+    while (written < aSize)
     {
-        aSize = sizeof(iTxSize) - iTxSize;
-    }
+        if (iTxSize == sizeof(iTxBuffer))
+        {
+            if (iTxMessageType & 0x8)
+            {
+                // control frames can't be fragmented
+                break;
+            }
 
-    // copy data into the buffer
-    memcpy(iTxBuffer + iTxSize, aBuffer, aSize);
+            // send what we have so far as a fragment, FIN clear
+            uint8_t opCode = iTxFragmented ? TYPE_CONTINUATION : iTxMessageType;
 
-    iTxSize += aSize;
-    
-    return aSize;
+            iTxSize = 0;
+            if (sendFrame(opCode, iTxBuffer, sizeof(iTxBuffer)))
+            {
+                break;
+            }
+            iTxFragmented = true;
+        }
+
+        // copy as much as fits into the buffer
+        size_t copySize = min(aSize - written, sizeof(iTxBuffer) - iTxSize);
+
+        memcpy(iTxBuffer + iTxSize, aBuffer + written, copySize);
+
+        iTxSize += copySize;
+        written += copySize;
+    }
+
+    return written;
 }
 
 int WebSocketClient::parseMessage()
 {
     flushRx();
 
-    // make sure 2 bytes (opcode + length)
-    // are available
-    if (HttpClient::available() < 2)
+    if (iRxSize > 0)
     {
+        // the rest of the last frame hasn't arrived yet
+        checkPing();
         return 0;
     }
 
-    // read open code and length
-    uint8_t opcode = HttpClient::read();
-    int length = HttpClient::read();
+    // gather the frame header, 2 to 14 bytes, as it arrives
+    int headerSize = 2;
 
-    if ((opcode & 0x0f) == 0)
+    while (iRxHeaderLength < headerSize)
     {
-        // continuation, use previous opcode and update flags
-        iRxOpCode |= opcode;
-    }
-    else
-    {
-        iRxOpCode = opcode;
+        if (HttpClient::available() < 1)
+        {
+            checkPing();
+            return 0;
+        }
+
+        iRxHeader[iRxHeaderLength++] = HttpClient::read();
+
+        if (iRxHeaderLength >= 2)
+        {
+            // the length byte says how long the rest of the header is
+            int length = iRxHeader[1] & 0x7f;
+
+            headerSize = 2 + ((length == 126) ? 2 : (length == 127) ? 8 : 0) +
+                         ((iRxHeader[1] & 0x80) ? 4 : 0);
+        }
     }
 
-    iRxMasked = (length & 0x80);
-    length &= 0x7f;
+    // read open code and length
+    uint8_t opcode = iRxHeader[0];
+    int length = iRxHeader[1] & 0x7f;
+    int headerIndex = 2;
+    uint64_t rxSize;
 
     // read the RX size
     if (length < 126)
     {
-        iRxSize = length;
+        rxSize = length;
     }
-    else if (length == 126)
+    else
     {
-        iRxSize = (HttpClient::read() << 8) | HttpClient::read();
+        int lengthSize = (length == 126) ? 2 : 8;
+
+        rxSize = 0;
+        for (int i = 0; i < lengthSize; i++)
+        {
+            rxSize = (rxSize << 8) | iRxHeader[headerIndex++];
+        }
     }
-    else
+
+    if ((opcode & 0x08) && (HttpClient::available() < (int)rxSize))
     {
-        iRxSize = ((uint64_t)HttpClient::read() << 56) | 
-                    ((uint64_t)HttpClient::read() << 48) | 
-                    ((uint64_t)HttpClient::read() << 40) | 
-                    ((uint64_t)HttpClient::read() << 32) | 
-                    ((uint64_t)HttpClient::read() << 24) | 
-                    ((uint64_t)HttpClient::read() << 16) | 
-                    ((uint64_t)HttpClient::read() << 8)  |
-                    (uint64_t)HttpClient::read(); 
+        // control frames are short, handle one once it has all arrived
+        checkPing();
+        return 0;
     }
 
     // read in the mask, if present
+    iRxMasked = (iRxHeader[1] & 0x80);
     if (iRxMasked)
     {
-        for (int i = 0; i < (int)sizeof(iRxMaskKey); i++)
-        {
-            iRxMaskKey[i] = HttpClient::read();
-        }
+        memcpy(iRxMaskKey, iRxHeader + headerIndex, sizeof(iRxMaskKey));
     }
 
     iRxMaskIndex = 0;
+    iRxSize = rxSize;
+    iRxHeaderLength = 0;
+
+    // anything at all shows the connection is alive
+    iLastRxTime = millis();
+    iPingSent = false;
 
-    if (TYPE_CONNECTION_CLOSE == messageType())
+    if ((opcode & 0x0f) == TYPE_CONNECTION_CLOSE)
     {
+        iRxOpCode = opcode;
         flushRx();
         stop();
         iRxSize = 0;
     }
-    else if (TYPE_PING == messageType())
+    else if ((opcode & 0x0f) == TYPE_PING)
     {
-        beginMessage(TYPE_PONG);
-        while(available())
-        {
-            write(read());
-        }
-        endMessage();
-
+        sendPong();
         iRxSize = 0;
     }
-    else if (TYPE_PONG == messageType())
+    else if (opcode & 0x08)
     {
+        // a pong, or a control frame we don't know
         flushRx();
         iRxSize = 0;
     }
+    else if ((opcode & 0x0f) == TYPE_CONTINUATION)
+    {
+        // continuation, use previous opcode and update flags.  Control frames
+        // in between don't touch it
+        iRxOpCode = (iRxOpCode & 0x0f) | (opcode & 0x80);
+    }
+    else
+    {
+        iRxOpCode = opcode;
+    }
+
+    return (iRxSize > INT_MAX) ? INT_MAX : (int)iRxSize;
+}
+
+void WebSocketClient::setPingInterval(unsigned long aInterval)
+{
+    iPingInterval = aInterval;
+    iLastRxTime = millis();
+    iPingSent = false;
+}
+
+void WebSocketClient::sendPong()
+{
+    uint8_t maskKey[4];
+    uint8_t buffer[16];
+    uint64_t offset = 0;
+
+    // the ping has all arrived, so stream it straight back
+    beginFrame(0x80 | TYPE_PONG, iRxSize, maskKey);
+    while (iRxSize > 0)
+    {
+        int readCount = read(buffer, sizeof(buffer));
+
+        if (readCount <= 0)
+        {
+            break;
+        }
+        mask(buffer, readCount, maskKey, offset);
+        offset += readCount;
+        HttpClient::write(buffer, readCount);
+    }
+}
+
+void WebSocketClient::checkPing()
+{
+    if (!iPingInterval || !connected())
+    {
+        return;
+    }
 
-    return iRxSize;
+    unsigned long quiet = millis() - iLastRxTime;
+
+    if (iPingSent)
+    {
+        if (quiet >= 2 * iPingInterval)
+        {
+            // no pong, the connection has gone
+            stop();
+        }
+    }
+    else if (quiet >= iPingInterval)
+    {
+        iPingSent = (ping() == 0);
+    }
 }
 
 int WebSocketClient::messageType()
@@ -285,7 +449,13 @@ String WebSocketClient::readString()
 
         for (int i = 0; i < avail; i++)
         {
-            s += (char)read();
+            int c = read();
+
+            if (c < 0)
+            {
+                break;
+            }
+            s += (char)c;
         }
     }
 
@@ -302,9 +472,8 @@ int WebSocketClient::ping()
         pingData[i] = random(0xff);
     }
 
-    beginMessage(TYPE_PING);
-    write(pingData, sizeof(pingData));
-    return endMessage();
+    // sent as its own frame, so it can go in the middle of a message
+    return sendFrame(0x80 | TYPE_PING, pingData, sizeof(pingData));
 }
 
 int WebSocketClient::available()
@@ -314,14 +483,14 @@ int WebSocketClient::available()
         return HttpClient::available();
     }
 
-    return iRxSize;
+    return (iRxSize > INT_MAX) ? INT_MAX : (int)iRxSize;
 }
 
 int WebSocketClient::read()
 {
     byte b;
 
-    if (read(&b, sizeof(b)))
+    if (read(&b, sizeof(b)) > 0)
     {
         return b;
     }
@@ -331,6 +500,23 @@ int WebSocketClient::read()
 
 int WebSocketClient::read(uint8_t *aBuffer, size_t aSize)
 {
+    if (iState < eReadingBody)
+    {
+        // have not upgraded the connection yet
+        return HttpClient::read(aBuffer, aSize);
+    }
+
+    if (aSize > iRxSize)
+    {
+        // don't read into the next frame
+        aSize = iRxSize;
+    }
+
+    if (aSize == 0)
+    {
+        return 0;
+    }
+
     int readCount = HttpClient::read(aBuffer, aSize);
 
     if (readCount > 0)
@@ -340,10 +526,8 @@ int WebSocketClient::read(uint8_t *aBuffer, size_t aSize)
         // unmask the RX data if needed
         if (iRxMasked)
         {
-            for (int i = 0; i < (int)aSize; i++, iRxMaskIndex++)
-            {
-                aBuffer[i] ^= iRxMaskKey[iRxMaskIndex % sizeof(iRxMaskKey)];
-            }
+            mask(aBuffer, readCount, iRxMaskKey, iRxMaskIndex);
+            iRxMaskIndex += readCount;
         }
     }
 
@@ -352,6 +536,16 @@ int WebSocketClient::read(uint8_t *aBuffer, size_t aSize)
 
 int WebSocketClient::peek()
 {
+    if (iState < eReadingBody)
+    {
+        return HttpClient::peek();
+    }
+
+    if (iRxSize == 0)
+    {
+        return -1;
+    }
+
     int p = HttpClient::peek();
 
     if (p != -1 && iRxMasked)
@@ -365,8 +559,15 @@ int WebSocketClient::peek()
 
 void WebSocketClient::flushRx()
 {
-    while(available())
+    uint8_t buffer[16];
+
+    // skip what has arrived of the current frame, without waiting for the
+    // rest
+    while (iRxSize > 0 && HttpClient::available() > 0)
     {
-        read();
+        if (read(buffer, sizeof(buffer)) <= 0)
+        {
+            break;
+        }
     }
 }
@@ -31,7 +31,9 @@ public:
 
     /** Begin to send a message of type (TYPE_TEXT or TYPE_BINARY)
         Use the write or Stream API's to set message content, followed by endMessage
-        to complete the message.
+        to complete the message.  A message can be any length: each time
+        the transmit buffer fills it is sent as a fragment, and the message
+        is completed by endMessage
       @param aURLPath     Path to use in request
       @return 0 if successful, else error
     */
@@ -43,10 +45,22 @@ public:
     int endMessage();
 
     /** Try to parse an incoming messages
-      @return 0 if no message available, else size of parsed message
+        Each frame of a fragmented message is returned in turn, so a
+        message can be read as it arrives, with isFinal() true for its last
+        frame.  Pings are answered, and the ping interval kept, in here too,
+        so call it regularly
+      @return 0 if no message available, else size of parsed message (or
+      frame of a fragmented one), capped at INT_MAX
     */
     int parseMessage();
 
+    /** Send a ping from parseMessage() whenever nothing has been received for
+        aInterval milliseconds.  If nothing, not even the pong, arrives within
+        a further aInterval the connection is stopped
+      @param aInterval  Milliseconds between pings, or 0 (the default) for none
+    */
+    void setPingInterval(unsigned long aInterval);
+
     /** Returns type of current parsed message
       @return type of current parsedMessage (TYPE_TEXT or TYPE_BINARY)
     */
@@ -83,17 +97,49 @@ public:
 private:
     void flushRx();
 
+    /** Send a frame header with a new mask key, which is returned in aMaskKey
+      @return 0 if successful, else error
+    */
+    int beginFrame(uint8_t aOpCode, uint64_t aLength, uint8_t aMaskKey[4]);
+
+    /** Mask and send a whole frame, aData is masked in place
+      @return 0 if successful, else error
+    */
+    int sendFrame(uint8_t aOpCode, uint8_t* aData, size_t aLength);
+
+    /** Answer a ping with a pong carrying the same data
+    */
+    void sendPong();
+
+    /** Send a ping, or stop the connection, if it has been quiet too long
+    */
+    void checkPing();
+
+    /** XOR aLength bytes of aData with aMaskKey, starting aOffset bytes into
+        the key, a 32 bit word at a time
+    */
+    static void mask(uint8_t* aData, size_t aLength, const uint8_t aMaskKey[4], uint64_t aOffset);
+
 private:
     bool iTxStarted;
+    // Set once part of the message has been sent as a fragment
+    bool iTxFragmented;
     uint8_t iTxMessageType;
     uint8_t iTxBuffer[128];
-    uint64_t iTxSize;
+    size_t iTxSize;
 
     uint8_t iRxOpCode;
     uint64_t iRxSize;
     bool iRxMasked;
-    int iRxMaskIndex;
+    uint64_t iRxMaskIndex;
     uint8_t iRxMaskKey[4];
+    // The header of the next frame, gathered as it arrives
+    uint8_t iRxHeader[14];
+    uint8_t iRxHeaderLength;
+
+    unsigned long iPingInterval;
+    unsigned long iLastRxTime;
+    bool iPingSent;
 };
 
 #endif
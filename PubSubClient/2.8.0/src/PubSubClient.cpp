@@ -14,6 +14,10 @@ PubSubClient::PubSubClient() {
     this->stream = NULL;
     setCallback(NULL);
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -24,6 +28,10 @@ PubSubClient::PubSubClient(Client& client) {
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -35,6 +43,10 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client) {
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -45,6 +57,10 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, Client& client, Stream
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -56,6 +72,10 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATUR
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -67,6 +87,10 @@ PubSubClient::PubSubClient(IPAddress addr, uint16_t port, MQTT_CALLBACK_SIGNATUR
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -78,6 +102,10 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client) {
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -88,6 +116,10 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, Client& client, Stream& s
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -99,6 +131,10 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE,
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -110,6 +146,10 @@ PubSubClient::PubSubClient(uint8_t *ip, uint16_t port, MQTT_CALLBACK_SIGNATURE,
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -121,6 +161,10 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client) {
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -131,6 +175,10 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, Client& client, St
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -142,6 +190,10 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGN
     setClient(client);
     this->stream = NULL;
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -153,6 +205,10 @@ PubSubClient::PubSubClient(const char* domain, uint16_t port, MQTT_CALLBACK_SIGN
     setClient(client);
     setStream(stream);
     this->bufferSize = 0;
+    this->persistence = NULL;
+    this->streamCallback = NULL;
+    this->topics = NULL;
+    this->topicCount = 0;
     setBufferSize(MQTT_MAX_PACKET_SIZE);
     setKeepAlive(MQTT_KEEPALIVE);
     setSocketTimeout(MQTT_SOCKET_TIMEOUT);
@@ -202,7 +258,7 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
 #if MQTT_VERSION == MQTT_VERSION_3_1
             uint8_t d[9] = {0x00,0x06,'M','Q','I','s','d','p', MQTT_VERSION};
 #define MQTT_HEADER_VERSION_LENGTH 9
-#elif MQTT_VERSION == MQTT_VERSION_3_1_1
+#elif MQTT_VERSION == MQTT_VERSION_3_1_1 || MQTT_VERSION == MQTT_VERSION_5
             uint8_t d[7] = {0x00,0x04,'M','Q','T','T',MQTT_VERSION};
 #define MQTT_HEADER_VERSION_LENGTH 7
 #endif
@@ -231,10 +287,18 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
 
             this->buffer[length++] = ((this->keepAlive) >> 8);
             this->buffer[length++] = ((this->keepAlive) & 0xFF);
+#if MQTT_VERSION == MQTT_VERSION_5
+            this->buffer[length++] = 0; // No properties
+            this->topicAliasMaximum = 0;
+            this->topicAliasSent = 0;
+#endif
 
             CHECK_STRING_LENGTH(length,id)
             length = writeString(id,this->buffer,length);
             if (willTopic) {
+#if MQTT_VERSION == MQTT_VERSION_5
+                this->buffer[length++] = 0; // No will properties
+#endif
                 CHECK_STRING_LENGTH(length,willTopic)
                 length = writeString(willTopic,this->buffer,length);
                 CHECK_STRING_LENGTH(length,willMessage)
@@ -265,14 +329,25 @@ boolean PubSubClient::connect(const char *id, const char *user, const char *pass
             uint8_t llen;
             uint32_t len = readPacket(&llen);
 
+#if MQTT_VERSION == MQTT_VERSION_5
+            if (len >= 5) {
+                if (buffer[llen+2] == 0) {
+                    readConnackProperties(llen+3, len);
+#else
             if (len == 4) {
                 if (buffer[3] == 0) {
+#endif
                     lastInActivity = millis();
                     pingOutstanding = false;
                     _state = MQTT_CONNECTED;
+                    resendInflight();
                     return true;
                 } else {
+#if MQTT_VERSION == MQTT_VERSION_5
+                    _state = buffer[llen+2];
+#else
                     _state = buffer[3];
+#endif
                 }
             }
             _client->stop();
@@ -318,6 +393,8 @@ uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
     uint8_t digit = 0;
     uint16_t skip = 0;
     uint32_t start = 0;
+    uint32_t msgIdAt = 0;
+    uint16_t msgId = 0;
 
     do {
         if (len == 5) {
@@ -342,12 +419,50 @@ uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
         if (this->buffer[0]&MQTTQOS1) {
             // skip message id
             skip += 2;
+            msgIdAt = skip;
         }
     }
     uint32_t idx = len;
+    uint32_t end = length;
+    if (isPublish && this->streamCallback) {
+        // Stop after the topic and message id, loop() reads the payload
+        uint32_t headerEnd = (uint32_t)skip + 2 + MQTT_PROPERTIES_SIZE;
+        if (end > headerEnd) {
+            end = headerEnd;
+        }
+    }
+#if MQTT_VERSION == MQTT_VERSION_5
+    // The properties follow the message id; their length is only known
+    // once it has been read, then they are skipped like the topic
+    uint32_t propertiesLength = 0;
+    uint32_t propertiesMultiplier = 1;
+    boolean inPropertiesLength = isPublish;
+#endif
 
-    for (uint32_t i = start;i<length;i++) {
+    for (uint32_t i = start;i<end;i++) {
         if(!readByte(&digit)) return 0;
+#if MQTT_VERSION == MQTT_VERSION_5
+        if (inPropertiesLength && i == (uint32_t)skip+2) {
+            propertiesLength += (digit & 127) * propertiesMultiplier;
+            propertiesMultiplier <<= 7;
+            skip++;
+            if ((digit & 128) == 0) {
+                inPropertiesLength = false;
+                skip += propertiesLength;
+            }
+            if (this->streamCallback) {
+                end = skip + 2 + (inPropertiesLength ? 1 : 0);
+                if (end > length) {
+                    end = length;
+                }
+            }
+        }
+#endif
+        if (msgIdAt && (i == msgIdAt || i == msgIdAt+1)) {
+            // Kept aside in case the buffer cannot hold it
+            msgId = (msgId<<8)+digit;
+        }
+
         if (this->stream) {
             if (isPublish && idx-*lengthLength-2>skip) {
                 this->stream->write(digit);
@@ -361,7 +476,25 @@ uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
         idx++;
     }
 
-    if (!this->stream && idx > this->bufferSize) {
+    if (isPublish && this->streamCallback) {
+        this->streamRemaining = length - end;
+        if (idx >= this->bufferSize) {
+            // No room for the topic and a chunk, drop the payload
+            for (uint32_t i = 0;i<this->streamRemaining;i++) {
+                if(!readByte(&digit)) return 0;
+            }
+            if (msgIdAt) {
+                // Still acknowledge it, or the broker sends it again
+                this->buffer[0] = MQTTPUBACK;
+                this->buffer[1] = 2;
+                this->buffer[2] = (msgId >> 8);
+                this->buffer[3] = (msgId & 0xFF);
+                _client->write(this->buffer,4);
+                lastOutActivity = millis();
+            }
+            len = 0;
+        }
+    } else if (!this->stream && idx > this->bufferSize) {
         len = 0; // This will cause the packet to be ignored.
     }
     return len;
@@ -393,7 +526,7 @@ boolean PubSubClient::loop() {
                 lastInActivity = t;
                 uint8_t type = this->buffer[0]&0xF0;
                 if (type == MQTTPUBLISH) {
-                    if (callback) {
+                    if (callback || streamCallback) {
                         uint16_t tl = (this->buffer[llen+1]<<8)+this->buffer[llen+2]; /* topic length in bytes */
                         memmove(this->buffer+llen+2,this->buffer+llen+3,tl); /* move topic inside buffer 1 byte to front */
                         this->buffer[llen+2+tl] = 0; /* end the topic as a 'C' string with \x00 */
@@ -402,7 +535,16 @@ boolean PubSubClient::loop() {
                         if ((this->buffer[0]&0x06) == MQTTQOS1) {
                             msgId = (this->buffer[llen+3+tl]<<8)+this->buffer[llen+3+tl+1];
                             payload = this->buffer+llen+3+tl+2;
-                            callback(topic,payload,len-llen-3-tl-2);
+#if MQTT_VERSION == MQTT_VERSION_5
+                            payload = this->buffer+skipProperties(llen+3+tl+2,len);
+#endif
+                            if (streamCallback) {
+                                if (!readPayload(topic,payload,this->bufferSize-len,this->streamRemaining)) {
+                                    return false;
+                                }
+                            } else {
+                                callback(topic,payload,this->buffer+len-payload);
+                            }
 
                             this->buffer[0] = MQTTPUBACK;
                             this->buffer[1] = 2;
@@ -413,7 +555,16 @@ boolean PubSubClient::loop() {
 
                         } else {
                             payload = this->buffer+llen+3+tl;
-                            callback(topic,payload,len-llen-3-tl);
+#if MQTT_VERSION == MQTT_VERSION_5
+                            payload = this->buffer+skipProperties(llen+3+tl,len);
+#endif
+                            if (streamCallback) {
+                                if (!readPayload(topic,payload,this->bufferSize-len,this->streamRemaining)) {
+                                    return false;
+                                }
+                            } else {
+                                callback(topic,payload,this->buffer+len-payload);
+                            }
                         }
                     }
                 } else if (type == MQTTPINGREQ) {
@@ -422,6 +573,13 @@ boolean PubSubClient::loop() {
                     _client->write(this->buffer,2);
                 } else if (type == MQTTPINGRESP) {
                     pingOutstanding = false;
+                } else if (type == MQTTPUBACK) {
+                    if (len >= llen+3) {
+                        msgId = (this->buffer[llen+1]<<8)+this->buffer[llen+2];
+                        if (inflight.remove(msgId) && this->persistence) {
+                            this->persistence->remove(msgId);
+                        }
+                    }
                 }
             } else if (!connected()) {
                 // readPacket has closed the connection
@@ -433,6 +591,50 @@ boolean PubSubClient::loop() {
     return false;
 }
 
+// Hands total payload bytes to streamCallback, reading up to size of them
+// at a time into chunk. A chunk is passed on as soon as the client has no
+// more data ready, so the callback sees the payload as it arrives.
+boolean PubSubClient::readPayload(char* topic, uint8_t* chunk, uint16_t size, uint32_t total) {
+    uint32_t index = 0;
+    do {
+        uint16_t n = 0;
+        while (n < size && index+n < total) {
+            int available = _client->available();
+            if (available <= 0) {
+                if (n > 0) {
+                    break;
+                }
+                if (!readByte(chunk)) {
+                    // The rest of the packet is lost, so is the framing
+                    this->_state = MQTT_CONNECTION_TIMEOUT;
+                    _client->stop();
+                    return false;
+                }
+                n++;
+                continue;
+            }
+            uint32_t want = size-n;
+            if (want > total-index-n) {
+                want = total-index-n;
+            }
+            if (want > (uint32_t)available) {
+                want = available;
+            }
+            int got = _client->read(chunk+n, want);
+            if (got <= 0) {
+                this->_state = MQTT_CONNECTION_LOST;
+                _client->stop();
+                return false;
+            }
+            n += got;
+        }
+        streamCallback(topic,chunk,n,index,total);
+        index += n;
+    } while (index < total);
+    lastInActivity = millis();
+    return true;
+}
+
 boolean PubSubClient::publish(const char* topic, const char* payload) {
     return publish(topic,(const uint8_t*)payload, payload ? strnlen(payload, this->bufferSize) : 0,false);
 }
@@ -447,13 +649,62 @@ boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigne
 
 boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained) {
     if (connected()) {
-        if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2+strnlen(topic, this->bufferSize) + plength) {
+        if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2+strnlen(topic, this->bufferSize) + MQTT_PROPERTIES_SIZE + plength) {
             // Too long
             return false;
         }
         // Leave room in the buffer for header and variable length field
         uint16_t length = MQTT_MAX_HEADER_SIZE;
         length = writeString(topic,this->buffer,length);
+#if MQTT_VERSION == MQTT_VERSION_5
+        this->buffer[length++] = 0; // No properties
+#endif
+
+        // Add payload
+        uint16_t i;
+        for (i=0;i<plength;i++) {
+            this->buffer[length++] = payload[i];
+        }
+
+        // Write the header
+        uint8_t header = MQTTPUBLISH;
+        if (retained) {
+            header |= 1;
+        }
+        return write(header,this->buffer,length-MQTT_MAX_HEADER_SIZE);
+    }
+    return false;
+}
+
+boolean PubSubClient::publish(const char* topic, const char* payload, boolean retained, uint8_t qos) {
+    return publish(topic,(const uint8_t*)payload, payload ? strnlen(payload, this->bufferSize) : 0,retained,qos);
+}
+
+boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, boolean retained, uint8_t qos) {
+    if (qos == 0) {
+        return publish(topic, payload, plength, retained);
+    }
+    if (qos > 1) {
+        return false;
+    }
+    if (connected()) {
+        uint16_t packetLength = 2+strnlen(topic, this->bufferSize) + 2 + MQTT_PROPERTIES_SIZE + plength;
+        if (this->bufferSize < MQTT_MAX_HEADER_SIZE + packetLength) {
+            // Too long
+            return false;
+        }
+        // loop() reuses the buffer, so make room before filling it
+        if (!waitForInflight(packetLength)) {
+            return false;
+        }
+        uint16_t msgId = nextPublishId();
+        uint16_t length = MQTT_MAX_HEADER_SIZE;
+        length = writeString(topic,this->buffer,length);
+        this->buffer[length++] = (msgId >> 8);
+        this->buffer[length++] = (msgId & 0xFF);
+#if MQTT_VERSION == MQTT_VERSION_5
+        this->buffer[length++] = 0; // No properties
+#endif
 
         // Add payload
         uint16_t i;
@@ -461,6 +712,87 @@ boolean PubSubClient::publish(const char* topic, const uint8_t* payload, unsigne
             this->buffer[length++] = payload[i];
         }
 
+        // Write the header
+        uint8_t header = MQTTPUBLISH | MQTTQOS1;
+        if (retained) {
+            header |= 1;
+        }
+        if (!inflight.add(msgId, header, this->buffer+MQTT_MAX_HEADER_SIZE, packetLength)) {
+            return false;
+        }
+        if (this->persistence) {
+            this->persistence->save(msgId, header, this->buffer+MQTT_MAX_HEADER_SIZE, packetLength);
+        }
+        // Once in the window the message is sent again after a reconnect,
+        // so a failed write here does not lose it
+        write(header,this->buffer,packetLength);
+        return true;
+    }
+    return false;
+}
+
+uint16_t PubSubClient::nextPublishId() {
+    do {
+        nextMsgId++;
+        if (nextMsgId == 0) {
+            nextMsgId = 1;
+        }
+    } while (inflight.contains(nextMsgId));
+    return nextMsgId;
+}
+
+boolean PubSubClient::waitForInflight(uint16_t length) {
+    if (length > inflight.getBufferSize()) {
+        return false;
+    }
+    uint32_t previousMillis = millis();
+    while (!inflight.hasRoom(length)) {
+        if (!loop()) {
+            return false;
+        }
+        yield();
+        if (millis() - previousMillis >= ((int32_t) this->socketTimeout * 1000)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+boolean PubSubClient::resendInflight() {
+    boolean result = true;
+    uint16_t msgId;
+    uint8_t header;
+    uint16_t length;
+    const uint8_t* packet;
+    for (uint8_t i = 0; (packet = inflight.get(i, &msgId, &header, &length)) != NULL; i++) {
+        if (msgId == 0 || MQTT_MAX_HEADER_SIZE + length > this->bufferSize) {
+            continue;
+        }
+        memcpy(this->buffer+MQTT_MAX_HEADER_SIZE, packet, length);
+        result = write(header|MQTTDUP, this->buffer, length) && result;
+    }
+    return result;
+}
+
+boolean PubSubClient::publishTopic(uint8_t topic, const char* payload, boolean retained) {
+    return publishTopic(topic,(const uint8_t*)payload, payload ? strnlen(payload, this->bufferSize) : 0,retained);
+}
+
+boolean PubSubClient::publishTopic(uint8_t topic, const uint8_t* payload, unsigned int plength, boolean retained) {
+    if (connected()) {
+        uint16_t tsize = topicSize(topic);
+        if (tsize == 0 || this->bufferSize < MQTT_MAX_HEADER_SIZE + tsize + MQTT_ALIAS_PROPERTIES_SIZE + plength) {
+            // Unknown topic or too long
+            return false;
+        }
+        // Leave room in the buffer for header and variable length field
+        uint16_t length = MQTT_MAX_HEADER_SIZE;
+        length = writePublishTopic(topic,this->buffer,length);
+
+        // Add payload
+        memcpy(this->buffer+length,payload,plength);
+        length += plength;
+
         // Write the header
         uint8_t header = MQTTPUBLISH;
         if (retained) {
@@ -497,7 +829,7 @@ boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsig
         header |= 1;
     }
     this->buffer[pos++] = header;
-    len = plength + 2 + tlen;
+    len = plength + 2 + tlen + MQTT_PROPERTIES_SIZE;
     do {
         digit = len  & 127; //digit = len %128
         len >>= 7; //len = len / 128
@@ -509,6 +841,9 @@ boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsig
     } while(len>0);
 
     pos = writeString(topic,this->buffer,pos);
+#if MQTT_VERSION == MQTT_VERSION_5
+    this->buffer[pos++] = 0; // No properties
+#endif
 
     rc += _client->write(this->buffer,pos);
 
@@ -518,7 +853,7 @@ boolean PubSubClient::publish_P(const char* topic, const uint8_t* payload, unsig
 
     lastOutActivity = millis();
 
-    expectedLength = 1 + llen + 2 + tlen + plength;
+    expectedLength = 1 + llen + 2 + tlen + MQTT_PROPERTIES_SIZE + plength;
 
     return (rc == expectedLength);
 }
@@ -528,6 +863,30 @@ boolean PubSubClient::beginPublish(const char* topic, unsigned int plength, bool
         // Send the header and variable length field
         uint16_t length = MQTT_MAX_HEADER_SIZE;
         length = writeString(topic,this->buffer,length);
+#if MQTT_VERSION == MQTT_VERSION_5
+        this->buffer[length++] = 0; // No properties
+#endif
+        uint8_t header = MQTTPUBLISH;
+        if (retained) {
+            header |= 1;
+        }
+        size_t hlen = buildHeader(header, this->buffer, plength+length-MQTT_MAX_HEADER_SIZE);
+        uint16_t rc = _client->write(this->buffer+(MQTT_MAX_HEADER_SIZE-hlen),length-(MQTT_MAX_HEADER_SIZE-hlen));
+        lastOutActivity = millis();
+        return (rc == (length-(MQTT_MAX_HEADER_SIZE-hlen)));
+    }
+    return false;
+}
+
+boolean PubSubClient::beginPublishTopic(uint8_t topic, unsigned int plength, boolean retained) {
+    if (connected()) {
+        uint16_t tsize = topicSize(topic);
+        if (tsize == 0 || this->bufferSize < MQTT_MAX_HEADER_SIZE + tsize + MQTT_ALIAS_PROPERTIES_SIZE) {
+            return false;
+        }
+        // Send the header and variable length field
+        uint16_t length = MQTT_MAX_HEADER_SIZE;
+        length = writePublishTopic(topic,this->buffer,length);
         uint8_t header = MQTTPUBLISH;
         if (retained) {
             header |= 1;
@@ -614,7 +973,7 @@ boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
     if (qos > 1) {
         return false;
     }
-    if (this->bufferSize < 9 + topicLength) {
+    if (this->bufferSize < 9 + MQTT_PROPERTIES_SIZE + topicLength) {
         // Too long
         return false;
     }
@@ -627,6 +986,9 @@ boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
         }
         this->buffer[length++] = (nextMsgId >> 8);
         this->buffer[length++] = (nextMsgId & 0xFF);
+#if MQTT_VERSION == MQTT_VERSION_5
+        this->buffer[length++] = 0; // No properties
+#endif
         length = writeString((char*)topic, this->buffer,length);
         this->buffer[length++] = qos;
         return write(MQTTSUBSCRIBE|MQTTQOS1,this->buffer,length-MQTT_MAX_HEADER_SIZE);
@@ -634,12 +996,43 @@ boolean PubSubClient::subscribe(const char* topic, uint8_t qos) {
     return false;
 }
 
+boolean PubSubClient::subscribeTopic(uint8_t topic, uint8_t qos) {
+    uint16_t tsize = topicSize(topic);
+    if (tsize == 0) {
+        return false;
+    }
+    if (qos > 1) {
+        return false;
+    }
+    if (this->bufferSize < MQTT_MAX_HEADER_SIZE + 2 + MQTT_PROPERTIES_SIZE + tsize + 1) {
+        // Too long
+        return false;
+    }
+    if (connected()) {
+        // Leave room in the buffer for header and variable length field
+        uint16_t length = MQTT_MAX_HEADER_SIZE;
+        nextMsgId++;
+        if (nextMsgId == 0) {
+            nextMsgId = 1;
+        }
+        this->buffer[length++] = (nextMsgId >> 8);
+        this->buffer[length++] = (nextMsgId & 0xFF);
+#if MQTT_VERSION == MQTT_VERSION_5
+        this->buffer[length++] = 0; // No properties
+#endif
+        length = writeTopic(topic, this->buffer,length);
+        this->buffer[length++] = qos;
+        return write(MQTTSUBSCRIBE|MQTTQOS1,this->buffer,length-MQTT_MAX_HEADER_SIZE);
+    }
+    return false;
+}
+
 boolean PubSubClient::unsubscribe(const char* topic) {
 	size_t topicLength = strnlen(topic, this->bufferSize);
     if (topic == 0) {
         return false;
     }
-    if (this->bufferSize < 9 + topicLength) {
+    if (this->bufferSize < 9 + MQTT_PROPERTIES_SIZE + topicLength) {
         // Too long
         return false;
     }
@@ -651,6 +1044,9 @@ boolean PubSubClient::unsubscribe(const char* topic) {
         }
         this->buffer[length++] = (nextMsgId >> 8);
         this->buffer[length++] = (nextMsgId & 0xFF);
+#if MQTT_VERSION == MQTT_VERSION_5
+        this->buffer[length++] = 0; // No properties
+#endif
         length = writeString(topic, this->buffer,length);
         return write(MQTTUNSUBSCRIBE|MQTTQOS1,this->buffer,length-MQTT_MAX_HEADER_SIZE);
     }
@@ -680,6 +1076,125 @@ uint16_t PubSubClient::writeString(const char* string, uint8_t* buf, uint16_t po
     return pos;
 }
 
+// Size of a topic from the table as an MQTT string, 0 if there is no such topic
+uint16_t PubSubClient::topicSize(uint8_t topic) {
+    if (topic >= this->topicCount) {
+        return 0;
+    }
+    MQTTTopic t = (MQTTTopic)pgm_read_ptr(&this->topics[topic]);
+    return 2 + ((pgm_read_byte(t) << 8) | pgm_read_byte(t+1));
+}
+
+// Copies a topic from the table, length bytes included, in one go
+uint16_t PubSubClient::writeTopic(uint8_t topic, uint8_t* buf, uint16_t pos) {
+    MQTTTopic t = (MQTTTopic)pgm_read_ptr(&this->topics[topic]);
+    uint16_t size = topicSize(topic);
+    memcpy_P(buf+pos, t, size);
+    return pos+size;
+}
+
+// Writes the topic and properties of a publish to a topic from the table.
+// With MQTT 5 the topic is left out once the broker knows its alias.
+uint16_t PubSubClient::writePublishTopic(uint8_t topic, uint8_t* buf, uint16_t pos) {
+#if MQTT_VERSION == MQTT_VERSION_5
+    uint16_t alias = topic + 1;
+    if (alias <= this->topicAliasMaximum && alias <= 32) {
+        if (this->topicAliasSent & (1UL << topic)) {
+            buf[pos++] = 0;
+            buf[pos++] = 0;
+        } else {
+            pos = writeTopic(topic, buf, pos);
+            this->topicAliasSent |= (1UL << topic);
+        }
+        buf[pos++] = 3;
+        buf[pos++] = MQTTPROP_TOPIC_ALIAS;
+        buf[pos++] = (alias >> 8);
+        buf[pos++] = (alias & 0xFF);
+        return pos;
+    }
+    pos = writeTopic(topic, buf, pos);
+    buf[pos++] = 0; // No properties
+    return pos;
+#else
+    return writeTopic(topic, buf, pos);
+#endif
+}
+
+#if MQTT_VERSION == MQTT_VERSION_5
+// Returns the position after the property list at pos in the buffer
+uint16_t PubSubClient::skipProperties(uint16_t pos, uint16_t length) {
+    uint32_t size = 0;
+    uint32_t multiplier = 1;
+    uint8_t digit;
+    do {
+        if (pos >= length) {
+            return length;
+        }
+        digit = this->buffer[pos++];
+        size += (digit & 127) * multiplier;
+        multiplier <<= 7;
+    } while ((digit & 128) != 0);
+    return (pos + size < length) ? pos + size : length;
+}
+
+// Picks the settings this client uses from the CONNACK properties at pos
+void PubSubClient::readConnackProperties(uint16_t pos, uint16_t length) {
+    uint16_t end = skipProperties(pos, length);
+    while (pos < end && (this->buffer[pos] & 0x80)) {
+        pos++;
+    }
+    pos++;
+    while (pos < end) {
+        uint8_t id = this->buffer[pos++];
+        uint16_t size;
+        switch (id) {
+        case MQTTPROP_SERVER_KEEP_ALIVE:
+        case MQTTPROP_TOPIC_ALIAS_MAXIMUM:
+        case 0x21: // Receive Maximum
+            if (pos + 2 > end) {
+                return;
+            }
+            if (id == MQTTPROP_SERVER_KEEP_ALIVE) {
+                this->keepAlive = (this->buffer[pos]<<8)+this->buffer[pos+1];
+            } else if (id == MQTTPROP_TOPIC_ALIAS_MAXIMUM) {
+                this->topicAliasMaximum = (this->buffer[pos]<<8)+this->buffer[pos+1];
+            }
+            size = 2;
+            break;
+        case 0x11: // Session Expiry Interval
+        case 0x27: // Maximum Packet Size
+            size = 4;
+            break;
+        case 0x24: // Maximum QoS
+        case 0x25: // Retain Available
+        case 0x28: // Wildcard Subscription Available
+        case 0x29: // Subscription Identifiers Available
+        case 0x2A: // Shared Subscription Available
+            size = 1;
+            break;
+        case 0x12: // Assigned Client Identifier
+        case 0x15: // Authentication Method
+        case 0x16: // Authentication Data
+        case 0x1A: // Response Information
+        case 0x1C: // Server Reference
+        case 0x1F: // Reason String
+        case 0x26: // User Property, a second string follows
+            if (pos + 2 > end) {
+                return;
+            }
+            size = 2 + (this->buffer[pos]<<8)+this->buffer[pos+1];
+            if (id == 0x26 && pos + size + 2 <= end) {
+                size += 2 + (this->buffer[pos+size]<<8)+this->buffer[pos+size+1];
+            }
+            break;
+        default:
+            // Unknown property, its size is unknown too
+            return;
+        }
+        pos += size;
+    }
+}
+#endif
 
 boolean PubSubClient::connected() {
     boolean rc;
@@ -723,6 +1238,17 @@ PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
     return *this;
 }
 
+PubSubClient& PubSubClient::setStreamCallback(MQTT_STREAM_CALLBACK_SIGNATURE) {
+    this->streamCallback = streamCallback;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setTopics(const MQTTTopic* topics, uint8_t count) {
+    this->topics = topics;
+    this->topicCount = count;
+    return *this;
+}
+
 PubSubClient& PubSubClient::setClient(Client& client){
     this->_client = &client;
     return *this;
@@ -759,6 +1285,147 @@ boolean PubSubClient::setBufferSize(uint16_t size) {
 uint16_t PubSubClient::getBufferSize() {
     return this->bufferSize;
 }
+
+boolean PubSubClient::setInflightBufferSize(uint16_t size) {
+    return inflight.setBufferSize(size);
+}
+
+uint8_t PubSubClient::getInflight() {
+    return inflight.pending();
+}
+
+boolean PubSubClient::setPersistence(MQTTPersistence& persistence) {
+    this->persistence = &persistence;
+    boolean result = true;
+    uint16_t msgId;
+    uint8_t header;
+    uint16_t length;
+    uint8_t* packet = this->buffer+MQTT_MAX_HEADER_SIZE;
+    for (uint8_t i = 0; (length = persistence.restore(i, &msgId, &header, packet, this->bufferSize-MQTT_MAX_HEADER_SIZE)) != 0; i++) {
+        if (length > this->bufferSize-MQTT_MAX_HEADER_SIZE || inflight.contains(msgId) ||
+            !inflight.add(msgId, header, packet, length)) {
+            result = false;
+        }
+    }
+    return result;
+}
+
+MQTTInflightWindow::MQTTInflightWindow() {
+    this->buffer = NULL;
+    this->bufferSize = MQTT_MAX_PACKET_SIZE;
+    this->used = 0;
+    this->entries = 0;
+}
+
+MQTTInflightWindow::~MQTTInflightWindow() {
+    free(this->buffer);
+}
+
+boolean MQTTInflightWindow::setBufferSize(uint16_t size) {
+    if (size < this->used) {
+        // Would drop packets in flight
+        return false;
+    }
+    if (this->buffer != NULL) {
+        uint8_t* newBuffer = (uint8_t*)realloc(this->buffer, size);
+        if (newBuffer == NULL) {
+            return false;
+        }
+        this->buffer = newBuffer;
+    }
+    this->bufferSize = size;
+    return true;
+}
+
+uint16_t MQTTInflightWindow::getBufferSize() {
+    return this->bufferSize;
+}
+
+uint8_t MQTTInflightWindow::pending() {
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < this->entries; i++) {
+        if (this->ids[i] != 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+boolean MQTTInflightWindow::contains(uint16_t msgId) {
+    if (msgId == 0) {
+        return false;
+    }
+    for (uint8_t i = 0; i < this->entries; i++) {
+        if (this->ids[i] == msgId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+boolean MQTTInflightWindow::hasRoom(uint16_t length) {
+    return this->entries < MQTT_MAX_INFLIGHT && this->used + length <= this->bufferSize;
+}
+
+boolean MQTTInflightWindow::add(uint16_t msgId, uint8_t header, const uint8_t* packet, uint16_t length) {
+    if (msgId == 0 || !hasRoom(length)) {
+        return false;
+    }
+    if (this->buffer == NULL) {
+        this->buffer = (uint8_t*)malloc(this->bufferSize);
+        if (this->buffer == NULL) {
+            return false;
+        }
+    }
+    memcpy(this->buffer+this->used, packet, length);
+    this->used += length;
+    this->ids[this->entries] = msgId;
+    this->lengths[this->entries] = length;
+    this->headers[this->entries] = header;
+    this->entries++;
+    return true;
+}
+
+boolean MQTTInflightWindow::remove(uint16_t msgId) {
+    uint8_t i;
+    for (i = 0; i < this->entries && this->ids[i] != msgId; i++);
+    if (msgId == 0 || i == this->entries) {
+        return false;
+    }
+    this->ids[i] = 0;
+    // Release the acknowledged packets at the front
+    uint8_t done = 0;
+    uint16_t bytes = 0;
+    while (done < this->entries && this->ids[done] == 0) {
+        bytes += this->lengths[done];
+        done++;
+    }
+    if (done > 0) {
+        memmove(this->buffer, this->buffer+bytes, this->used-bytes);
+        this->used -= bytes;
+        this->entries -= done;
+        for (i = 0; i < this->entries; i++) {
+            this->ids[i] = this->ids[i+done];
+            this->lengths[i] = this->lengths[i+done];
+            this->headers[i] = this->headers[i+done];
+        }
+    }
+    return true;
+}
+
+const uint8_t* MQTTInflightWindow::get(uint8_t index, uint16_t* msgId, uint8_t* header, uint16_t* length) {
+    if (index >= this->entries) {
+        return NULL;
+    }
+    uint16_t offset = 0;
+    for (uint8_t i = 0; i < index; i++) {
+        offset += this->lengths[i];
+    }
+    *msgId = this->ids[index];
+    *header = this->headers[index];
+    *length = this->lengths[index];
+    return this->buffer+offset;
+}
 PubSubClient& PubSubClient::setKeepAlive(uint16_t keepAlive) {
     this->keepAlive = keepAlive;
     return *this;
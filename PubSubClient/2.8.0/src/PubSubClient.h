@@ -14,9 +14,13 @@
 
 #define MQTT_VERSION_3_1      3
 #define MQTT_VERSION_3_1_1    4
+#define MQTT_VERSION_5        5
 
 // MQTT_VERSION : Pick the version
 //#define MQTT_VERSION MQTT_VERSION_3_1
+//  MQTT_VERSION_5 covers what topic aliases need: packets carry an empty
+//  property list, and publishTopic() uses the aliases the broker allows.
+//#define MQTT_VERSION MQTT_VERSION_5
 #ifndef MQTT_VERSION
 #define MQTT_VERSION MQTT_VERSION_3_1_1
 #endif
@@ -36,6 +40,13 @@
 #define MQTT_SOCKET_TIMEOUT 15
 #endif
 
+// MQTT_MAX_INFLIGHT : Maximum number of QoS 1 publishes awaiting their PUBACK.
+//  Their packets are kept in a separate buffer, allocated by the first QoS 1
+//  publish, of MQTT_MAX_PACKET_SIZE bytes. Override with setInflightBufferSize().
+#ifndef MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT 4
+#endif
+
 // MQTT_MAX_TRANSFER_SIZE : limit how much data is passed to the network client
 //  in each write call. Needed for the Arduino Wifi Shield. Leave undefined to
 //  pass the entire MQTT packet in each write call.
@@ -72,17 +83,94 @@
 #define MQTTQOS0        (0 << 1)
 #define MQTTQOS1        (1 << 1)
 #define MQTTQOS2        (2 << 1)
+#define MQTTDUP         (1 << 3)
 
 // Maximum size of fixed header and variable length size header
 #define MQTT_MAX_HEADER_SIZE 5
 
+// Size of the empty property list MQTT 5 adds to most packets, and of the
+// property list of a publish with a topic alias
+#if MQTT_VERSION == MQTT_VERSION_5
+#define MQTT_PROPERTIES_SIZE 1
+#define MQTT_ALIAS_PROPERTIES_SIZE 4
+#else
+#define MQTT_PROPERTIES_SIZE 0
+#define MQTT_ALIAS_PROPERTIES_SIZE 0
+#endif
+
+// MQTT 5 property identifiers
+#define MQTTPROP_SERVER_KEEP_ALIVE   0x13
+#define MQTTPROP_TOPIC_ALIAS_MAXIMUM 0x22
+#define MQTTPROP_TOPIC_ALIAS         0x23
+
+// A topic kept in flash, already encoded as an MQTT string: two length
+// bytes followed by the characters. Declare topics with MQTT_TOPIC_P and
+// list them in a PROGMEM table of MQTTTopic for setTopics():
+//   MQTT_TOPIC_P(telemetry, "v1/devices/me/telemetry");
+//   const MQTTTopic topics[] PROGMEM = { MQTT_TOPIC(telemetry) };
+typedef const uint8_t* MQTTTopic;
+#define MQTT_TOPIC_P(name, topic) \
+    const struct { uint8_t length[2]; char string[sizeof(topic)]; } name PROGMEM = \
+        { { (sizeof(topic) - 1) >> 8, (sizeof(topic) - 1) & 0xFF }, topic }
+#define MQTT_TOPIC(name) ((MQTTTopic)&(name))
+
+#ifndef pgm_read_ptr
+#define pgm_read_ptr(addr) ((void*)pgm_read_word(addr))
+#endif
+
 #if defined(ESP8266) || defined(ESP32)
 #include <functional>
 #define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+#define MQTT_STREAM_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int, uint32_t, uint32_t)> streamCallback
 #else
 #define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+#define MQTT_STREAM_CALLBACK_SIGNATURE void (*streamCallback)(char*, uint8_t*, unsigned int, uint32_t, uint32_t)
 #endif
 
+// Optional storage for QoS 1 publishes that have not been acknowledged yet,
+// so they survive a reboot. Packets are handed over without the fixed header:
+// topic, message id and payload.
+class MQTTPersistence {
+public:
+   // Called when a packet enters the in-flight window
+   virtual void save(uint16_t msgId, uint8_t header, const uint8_t* packet, uint16_t length) = 0;
+   // Called when the PUBACK for msgId arrived
+   virtual void remove(uint16_t msgId) = 0;
+   // Copies the index-th stored packet, oldest first, into packet (at most
+   // size bytes). Returns its length, 0 if there is no such packet.
+   virtual uint16_t restore(uint8_t index, uint16_t* msgId, uint8_t* header, uint8_t* packet, uint16_t size) = 0;
+};
+
+// Copies of the QoS 1 publishes awaiting their PUBACK, oldest first, packed
+// back to back in one buffer. Acknowledged packets are released from the
+// front, so one that is acknowledged out of order holds its space until
+// the ones before it are.
+class MQTTInflightWindow {
+private:
+   uint8_t* buffer;
+   uint16_t bufferSize;
+   uint16_t used;
+   uint8_t entries;
+   uint16_t ids[MQTT_MAX_INFLIGHT];      // 0 once acknowledged
+   uint16_t lengths[MQTT_MAX_INFLIGHT];
+   uint8_t headers[MQTT_MAX_INFLIGHT];
+public:
+   MQTTInflightWindow();
+   ~MQTTInflightWindow();
+   // The buffer is allocated by the first add()
+   boolean setBufferSize(uint16_t size);
+   uint16_t getBufferSize();
+   // Number of packets not acknowledged yet
+   uint8_t pending();
+   boolean contains(uint16_t msgId);
+   boolean hasRoom(uint16_t length);
+   boolean add(uint16_t msgId, uint8_t header, const uint8_t* packet, uint16_t length);
+   // Returns true if msgId was in flight
+   boolean remove(uint16_t msgId);
+   // The index-th oldest packet, NULL past the end; acknowledged ones have msgId 0
+   const uint8_t* get(uint8_t index, uint16_t* msgId, uint8_t* header, uint16_t* length);
+};
+
 #define CHECK_STRING_LENGTH(l,s) if (l+2+strnlen(s, this->bufferSize) > this->bufferSize) {_client->stop();return false;}
 
 class PubSubClient : public Print {
@@ -97,7 +185,10 @@ private:
    unsigned long lastInActivity;
    bool pingOutstanding;
    MQTT_CALLBACK_SIGNATURE;
+   MQTT_STREAM_CALLBACK_SIGNATURE;
+   uint32_t streamRemaining;
    uint32_t readPacket(uint8_t*);
+   boolean readPayload(char* topic, uint8_t* chunk, uint16_t size, uint32_t total);
    boolean readByte(uint8_t * result);
    boolean readByte(uint8_t * result, uint16_t * index);
    boolean write(uint8_t header, uint8_t* buf, uint16_t length);
@@ -112,6 +203,22 @@ private:
    uint16_t port;
    Stream* stream;
    int _state;
+   MQTTInflightWindow inflight;
+   MQTTPersistence* persistence;
+   const MQTTTopic* topics;
+   uint8_t topicCount;
+#if MQTT_VERSION == MQTT_VERSION_5
+   uint16_t topicAliasMaximum;
+   uint32_t topicAliasSent;        // Bit n: alias n+1 is known to the broker
+   uint16_t skipProperties(uint16_t pos, uint16_t length);
+   void readConnackProperties(uint16_t pos, uint16_t length);
+#endif
+   uint16_t topicSize(uint8_t topic);
+   uint16_t writeTopic(uint8_t topic, uint8_t* buf, uint16_t pos);
+   uint16_t writePublishTopic(uint8_t topic, uint8_t* buf, uint16_t pos);
+   uint16_t nextPublishId();
+   boolean waitForInflight(uint16_t length);
+   boolean resendInflight();
 public:
    PubSubClient();
    PubSubClient(Client& client);
@@ -134,6 +241,19 @@ public:
    PubSubClient& setServer(uint8_t * ip, uint16_t port);
    PubSubClient& setServer(const char * domain, uint16_t port);
    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+   // Receive messages of any size without buffering them: the callback gets
+   // the topic with the payload in chunks read straight from the client,
+   // streamCallback(topic, chunk, length, index, total), where index is the
+   // offset of the chunk in the payload of total bytes. It is called at
+   // least once, with length 0 for an empty payload. Only the topic has to
+   // fit in the buffer; the rest of it is the chunk space. Takes the place
+   // of the callback set with setCallback() and of setStream().
+   PubSubClient& setStreamCallback(MQTT_STREAM_CALLBACK_SIGNATURE);
+   // Registers a PROGMEM table of topics declared with MQTT_TOPIC_P, for
+   // publishTopic() and subscribeTopic() to refer to by index. With
+   // MQTT_VERSION_5, topic n gets the topic alias n+1 if the broker allows
+   // that many; only the first 32 topics can have an alias.
+   PubSubClient& setTopics(const MQTTTopic* topics, uint8_t count);
    PubSubClient& setClient(Client& client);
    PubSubClient& setStream(Stream& stream);
    PubSubClient& setKeepAlive(uint16_t keepAlive);
@@ -141,6 +261,13 @@ public:
 
    boolean setBufferSize(uint16_t size);
    uint16_t getBufferSize();
+   boolean setInflightBufferSize(uint16_t size);
+   // Number of QoS 1 publishes awaiting their PUBACK
+   uint8_t getInflight();
+   // Loads the packets stored by persistence into the in-flight window, to
+   // be sent again on the next connect, and keeps it informed from then on.
+   // Call before connect().
+   boolean setPersistence(MQTTPersistence& persistence);
 
    boolean connect(const char* id);
    boolean connect(const char* id, const char* user, const char* pass);
@@ -152,6 +279,15 @@ public:
    boolean publish(const char* topic, const char* payload, boolean retained);
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength);
    boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
+   // Publish at QoS 0 or 1. A QoS 1 message is kept until its PUBACK arrives
+   // in loop(), and sent again with the DUP flag after a reconnect. Up to
+   // MQTT_MAX_INFLIGHT messages can be awaiting their PUBACK; when the window
+   // is full this waits for one, at most the socket timeout.
+   boolean publish(const char* topic, const char* payload, boolean retained, uint8_t qos);
+   boolean publish(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained, uint8_t qos);
+   // Publish at QoS 0 to a topic from the setTopics() table
+   boolean publishTopic(uint8_t topic, const char* payload, boolean retained);
+   boolean publishTopic(uint8_t topic, const uint8_t * payload, unsigned int plength, boolean retained);
    boolean publish_P(const char* topic, const char* payload, boolean retained);
    boolean publish_P(const char* topic, const uint8_t * payload, unsigned int plength, boolean retained);
    // Start to publish a message.
@@ -163,6 +299,7 @@ public:
    // a new buffer and held in memory at one time
    // Returns 1 if the message was started successfully, 0 if there was an error
    boolean beginPublish(const char* topic, unsigned int plength, boolean retained);
+   boolean beginPublishTopic(uint8_t topic, unsigned int plength, boolean retained);
    // Finish off this publish message (started with beginPublish)
    // Returns 1 if the packet was sent successfully, 0 if there was an error
    int endPublish();
@@ -173,6 +310,7 @@ public:
    virtual size_t write(const uint8_t *buffer, size_t size);
    boolean subscribe(const char* topic);
    boolean subscribe(const char* topic, uint8_t qos);
+   boolean subscribeTopic(uint8_t topic, uint8_t qos);
    boolean unsubscribe(const char* topic);
    boolean loop();
    boolean connected();
@@ -20,6 +20,9 @@ extern "C"{
 
 #define PROGMEM
 #define pgm_read_byte_near(x) *(x)
+#define pgm_read_byte(x) *(x)
+#define pgm_read_ptr(x) *(x)
+#define memcpy_P memcpy
 
 #define yield(x) {}
 
@@ -0,0 +1,267 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+// Built with -DMQTT_VERSION=5, see the Makefile
+
+byte server[] = { 172, 16, 0, 2 };
+
+MQTT_TOPIC_P(topicTopic, "topic");
+MQTT_TOPIC_P(telemetryTopic, "v1/devices/me/telemetry");
+const MQTTTopic topics[] PROGMEM = { MQTT_TOPIC(topicTopic), MQTT_TOPIC(telemetryTopic) };
+
+bool callback_called = false;
+char lastTopic[1024];
+char lastPayload[1024];
+unsigned int lastLength;
+
+void reset_callback() {
+    callback_called = false;
+    lastTopic[0] = '\0';
+    lastPayload[0] = '\0';
+    lastLength = 0;
+}
+
+void callback(char* topic, byte* payload, unsigned int length) {
+    callback_called = true;
+    strcpy(lastTopic,topic);
+    memcpy(lastPayload,payload,length);
+    lastLength = length;
+}
+
+void chunk_callback(char* topic, byte* chunk, unsigned int length, uint32_t index, uint32_t total) {
+    callback_called = true;
+    strcpy(lastTopic,topic);
+    memcpy(lastPayload+index,chunk,length);
+    lastLength = index+length;
+}
+
+int test_connect() {
+    IT("sends an MQTT 5 connect packet");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connect[] = {0x10,0x19,0x0,0x4,0x4d,0x51,0x54,0x54,0x5,0x2,0x0,0xf,0x0,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,27);
+
+    byte connack[] = { 0x20, 0x03, 0x00, 0x00, 0x00 };
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_connect_refused() {
+    IT("reports the reason code of a refused connection");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x03, 0x00, 0x87, 0x00 };
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_FALSE(rc);
+    IS_TRUE(client.state() == 0x87);
+
+    END_IT
+}
+
+int test_publish() {
+    IT("publishes with an empty property list");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x03, 0x00, 0x00, 0x00 };
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xf,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,17);
+    byte qos1[] = {0x32,0x11,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x0,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(qos1,19);
+    byte subscribe[] = { 0x82,0xb,0x0,0x3,0x0,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x1 };
+    shimClient.expect(subscribe,13);
+
+    rc = client.publish((char*)"topic",(char*)"payload");
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",(char*)"payload",false,1);
+    IS_TRUE(rc);
+    rc = client.subscribe((char*)"topic",1);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_topic_alias() {
+    IT("leaves the topic out once the broker knows its alias");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    // Topic Alias Maximum 10
+    byte connack[] = { 0x20, 0x06, 0x00, 0x00, 0x03, 0x22, 0x00, 0x0a };
+    shimClient.respond(connack,8);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopics(topics, 2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte first[] = {0x30,0x24,0x0,0x17,
+        'v','1','/','d','e','v','i','c','e','s','/','m','e','/','t','e','l','e','m','e','t','r','y',
+        0x3,0x23,0x0,0x2,'p','a','y','l','o','a','d'};
+    shimClient.expect(first,38);
+    byte next[] = {0x30,0xd,0x0,0x0,0x3,0x23,0x0,0x2,'p','a','y','l','o','a','d'};
+    shimClient.expect(next,15);
+
+    uint16_t start = shimClient.received();
+    rc = client.publishTopic(1,(char*)"payload",false);
+    IS_TRUE(rc);
+    uint16_t firstBytes = shimClient.received() - start;
+
+    start = shimClient.received();
+    rc = client.publishTopic(1,(char*)"payload",false);
+    IS_TRUE(rc);
+    uint16_t nextBytes = shimClient.received() - start;
+
+    // 34 bytes per publish with MQTT 3.1.1
+    IS_TRUE(firstBytes == 38);
+    IS_TRUE(nextBytes == 15);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_topic_alias_reconnect() {
+    IT("sends the topic again after reconnecting");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x06, 0x00, 0x00, 0x03, 0x22, 0x00, 0x01 };
+    shimClient.respond(connack,8);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopics(topics, 2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0x12,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x3,0x23,0x0,0x1,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,20);
+    // Only alias 1 is allowed, topic 1 goes out in full
+    byte noAlias[] = {0x30,0x21,0x0,0x17,
+        'v','1','/','d','e','v','i','c','e','s','/','m','e','/','t','e','l','e','m','e','t','r','y',
+        0x0,'p','a','y','l','o','a','d'};
+    shimClient.expect(noAlias,35);
+
+    rc = client.publishTopic(0,(char*)"payload",false);
+    IS_TRUE(rc);
+    rc = client.publishTopic(1,(char*)"payload",false);
+    IS_TRUE(rc);
+
+    shimClient.setConnected(false);
+    byte connect[] = {0x10,0x19,0x0,0x4,0x4d,0x51,0x54,0x54,0x5,0x2,0x0,0xf,0x0,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,27);
+    shimClient.expect(publish,20);
+    shimClient.respond(connack,8);
+
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    rc = client.publishTopic(0,(char*)"payload",false);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_properties() {
+    IT("skips the properties of a received message");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x03, 0x00, 0x00, 0x00 };
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    // Payload Format Indicator 1
+    byte publish[] = {0x32,0x13,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x2,0x1,0x1,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,21);
+
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.expect(puback,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(lastLength == 7);
+    IS_TRUE(memcmp(lastPayload,"payload",7)==0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_properties_chunks() {
+    IT("skips the properties of a message received in chunks");
+    reset_callback();
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x03, 0x00, 0x00, 0x00 };
+    shimClient.respond(connack,5);
+
+    PubSubClient client(server, 1883, shimClient);
+    client.setStreamCallback(chunk_callback);
+    int rc = client.connect((char*)"c1");
+    IS_TRUE(rc);
+    client.setBufferSize(16);
+
+    byte publish[] = {0x30,0x11,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x2,0x1,0x1,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,19);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_TRUE(callback_called);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(lastLength == 7);
+    IS_TRUE(memcmp(lastPayload,"payload",7)==0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+
+int main()
+{
+    SUITE("MQTT 5");
+    test_connect();
+    test_connect_refused();
+    test_publish();
+    test_topic_alias();
+    test_topic_alias_reconnect();
+    test_receive_properties();
+    test_receive_properties_chunks();
+
+    FINISH
+}
@@ -0,0 +1,319 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+// Keeps the in-flight packets in RAM, as an EEPROM or flash store would
+class ShimPersistence : public MQTTPersistence {
+public:
+    uint8_t count;
+    uint16_t ids[4];
+    uint8_t headers[4];
+    uint16_t lengths[4];
+    uint8_t packets[4][64];
+
+    ShimPersistence() {
+        count = 0;
+    }
+    void save(uint16_t msgId, uint8_t header, const uint8_t* packet, uint16_t length) {
+        ids[count] = msgId;
+        headers[count] = header;
+        lengths[count] = length;
+        memcpy(packets[count], packet, length);
+        count++;
+    }
+    void remove(uint16_t msgId) {
+        for (uint8_t i = 0; i < count; i++) {
+            if (ids[i] == msgId) {
+                for (uint8_t j = i+1; j < count; j++) {
+                    ids[j-1] = ids[j];
+                    headers[j-1] = headers[j];
+                    lengths[j-1] = lengths[j];
+                    memcpy(packets[j-1], packets[j], lengths[j]);
+                }
+                count--;
+                return;
+            }
+        }
+    }
+    uint16_t restore(uint8_t index, uint16_t* msgId, uint8_t* header, uint8_t* packet, uint16_t size) {
+        if (index >= count || lengths[index] > size) {
+            return 0;
+        }
+        *msgId = ids[index];
+        *header = headers[index];
+        memcpy(packet, packets[index], lengths[index]);
+        return lengths[index];
+    }
+};
+
+
+int test_publish_qos1() {
+    IT("publishes at qos 1 with a message id");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,18);
+
+    rc = client.publish((char*)"topic",(char*)"payload",false,1);
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflight() == 1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_qos0() {
+    IT("publishes at qos 0 without keeping the message");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x31,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,16);
+
+    rc = client.publish((char*)"topic",(char*)"payload",true,0);
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflight() == 0);
+
+    rc = client.publish((char*)"topic",(char*)"payload",false,2);
+    IS_FALSE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_puback() {
+    IT("releases a message when its puback arrives");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publish((char*)"topic",(char*)"payload",false,1);
+    IS_TRUE(rc);
+
+    byte otherAck[] = { 0x40, 0x02, 0x00, 0x07 };
+    shimClient.respond(otherAck,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflight() == 1);
+
+    byte puback[] = { 0x40, 0x02, 0x00, 0x02 };
+    shimClient.respond(puback,4);
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflight() == 0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_pipeline() {
+    IT("pipelines publishes up to the window size");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT + 1; i++) {
+        publish[10] = 2 + i;
+        shimClient.expect(publish,18);
+    }
+
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        rc = client.publish((char*)"topic",(char*)"payload",false,1);
+        IS_TRUE(rc);
+    }
+    IS_TRUE(client.getInflight() == MQTT_MAX_INFLIGHT);
+
+    // The window is full: the next publish reads acks until there is room
+    byte puback[] = { 0x40, 0x02, 0x00, 0x03, 0x40, 0x02, 0x00, 0x02 };
+    shimClient.respond(puback,8);
+    rc = client.publish((char*)"topic",(char*)"payload",false,1);
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflight() == MQTT_MAX_INFLIGHT - 1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_window_full() {
+    IT("fails to publish when the window stays full");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setSocketTimeout(1);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        rc = client.publish((char*)"topic",(char*)"payload",false,1);
+        IS_TRUE(rc);
+    }
+    rc = client.publish((char*)"topic",(char*)"payload",false,1);
+    IS_FALSE(rc);
+    IS_TRUE(client.getInflight() == MQTT_MAX_INFLIGHT);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_resend_on_reconnect() {
+    IT("resends unacknowledged messages with the dup flag after reconnecting");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,18);
+    rc = client.publish((char*)"topic",(char*)"payload",false,1);
+    IS_TRUE(rc);
+
+    shimClient.setConnected(false);
+    IS_FALSE(client.connected());
+
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,26);
+    publish[0] = 0x3a;
+    shimClient.expect(publish,18);
+    shimClient.respond(connack,4);
+
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflight() == 1);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_persistence() {
+    IT("restores unacknowledged messages from persistence");
+    ShimPersistence persistence;
+    {
+        ShimClient shimClient;
+        shimClient.setAllowConnect(true);
+
+        byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+        shimClient.respond(connack,4);
+
+        PubSubClient client(server, 1883, callback, shimClient);
+        int rc = client.setPersistence(persistence);
+        IS_TRUE(rc);
+        rc = client.connect((char*)"client_test1");
+        IS_TRUE(rc);
+
+        rc = client.publish((char*)"topic",(char*)"one",false,1);
+        IS_TRUE(rc);
+        rc = client.publish((char*)"topic",(char*)"two",false,1);
+        IS_TRUE(rc);
+        IS_TRUE(persistence.count == 2);
+
+        byte puback[] = { 0x40, 0x02, 0x00, 0x02 };
+        shimClient.respond(puback,4);
+        rc = client.loop();
+        IS_TRUE(rc);
+        IS_TRUE(persistence.count == 1);
+    }
+
+    // A new client, as after a reboot
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.setPersistence(persistence);
+    IS_TRUE(rc);
+    IS_TRUE(client.getInflight() == 1);
+
+    byte connect[] = {0x10,0x18,0x0,0x4,0x4d,0x51,0x54,0x54,0x4,0x2,0x0,0xf,0x0,0xc,0x63,0x6c,0x69,0x65,0x6e,0x74,0x5f,0x74,0x65,0x73,0x74,0x31};
+    shimClient.expect(connect,26);
+    byte resend[] = {0x3a,0xc,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x3,0x74,0x77,0x6f};
+    shimClient.expect(resend,14);
+    // Message id 3 is still in flight, so the next one is 2
+    byte publish[] = {0x32,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x0,0x2,0x74,0x68,0x72,0x65,0x65};
+    shimClient.expect(publish,16);
+
+    rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    rc = client.publish((char*)"topic",(char*)"three",false,1);
+    IS_TRUE(rc);
+    IS_TRUE(persistence.count == 2);
+
+    byte puback[] = { 0x40, 0x02, 0x00, 0x03, 0x40, 0x02, 0x00, 0x02 };
+    shimClient.respond(puback,8);
+    client.loop();
+    client.loop();
+    IS_TRUE(client.getInflight() == 0);
+    IS_TRUE(persistence.count == 0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+
+int main()
+{
+    SUITE("QoS");
+    test_publish_qos1();
+    test_publish_qos0();
+    test_puback();
+    test_pipeline();
+    test_window_full();
+    test_resend_on_reconnect();
+    test_persistence();
+
+    FINISH
+}
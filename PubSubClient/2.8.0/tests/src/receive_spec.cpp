@@ -27,6 +27,28 @@ void callback(char* topic, byte* payload, unsigned int length) {
     lastLength = length;
 }
 
+unsigned int chunkCount;
+bool chunksInOrder;
+
+void reset_chunk_callback() {
+    reset_callback();
+    chunkCount = 0;
+    chunksInOrder = true;
+}
+
+void chunk_callback(char* topic, byte* chunk, unsigned int length, uint32_t index, uint32_t total) {
+    TRACE("Chunk received topic=[" << topic << "] index=" << index << " length=" << length << " total=" << total << "\n")
+    callback_called = true;
+    strcpy(lastTopic,topic);
+    if (index != lastLength || index+length > total) {
+        chunksInOrder = false;
+    } else {
+        memcpy(lastPayload+index,chunk,length);
+        lastLength = index+length;
+    }
+    chunkCount++;
+}
+
 int test_receive_callback() {
     IT("receives a callback message");
     reset_callback();
@@ -324,6 +346,182 @@ int test_receive_qos1() {
     END_IT
 }
 
+int test_receive_chunks() {
+    IT("receives a message larger than the buffer in chunks");
+    reset_chunk_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, shimClient);
+    client.setStreamCallback(chunk_callback);
+    int rc = client.connect((char*)"c1");
+    IS_TRUE(rc);
+    client.setBufferSize(20);
+
+    // 10 bytes of header and topic leave 10 byte chunks
+    int length = 300;
+    byte publish[] = {0x30,0xb3,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    byte bigPublish[length+10];
+    memcpy(bigPublish,publish,10);
+    for (int i = 0; i < length; i++) {
+        bigPublish[10+i] = 'a' + i % 26;
+    }
+    shimClient.respond(bigPublish,length+10);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_TRUE(callback_called);
+    IS_TRUE(chunksInOrder);
+    IS_TRUE(chunkCount == 30);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(lastLength == length);
+    IS_TRUE(memcmp(lastPayload,bigPublish+10,length)==0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_empty_chunk() {
+    IT("receives an empty message as one empty chunk");
+    reset_chunk_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, shimClient);
+    client.setStreamCallback(chunk_callback);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0x7,0x0,0x5,0x74,0x6f,0x70,0x69,0x63};
+    shimClient.respond(publish,9);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_TRUE(callback_called);
+    IS_TRUE(chunksInOrder);
+    IS_TRUE(chunkCount == 1);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(lastLength == 0);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_qos1_chunks() {
+    IT("receives a qos1 message in chunks");
+    reset_chunk_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, shimClient);
+    client.setStreamCallback(chunk_callback);
+    int rc = client.connect((char*)"c1");
+    IS_TRUE(rc);
+    client.setBufferSize(14);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,18);
+
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.expect(puback,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+
+    IS_TRUE(callback_called);
+    IS_TRUE(chunksInOrder);
+    IS_TRUE(chunkCount == 3);
+    IS_TRUE(strcmp(lastTopic,"topic")==0);
+    IS_TRUE(memcmp(lastPayload,"payload",7)==0);
+    IS_TRUE(lastLength == 7);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_oversized_topic_chunks() {
+    IT("drops a chunked message whose topic does not fit the buffer");
+    reset_chunk_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, shimClient);
+    client.setStreamCallback(chunk_callback);
+    int rc = client.connect((char*)"c1");
+    IS_TRUE(rc);
+    client.setBufferSize(9);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,16);
+    byte ping[] = {0xd0,0x0};
+    shimClient.respond(ping,2);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    // The next packet is still read correctly
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_receive_oversized_topic_qos1_chunks() {
+    IT("acknowledges a dropped qos1 chunked message");
+    reset_chunk_callback();
+
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, shimClient);
+    client.setStreamCallback(chunk_callback);
+    int rc = client.connect((char*)"c1");
+    IS_TRUE(rc);
+    client.setBufferSize(9);
+
+    byte publish[] = {0x32,0x10,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x12,0x34,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.respond(publish,18);
+
+    byte puback[] = {0x40,0x2,0x12,0x34};
+    shimClient.expect(puback,4);
+
+    rc = client.loop();
+    IS_TRUE(rc);
+    IS_FALSE(callback_called);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
 int main()
 {
     SUITE("Receive");
@@ -335,6 +533,11 @@ int main()
     test_resize_buffer();
     test_receive_oversized_stream_message();
     test_receive_qos1();
+    test_receive_chunks();
+    test_receive_empty_chunk();
+    test_receive_qos1_chunks();
+    test_receive_oversized_topic_chunks();
+    test_receive_oversized_topic_qos1_chunks();
 
     FINISH
 }
@@ -0,0 +1,206 @@
+#include "PubSubClient.h"
+#include "ShimClient.h"
+#include "Buffer.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+
+byte server[] = { 172, 16, 0, 2 };
+
+MQTT_TOPIC_P(topicTopic, "topic");
+MQTT_TOPIC_P(telemetryTopic, "v1/devices/me/telemetry");
+const MQTTTopic topics[] PROGMEM = { MQTT_TOPIC(topicTopic), MQTT_TOPIC(telemetryTopic) };
+
+void callback(char* topic, byte* payload, unsigned int length) {
+  // handle message arrived
+}
+
+int test_topic_encoding() {
+    IT("encodes topics as MQTT strings");
+
+    IS_TRUE(sizeof(telemetryTopic) == 2 + 23 + 1);
+    IS_TRUE(telemetryTopic.length[0] == 0);
+    IS_TRUE(telemetryTopic.length[1] == 23);
+    IS_TRUE(strcmp(telemetryTopic.string, "v1/devices/me/telemetry") == 0);
+
+    END_IT
+}
+
+int test_publish_topic() {
+    IT("publishes to a topic from the table");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopics(topics, 2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,16);
+    // Retained
+    publish[0] = 0x31;
+    shimClient.expect(publish,16);
+
+    rc = client.publishTopic(0,(char*)"payload",false);
+    IS_TRUE(rc);
+    rc = client.publishTopic(0,(const uint8_t*)"payload",7,true);
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_topic_bytes_on_air() {
+    IT("sends the same bytes as publish() with a RAM topic");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopics(topics, 2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    uint16_t start = shimClient.received();
+    rc = client.publish((char*)"v1/devices/me/telemetry",(char*)"{\"t\":21}");
+    IS_TRUE(rc);
+    uint16_t ramTopic = shimClient.received() - start;
+
+    start = shimClient.received();
+    rc = client.publishTopic(1,(char*)"{\"t\":21}",false);
+    IS_TRUE(rc);
+    uint16_t flashTopic = shimClient.received() - start;
+
+    // 2 byte fixed header, 25 byte topic, 8 byte payload
+    IS_TRUE(ramTopic == 35);
+    IS_TRUE(flashTopic == 35);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_publish_topic_unknown() {
+    IT("fails to publish to a topic missing from the table");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    rc = client.publishTopic(0,(char*)"payload",false);
+    IS_FALSE(rc);
+
+    client.setTopics(topics, 2);
+    rc = client.publishTopic(2,(char*)"payload",false);
+    IS_FALSE(rc);
+    rc = client.subscribeTopic(2,0);
+    IS_FALSE(rc);
+
+    IS_TRUE(shimClient.received() == 26);
+
+    END_IT
+}
+
+int test_publish_topic_too_long() {
+    IT("fails to publish a message too long for the buffer");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopics(topics, 2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+    client.setBufferSize(38);
+
+    rc = client.publishTopic(1,(char*)"{\"t\":215}",false);
+    IS_FALSE(rc);
+    rc = client.publishTopic(1,(char*)"{\"t\":21}",false);
+    IS_TRUE(rc);
+
+    END_IT
+}
+
+int test_begin_publish_topic() {
+    IT("starts a streamed publish to a topic from the table");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopics(topics, 2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte publish[] = {0x30,0xe,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x70,0x61,0x79,0x6c,0x6f,0x61,0x64};
+    shimClient.expect(publish,16);
+
+    rc = client.beginPublishTopic(0,7,false);
+    IS_TRUE(rc);
+    rc = client.write((const uint8_t*)"payload",7);
+    IS_TRUE(rc == 7);
+    rc = client.endPublish();
+    IS_TRUE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+int test_subscribe_topic() {
+    IT("subscribes to a topic from the table");
+    ShimClient shimClient;
+    shimClient.setAllowConnect(true);
+
+    byte connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    shimClient.respond(connack,4);
+
+    PubSubClient client(server, 1883, callback, shimClient);
+    client.setTopics(topics, 2);
+    int rc = client.connect((char*)"client_test1");
+    IS_TRUE(rc);
+
+    byte subscribe[] = { 0x82,0xa,0x0,0x2,0x0,0x5,0x74,0x6f,0x70,0x69,0x63,0x1 };
+    shimClient.expect(subscribe,12);
+
+    rc = client.subscribeTopic(0,1);
+    IS_TRUE(rc);
+
+    rc = client.subscribeTopic(0,2);
+    IS_FALSE(rc);
+
+    IS_FALSE(shimClient.error());
+
+    END_IT
+}
+
+
+int main()
+{
+    SUITE("Topic table");
+    test_topic_encoding();
+    test_publish_topic();
+    test_publish_topic_bytes_on_air();
+    test_publish_topic_unknown();
+    test_publish_topic_too_long();
+    test_begin_publish_topic();
+    test_subscribe_topic();
+
+    FINISH
+}
@@ -0,0 +1,68 @@
+/*
+  Arduino.h - Just enough of the Arduino core to build the SD library on a
+  PC. The chip select pin and the SPI bus (SPI.h) are wired to the card
+  emulator in SdCardImage.h, so the library runs unchanged against a disk
+  image file.
+
+  Build with -D__arm__ so that Sd2PinMap.h takes the generic pin mapping.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "Stream.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+#define MSBFIRST 1
+#define SPI_MODE0 0x00
+
+// Pins Sd2PinMap.h takes from the core. SS is the default chip select.
+#define SS   10
+#define MOSI 11
+#define MISO 12
+#define SCK  13
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+#define pgm_read_byte(x) (*(const uint8_t*)(x))
+
+uint32_t millis(void);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+class String {
+  public:
+    String(const char* s = "") : s_(s) {}
+    const char* c_str() const {
+      return s_.c_str();
+    }
+    unsigned int length() const {
+      return s_.size();
+    }
+
+  private:
+    std::string s_;
+};
+
+class HostSerial : public Print {
+  public:
+    size_t write(uint8_t c) {
+      return fputc(c, stdout) == EOF ? 0 : 1;
+    }
+};
+
+extern HostSerial Serial;
+
+#endif
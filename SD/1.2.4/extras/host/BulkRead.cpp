@@ -0,0 +1,134 @@
+/*
+  BulkRead.cpp - Reads a 1 MB log file sequentially, as an upload does,
+  with different sizes for each read() call.
+
+  Whole blocks go from the card to the caller's buffer, several of them in
+  one multiple block read (CMD18) up to the end of each cluster, and the
+  read continues across clusters that follow each other.  Reads smaller
+  than a block go through the block cache.
+
+  For each read size it prints the single block reads (CMD17), the
+  multiple block reads started (CMD18) and the blocks sent in them, the
+  SPI traffic and a time estimate for an 8 MHz SPI clock with the card
+  timing described in SdCardImage.cpp.  Every case checks the data read
+  and that no command but CMD12 interrupted a multiple block read.
+
+  Build and run from this directory:
+    g++ -O2 -D__arm__ -I. -I../../src BulkRead.cpp SdCardImage.cpp \
+        ../../src/utility/Sd2Card.cpp ../../src/utility/SdVolume.cpp \
+        ../../src/utility/SdFile.cpp -o BulkRead && ./BulkRead
+
+  The image is written to BulkRead.img in the current directory and
+  removed at the end.
+*/
+#include <Arduino.h>
+#include "utility/SdFat.h"
+#include "SdCardImage.h"
+
+static const char IMAGE[] = "BulkRead.img";
+static const uint32_t LOG_SIZE = 1024UL * 1024;
+static const uint32_t SPI_CLOCK = 8000000;
+
+static uint8_t buf[8192];
+
+static uint8_t pattern(uint32_t pos) {
+  return (pos >> 9) ^ (pos * 11);
+}
+
+static int fail(const char* what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+static int writeLog(SdFile* root) {
+  SdFile log;
+  SdFile other;
+  if (!log.open(root, "LOG.BIN", O_CREAT | O_WRITE | O_TRUNC)
+      || !other.open(root, "OTHER.BIN", O_CREAT | O_WRITE | O_TRUNC)) {
+    return fail("open");
+  }
+  for (uint32_t pos = 0; pos < LOG_SIZE; pos += 512) {
+    for (uint16_t i = 0; i < 512; i++) {
+      buf[i] = pattern(pos + i);
+    }
+    if (log.write(buf, 512) != 512) {
+      return fail("write");
+    }
+    // break the cluster chain now and then
+    if (pos % 65536 == 0 && other.write(buf, 512) != 512) {
+      return fail("write other");
+    }
+  }
+  if (!log.close() || !other.close()) {
+    return fail("close");
+  }
+  return 0;
+}
+
+static int readLog(SdCardImage* image, SdFile* root, uint16_t size) {
+  SdFile log;
+  if (!log.open(root, "LOG.BIN", O_READ)) {
+    return fail("open log");
+  }
+  image->clearCounters();
+  for (uint32_t pos = 0; pos < LOG_SIZE; pos += size) {
+    uint16_t n = LOG_SIZE - pos < size ? LOG_SIZE - pos : size;
+    if (log.read(buf, n) != n) {
+      return fail("read");
+    }
+    for (uint16_t i = 0; i < n; i++) {
+      if (buf[i] != pattern(pos + i)) {
+        return fail("data");
+      }
+    }
+  }
+  log.close();
+  SdCardCounters n = image->counters();
+  double ms = image->estimateMillis(SPI_CLOCK);
+  printf("%5u %6lu %5lu %6lu %6lu %6.0f %5.0f\n", size,
+         (unsigned long)n.blocksRead, (unsigned long)n.readStarts,
+         (unsigned long)n.readBlocks, (unsigned long)(n.spiBytes / 1024), ms,
+         LOG_SIZE / 1.024 / ms);
+  if (n.protocolErrors) {
+    return fail("command during a multiple block read");
+  }
+  return 0;
+}
+
+int main() {
+  static const struct {
+    const char* name;
+    uint32_t blocks;
+    uint8_t blocksPerCluster;
+  } volumes[] = {
+    {"FAT16, 64 MB, 2 KB clusters", 131072, 4},
+    {"FAT32, 512 MB, 4 KB clusters", 1048576, 8},
+  };
+  static const uint16_t sizes[] = {100, 512, 1024, 4096, 8192};
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(volumes) / sizeof(volumes[0]); i++) {
+    SdCardImage image;
+    Sd2Card card;
+    SdVolume volume;
+    SdFile root;
+    if (!SdCardImage::format(IMAGE, volumes[i].blocks,
+                             volumes[i].blocksPerCluster)
+        || !image.open(IMAGE)) {
+      return fail("image");
+    }
+    if (!card.init(SPI_FULL_SPEED, SS) || !volume.init(&card)
+        || !root.openRoot(&volume)) {
+      return fail("init");
+    }
+    failed |= writeLog(&root);
+    printf("%s, 1 MB log\n", volumes[i].name);
+    printf(" read  CMD17 CMD18 blocks SPI KB est ms  KB/s\n");
+    for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+      failed |= readLog(&image, &root, sizes[j]);
+    }
+    printf("\n");
+    root.close();
+  }
+  remove(IMAGE);
+  return failed;
+}
@@ -0,0 +1,207 @@
+/*
+  CacheBenchmark.cpp - Counts the block reads and writes of the SdVolume
+  cache for three workloads on a FAT16 and a FAT32 image:
+    open    open and close 48 files by name in a subdirectory,
+    append  two logs written in turn with 100 byte records and a sync()
+            every 4 KB, as a logger with two channels does,
+    seek    500 reads of 16 bytes at random positions in a fragmented
+            256 KB file.
+  The counts come from SdVolume::blockReadCount() and blockWriteCount().
+  Every workload also checks the data it reads back.
+
+  The cache size is fixed at compile time, so build and run once per size
+  from this directory:
+    for n in 1 2 4 8; do
+      g++ -O2 -D__arm__ -DSD_CACHE_WAYS=$n -I. -I../../src \
+          CacheBenchmark.cpp SdCardImage.cpp ../../src/utility/Sd2Card.cpp \
+          ../../src/utility/SdVolume.cpp ../../src/utility/SdFile.cpp \
+          -o CacheBenchmark && ./CacheBenchmark || break
+    done
+
+  The image is written to CacheBenchmark.img in the current directory and
+  removed at the end.
+*/
+#include <Arduino.h>
+#include "utility/SdFat.h"
+#include "SdCardImage.h"
+
+static const char IMAGE[] = "CacheBenchmark.img";
+static const uint8_t FILE_COUNT = 48;
+static const uint32_t LOG_SIZE = 128UL * 1024;
+static const uint32_t SEEK_FILE_SIZE = 256UL * 1024;
+static const uint16_t SEEKS = 500;
+
+static Sd2Card card;
+static SdVolume volume;
+static SdFile root;
+
+static uint8_t pattern(uint8_t file, uint32_t pos) {
+  return (pos >> 8) ^ pos ^ (file << 5);
+}
+
+static int fail(const char* what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+static void report(const char* volumeName, const char* workload) {
+  printf("%-6s %-7s %7lu %7lu\n", volumeName, workload,
+         (unsigned long)SdVolume::blockReadCount(),
+         (unsigned long)SdVolume::blockWriteCount());
+}
+
+static void fileName(char* name, const char* prefix, uint8_t i) {
+  sprintf(name, "%s%02u.TXT", prefix, i);
+}
+
+static int openWorkload(const char* volumeName) {
+  SdFile dir;
+  SdFile file;
+  char name[13];
+  if (!dir.makeDir(&root, "DATA")) {
+    return fail("makeDir");
+  }
+  for (uint8_t i = 0; i < FILE_COUNT; i++) {
+    fileName(name, "FILE", i);
+    if (!file.open(&dir, name, O_CREAT | O_WRITE) || file.write(i) != 1
+        || !file.close()) {
+      return fail("create");
+    }
+  }
+  SdVolume::clearBlockCounts();
+  for (uint8_t i = FILE_COUNT; i-- > 0;) {
+    fileName(name, "FILE", i);
+    if (!file.open(&dir, name, O_READ) || file.read() != i) {
+      return fail("open");
+    }
+    file.close();
+  }
+  report(volumeName, "open");
+  dir.close();
+  return 0;
+}
+
+static int appendWorkload(const char* volumeName) {
+  SdFile log[2];
+  uint8_t record[100];
+  for (uint8_t f = 0; f < 2; f++) {
+    char name[13];
+    fileName(name, "LOG", f);
+    if (!log[f].open(&root, name, O_CREAT | O_WRITE | O_TRUNC)) {
+      return fail("open log");
+    }
+  }
+  SdVolume::clearBlockCounts();
+  for (uint32_t pos = 0; pos < LOG_SIZE; pos += sizeof(record)) {
+    uint16_t n = LOG_SIZE - pos < sizeof(record) ? LOG_SIZE - pos : sizeof(record);
+    for (uint8_t f = 0; f < 2; f++) {
+      for (uint16_t i = 0; i < n; i++) {
+        record[i] = pattern(f, pos + i);
+      }
+      if (log[f].write(record, n) != n) {
+        return fail("append");
+      }
+      if ((pos + n) % 4096 < n && !log[f].sync()) {
+        return fail("sync");
+      }
+    }
+  }
+  for (uint8_t f = 0; f < 2; f++) {
+    if (!log[f].close()) {
+      return fail("close log");
+    }
+  }
+  report(volumeName, "append");
+
+  for (uint8_t f = 0; f < 2; f++) {
+    char name[13];
+    fileName(name, "LOG", f);
+    if (!log[f].open(&root, name, O_READ) || log[f].fileSize() != LOG_SIZE) {
+      return fail("log size");
+    }
+    for (uint32_t pos = 0; pos < LOG_SIZE; pos++) {
+      if (log[f].read() != pattern(f, pos)) {
+        return fail("log data");
+      }
+    }
+    log[f].close();
+  }
+  return 0;
+}
+
+static int seekWorkload(const char* volumeName) {
+  SdFile file;
+  SdFile other;
+  uint8_t buf[512];
+  // written in turn with another file so the clusters are not contiguous
+  if (!file.open(&root, "SEEK.BIN", O_CREAT | O_WRITE | O_TRUNC)
+      || !other.open(&root, "OTHER.BIN", O_CREAT | O_WRITE | O_TRUNC)) {
+    return fail("open seek file");
+  }
+  for (uint32_t pos = 0; pos < SEEK_FILE_SIZE; pos += sizeof(buf)) {
+    for (uint16_t i = 0; i < sizeof(buf); i++) {
+      buf[i] = pattern(7, pos + i);
+    }
+    if (file.write(buf, sizeof(buf)) != sizeof(buf)
+        || other.write(buf, sizeof(buf)) != sizeof(buf)) {
+      return fail("write seek file");
+    }
+  }
+  if (!file.close() || !other.close()
+      || !file.open(&root, "SEEK.BIN", O_READ)) {
+    return fail("reopen seek file");
+  }
+  SdVolume::clearBlockCounts();
+  uint32_t seed = 12345;
+  for (uint16_t i = 0; i < SEEKS; i++) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t pos = (seed >> 8) % (SEEK_FILE_SIZE - 16);
+    if (!file.seekSet(pos) || file.read(buf, 16) != 16) {
+      return fail("seek");
+    }
+    for (uint8_t j = 0; j < 16; j++) {
+      if (buf[j] != pattern(7, pos + j)) {
+        return fail("seek data");
+      }
+    }
+  }
+  report(volumeName, "seek");
+  file.close();
+  return 0;
+}
+
+int main() {
+  static const struct {
+    const char* name;
+    uint32_t blocks;
+    uint8_t blocksPerCluster;
+  } volumes[] = {
+    {"FAT16", 131072, 4},
+    {"FAT32", 1048576, 8},
+  };
+  int failed = 0;
+  printf("SD_CACHE_WAYS %u\n", SD_CACHE_WAYS);
+  printf("volume workload reads  writes\n");
+  for (size_t i = 0; i < sizeof(volumes) / sizeof(volumes[0]); i++) {
+    SdCardImage image;
+    if (!SdCardImage::format(IMAGE, volumes[i].blocks,
+                             volumes[i].blocksPerCluster)
+        || !image.open(IMAGE)) {
+      return fail("image");
+    }
+    if (!card.init(SPI_FULL_SPEED, SS) || !volume.init(&card)
+        || !root.openRoot(&volume)) {
+      return fail("init");
+    }
+    failed |= openWorkload(volumes[i].name);
+    failed |= appendWorkload(volumes[i].name);
+    failed |= seekWorkload(volumes[i].name);
+    root.close();
+    if (image.counters().protocolErrors) {
+      failed |= fail("command during a multiple block write");
+    }
+  }
+  printf("\n");
+  remove(IMAGE);
+  return failed;
+}
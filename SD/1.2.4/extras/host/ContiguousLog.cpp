@@ -0,0 +1,163 @@
+/*
+  ContiguousLog.cpp - Compares writing a 1 MB data log to an SD card the
+  usual way, cluster by cluster with a block write for each 512 bytes,
+  with writing it to space reserved up front by SdFile::preAllocate().
+
+  Each case runs on a freshly formatted FAT16 or FAT32 image behind the
+  SdCardImage emulator. It prints the single block writes (CMD24), the
+  multiple block writes started (CMD25) and the blocks sent in them, the
+  blocks read, the SPI traffic, and a time estimate for an 8 MHz SPI
+  clock with the card timing described in SdCardImage.cpp. The estimate
+  only tells the cases apart, it is no measurement of a real card.
+
+  Every case then checks that
+    - the file reads back as written and has the right size,
+    - the next file allocated starts right after the log, so close() gave
+      back the clusters that were pre-allocated but not written,
+    - no command was sent during an open multiple block write.
+
+  Build and run from this directory:
+    g++ -O2 -D__arm__ -I. -I../../src ContiguousLog.cpp SdCardImage.cpp \
+        ../../src/utility/Sd2Card.cpp ../../src/utility/SdVolume.cpp \
+        ../../src/utility/SdFile.cpp -o ContiguousLog && ./ContiguousLog
+
+  The image is written to ContiguousLog.img in the current directory and
+  removed at the end.
+*/
+#include <Arduino.h>
+#include "utility/SdFat.h"
+#include "SdCardImage.h"
+
+static const char IMAGE[] = "ContiguousLog.img";
+static const uint32_t LOG_SIZE = 1024UL * 1024;
+static const uint32_t SPI_CLOCK = 8000000;
+
+struct Volume {
+  const char* name;
+  uint32_t blocks;
+  uint8_t blocksPerCluster;
+};
+
+struct Case {
+  uint16_t record;     // bytes per write() call
+  uint32_t syncEvery;  // bytes between sync() calls, zero for none
+  uint32_t allocate;   // bytes to pre-allocate, zero for none
+};
+
+static uint8_t pattern(uint32_t pos) {
+  return (pos >> 9) ^ (pos * 7);
+}
+
+static int fail(const char* what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+static int runCase(const Volume& v, const Case& c) {
+  SdCardImage image;
+  Sd2Card card;
+  SdVolume volume;
+  SdFile root;
+  SdFile file;
+  uint8_t buf[512];
+
+  if (!SdCardImage::format(IMAGE, v.blocks, v.blocksPerCluster)
+      || !image.open(IMAGE)) {
+    return fail("image");
+  }
+  if (!card.init(SPI_FULL_SPEED, SS) || !volume.init(&card)
+      || !root.openRoot(&volume)) {
+    return fail("init");
+  }
+  if (!file.open(&root, "LOG.BIN", O_CREAT | O_WRITE | O_TRUNC)) {
+    return fail("open");
+  }
+  image.clearCounters();
+  if (c.allocate && !file.preAllocate(c.allocate)) {
+    return fail("preAllocate");
+  }
+  uint32_t firstCluster = file.firstCluster();
+  for (uint32_t pos = 0; pos < LOG_SIZE; pos += c.record) {
+    uint16_t n = LOG_SIZE - pos < c.record ? LOG_SIZE - pos : c.record;
+    for (uint16_t i = 0; i < n; i++) {
+      buf[i] = pattern(pos + i);
+    }
+    if (file.write(buf, n) != n) {
+      return fail("write");
+    }
+    if (c.syncEvery && (pos + n) % c.syncEvery < n && !file.sync()) {
+      return fail("sync");
+    }
+  }
+  if (!firstCluster) {
+    firstCluster = file.firstCluster();
+  }
+  if (!file.close()) {
+    return fail("close");
+  }
+  SdCardCounters n = image.counters();
+  double ms = image.estimateMillis(SPI_CLOCK);
+
+  printf("%6u %5lu %-12s %6lu %5lu %6lu %5lu %6lu %6.0f %5.0f\n",
+         c.record, (unsigned long)(c.syncEvery / 1024),
+         !c.allocate ? "append" :
+         c.allocate < LOG_SIZE ? "half alloc" : "preAllocate",
+         (unsigned long)n.singleWrites, (unsigned long)n.multipleStarts,
+         (unsigned long)n.multipleBlocks, (unsigned long)n.blocksRead,
+         (unsigned long)(n.spiBytes / 1024), ms, LOG_SIZE / 1.024 / ms);
+
+  if (n.protocolErrors) {
+    return fail("command during a multiple block write");
+  }
+  if (!file.open(&root, "LOG.BIN", O_READ) || file.fileSize() != LOG_SIZE) {
+    return fail("size");
+  }
+  for (uint32_t pos = 0; pos < LOG_SIZE; pos += sizeof(buf)) {
+    if (file.read(buf, sizeof(buf)) != (int16_t)sizeof(buf)) {
+      return fail("read");
+    }
+    for (uint16_t i = 0; i < sizeof(buf); i++) {
+      if (buf[i] != pattern(pos + i)) {
+        return fail("data");
+      }
+    }
+  }
+  file.close();
+
+  uint32_t clusterSize = 512UL * v.blocksPerCluster;
+  SdFile next;
+  if (!next.open(&root, "NEXT.BIN", O_CREAT | O_WRITE) || next.write('x') != 1
+      || next.firstCluster() != firstCluster + LOG_SIZE / clusterSize
+      || !next.close()) {
+    return fail("clusters past the end of the log were not freed");
+  }
+  image.close();
+  return 0;
+}
+
+int main() {
+  static const Volume volumes[] = {
+    {"FAT16, 64 MB, 2 KB clusters", 131072, 4},
+    {"FAT32, 512 MB, 4 KB clusters", 1048576, 8},
+  };
+  static const Case cases[] = {
+    {512, 0, 0},
+    {512, 0, 2 * LOG_SIZE},
+    {100, 0, 0},
+    {100, 0, 2 * LOG_SIZE},
+    {100, 0, LOG_SIZE / 2},
+    {100, 16384, 0},
+    {100, 16384, 2 * LOG_SIZE},
+  };
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(volumes) / sizeof(volumes[0]); i++) {
+    printf("%s, 1 MB log\n", volumes[i].name);
+    printf("record  sync mode          CMD24 CMD25 blocks reads SPI KB est ms  KB/s\n");
+    for (size_t j = 0; j < sizeof(cases) / sizeof(cases[0]); j++) {
+      failed |= runCase(volumes[i], cases[j]);
+    }
+    printf("\n");
+  }
+  remove(IMAGE);
+  return failed;
+}
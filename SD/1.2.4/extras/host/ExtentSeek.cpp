@@ -0,0 +1,159 @@
+/*
+  ExtentSeek.cpp - Compares seeks in a 4 MB log file with and without an
+  extent cache, see SdFile::setExtentCache().
+
+  The log is written in 64 KB pieces, alternating with a second file for
+  the first half, so its cluster chain has a few dozen runs.  Each case
+  then
+    replay  reads the log backwards in 4 KB pieces, seeking before each,
+            as an upload of the newest records first does,
+    random  reads 16 bytes at 1000 random positions.
+  It prints the block reads and the host time per seek.  Without the
+  cache a seek backwards follows the chain from the first cluster, up to
+  two thousand FAT entries here, and the block reads show how often the
+  FAT blocks had to be read again.
+
+  Build and run from this directory:
+    g++ -O2 -D__arm__ -I. -I../../src ExtentSeek.cpp SdCardImage.cpp \
+        ../../src/utility/Sd2Card.cpp ../../src/utility/SdVolume.cpp \
+        ../../src/utility/SdFile.cpp -o ExtentSeek && ./ExtentSeek
+  Add -DSD_CACHE_WAYS=1 to see the single block cache of small AVR boards.
+
+  The image is written to ExtentSeek.img in the current directory and
+  removed at the end.
+*/
+#include <Arduino.h>
+#include <time.h>
+#include "utility/SdFat.h"
+#include "SdCardImage.h"
+
+static const char IMAGE[] = "ExtentSeek.img";
+static const uint32_t LOG_SIZE = 4096UL * 1024;
+static const uint32_t PIECE = 64UL * 1024;
+static const uint16_t READ_SIZE = 4096;
+static const uint16_t SEEKS = 1000;
+
+static Sd2Card card;
+static SdVolume volume;
+static SdFile root;
+static uint8_t buf[READ_SIZE];
+
+static uint8_t pattern(uint32_t pos) {
+  return (pos >> 9) ^ (pos * 13);
+}
+
+static int fail(const char* what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+static uint8_t check(uint32_t pos, uint16_t n) {
+  for (uint16_t i = 0; i < n; i++) {
+    if (buf[i] != pattern(pos + i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int writeLog(void) {
+  SdFile log;
+  SdFile other;
+  if (!log.open(&root, "LOG.BIN", O_CREAT | O_WRITE | O_TRUNC)
+      || !other.open(&root, "OTHER.BIN", O_CREAT | O_WRITE | O_TRUNC)) {
+    return fail("open");
+  }
+  for (uint32_t pos = 0; pos < LOG_SIZE; pos += sizeof(buf)) {
+    for (uint16_t i = 0; i < sizeof(buf); i++) {
+      buf[i] = pattern(pos + i);
+    }
+    if (log.write(buf, sizeof(buf)) != sizeof(buf)) {
+      return fail("write");
+    }
+    // a piece of the other file after each piece of the first half
+    if ((pos + sizeof(buf)) % PIECE == 0 && pos < LOG_SIZE / 2
+        && other.write(buf, 512) != 512) {
+      return fail("write other");
+    }
+  }
+  if (!log.close() || !other.close()) {
+    return fail("close");
+  }
+  return 0;
+}
+
+static void report(const char* workload, uint8_t extents, clock_t start,
+                   uint16_t seeks) {
+  double us = 1e6 * (clock() - start) / CLOCKS_PER_SEC / seeks;
+  printf("%-7s %7u %7lu %8.1f\n", workload, extents,
+         (unsigned long)SdVolume::blockReadCount(), us);
+}
+
+static int runCase(uint8_t extents) {
+  fat_extent_t extent[255];
+  SdFile log;
+  if (!log.open(&root, "LOG.BIN", O_READ)
+      || (extents && !log.setExtentCache(extent, extents))) {
+    return fail("open log");
+  }
+  SdVolume::clearBlockCounts();
+  clock_t start = clock();
+  for (uint32_t end = LOG_SIZE; end > 0; end -= READ_SIZE) {
+    uint32_t pos = end - READ_SIZE;
+    if (!log.seekSet(pos) || log.read(buf, READ_SIZE) != READ_SIZE
+        || !check(pos, READ_SIZE)) {
+      return fail("replay");
+    }
+  }
+  report("replay", extents, start, LOG_SIZE / READ_SIZE);
+
+  SdVolume::clearBlockCounts();
+  start = clock();
+  uint32_t seed = 1;
+  for (uint16_t i = 0; i < SEEKS; i++) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t pos = (seed >> 4) % (LOG_SIZE - 16);
+    if (!log.seekSet(pos) || log.read(buf, 16) != 16 || !check(pos, 16)) {
+      return fail("random");
+    }
+  }
+  report("random", extents, start, SEEKS);
+  log.close();
+  return 0;
+}
+
+int main() {
+  static const struct {
+    const char* name;
+    uint32_t blocks;
+    uint8_t blocksPerCluster;
+  } volumes[] = {
+    {"FAT16, 64 MB, 2 KB clusters", 131072, 4},
+    {"FAT32, 512 MB, 4 KB clusters", 1048576, 8},
+  };
+  static const uint8_t extents[] = {0, 4, 64};
+  int failed = 0;
+  printf("SD_CACHE_WAYS %u\n", SD_CACHE_WAYS);
+  for (size_t i = 0; i < sizeof(volumes) / sizeof(volumes[0]); i++) {
+    SdCardImage image;
+    if (!SdCardImage::format(IMAGE, volumes[i].blocks,
+                             volumes[i].blocksPerCluster)
+        || !image.open(IMAGE)) {
+      return fail("image");
+    }
+    if (!card.init(SPI_FULL_SPEED, SS) || !volume.init(&card)
+        || !root.openRoot(&volume)) {
+      return fail("init");
+    }
+    failed |= writeLog();
+    printf("%s, 4 MB log\n", volumes[i].name);
+    printf("seeks   extents   reads  us/seek\n");
+    for (size_t j = 0; j < sizeof(extents); j++) {
+      failed |= runCase(extents[j]);
+    }
+    printf("\n");
+    root.close();
+  }
+  remove(IMAGE);
+  return failed;
+}
@@ -0,0 +1,67 @@
+/*
+  Print.h - Host version of the Arduino Print class, for the programs in
+  this directory.
+*/
+#ifndef Print_h
+#define Print_h
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+class Print {
+  public:
+    Print() : writeError_(0) {}
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+      size_t n = 0;
+      while (size-- && write(*buffer++)) {
+        n++;
+      }
+      return n;
+    }
+    size_t write(const char* str) {
+      return str ? write((const uint8_t*)str, strlen(str)) : 0;
+    }
+
+    size_t print(const char* str) {
+      return write(str);
+    }
+    size_t print(char c) {
+      return write((uint8_t)c);
+    }
+    size_t print(unsigned long n) {
+      char buf[12];
+      snprintf(buf, sizeof(buf), "%lu", n);
+      return write(buf);
+    }
+    size_t print(unsigned int n) {
+      return print((unsigned long)n);
+    }
+    size_t print(int n) {
+      char buf[12];
+      snprintf(buf, sizeof(buf), "%d", n);
+      return write(buf);
+    }
+    size_t println(void) {
+      return write("\r\n");
+    }
+    int getWriteError() {
+      return writeError_;
+    }
+    void clearWriteError() {
+      writeError_ = 0;
+    }
+
+  protected:
+    void setWriteError(int err = 1) {
+      writeError_ = err;
+    }
+
+  private:
+    int writeError_;
+};
+
+#endif
@@ -0,0 +1,449 @@
+/*
+  RecordLogTest.cpp - Writes and reads an SdRecordLog, cuts the power in
+  the middle of appends and checks what begin() recovers.
+
+  Each case runs on a freshly formatted image, once with a card that can
+  erase and once with one that cannot.  A power cut closes the image and
+  mounts it again, what sat in the block cache is lost and what was sent
+  to the card is kept.  The cases check that
+    - the log rotates to new segments and reads back in order across them,
+    - after a power cut begin() keeps every record that was complete on
+      the card and appends continue after the last one,
+    - a corrupt record ends the log there,
+    - records of an older log in the same clusters are not taken for new
+      ones, even if they have the sequence numbers the scan looks for,
+    - a reader finds a record in the middle, sees records once sync()
+      wrote them and stops at the end,
+    - discard() removes whole segments only,
+    - a power cut in any step of starting a new segment leaves a log that
+      begin() opens, with every record that was synced,
+    - no command was sent during an open multiple block write.
+
+  Build and run from this directory:
+    g++ -O2 -D__arm__ -I. -I../../src RecordLogTest.cpp SdCardImage.cpp \
+        ../../src/utility/Sd2Card.cpp ../../src/utility/SdVolume.cpp \
+        ../../src/utility/SdFile.cpp ../../src/utility/SdRecordLog.cpp \
+        -o RecordLogTest && ./RecordLogTest
+
+  The image is written to RecordLogTest.img in the current directory and
+  removed at the end.
+*/
+#include <Arduino.h>
+#include "utility/SdFat.h"
+#include "utility/SdRecordLog.h"
+#include "SdCardImage.h"
+
+static const char IMAGE[] = "RecordLogTest.img";
+static const char PREFIX[] = "TLM";
+static const uint16_t RECORD_SIZE = 26;
+static const uint16_t RECORD_BYTES = RECORD_SIZE + 6;
+static const uint32_t SEGMENT_SIZE = 65536;
+static const uint32_t SPI_CLOCK = 8000000;
+
+struct Card {
+  SdCardImage image;
+  Sd2Card card;
+  SdVolume volume;
+  SdFile root;
+};
+
+static int fail(const char* what) {
+  printf("FAILED: %s\n", what);
+  return 1;
+}
+
+static void fill(uint32_t seq, uint8_t* record) {
+  for (uint16_t i = 0; i < RECORD_SIZE; i++) {
+    record[i] = seq * 7 + i * 13;
+  }
+}
+
+static uint8_t check(uint32_t seq, const uint8_t* record) {
+  for (uint16_t i = 0; i < RECORD_SIZE; i++) {
+    if (record[i] != (uint8_t)(seq * 7 + i * 13)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// mount the image, the card comes up the way it was left
+static uint8_t powerUp(Card* c) {
+  c->root = SdFile();
+  return c->image.open(IMAGE) && c->card.init(SPI_FULL_SPEED, SS)
+         && c->volume.init(&c->card) && c->root.openRoot(&c->volume);
+}
+
+// lose whatever did not reach the card and mount it again
+static uint8_t powerCut(Card* c) {
+  c->image.close();
+  return powerUp(c);
+}
+
+static int append(SdRecordLog* log, uint32_t count, uint32_t syncEvery) {
+  uint8_t record[RECORD_SIZE];
+  for (uint32_t i = 0; i < count; i++) {
+    fill(log->nextSeq(), record);
+    if (!log->append(record)) {
+      return fail("append");
+    }
+    if (syncEvery && (i + 1) % syncEvery == 0 && !log->sync()) {
+      return fail("sync");
+    }
+  }
+  return 0;
+}
+
+// The records that begin() should find after a power cut: all synced
+// ones and those that end in a block that was complete and so went to
+// the card with the multiple block write.
+static uint8_t expectedNext(Card* c, uint32_t segment, uint32_t synced,
+                            uint32_t next, uint32_t* expected) {
+  record_log_header_t header;
+  SdFile file;
+  char name[16];
+  sprintf(name, "%s%05lu.LOG", PREFIX, (unsigned long)segment);
+  if (!file.open(&c->root, name, O_READ)
+      || file.read(&header, sizeof(header)) != sizeof(header)) {
+    return false;
+  }
+  file.close();
+  uint32_t pos = sizeof(header) + (next - header.firstSeq) * RECORD_BYTES;
+  uint32_t onCard = pos & ~511UL;
+  uint32_t count = onCard < sizeof(header) ? 0
+                   : (onCard - sizeof(header)) / RECORD_BYTES;
+  *expected = header.firstSeq + count;
+  if (*expected < synced) {
+    *expected = synced;
+  }
+  return true;
+}
+
+// write a byte of a record straight to the card
+static uint8_t corrupt(Card* c, uint32_t segment, uint32_t seq) {
+  record_log_header_t header;
+  SdFile file;
+  char name[13];
+  uint32_t bgnBlock;
+  uint32_t endBlock;
+  uint8_t block[512];
+  sprintf(name, "%s%05lu.LOG", PREFIX, (unsigned long)segment);
+  if (!file.open(&c->root, name, O_READ)
+      || file.read(&header, sizeof(header)) != sizeof(header)
+      || !file.contiguousRange(&bgnBlock, &endBlock)
+      || seq < header.firstSeq) {
+    return false;
+  }
+  file.close();
+  uint32_t pos = sizeof(header) + (seq - header.firstSeq) * RECORD_BYTES + 9;
+  uint32_t lba = bgnBlock + pos / 512;
+  if (!c->card.readBlock(lba, block)) {
+    return false;
+  }
+  block[pos % 512] ^= 0X5A;
+  return c->card.writeBlock(lba, block);
+}
+
+// read from seq on and check every record, the first one read may come
+// later if seq was discarded
+static int readAll(SdRecordLog* log, uint32_t seq, uint32_t* first,
+                   uint32_t* count) {
+  SdRecordReader reader;
+  uint8_t record[RECORD_SIZE];
+  uint32_t s;
+  int8_t n;
+  *count = 0;
+  if (!reader.begin(log, seq)) {
+    return fail("reader begin");
+  }
+  *first = reader.nextSeq();
+  while ((n = reader.read(record, &s)) > 0) {
+    if (s != *first + *count || !check(s, record)) {
+      return fail("reader data");
+    }
+    (*count)++;
+  }
+  if (n < 0) {
+    return fail("reader read");
+  }
+  reader.close();
+  return 0;
+}
+
+static int crashCase(Card* c, uint32_t syncedCount, uint32_t unsynced,
+                     uint32_t corruptAt, const char* what) {
+  SdRecordLog log;
+  uint32_t expected;
+  uint32_t count;
+  if (!log.begin(&c->root, PREFIX, RECORD_SIZE, SEGMENT_SIZE)) {
+    return fail("begin before power cut");
+  }
+  uint32_t first = log.nextSeq();
+  if (append(&log, syncedCount, 100) || !log.sync()) {
+    return 1;
+  }
+  uint32_t synced = log.syncedSeq();
+  if (append(&log, unsynced, 0)) {
+    return 1;
+  }
+  uint32_t segment = log.lastSegment();
+  uint32_t next = log.nextSeq();
+  if (!powerCut(c)
+      || !expectedNext(c, segment, synced, next, &expected)) {
+    return fail("power cut");
+  }
+  if (corruptAt) {
+    if (!corrupt(c, segment, synced + corruptAt)) {
+      return fail("corrupt");
+    }
+    expected = synced + corruptAt;
+  }
+  SdRecordLog again;
+  if (!again.begin(&c->root, PREFIX, RECORD_SIZE, SEGMENT_SIZE)) {
+    return fail("begin after power cut");
+  }
+  printf("%-28s %6lu %6lu %6lu %6lu\n", what, (unsigned long)synced,
+         (unsigned long)next, (unsigned long)again.nextSeq(),
+         (unsigned long)again.recovered());
+  if (again.nextSeq() != expected) {
+    return fail("records recovered");
+  }
+  // keep appending after the last record found and read it all back
+  if (append(&again, 500, 100) || !again.sync()) {
+    return 1;
+  }
+  uint32_t read;
+  if (readAll(&again, first, &read, &count)) {
+    return 1;
+  }
+  if (read != first || first + count != again.nextSeq()) {
+    return fail("records read after recovery");
+  }
+  return again.close() ? 0 : fail("close");
+}
+
+static int readerCase(Card* c) {
+  SdRecordLog log;
+  SdRecordReader reader;
+  uint8_t record[RECORD_SIZE];
+  uint32_t seq;
+  uint32_t count;
+  if (!log.begin(&c->root, PREFIX, RECORD_SIZE, SEGMENT_SIZE)) {
+    return fail("begin reader case");
+  }
+  if (log.recovered()) {
+    return fail("records recovered after close");
+  }
+  // a seek goes straight to the record
+  uint32_t mid = log.firstSegment() ? log.nextSeq() / 2 : 0;
+  SdCardCounters n = c->image.counters();
+  uint32_t blocks = n.blocksRead + n.readBlocks;
+  if (!reader.begin(&log, mid) || reader.read(record, &seq) != 1
+      || seq != mid || !check(seq, record)) {
+    return fail("reader seek");
+  }
+  printf("seek to %lu of %lu in %lu segments: %lu blocks read\n",
+         (unsigned long)mid, (unsigned long)log.nextSeq(),
+         (unsigned long)(log.lastSegment() - log.firstSegment() + 1),
+         (unsigned long)(c->image.counters().blocksRead
+                         + c->image.counters().readBlocks - blocks));
+  // records show up once synced
+  if (!reader.seek(log.nextSeq()) || reader.read(record) != 0) {
+    return fail("reader at the end");
+  }
+  if (append(&log, 40, 0) || reader.read(record) != 0) {
+    return fail("reader before sync");
+  }
+  if (!log.sync()) {
+    return fail("sync");
+  }
+  for (count = 0; reader.read(record, &seq) == 1; count++) {
+    if (!check(seq, record)) {
+      return fail("reader data after sync");
+    }
+  }
+  if (count != 40) {
+    return fail("records after sync");
+  }
+  reader.close();
+
+  // discard everything read, the newest segment stays
+  uint32_t last = log.lastSegment();
+  if (!log.discard(log.nextSeq()) || log.firstSegment() != last) {
+    return fail("discard");
+  }
+  uint32_t first;
+  if (readAll(&log, 0, &first, &count)) {
+    return 1;
+  }
+  if (first + count != log.nextSeq() || count > SEGMENT_SIZE / RECORD_BYTES) {
+    return fail("records after discard");
+  }
+  printf("discard kept %lu records in segment %lu\n", (unsigned long)count,
+         (unsigned long)last);
+  return log.close() ? 0 : fail("close");
+}
+
+// Write a log, remove it and write a new one with the same prefix over
+// the same clusters.  The new log's records have the sequence numbers of
+// the old ones at the same positions.  Without an erase the first block
+// of the new segment goes to the card with the old records after the
+// header and the old blocks follow it, only the salt tells them apart.
+static int staleCase(Card* c) {
+  SdRecordLog log;
+  char name[13];
+  uint32_t expected;
+  if (!log.begin(&c->root, PREFIX, RECORD_SIZE, SEGMENT_SIZE)) {
+    return fail("begin stale case");
+  }
+  for (uint32_t s = log.firstSegment(); s && s <= log.lastSegment(); s++) {
+    log.segmentName(s, name);
+    if (!SdFile::remove(&c->root, name)) {
+      return fail("remove");
+    }
+  }
+  if (!c->root.sync()) {
+    return fail("sync root");
+  }
+  // the volume allocates from the start again after a reset
+  if (!powerCut(c)) {
+    return fail("power cut");
+  }
+  SdRecordLog first;
+  if (!first.begin(&c->root, PREFIX, RECORD_SIZE, SEGMENT_SIZE)
+      || append(&first, 1000, 0) || !first.close()) {
+    return fail("first log");
+  }
+  for (uint32_t s = first.firstSegment(); s <= first.lastSegment(); s++) {
+    first.segmentName(s, name);
+    if (!SdFile::remove(&c->root, name)) {
+      return fail("remove");
+    }
+  }
+  if (!c->root.sync()) {
+    return fail("sync root");
+  }
+  if (!powerCut(c)) {
+    return fail("power cut");
+  }
+  SdRecordLog second;
+  if (!second.begin(&c->root, PREFIX, RECORD_SIZE, SEGMENT_SIZE)
+      || append(&second, 1, 0) || !second.sync()
+      || append(&second, 7, 0)) {
+    return fail("second log");
+  }
+  uint32_t next = second.nextSeq();
+  if (!powerCut(c)
+      || !expectedNext(c, second.lastSegment(), 1, next, &expected)) {
+    return fail("power cut");
+  }
+  SdRecordLog again;
+  if (!again.begin(&c->root, PREFIX, RECORD_SIZE, SEGMENT_SIZE)) {
+    return fail("begin after power cut");
+  }
+  printf("%-28s %6u %6lu %6lu %6lu\n", "over an older log", 1,
+         (unsigned long)next, (unsigned long)again.nextSeq(),
+         (unsigned long)again.recovered());
+  if (again.nextSeq() != expected) {
+    return fail("stale records taken");
+  }
+  return again.close() ? 0 : fail("close");
+}
+
+// Cut the power after 0, 1, 2, ... block writes while appends start new
+// segments.  Each round starts with a new segment, as the segment close()
+// left behind gets no more records, so the cut lands in every step of
+// the rotation: the directory entry, the FAT, the header and the records.
+static int rotationCase(Card* c) {
+  static const char ROT[] = "ROT";
+  static const uint32_t ROT_SEGMENT_SIZE = 4096;
+  uint8_t record[RECORD_SIZE];
+  uint32_t first;
+  uint32_t count;
+  uint32_t cuts;
+  for (cuts = 0; cuts < 48; cuts++) {
+    SdRecordLog log;
+    if (!log.begin(&c->root, ROT, RECORD_SIZE, ROT_SEGMENT_SIZE)) {
+      return fail("begin before rotation");
+    }
+    uint32_t synced = log.syncedSeq();
+    c->image.cutPowerAfter(cuts);
+    // the library does not notice the cut, stop at its first error
+    for (uint16_t i = 0; i < 200; i++) {
+      fill(log.nextSeq(), record);
+      if (!log.append(record)) {
+        break;
+      }
+    }
+    if (!powerCut(c)) {
+      return fail("power cut");
+    }
+    SdRecordLog again;
+    if (!again.begin(&c->root, ROT, RECORD_SIZE, ROT_SEGMENT_SIZE)) {
+      printf("power cut after %lu block writes\n", (unsigned long)cuts);
+      return fail("begin after a power cut in rotation");
+    }
+    if (again.nextSeq() < synced) {
+      return fail("synced records lost in rotation");
+    }
+    if (readAll(&again, 0, &first, &count)) {
+      return 1;
+    }
+    if (first + count != again.nextSeq()) {
+      return fail("records read after a power cut in rotation");
+    }
+    if (!again.close()) {
+      return fail("close");
+    }
+  }
+  printf("power cut after 0 to %lu block writes in rotation: ok\n",
+         (unsigned long)cuts - 1);
+  return 0;
+}
+
+int main() {
+  static const struct {
+    const char* name;
+    uint32_t blocks;
+    uint8_t blocksPerCluster;
+  } volumes[] = {
+    {"FAT16, 64 MB, 2 KB clusters", 131072, 4},
+    {"FAT32, 512 MB, 4 KB clusters", 1048576, 8},
+  };
+  int failed = 0;
+  for (size_t i = 0; i < sizeof(volumes) / sizeof(volumes[0]); i++) {
+    for (int erase = 1; erase >= 0; erase--) {
+      Card c;
+      if (!SdCardImage::format(IMAGE, volumes[i].blocks,
+                               volumes[i].blocksPerCluster)) {
+        return fail("image");
+      }
+      c.image.setEraseEnable(erase);
+      if (!powerUp(&c)) {
+        return fail("init");
+      }
+      printf("%s, %s erase\n", volumes[i].name, erase ? "with" : "no");
+      printf("%-28s %6s %6s %6s %6s\n", "power cut", "synced", "next",
+             "found", "recov");
+      c.image.clearCounters();
+      failed |= crashCase(&c, 5000, 1000, 0, "in the first segments");
+      failed |= crashCase(&c, 0, 2000, 0, "right after begin()");
+      failed |= crashCase(&c, 300, 200, 50, "before a corrupt record");
+      failed |= crashCase(&c, 2040, 20, 0, "with few records unsynced");
+      failed |= readerCase(&c);
+      failed |= staleCase(&c);
+      failed |= rotationCase(&c);
+      SdCardCounters n = c.image.counters();
+      printf("%lu blocks erased, %lu CMD24, %lu CMD25, est %.0f ms\n\n",
+             (unsigned long)n.blocksErased, (unsigned long)n.singleWrites,
+             (unsigned long)n.multipleStarts,
+             c.image.estimateMillis(SPI_CLOCK));
+      if (n.protocolErrors) {
+        failed |= fail("command during a multiple block write");
+      }
+      c.image.close();
+    }
+  }
+  remove(IMAGE);
+  return failed;
+}
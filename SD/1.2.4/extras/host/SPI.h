@@ -0,0 +1,37 @@
+/*
+  SPI.h - Host version of the Arduino SPI library. Every byte goes to the
+  card emulator in SdCardImage.h.
+*/
+#ifndef SPI_h
+#define SPI_h
+
+#include <Arduino.h>
+
+class SPISettings {
+  public:
+    SPISettings() : clock_(4000000) {}
+    SPISettings(uint32_t clock, uint8_t, uint8_t) : clock_(clock) {}
+    uint32_t clock_;
+};
+
+class SPIClass {
+  public:
+    SPIClass() : clock_(4000000) {}
+    void begin(void) {}
+    void beginTransaction(SPISettings settings) {
+      clock_ = settings.clock_;
+    }
+    void endTransaction(void) {}
+    uint8_t transfer(uint8_t data);
+    /** Clock of the last transaction, for the time estimates */
+    uint32_t clock(void) const {
+      return clock_;
+    }
+
+  private:
+    uint32_t clock_;
+};
+
+extern SPIClass SPI;
+
+#endif
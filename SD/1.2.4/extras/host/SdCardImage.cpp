@@ -0,0 +1,492 @@
+/*
+  SdCardImage.cpp - SD card emulator and the host side of the Arduino core
+  it needs, see SdCardImage.h.
+*/
+#include <chrono>
+#include <string.h>
+#include <unistd.h>
+
+#include <Arduino.h>
+#include <SPI.h>
+#include "SdCardImage.h"
+#include "utility/SdFat.h"
+
+HostSerial Serial;
+SPIClass SPI;
+SdCardImage* SdCardImage::current = NULL;
+
+uint32_t millis(void) {
+  static std::chrono::steady_clock::time_point t0 =
+    std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+           std::chrono::steady_clock::now() - t0).count();
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+// Every pin is taken for the chip select of the emulated card.
+void digitalWrite(uint8_t, uint8_t value) {
+  if (SdCardImage::current) {
+    SdCardImage::current->select(value == LOW);
+  }
+}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  return SdCardImage::current ? SdCardImage::current->transfer(data) : 0XFF;
+}
+
+//------------------------------------------------------------------------------
+// Card timing used by estimateMillis(). These are typical of a class 10
+// microSD card in SPI mode, not of any card in particular:
+//  - a single block write keeps the card busy for about 1.5 ms while it
+//    programs, as most cards rewrite a whole flash page for it,
+//  - a multiple block write streams at about 10 MB/s, 50 us a block,
+//    plus about 1 ms to open the stream and close it again,
+//  - a block read takes about 100 us before the data token comes,
+//  - a multiple block read takes that once and then streams at about
+//    20 MB/s, 25 us a block, as the card reads ahead.
+static const double SINGLE_WRITE_MS = 1.5;
+static const double MULTIPLE_BLOCK_MS = 0.05;
+static const double MULTIPLE_START_MS = 1.0;
+static const double READ_ACCESS_MS = 0.1;
+static const double READ_BLOCK_MS = 0.025;
+
+double SdCardImage::estimateMillis(uint32_t spiClock) const {
+  return counters_.spiBytes * 8000.0 / spiClock
+         + counters_.singleWrites * SINGLE_WRITE_MS
+         + counters_.multipleStarts * MULTIPLE_START_MS
+         + counters_.multipleBlocks * MULTIPLE_BLOCK_MS
+         + counters_.blocksRead * READ_ACCESS_MS
+         + counters_.readStarts * READ_ACCESS_MS
+         + counters_.readBlocks * READ_BLOCK_MS;
+}
+
+//------------------------------------------------------------------------------
+SdCardImage::SdCardImage(void) : file_(NULL), blocks_(0), selected_(0),
+  appCmd_(0), readCmd_(0), eraseEnable_(1), state_(IDLE), count_(0), readBlock_(0), writeBlock_(0),
+  eraseFirst_(0), eraseLast_(0), writesLeft_(0XFFFFFFFF), outHead_(0),
+  outTail_(0) {
+  clearCounters();
+}
+
+SdCardImage::~SdCardImage(void) {
+  close();
+}
+
+void SdCardImage::clearCounters(void) {
+  memset(&counters_, 0, sizeof(counters_));
+}
+
+uint8_t SdCardImage::open(const char* path) {
+  close();
+  file_ = fopen(path, "r+b");
+  if (!file_ || fseeko(file_, 0, SEEK_END)) {
+    close();
+    return false;
+  }
+  blocks_ = ftello(file_) / 512;
+  state_ = IDLE;
+  writesLeft_ = 0XFFFFFFFF;
+  outHead_ = outTail_ = 0;
+  current = this;
+  return true;
+}
+
+void SdCardImage::close(void) {
+  if (file_) {
+    fclose(file_);
+    file_ = NULL;
+  }
+  if (current == this) {
+    current = NULL;
+  }
+}
+
+uint8_t SdCardImage::readImage(uint32_t block, uint8_t* dst) {
+  return block < blocks_ && !fseeko(file_, (off_t)block * 512, SEEK_SET)
+         && fread(dst, 512, 1, file_) == 1;
+}
+
+uint8_t SdCardImage::writeImage(uint32_t block, const uint8_t* src) {
+  // the power is gone, the card answers but keeps nothing
+  if (writesLeft_ == 0) {
+    return block < blocks_;
+  }
+  if (writesLeft_ != 0XFFFFFFFF) {
+    writesLeft_--;
+  }
+  return block < blocks_ && !fseeko(file_, (off_t)block * 512, SEEK_SET)
+         && fwrite(src, 512, 1, file_) == 1;
+}
+
+//------------------------------------------------------------------------------
+void SdCardImage::select(uint8_t select) {
+  selected_ = select;
+  if (!select) {
+    // a command cut short is lost, unread response bytes too
+    if (state_ == COMMAND) {
+      state_ = IDLE;
+    }
+    outHead_ = outTail_ = 0;
+  }
+}
+
+void SdCardImage::queue(uint8_t b) {
+  out_[outTail_++] = b;
+}
+
+uint8_t SdCardImage::transfer(uint8_t in) {
+  if (!selected_) {
+    return 0XFF;
+  }
+  counters_.spiBytes++;
+  // a command ends a multiple block read, even in the middle of a block
+  if (state_ == MULTIPLE_READ && (in & 0XC0) == 0X40) {
+    outHead_ = outTail_ = 0;
+    readCmd_ = 1;
+    cmd_[0] = in;
+    count_ = 1;
+    state_ = COMMAND;
+    return 0XFF;
+  }
+  // the card ignores the host while it answers
+  if (outHead_ != outTail_) {
+    uint8_t b = out_[outHead_++];
+    if (outHead_ == outTail_) {
+      outHead_ = outTail_ = 0;
+    }
+    return b;
+  }
+  switch (state_) {
+    case IDLE:
+    case MULTIPLE_TOKEN:
+      if ((in & 0XC0) == 0X40) {
+        if (state_ == MULTIPLE_TOKEN) {
+          counters_.protocolErrors++;
+        }
+        cmd_[0] = in;
+        count_ = 1;
+        state_ = COMMAND;
+      } else if (state_ == MULTIPLE_TOKEN && in == WRITE_MULTIPLE_TOKEN) {
+        count_ = 0;
+        state_ = MULTIPLE_DATA;
+      } else if (state_ == MULTIPLE_TOKEN && in == STOP_TRAN_TOKEN) {
+        state_ = IDLE;
+      }
+      break;
+
+    case MULTIPLE_READ: {
+      // send the next block, this byte is the access time
+      uint8_t block[512];
+      if (!readImage(readBlock_, block)) {
+        queue(0X08);  // out of range error token
+        break;
+      }
+      readBlock_++;
+      counters_.readBlocks++;
+      queue(DATA_START_BLOCK);
+      for (uint16_t i = 0; i < 512; i++) {
+        queue(block[i]);
+      }
+      queue(0XFF);
+      queue(0XFF);
+      break;
+    }
+    case COMMAND:
+      cmd_[count_++] = in;
+      if (count_ == 6) {
+        state_ = IDLE;
+        command();
+      }
+      break;
+
+    case WRITE_TOKEN:
+      if (in == DATA_START_BLOCK) {
+        count_ = 0;
+        state_ = WRITE_DATA;
+      }
+      break;
+
+    case WRITE_DATA:
+    case MULTIPLE_DATA:
+      data_[count_++] = in;
+      if (count_ == sizeof(data_)) {
+        uint8_t ok = writeImage(writeBlock_++, data_);
+        if (state_ == WRITE_DATA) {
+          counters_.singleWrites++;
+          state_ = IDLE;
+        } else {
+          counters_.multipleBlocks++;
+          state_ = MULTIPLE_TOKEN;
+        }
+        // error responses carry the write error code 6
+        queue(ok ? DATA_RES_ACCEPTED : 0X0D);
+      }
+      break;
+  }
+  return 0XFF;
+}
+
+//------------------------------------------------------------------------------
+void SdCardImage::command(void) {
+  uint8_t cmd = cmd_[0] & 0X3F;
+  uint32_t arg = (uint32_t)cmd_[1] << 24 | (uint32_t)cmd_[2] << 16
+                 | (uint32_t)cmd_[3] << 8 | cmd_[4];
+  uint8_t app = appCmd_;
+  appCmd_ = 0;
+  if (cmd != CMD55) {
+    counters_.commands++;
+  }
+  if (readCmd_ && cmd != CMD12) {
+    counters_.protocolErrors++;
+  }
+  readCmd_ = 0;
+  if (cmd == CMD12) {
+    // a stuff byte comes before the response, it may look like one
+    queue(0X3F);
+    queue(R1_READY_STATE);
+    return;
+  }
+  if (app && cmd == ACMD41) {
+    queue(R1_READY_STATE);
+    return;
+  }
+  if (app && cmd == ACMD23) {
+    queue(R1_READY_STATE);
+    return;
+  }
+  switch (cmd) {
+    case CMD0:
+      queue(R1_IDLE_STATE);
+      break;
+
+    case CMD8:
+      queue(R1_IDLE_STATE);
+      queue(0);
+      queue(0);
+      queue(1);
+      queue(0XAA);
+      break;
+
+    case CMD55:
+      appCmd_ = 1;
+      queue(R1_READY_STATE);
+      break;
+
+    case CMD58:
+      // powered up, high capacity
+      queue(R1_READY_STATE);
+      queue(0XC0);
+      queue(0XFF);
+      queue(0X80);
+      queue(0X00);
+      break;
+
+    case CMD9:
+    case CMD10: {
+      uint8_t reg[16];
+      memset(reg, 0, sizeof(reg));
+      if (cmd == CMD9) {
+        // CSD version 2, capacity (c_size + 1) * 512 KB
+        uint32_t cSize = blocks_ / 1024 - 1;
+        reg[0] = 0X40;
+        reg[7] = (cSize >> 16) & 0X3F;
+        reg[8] = cSize >> 8;
+        reg[9] = cSize;
+        // single block erase
+        reg[10] = eraseEnable_ ? 0X40 : 0;
+      }
+      queue(R1_READY_STATE);
+      queue(DATA_START_BLOCK);
+      for (uint8_t i = 0; i < 16; i++) {
+        queue(reg[i]);
+      }
+      queue(0XFF);
+      queue(0XFF);
+      break;
+    }
+
+    case CMD13:
+      queue(R1_READY_STATE);
+      queue(0);
+      break;
+
+    case CMD17: {
+      uint8_t block[512];
+      if (!readImage(arg, block)) {
+        queue(0X40);  // parameter error
+        break;
+      }
+      counters_.blocksRead++;
+      queue(R1_READY_STATE);
+      queue(DATA_START_BLOCK);
+      for (uint16_t i = 0; i < 512; i++) {
+        queue(block[i]);
+      }
+      queue(0XFF);
+      queue(0XFF);
+      break;
+    }
+
+    case CMD18:
+      if (arg >= blocks_) {
+        queue(0X40);
+        break;
+      }
+      readBlock_ = arg;
+      counters_.readStarts++;
+      state_ = MULTIPLE_READ;
+      queue(R1_READY_STATE);
+      break;
+    case CMD24:
+    case CMD25:
+      if (arg >= blocks_) {
+        queue(0X40);
+        break;
+      }
+      writeBlock_ = arg;
+      if (cmd == CMD24) {
+        state_ = WRITE_TOKEN;
+      } else {
+        counters_.multipleStarts++;
+        state_ = MULTIPLE_TOKEN;
+      }
+      queue(R1_READY_STATE);
+      break;
+
+    case CMD32:
+    case CMD33:
+      if (arg >= blocks_) {
+        queue(0X40);
+        break;
+      }
+      if (cmd == CMD32) {
+        eraseFirst_ = arg;
+      } else {
+        eraseLast_ = arg;
+      }
+      queue(R1_READY_STATE);
+      break;
+
+    case CMD38: {
+      // this card erases to zeros
+      uint8_t block[512];
+      memset(block, 0, sizeof(block));
+      if (eraseFirst_ > eraseLast_) {
+        queue(0X10);  // erase sequence error
+        break;
+      }
+      for (uint32_t b = eraseFirst_; b <= eraseLast_; b++) {
+        writeImage(b, block);
+      }
+      counters_.blocksErased += eraseLast_ - eraseFirst_ + 1;
+      queue(R1_READY_STATE);
+      break;
+    }
+
+    default:
+      queue(R1_ILLEGAL_COMMAND);
+      break;
+  }
+}
+
+//------------------------------------------------------------------------------
+// The partition starts at 4 MB, the volume layout follows the FAT
+// specification: FAT16 gets 512 root entries, FAT32 32 reserved blocks and
+// the root directory in cluster 2.
+uint8_t SdCardImage::format(const char* path, uint32_t blocks,
+                            uint8_t blocksPerCluster) {
+  const uint32_t partStart = 8192;
+  if (blocks <= partStart + 1024) {
+    return false;
+  }
+  uint32_t partBlocks = blocks - partStart;
+
+  // FAT size and cluster count depend on each other, settle them
+  uint8_t fatType = 16;
+  uint16_t reserved = 1;
+  uint16_t rootEntries = 512;
+  uint32_t fatBlocks = 1;
+  uint32_t clusters = 0;
+  for (uint8_t pass = 0; pass < 2; pass++) {
+    for (uint8_t i = 0; i < 8; i++) {
+      uint32_t data = partBlocks - reserved - 2 * fatBlocks - rootEntries / 16;
+      clusters = data / blocksPerCluster;
+      fatBlocks = ((clusters + 2) * (fatType / 8) + 511) / 512;
+    }
+    if (clusters < 65525) {
+      break;
+    }
+    fatType = 32;
+    reserved = 32;
+    rootEntries = 0;
+  }
+  if (clusters < 4085) {
+    return false;
+  }
+
+  FILE* file = fopen(path, "w+b");
+  if (!file) {
+    return false;
+  }
+  uint8_t ok = !ftruncate(fileno(file), (off_t)blocks * 512);
+
+  cache_t block;
+  memset(&block, 0, sizeof(block));
+  part_t* part = &block.mbr.part[0];
+  part->type = fatType == 16 ? 0X06 : 0X0C;
+  part->firstSector = partStart;
+  part->totalSectors = partBlocks;
+  block.mbr.mbrSig0 = BOOTSIG0;
+  block.mbr.mbrSig1 = BOOTSIG1;
+  ok = ok && !fseeko(file, 0, SEEK_SET) && fwrite(&block, 512, 1, file) == 1;
+
+  memset(&block, 0, sizeof(block));
+  fbs_t* fbs = &block.fbs;
+  fbs->jmpToBootCode[0] = 0XEB;
+  fbs->jmpToBootCode[1] = 0X58;
+  fbs->jmpToBootCode[2] = 0X90;
+  memcpy(fbs->oemName, "SDIMAGE ", 8);
+  bpb_t* bpb = &fbs->bpb;
+  bpb->bytesPerSector = 512;
+  bpb->sectorsPerCluster = blocksPerCluster;
+  bpb->reservedSectorCount = reserved;
+  bpb->fatCount = 2;
+  bpb->rootDirEntryCount = rootEntries;
+  bpb->mediaType = 0XF8;
+  bpb->hidddenSectors = partStart;
+  bpb->totalSectors32 = partBlocks;
+  if (fatType == 16) {
+    bpb->sectorsPerFat16 = fatBlocks;
+  } else {
+    bpb->sectorsPerFat32 = fatBlocks;
+    bpb->fat32RootCluster = 2;
+    bpb->fat32FSInfo = 1;
+    bpb->fat32BackBootBlock = 6;
+  }
+  fbs->bootSectorSig0 = BOOTSIG0;
+  fbs->bootSectorSig1 = BOOTSIG1;
+  ok = ok && !fseeko(file, (off_t)partStart * 512, SEEK_SET)
+       && fwrite(&block, 512, 1, file) == 1;
+  if (fatType == 32) {
+    ok = ok && !fseeko(file, (off_t)(partStart + 6) * 512, SEEK_SET)
+         && fwrite(&block, 512, 1, file) == 1;
+  }
+
+  // media byte and end of chain in the first two entries, FAT32 also ends
+  // the chain of the root directory
+  memset(&block, 0, sizeof(block));
+  if (fatType == 16) {
+    block.fat16[0] = 0XFFF8;
+    block.fat16[1] = FAT16EOC;
+  } else {
+    block.fat32[0] = 0X0FFFFFF8;
+    block.fat32[1] = FAT32EOC;
+    block.fat32[2] = FAT32EOC;
+  }
+  for (uint8_t i = 0; i < 2; i++) {
+    off_t fat = (off_t)(partStart + reserved + i * fatBlocks) * 512;
+    ok = ok && !fseeko(file, fat, SEEK_SET) && fwrite(&block, 512, 1, file) == 1;
+  }
+  return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,109 @@
+/*
+  SdCardImage.h - An SD card in SPI mode, emulated on a PC and backed by a
+  disk image file, for the programs in this directory.
+
+  The emulator answers the commands Sd2Card sends as an SDHC card would,
+  byte by byte on the SPI bus, and counts what goes over the bus so that
+  different ways of using the library can be compared without hardware.
+  A command sent while a multiple block write is still open is a protocol
+  error on a real card; the emulator counts those too, and so any command
+  but CMD12 during a multiple block read.
+*/
+#ifndef SdCardImage_h
+#define SdCardImage_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+/** What went over the bus since the last clearCounters() */
+struct SdCardCounters {
+  uint32_t commands;        // commands, ACMDs counted once
+  uint32_t blocksRead;      // CMD17 data blocks
+  uint32_t readStarts;      // CMD18 commands
+  uint32_t readBlocks;      // data blocks sent after CMD18
+  uint32_t singleWrites;    // CMD24 data blocks
+  uint32_t multipleStarts;  // CMD25 commands
+  uint32_t multipleBlocks;  // data blocks sent after CMD25
+  uint32_t blocksErased;    // blocks erased by CMD38
+  uint32_t protocolErrors;  // commands sent during a multiple block write
+                            // and commands but CMD12 during a multiple
+                            // block read
+  uint32_t spiBytes;        // bytes clocked while the card is selected
+};
+
+class SdCardImage {
+  public:
+    SdCardImage(void);
+    ~SdCardImage(void);
+    /**
+       Create a sparse image of \a blocks blocks with an MBR and one FAT16
+       or FAT32 partition. The FAT type follows from the cluster count, as
+       for SdVolume.
+    */
+    static uint8_t format(const char* path, uint32_t blocks,
+                          uint8_t blocksPerCluster);
+    /** Use an image file as the card and make it the card on the bus */
+    uint8_t open(const char* path);
+    void close(void);
+
+    uint32_t blocks(void) const {
+      return blocks_;
+    }
+    const SdCardCounters& counters(void) const {
+      return counters_;
+    }
+    void clearCounters(void);
+    /** Report single block erase in the CSD or not, it is on at first */
+    void setEraseEnable(uint8_t enable) {
+      eraseEnable_ = enable;
+    }
+    /**
+       Lose the power after \a blocks more block writes: later writes and
+       erases still succeed on the bus but never reach the image, until the
+       next open().
+    */
+    void cutPowerAfter(uint32_t blocks) {
+      writesLeft_ = blocks;
+    }
+    /** Time the counted traffic takes with \a spiClock, see SdCardImage.cpp */
+    double estimateMillis(uint32_t spiClock) const;
+
+    // called by the host SPI.h and Arduino.h
+    void select(uint8_t select);
+    uint8_t transfer(uint8_t in);
+
+    /** The card on the bus, if any */
+    static SdCardImage* current;
+
+  private:
+    enum State {
+      IDLE, COMMAND, WRITE_TOKEN, WRITE_DATA, MULTIPLE_TOKEN, MULTIPLE_DATA,
+      MULTIPLE_READ
+    };
+    void command(void);
+    void queue(uint8_t b);
+    uint8_t readImage(uint32_t block, uint8_t* dst);
+    uint8_t writeImage(uint32_t block, const uint8_t* src);
+
+    FILE* file_;
+    uint32_t blocks_;
+    uint8_t selected_;
+    uint8_t appCmd_;
+    uint8_t readCmd_;  // the command came during a multiple block read
+    uint8_t eraseEnable_;
+    State state_;
+    uint8_t cmd_[6];
+    uint16_t count_;
+    uint32_t readBlock_;
+    uint32_t writeBlock_;
+    uint32_t eraseFirst_;
+    uint32_t eraseLast_;
+    uint32_t writesLeft_;  // block writes until the power cut
+    uint8_t data_[514];
+    uint8_t out_[1 + 1 + 512 + 2];
+    uint16_t outHead_;
+    uint16_t outTail_;
+    SdCardCounters counters_;
+};
+
+#endif
@@ -145,6 +145,22 @@ uint32_t File::size() {
   return _file->fileSize();
 }
 
+// reserve contiguous space for a new file, see SdFile::preAllocate()
+boolean File::preAllocate(uint32_t size) {
+  if (! _file) {
+    return false;
+  }
+  return _file->preAllocate(size);
+}
+
+// remember cluster runs for fast seeks, see SdFile::setExtentCache()
+boolean File::setExtentCache(fat_extent_t* extents, uint8_t count) {
+  if (! _file) {
+    return false;
+  }
+  return _file->setExtentCache(extents, count);
+}
+
 void File::close() {
   if (_file) {
     _file->close();
@@ -44,6 +44,8 @@ namespace SDLib {
       boolean seek(uint32_t pos);
       uint32_t position();
       uint32_t size();
+      boolean preAllocate(uint32_t size);
+      boolean setExtentCache(fat_extent_t* extents, uint8_t count);
       void close();
       operator bool();
       char * name();
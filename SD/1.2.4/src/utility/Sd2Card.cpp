@@ -114,11 +114,24 @@ uint8_t Sd2Card::cardCommand(uint8_t cmd, uint32_t arg) {
   // end read if in partialBlockRead mode
   readEnd();
 
+  // end read if a multiple block read is open
+  if (readBlock_ != 0XFFFFFFFF) {
+    readStop();
+  }
+
+  // end write if a multiple block write is open
+  if (writeBlock_ != 0XFFFFFFFF) {
+    writeStop();
+  }
+
   // select card
   chipSelectLow();
 
-  // wait up to 300 ms if busy
-  waitNotBusy(300);
+  // wait up to 300 ms if busy, the card sends data instead while CMD12
+  // ends a multiple block read
+  if (cmd != CMD12) {
+    waitNotBusy(300);
+  }
 
   // send command
   spiSend(cmd | 0x40);
@@ -138,6 +151,11 @@ uint8_t Sd2Card::cardCommand(uint8_t cmd, uint32_t arg) {
   }
   spiSend(crc);
 
+  // skip the stuff byte that follows CMD12
+  if (cmd == CMD12) {
+    spiRec();
+  }
+
   // wait for response
   for (uint8_t i = 0; ((status_ = spiRec()) & 0X80) && i != 0XFF; i++)
     ;
@@ -256,6 +274,7 @@ uint8_t Sd2Card::eraseSingleBlockEnable(void) {
 */
 uint8_t Sd2Card::init(uint8_t sckRateID, uint8_t chipSelectPin) {
   errorCode_ = inBlock_ = partialBlockRead_ = type_ = 0;
+  readBlock_ = writeBlock_ = 0XFFFFFFFF;
   chipSelectPin_ = chipSelectPin;
   // 16-bit init start time allows over a minute
   unsigned int t0 = millis();
@@ -471,6 +490,32 @@ fail:
   return false;
 }
 //------------------------------------------------------------------------------
+/** Read the next data block of a multiple block read sequence
+
+   The card is deselected between blocks, as for writeData().
+
+   \param[out] dst Pointer to the location that will receive the data.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+*/
+uint8_t Sd2Card::readData(uint8_t* dst) {
+  chipSelectLow();
+  if (!waitStartBlock()) {
+    return false;
+  }
+  // transfer data
+  for (uint16_t i = 0; i < 512; i++) {
+    dst[i] = spiRec();
+  }
+  // discard crc
+  spiRec();
+  spiRec();
+  readBlock_++;
+  chipSelectHigh();
+  return true;
+}
+//------------------------------------------------------------------------------
 /** Skip remaining data in a block when in partial block read mode. */
 void Sd2Card::readEnd(void) {
   if (inBlock_) {
@@ -515,6 +560,51 @@ uint8_t Sd2Card::readRegister(uint8_t cmd, void* buf) {
   chipSelectHigh();
   return true;
 
+fail:
+  chipSelectHigh();
+  return false;
+}
+//------------------------------------------------------------------------------
+/** Start a read multiple blocks sequence.
+
+   \param[in] blockNumber Address of first block in sequence.
+
+   \note This function is used with readData() and readStop()
+   for optimized multiple block reads.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+*/
+uint8_t Sd2Card::readStart(uint32_t blockNumber) {
+  // use address if not SDHC card
+  if (cardCommand(CMD18, type() != SD_CARD_TYPE_SDHC ?
+                  blockNumber << 9 : blockNumber)) {
+    error(SD_CARD_ERROR_CMD18);
+    goto fail;
+  }
+  readBlock_ = blockNumber;
+  chipSelectHigh();
+  return true;
+
+fail:
+  chipSelectHigh();
+  return false;
+}
+//------------------------------------------------------------------------------
+/** End a read multiple blocks sequence.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+*/
+uint8_t Sd2Card::readStop(void) {
+  readBlock_ = 0XFFFFFFFF;
+  if (cardCommand(CMD12, 0)) {
+    error(SD_CARD_ERROR_CMD12);
+    goto fail;
+  }
+  chipSelectHigh();
+  return true;
+
 fail:
   chipSelectHigh();
   return false;
@@ -652,15 +742,25 @@ fail:
   return false;
 }
 //------------------------------------------------------------------------------
-/** Write one data block in a multiple block write sequence */
+/** Write one data block in a multiple block write sequence
+
+   The card is deselected between blocks, so the SPI bus is free for
+   other devices while the next block is prepared.
+*/
 uint8_t Sd2Card::writeData(const uint8_t* src) {
+  chipSelectLow();
   // wait for previous write to finish
   if (!waitNotBusy(SD_WRITE_TIMEOUT)) {
     error(SD_CARD_ERROR_WRITE_MULTIPLE);
     chipSelectHigh();
     return false;
   }
-  return writeData(WRITE_MULTIPLE_TOKEN, src);
+  if (!writeData(WRITE_MULTIPLE_TOKEN, src)) {
+    return false;
+  }
+  writeBlock_++;
+  chipSelectHigh();
+  return true;
 }
 //------------------------------------------------------------------------------
 // send one block of data for write block or write multiple blocks
@@ -727,13 +827,13 @@ uint8_t Sd2Card::writeStart(uint32_t blockNumber, uint32_t eraseCount) {
     goto fail;
   }
   // use address if not SDHC card
-  if (type() != SD_CARD_TYPE_SDHC) {
-    blockNumber <<= 9;
-  }
-  if (cardCommand(CMD25, blockNumber)) {
+  if (cardCommand(CMD25, type() != SD_CARD_TYPE_SDHC ?
+                  blockNumber << 9 : blockNumber)) {
     error(SD_CARD_ERROR_CMD25);
     goto fail;
   }
+  writeBlock_ = blockNumber;
+  chipSelectHigh();
   return true;
 
 fail:
@@ -747,6 +847,8 @@ fail:
    the value zero, false, is returned for failure.
 */
 uint8_t Sd2Card::writeStop(void) {
+  writeBlock_ = 0XFFFFFFFF;
+  chipSelectLow();
   if (!waitNotBusy(SD_WRITE_TIMEOUT)) {
     goto fail;
   }
@@ -160,6 +160,10 @@ uint8_t const SD_CARD_ERROR_WRITE_PROGRAMMING = 0X14;
 uint8_t const SD_CARD_ERROR_WRITE_TIMEOUT = 0X15;
 /** incorrect rate selected */
 uint8_t const SD_CARD_ERROR_SCK_RATE = 0X16;
+/** card returned an error response for CMD12 (stop multiple block read) */
+uint8_t const SD_CARD_ERROR_CMD12 = 0X17;
+/** READ_MULTIPLE_BLOCKS command failed */
+uint8_t const SD_CARD_ERROR_CMD18 = 0X18;
 //------------------------------------------------------------------------------
 // card types
 /** Standard capacity V1 SD card */
@@ -176,7 +180,8 @@ uint8_t const SD_CARD_TYPE_SDHC = 3;
 class Sd2Card {
   public:
     /** Construct an instance of Sd2Card. */
-    Sd2Card(void) : errorCode_(0), inBlock_(0), partialBlockRead_(0), type_(0) {}
+    Sd2Card(void) : errorCode_(0), inBlock_(0), partialBlockRead_(0), type_(0),
+      readBlock_(0XFFFFFFFF), writeBlock_(0XFFFFFFFF) {}
     uint32_t cardSize(void);
     uint8_t erase(uint32_t firstBlock, uint32_t lastBlock);
     uint8_t eraseSingleBlockEnable(void);
@@ -214,6 +219,7 @@ class Sd2Card {
     uint8_t readBlock(uint32_t block, uint8_t* dst);
     uint8_t readData(uint32_t block,
                      uint16_t offset, uint16_t count, uint8_t* dst);
+    uint8_t readData(uint8_t* dst);
     /**
        Read a cards CID register. The CID contains card identification
        information such as Manufacturer ID, Product name, Product serial
@@ -228,6 +234,16 @@ class Sd2Card {
       return readRegister(CMD9, csd);
     }
     void readEnd(void);
+    /**
+       \return The block the next readData(uint8_t*) returns, or 0XFFFFFFFF
+       if no multiple block read is open.  Any other command ends an open
+       multiple block read with readStop() first.
+    */
+    uint32_t readNextBlock(void) const {
+      return readBlock_;
+    }
+    uint8_t readStart(uint32_t blockNumber);
+    uint8_t readStop(void);
     uint8_t setSckRate(uint8_t sckRateID);
     #ifdef USE_SPI_LIB
     uint8_t setSpiClock(uint32_t clock);
@@ -240,6 +256,14 @@ class Sd2Card {
     uint8_t writeData(const uint8_t* src);
     uint8_t writeStart(uint32_t blockNumber, uint32_t eraseCount);
     uint8_t writeStop(void);
+    /**
+       \return The block the next writeData() goes to, or 0XFFFFFFFF if no
+       multiple block write is open.  Any other command ends an open
+       multiple block write with writeStop() first.
+    */
+    uint32_t writeNextBlock(void) const {
+      return writeBlock_;
+    }
     uint8_t isBusy(void);
   private:
     uint32_t block_;
@@ -250,6 +274,8 @@ class Sd2Card {
     uint8_t partialBlockRead_;
     uint8_t status_;
     uint8_t type_;
+    uint32_t readBlock_;
+    uint32_t writeBlock_;
     // private functions
     uint8_t cardAcmd(uint8_t cmd, uint32_t arg) {
       cardCommand(CMD55, 0);
@@ -35,6 +35,22 @@
 */
 #define ALLOW_DEPRECATED_FUNCTIONS 1
 //------------------------------------------------------------------------------
+/**
+   Number of 512 byte blocks in the SdVolume cache.  Each way uses 522
+   bytes of RAM.  Boards with 2.5 KB of RAM or less, such as the Uno, keep
+   the single block cache, other AVR boards get two ways and boards with
+   more RAM four.  Define SD_CACHE_WAYS as a build flag to override.
+*/
+#ifndef SD_CACHE_WAYS
+  #if defined(RAMEND) && RAMEND < 0X0B00
+    #define SD_CACHE_WAYS 1
+  #elif defined(RAMEND) && RAMEND < 0X2200
+    #define SD_CACHE_WAYS 2
+  #else
+    #define SD_CACHE_WAYS 4
+  #endif
+#endif  // SD_CACHE_WAYS
+//------------------------------------------------------------------------------
 // forward declaration since SdVolume is used in SdFile
 class SdVolume;
 //==============================================================================
@@ -144,6 +160,18 @@ uint16_t const FAT_DEFAULT_DATE = ((2000 - 1980) << 9) | (1 << 5) | 1;
 /** Default time for file timestamp is 1 am */
 uint16_t const FAT_DEFAULT_TIME = (1 << 11);
 //------------------------------------------------------------------------------
+/**
+   \struct fat_extent_t
+   \brief A run of consecutive clusters in a file's cluster chain.
+   See SdFile::setExtentCache().
+*/
+struct fat_extent_t {
+  /** first cluster of the run */
+  uint32_t firstCluster;
+  /** number of clusters in the run */
+  uint32_t clusterCount;
+};
+//------------------------------------------------------------------------------
 /**
    \class SdFile
    \brief Access FAT16 and FAT32 files on SD and SDHC cards.
@@ -165,6 +193,13 @@ class SdFile : public Print {
     void clearUnbufferedRead(void) {
       flags_ &= ~F_FILE_UNBUFFERED_READ;
     }
+    /**
+       Stop using the extent cache of this file.
+       See setExtentCache()
+    */
+    void clearExtentCache(void) {
+      extentMax_ = extentCount_ = 0;
+    }
     uint8_t close(void);
     uint8_t contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock);
     uint8_t createContiguous(SdFile* dirFile,
@@ -260,6 +295,7 @@ class SdFile : public Print {
     uint8_t open(SdFile* dirFile, const char* fileName, uint8_t oflag);
 
     uint8_t openRoot(SdVolume* vol);
+    uint8_t preAllocate(uint32_t size, uint8_t erase = false);
     static void printDirName(const dir_t& dir, uint8_t width);
     static void printFatDate(uint16_t fatDate);
     static void printFatTime(uint16_t fatTime);
@@ -296,6 +332,7 @@ class SdFile : public Print {
       return seekSet(fileSize_);
     }
     uint8_t seekSet(uint32_t pos);
+    uint8_t setExtentCache(fat_extent_t* extents, uint8_t count);
     /**
        Use unbuffered reads to access this file.  Used with Wave
        Shield ISR.  Used with Sd2Card::partialBlockRead() in WaveRP.
@@ -444,13 +481,20 @@ class SdFile : public Print {
     uint8_t   dirIndex_;      // index of entry in dirBlock 0 <= dirIndex_ <= 0XF
     uint32_t  fileSize_;      // file size in bytes
     uint32_t  firstCluster_;  // first cluster of file
+    uint32_t  contiguousEnd_; // end of pre-allocated contiguous clusters
+    fat_extent_t* extent_;    // cluster runs, see setExtentCache()
+    uint8_t   extentMax_;     // size of extent_, zero for no extent cache
+    uint8_t   extentCount_;   // runs found, they start at firstCluster_
     SdVolume* vol_;           // volume where file is located
 
     // private functions
     uint8_t addCluster(void);
     uint8_t addDirCluster(void);
     dir_t* cacheDirEntry(uint8_t action);
+    uint32_t contiguousEndBlock(void) const;
+    friend class SdRecordLog;
     static void (*dateTime_)(uint16_t* date, uint16_t* time);
+    uint8_t extentSeek(uint32_t index);
     static uint8_t make83Name(const char* str, uint8_t* name);
     uint8_t openCachedEntry(uint8_t cacheIndex, uint8_t oflags);
     dir_t* readDirCache(void);
@@ -488,8 +532,25 @@ class SdVolume {
     */
     static uint8_t* cacheClear(void) {
       cacheFlush();
-      cacheBlockNumber_ = 0XFFFFFFFF;
-      return cacheBuffer_.data;
+      cacheBlockNumber_[cacheCurrent_] = 0XFFFFFFFF;
+      return cacheBuffer_[cacheCurrent_].data;
+    }
+    /** cachePin() flag to keep FAT blocks in the cache */
+    static uint8_t const CACHE_PIN_FAT = 0X04;
+    /** cachePin() flag to keep directory blocks in the cache */
+    static uint8_t const CACHE_PIN_DIR = 0X08;
+    static void cachePin(uint8_t flags);
+    /** \return The number of block reads since clearBlockCounts(). */
+    static uint32_t blockReadCount(void) {
+      return blockReads_;
+    }
+    /** \return The number of block writes since clearBlockCounts(). */
+    static uint32_t blockWriteCount(void) {
+      return blockWrites_;
+    }
+    /** Reset the block read and write counts. */
+    static void clearBlockCounts(void) {
+      blockReads_ = blockWrites_ = 0;
     }
     /**
        Initialize a FAT volume.  Try partition one first then try super
@@ -575,12 +636,24 @@ class SdVolume {
     static uint8_t const CACHE_FOR_READ = 0;
     // value for action argument in cacheRawBlock to indicate cache dirty
     static uint8_t const CACHE_FOR_WRITE = 1;
+    // action option for a block that will be overwritten, skip the read
+    static uint8_t const CACHE_OPTION_NO_READ = 2;
+    // action for a new block, see cacheZeroBlock()
+    static uint8_t const CACHE_RESERVE_FOR_WRITE =
+      CACHE_FOR_WRITE | CACHE_OPTION_NO_READ;
+    // cacheStatus_ bits, besides CACHE_FOR_WRITE and the CACHE_PIN_ kind
+    static uint8_t const CACHE_STATUS_PINNED = 0X10;
 
-    static cache_t cacheBuffer_;        // 512 byte cache for device blocks
-    static uint32_t cacheBlockNumber_;  // Logical number of block in the cache
+    static cache_t cacheBuffer_[SD_CACHE_WAYS];        // cached device blocks
+    static uint32_t cacheBlockNumber_[SD_CACHE_WAYS];  // block number per way
+    static uint32_t cacheMirrorBlock_[SD_CACHE_WAYS];  // mirror FAT block per way
+    static uint8_t cacheStatus_[SD_CACHE_WAYS];  // dirty, kind and pinned bits
+    static uint8_t cacheRank_[SD_CACHE_WAYS];    // zero for most recently used
+    static uint8_t cacheCurrent_;       // way of the last block cached
+    static uint8_t cachePin_;           // kinds of block to pin
     static Sd2Card* sdCard_;            // Sd2Card object for cache
-    static uint8_t cacheDirty_;         // cacheFlush() will write block if true
-    static uint32_t cacheMirrorBlock_;  // block number for mirror FAT
+    static uint32_t blockReads_;        // blocks read since clearBlockCounts()
+    static uint32_t blockWrites_;       // blocks written since clearBlockCounts()
     //
     uint32_t allocSearchStart_;   // start cluster for alloc search
     uint8_t blocksPerCluster_;    // cluster size in blocks
@@ -604,13 +677,31 @@ class SdVolume {
     uint32_t blockNumber(uint32_t cluster, uint32_t position) const {
       return clusterStartBlock(cluster) + blockOfCluster(position);
     }
+    static uint32_t cacheBlockNumber(void) {
+      return cacheBlockNumber_[cacheCurrent_];
+    }
+    static cache_t* cacheCurrent(void) {
+      return &cacheBuffer_[cacheCurrent_];
+    }
     static uint8_t cacheFlush(uint8_t blocking = 1);
+    static uint8_t cacheHas(uint32_t blockNumber) {
+      return cacheWay(blockNumber) != SD_CACHE_WAYS;
+    }
+    static void cacheInit(void);
+    static void cacheInvalidate(uint32_t blockNumber);
     static uint8_t cacheMirrorBlockFlush(uint8_t blocking);
-    static uint8_t cacheRawBlock(uint32_t blockNumber, uint8_t action);
+    static cache_t* cacheRawBlock(uint32_t blockNumber, uint8_t action);
+    static void cacheSetClean(void) {
+      cacheStatus_[cacheCurrent_] &= ~CACHE_FOR_WRITE;
+    }
     static void cacheSetDirty(void) {
-      cacheDirty_ |= CACHE_FOR_WRITE;
+      cacheStatus_[cacheCurrent_] |= CACHE_FOR_WRITE;
     }
+    static uint8_t cacheVictim(uint8_t kind);
+    static uint8_t cacheWay(uint32_t blockNumber);
+    static uint8_t cacheWayFlush(uint8_t way);
     static uint8_t cacheZeroBlock(uint32_t blockNumber);
+    static uint8_t eraseBlocks(uint32_t firstBlock, uint32_t lastBlock);
     uint8_t chainSize(uint32_t beginCluster, uint32_t* size) const;
     uint8_t fatGet(uint32_t cluster, uint32_t* value) const;
     uint8_t fatPut(uint32_t cluster, uint32_t value);
@@ -621,21 +712,37 @@ class SdVolume {
     uint8_t isEOC(uint32_t cluster) const {
       return  cluster >= (fatType_ == 16 ? FAT16EOC_MIN : FAT32EOC_MIN);
     }
-    uint8_t readBlock(uint32_t block, uint8_t* dst) {
+    static uint8_t readBlock(uint32_t block, uint8_t* dst) {
+      blockReads_++;
+      // take the block from an open multiple block read if it is next
+      if (sdCard_->readNextBlock() == block) {
+        return sdCard_->readData(dst);
+      }
       return sdCard_->readBlock(block, dst);
     }
-    uint8_t readData(uint32_t block, uint16_t offset,
-                     uint16_t count, uint8_t* dst) {
+    static uint8_t readBlocks(uint32_t block, uint8_t* dst, uint16_t count);
+    static uint8_t readData(uint32_t block, uint16_t offset,
+                            uint16_t count, uint8_t* dst) {
+      blockReads_++;
       return sdCard_->readData(block, offset, count, dst);
     }
-    uint8_t writeBlock(uint32_t block, const uint8_t* dst, uint8_t blocking = 1) {
+    static uint8_t writeBlock(uint32_t block, const uint8_t* dst,
+                              uint8_t blocking = 1) {
+      blockWrites_++;
       return sdCard_->writeBlock(block, dst, blocking);
     }
+    static uint8_t writeContiguous(uint32_t block, const uint8_t* src,
+                                   uint32_t endBlock);
     uint8_t isBusy(void) {
       return sdCard_->isBusy();
     }
     uint8_t isCacheMirrorBlockDirty(void) {
-      return (cacheMirrorBlock_ != 0);
+      for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+        if (cacheMirrorBlock_[i]) {
+          return true;
+        }
+      }
+      return false;
     }
 };
 #endif  // SdFat_h
@@ -68,10 +68,12 @@ uint8_t SdFile::addDirCluster(void) {
 // cache a file's directory entry
 // return pointer to cached entry or null for failure
 dir_t* SdFile::cacheDirEntry(uint8_t action) {
-  if (!SdVolume::cacheRawBlock(dirBlock_, action)) {
+  cache_t* pc = SdVolume::cacheRawBlock(dirBlock_,
+                                        action | SdVolume::CACHE_PIN_DIR);
+  if (!pc) {
     return NULL;
   }
-  return SdVolume::cacheBuffer_.dir + dirIndex_;
+  return pc->dir + dirIndex_;
 }
 //------------------------------------------------------------------------------
 /**
@@ -83,6 +85,10 @@ dir_t* SdFile::cacheDirEntry(uint8_t action) {
    Reasons for failure include no file is open or an I/O error.
 */
 uint8_t SdFile::close(void) {
+  // free pre-allocated clusters past the end of the file
+  if (contiguousEnd_ && !truncate(fileSize_)) {
+    return false;
+  }
   if (!sync()) {
     return false;
   }
@@ -127,6 +133,11 @@ uint8_t SdFile::contiguousRange(uint32_t* bgnBlock, uint32_t* endBlock) {
   }
 }
 //------------------------------------------------------------------------------
+// return the block after the last pre-allocated block
+uint32_t SdFile::contiguousEndBlock(void) const {
+  return vol_->clusterStartBlock(firstCluster_) + (contiguousEnd_ >> 9);
+}
+//------------------------------------------------------------------------------
 /**
    Create and open a new contiguous file of a specified size.
 
@@ -216,6 +227,64 @@ void SdFile::dirName(const dir_t& dir, char* name) {
   name[j] = 0;
 }
 //------------------------------------------------------------------------------
+// set curCluster_ to the cluster with index \a index in the file's chain.
+// Runs of consecutive clusters are recorded in the extent cache while the
+// chain is followed past the runs found so far.
+uint8_t SdFile::extentSeek(uint32_t index) {
+  if (firstCluster_ == 0) {
+    return false;
+  }
+  if (extentCount_ == 0) {
+    extent_[0].firstCluster = firstCluster_;
+    extent_[0].clusterCount = 1;
+    extentCount_ = 1;
+  }
+  // look for the cluster in the runs, first is the index of a run's start
+  uint32_t first = 0;
+  uint8_t i = 0;
+  do {
+    if (index - first < extent_[i].clusterCount) {
+      curCluster_ = extent_[i].firstCluster + index - first;
+      return true;
+    }
+    first += extent_[i].clusterCount;
+  } while (++i < extentCount_);
+
+  // follow the chain from the last cluster of the last run
+  fat_extent_t* run = &extent_[i - 1];
+  uint32_t cluster = run->firstCluster + run->clusterCount - 1;
+  uint32_t n = first - 1;
+
+  // start at the current cluster if the cache is full and it is closer
+  if (extentCount_ == extentMax_ && curPosition_ != 0) {
+    uint32_t nCur = (curPosition_ - 1) >> (vol_->clusterSizeShift_ + 9);
+    if (nCur > n && nCur <= index) {
+      cluster = curCluster_;
+      n = nCur;
+    }
+  }
+  while (n < index) {
+    uint32_t next;
+    if (!vol_->fatGet(cluster, &next) || vol_->isEOC(next)) {
+      return false;
+    }
+    // extend the last run or start a new one while there is room
+    if (cluster == run->firstCluster + run->clusterCount - 1) {
+      if (next == cluster + 1) {
+        run->clusterCount++;
+      } else if (extentCount_ < extentMax_) {
+        run = &extent_[extentCount_++];
+        run->firstCluster = next;
+        run->clusterCount = 1;
+      }
+    }
+    cluster = next;
+    n++;
+  }
+  curCluster_ = cluster;
+  return true;
+}
+//------------------------------------------------------------------------------
 /** List directory contents to Serial.
 
    \param[in] flags The inclusive OR of
@@ -378,12 +447,13 @@ uint8_t SdFile::makeDir(SdFile* dir, const char* dirName) {
 
   // cache block for '.'  and '..'
   uint32_t block = vol_->clusterStartBlock(firstCluster_);
-  if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_WRITE)) {
+  cache_t* pc = SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_WRITE);
+  if (!pc) {
     return false;
   }
 
   // copy '.' to block
-  memcpy(&SdVolume::cacheBuffer_.dir[0], &d, sizeof(d));
+  memcpy(&pc->dir[0], &d, sizeof(d));
 
   // make entry for '..'
   d.name[1] = '.';
@@ -395,7 +465,7 @@ uint8_t SdFile::makeDir(SdFile* dir, const char* dirName) {
     d.firstClusterHigh = dir->firstCluster_ >> 16;
   }
   // copy '..' to block
-  memcpy(&SdVolume::cacheBuffer_.dir[1], &d, sizeof(d));
+  memcpy(&pc->dir[1], &d, sizeof(d));
 
   // set position after '..'
   curPosition_ = 2 * sizeof(d);
@@ -481,7 +551,7 @@ uint8_t SdFile::open(SdFile* dirFile, const char* fileName, uint8_t oflag) {
       if (!emptyFound) {
         emptyFound = true;
         dirIndex_ = index;
-        dirBlock_ = SdVolume::cacheBlockNumber_;
+        dirBlock_ = SdVolume::cacheBlockNumber();
       }
       // done if no entries follow
       if (p->name[0] == DIR_NAME_FREE) {
@@ -520,7 +590,7 @@ uint8_t SdFile::open(SdFile* dirFile, const char* fileName, uint8_t oflag) {
 
     // use first entry in cluster
     dirIndex_ = 0;
-    p = SdVolume::cacheBuffer_.dir;
+    p = SdVolume::cacheCurrent()->dir;
   }
   // initialize as empty file
   memset(p, 0, sizeof(dir_t));
@@ -598,7 +668,7 @@ uint8_t SdFile::open(SdFile* dirFile, uint16_t index, uint8_t oflag) {
 // open a cached directory entry. Assumes vol_ is initializes
 uint8_t SdFile::openCachedEntry(uint8_t dirIndex, uint8_t oflag) {
   // location of entry in cache
-  dir_t* p = SdVolume::cacheBuffer_.dir + dirIndex;
+  dir_t* p = SdVolume::cacheCurrent()->dir + dirIndex;
 
   // write or truncate is an error for a directory or read-only file
   if (p->attributes & (DIR_ATT_READ_ONLY | DIR_ATT_DIRECTORY)) {
@@ -608,7 +678,7 @@ uint8_t SdFile::openCachedEntry(uint8_t dirIndex, uint8_t oflag) {
   }
   // remember location of directory entry on SD
   dirIndex_ = dirIndex;
-  dirBlock_ = SdVolume::cacheBlockNumber_;
+  dirBlock_ = SdVolume::cacheBlockNumber();
 
   // copy first cluster number for directory fields
   firstCluster_ = (uint32_t)p->firstClusterHigh << 16;
@@ -632,6 +702,8 @@ uint8_t SdFile::openCachedEntry(uint8_t dirIndex, uint8_t oflag) {
   // set to start of file
   curCluster_ = 0;
   curPosition_ = 0;
+  contiguousEnd_ = 0;
+  extentMax_ = 0;
 
   // truncate file to zero length if requested
   if (oflag & O_TRUNC) {
@@ -677,6 +749,8 @@ uint8_t SdFile::openRoot(SdVolume* vol) {
   // set to start of file
   curCluster_ = 0;
   curPosition_ = 0;
+  contiguousEnd_ = 0;
+  extentMax_ = 0;
 
   // root has no directory entry
   dirBlock_ = 0;
@@ -684,6 +758,59 @@ uint8_t SdFile::openRoot(SdVolume* vol) {
   return true;
 }
 //------------------------------------------------------------------------------
+/**
+   Allocate contiguous clusters for an empty file that will be written
+   sequentially, such as a data log.
+
+   Writes within the allocated space do not access the FAT, and whole
+   blocks go to the card as one multiple block write instead of a write
+   per block.  The file size in the directory entry is only updated by
+   sync() and close().  sync() also ends the multiple block write, so it
+   should be called rarely.  close() frees the clusters that were not
+   written.  A file that grows past the allocated space gets more
+   clusters as usual.
+
+   \param[in] size The number of bytes to allocate.
+   \param[in] erase Also erase the allocated blocks on the card, so they
+   read as all zeros or all ones instead of old data.  See Sd2Card::erase().
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+   Reasons for failure include the file is not empty or not open for
+   write, there is no contiguous free space of \a size, the card can not
+   erase single blocks or an I/O error.  The file is still empty after
+   a failure.
+*/
+uint8_t SdFile::preAllocate(uint32_t size, uint8_t erase) {
+  // only allow empty files open for write
+  if (!isFile() || !(flags_ & O_WRITE) || firstCluster_ != 0 || size == 0) {
+    return false;
+  }
+
+  // calculate number of clusters needed
+  uint32_t count = ((size - 1) >> (vol_->clusterSizeShift_ + 9)) + 1;
+
+  // allocate clusters
+  if (!vol_->allocContiguous(count, &firstCluster_)) {
+    return false;
+  }
+  if (erase) {
+    uint32_t bgnBlock = vol_->clusterStartBlock(firstCluster_);
+    uint32_t endBlock = bgnBlock + (count << vol_->clusterSizeShift_) - 1;
+    if (!SdVolume::eraseBlocks(bgnBlock, endBlock)) {
+      // give the clusters back
+      vol_->freeChain(firstCluster_);
+      firstCluster_ = 0;
+      return false;
+    }
+  }
+  contiguousEnd_ = count << (vol_->clusterSizeShift_ + 9);
+
+  // insure sync() will update dir entry
+  flags_ |= F_FILE_DIR_DIRTY;
+  return sync();
+}
+//------------------------------------------------------------------------------
 /** %Print the name field of a directory entry in 8.3 format to Serial.
 
    \param[in] dir The directory structure containing the name.
@@ -793,6 +920,11 @@ int16_t SdFile::read(void* buf, uint16_t nbyte) {
         if (curPosition_ == 0) {
           // use first cluster in file
           curCluster_ = firstCluster_;
+        } else if (extentMax_) {
+          // get next cluster from the extent cache
+          if (!extentSeek(curPosition_ >> (vol_->clusterSizeShift_ + 9))) {
+            return -1;
+          }
         } else {
           // get next cluster from FAT
           if (!vol_->fatGet(curCluster_, &curCluster_)) {
@@ -810,18 +942,42 @@ int16_t SdFile::read(void* buf, uint16_t nbyte) {
     }
 
     // no buffering needed if n == 512 or user requests no buffering
-    if ((unbufferedRead() || n == 512) &&
-        block != SdVolume::cacheBlockNumber_) {
-      if (!vol_->readData(block, offset, n, dst)) {
+    if ((unbufferedRead() || n == 512) && !SdVolume::cacheHas(block)) {
+      if (n == 512 && type_ != FAT_FILE_TYPE_ROOT16) {
+        // whole blocks up to the end of the cluster in one multiple block
+        // read, stop at a cached block since it may hold newer data
+        uint16_t count = toRead >> 9;
+        uint8_t left = vol_->blocksPerCluster_
+                       - vol_->blockOfCluster(curPosition_);
+        if (count > left) {
+          count = left;
+        }
+        for (uint16_t i = 1; i < count; i++) {
+          if (SdVolume::cacheHas(block + i)) {
+            count = i;
+            break;
+          }
+        }
+        if (!SdVolume::readBlocks(block, dst, count)) {
+          return -1;
+        }
+        n = count << 9;
+      } else if (!vol_->readData(block, offset, n, dst)) {
         return -1;
       }
       dst += n;
     } else {
       // read block to cache and copy data to caller
-      if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_READ)) {
+      uint8_t action = SdVolume::CACHE_FOR_READ;
+      if (isDir()) {
+        // keep directory blocks, see SdVolume::cachePin()
+        action |= SdVolume::CACHE_PIN_DIR;
+      }
+      cache_t* pc = SdVolume::cacheRawBlock(block, action);
+      if (!pc) {
         return -1;
       }
-      uint8_t* src = SdVolume::cacheBuffer_.data + offset;
+      uint8_t* src = pc->data + offset;
       uint8_t* end = src + n;
       while (src != end) {
         *dst++ = *src++;
@@ -889,7 +1045,7 @@ dir_t* SdFile::readDirCache(void) {
   curPosition_ += 31;
 
   // return pointer to entry
-  return (SdVolume::cacheBuffer_.dir + i);
+  return (SdVolume::cacheCurrent()->dir + i);
 }
 //------------------------------------------------------------------------------
 /**
@@ -1098,6 +1254,14 @@ uint8_t SdFile::seekSet(uint32_t pos) {
     curPosition_ = 0;
     return true;
   }
+  if (extentMax_) {
+    // find the cluster for the new position in the extent cache
+    if (!extentSeek((pos - 1) >> (vol_->clusterSizeShift_ + 9))) {
+      return false;
+    }
+    curPosition_ = pos;
+    return true;
+  }
   // calculate cluster index for cur and new position
   uint32_t nCur = (curPosition_ - 1) >> (vol_->clusterSizeShift_ + 9);
   uint32_t nNew = (pos - 1) >> (vol_->clusterSizeShift_ + 9);
@@ -1118,6 +1282,40 @@ uint8_t SdFile::seekSet(uint32_t pos) {
   return true;
 }
 //------------------------------------------------------------------------------
+/**
+   Remember the runs of consecutive clusters in this file's cluster chain
+   to speed up seekSet() and read().
+
+   Without an extent cache seekSet() follows the cluster chain in the FAT
+   one cluster at a time, from the start of the file for a seek backwards,
+   and read() reads the FAT at each cluster boundary.  With the cache the
+   runs are recorded the first time the chain is followed and later seeks
+   find the cluster by counting through the runs.  A file written to free
+   space, such as a log, has few runs even if it is many megabytes long.
+   When \a extents is full the rest of the chain is followed in the FAT.
+
+   truncate() empties the cache.  Closing the file or clearExtentCache()
+   stops using it.
+
+   \param[in] extents Storage for the runs.  It must be valid until the
+   file is closed or clearExtentCache() is called.
+   \param[in] count The number of entries in \a extents.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+   Reasons for failure include no file is open, this is a directory
+   or \a count is zero.
+*/
+uint8_t SdFile::setExtentCache(fat_extent_t* extents, uint8_t count) {
+  if (!isFile() || count == 0) {
+    return false;
+  }
+  extent_ = extents;
+  extentMax_ = count;
+  extentCount_ = 0;
+  return true;
+}
+//------------------------------------------------------------------------------
 /**
    The sync() call causes all modified data and directory fields
    to be written to the storage device.
@@ -1135,6 +1333,13 @@ uint8_t SdFile::sync(uint8_t blocking) {
     return false;
   }
 
+  // end a multiple block write so the data is programmed
+  if (SdVolume::sdCard_->writeNextBlock() != 0XFFFFFFFF) {
+    if (!SdVolume::sdCard_->writeStop()) {
+      return false;
+    }
+  }
+
   if (flags_ & F_FILE_DIR_DIRTY) {
     dir_t* d = cacheDirEntry(SdVolume::CACHE_FOR_WRITE);
     if (!d) {
@@ -1261,8 +1466,14 @@ uint8_t SdFile::truncate(uint32_t length) {
     return false;
   }
 
-  // fileSize and length are zero - nothing to do
-  if (fileSize_ == 0) {
+  // the rest of a pre-allocation is freed below
+  contiguousEnd_ = 0;
+
+  // recorded runs may include clusters freed below
+  extentCount_ = 0;
+
+  // fileSize and length are zero and no clusters - nothing to do
+  if (fileSize_ == 0 && firstCluster_ == 0) {
     return true;
   }
 
@@ -1351,7 +1562,12 @@ size_t SdFile::write(const void* buf, uint16_t nbyte) {
   while (nToWrite > 0) {
     uint8_t blockOfCluster = vol_->blockOfCluster(curPosition_);
     uint16_t blockOffset = curPosition_ & 0X1FF;
-    if (blockOfCluster == 0 && blockOffset == 0) {
+    // pre-allocated space, no need to follow the FAT chain
+    uint8_t contiguous = curPosition_ < contiguousEnd_;
+    if (contiguous) {
+      curCluster_ = firstCluster_
+                    + (curPosition_ >> (vol_->clusterSizeShift_ + 9));
+    } else if (blockOfCluster == 0 && blockOffset == 0) {
       // start of new cluster
       if (curCluster_ == 0) {
         if (firstCluster_ == 0) {
@@ -1390,32 +1606,40 @@ size_t SdFile::write(const void* buf, uint16_t nbyte) {
     if (n == 512) {
       // full block - don't need to use cache
       // invalidate cache if block is in cache
-      if (SdVolume::cacheBlockNumber_ == block) {
-        SdVolume::cacheBlockNumber_ = 0XFFFFFFFF;
-      }
-      if (!vol_->writeBlock(block, src, blocking)) {
+      SdVolume::cacheInvalidate(block);
+      if (contiguous) {
+        if (!SdVolume::writeContiguous(block, src, contiguousEndBlock())) {
+          goto writeErrorReturn;
+        }
+      } else if (!vol_->writeBlock(block, src, blocking)) {
         goto writeErrorReturn;
       }
       src += 512;
     } else {
+      cache_t* pc;
       if (blockOffset == 0 && curPosition_ >= fileSize_) {
         // start of new block don't need to read into cache
-        if (!SdVolume::cacheFlush()) {
-          goto writeErrorReturn;
-        }
-        SdVolume::cacheBlockNumber_ = block;
-        SdVolume::cacheSetDirty();
+        pc = SdVolume::cacheRawBlock(block, SdVolume::CACHE_RESERVE_FOR_WRITE);
       } else {
         // rewrite part of block
-        if (!SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_WRITE)) {
-          goto writeErrorReturn;
-        }
+        pc = SdVolume::cacheRawBlock(block, SdVolume::CACHE_FOR_WRITE);
       }
-      uint8_t* dst = SdVolume::cacheBuffer_.data + blockOffset;
+      if (!pc) {
+        goto writeErrorReturn;
+      }
+      uint8_t* dst = pc->data + blockOffset;
       uint8_t* end = dst + n;
       while (dst != end) {
         *dst++ = *src++;
       }
+      // block is complete, send it now rather than from cacheFlush()
+      if (contiguous && blockOffset + n == 512) {
+        if (!SdVolume::writeContiguous(block, pc->data,
+                                       contiguousEndBlock())) {
+          goto writeErrorReturn;
+        }
+        SdVolume::cacheSetClean();
+      }
     }
     nToWrite -= n;
     curPosition_ += n;
@@ -0,0 +1,664 @@
+/* Arduino SdFat Library
+
+   This file is part of the Arduino SdFat Library
+
+   This Library is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the Arduino SdFat Library.  If not, see
+   <http://www.gnu.org/licenses/>.
+*/
+#include "SdRecordLog.h"
+#ifdef __AVR__
+  #include <util/crc16.h>
+#endif
+#include <Arduino.h>
+//==============================================================================
+// SdRecordLog
+//------------------------------------------------------------------------------
+/**
+   Append a record to the log.  A new segment is started when the current
+   one is full.
+
+   The record stays in the block cache or in an open multiple block write
+   until its block is complete, call sync() to have it on the card.
+
+   \param[in] record recordSize bytes of data.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+   Reasons for failure include the log is not open, no more segments,
+   the volume is full or an I/O error.
+*/
+uint8_t SdRecordLog::append(const void* record) {
+  uint16_t size = recordBytes();
+  if (!isOpen()) {
+    return false;
+  }
+  if (!file_.isOpen() || file_.curPosition() + size > segmentSize_) {
+    if (file_.isOpen() && (!syncRecords() || !file_.close())) {
+      return false;
+    }
+    if (!startSegment()) {
+      return false;
+    }
+  }
+  uint32_t pos = file_.curPosition();
+  uint16_t crc = crc16(salt_, &nextSeq_, 4);
+  crc = crc16(crc, record, recordSize_);
+  if (file_.write(&nextSeq_, 4) != 4
+      || file_.write(record, recordSize_) != recordSize_
+      || file_.write(&crc, 2) != 2) {
+    // drop the part of the record that was written
+    if (file_.fileSize_ > pos) {
+      file_.fileSize_ = pos;
+    }
+    file_.seekSet(pos);
+    return false;
+  }
+  nextSeq_++;
+  return true;
+}
+//------------------------------------------------------------------------------
+/**
+   Open the log in a directory.  The newest segment is checked for
+   records that were written after the last sync() before a power loss,
+   they are kept and appends continue after them.
+
+   \param[in] dir An open directory for the segment files.
+   \param[in] prefix One to three characters that start the segment
+   names.  Logs in the same directory need different prefixes.
+   \param[in] recordSize Bytes of data in each record, the same for the
+   life of the log.
+   \param[in] segmentSize Most bytes in a segment file, with a 20 byte
+   header and six bytes more for each record.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+   Reasons for failure include the log is already open, \a dir is not a
+   directory, a bad prefix, the newest segment has another record size
+   or an I/O error.
+*/
+uint8_t SdRecordLog::begin(SdFile* dir, const char* prefix,
+                           uint16_t recordSize, uint32_t segmentSize) {
+  dir_t d;
+  int8_t n;
+  uint8_t i;
+  if (isOpen() || !dir->isDir() || recordSize == 0) {
+    return false;
+  }
+  // segment names are 8.3 names in upper case
+  for (i = 0; prefix[i]; i++) {
+    if (i == 3) {
+      return false;
+    }
+    char c = prefix[i];
+    prefix_[i] = c < 'a' || c > 'z' ? c : c + ('A' - 'a');
+  }
+  if (i == 0) {
+    return false;
+  }
+  prefix_[i] = 0;
+  recordSize_ = recordSize;
+  segmentSize_ = segmentSize;
+  if (segmentSize < sizeof(record_log_header_t) + recordBytes()) {
+    return false;
+  }
+  firstSegment_ = lastSegment_ = 0;
+  nextSeq_ = syncedSeq_ = recovered_ = 0;
+
+  // find the oldest and the newest segment
+  dir->rewind();
+  while ((n = dir->readDir(&d)) > 0) {
+    uint32_t segment = segmentNumber(d.name);
+    if (segment == 0 || !DIR_IS_FILE(&d)) {
+      continue;
+    }
+    if (firstSegment_ == 0 || segment < firstSegment_) {
+      firstSegment_ = segment;
+    }
+    if (segment > lastSegment_) {
+      lastSegment_ = segment;
+    }
+  }
+  if (n < 0) {
+    return false;
+  }
+  dir_ = dir;
+  if (lastSegment_ && !recover()) {
+    dir_ = 0;
+    return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+/**
+   Close the log.  The rest of the newest segment's allocation is freed
+   and its directory entry written.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+   Reasons for failure include the log is not open or an I/O error.
+*/
+uint8_t SdRecordLog::close(void) {
+  if (!isOpen()) {
+    return false;
+  }
+  if (file_.isOpen() && (!syncRecords() || !file_.close())) {
+    return false;
+  }
+  syncedSeq_ = nextSeq_;
+  dir_ = 0;
+  return true;
+}
+//------------------------------------------------------------------------------
+// CRC-16/XMODEM, polynomial 0X1021 most significant bit first
+uint16_t SdRecordLog::crc16(uint16_t crc, const void* buf, uint16_t n) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  while (n--) {
+    #ifdef __AVR__
+    crc = _crc_xmodem_update(crc, *p++);
+    #else  // __AVR__
+    crc ^= (uint16_t)*p++ << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = crc & 0X8000 ? (crc << 1) ^ 0X1021 : crc << 1;
+    }
+    #endif  // __AVR__
+  }
+  return crc;
+}
+//------------------------------------------------------------------------------
+/**
+   Remove the oldest segments, as long as all their records come before
+   a sequence number.  The newest segment is never removed.
+
+   Call it once records are uploaded, and not for records an
+   SdRecordReader is still reading.
+
+   \param[in] seq Records before this one may go.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+   Reasons for failure include the log is not open, a segment is
+   missing or an I/O error.
+*/
+uint8_t SdRecordLog::discard(uint32_t seq) {
+  record_log_header_t header;
+  SdFile file;
+  char name[13];
+  if (!isOpen()) {
+    return false;
+  }
+  while (firstSegment_ < lastSegment_) {
+    // the next segment tells where this one ends
+    if (!openSegment(&file, firstSegment_ + 1, O_READ, &header)) {
+      return false;
+    }
+    file.close();
+    if (header.firstSeq > seq) {
+      break;
+    }
+    segmentName(firstSegment_, name);
+    if (!SdFile::remove(dir_, name)) {
+      return false;
+    }
+    firstSegment_++;
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+// true if a segment header is intact and belongs to the segment
+uint8_t SdRecordLog::headerValid(const record_log_header_t* header,
+                                 uint32_t segment) {
+  return header->magic == RECORD_LOG_MAGIC
+         && header->crc == crc16(0, header, sizeof(*header) - 2)
+         && header->segment == segment;
+}
+//------------------------------------------------------------------------------
+// open a segment and check its header, the file is left after the header
+uint8_t SdRecordLog::openSegment(SdFile* file, uint32_t segment,
+                                 uint8_t oflag, record_log_header_t* header) {
+  char name[13];
+  segmentName(segment, name);
+  if (!file->open(dir_, name, oflag)) {
+    return false;
+  }
+  if (file->read(header, sizeof(*header)) != sizeof(*header)
+      || !headerValid(header, segment)
+      || header->recordSize != recordSize_) {
+    file->close();
+    return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+// read the record at the file position, 1 if it is record seq with a good
+// CRC, 0 if not and -1 for an I/O error.  With a zero record pointer the
+// record is only checked.
+int8_t SdRecordLog::readRecord(SdFile* file, uint16_t size, uint16_t salt,
+                               uint32_t seq, void* record) {
+  uint8_t buf[32];
+  uint8_t* dst = reinterpret_cast<uint8_t*>(record);
+  uint32_t s;
+  uint16_t check;
+  int16_t n = file->read(&s, 4);
+  if (n != 4) {
+    return n < 0 ? -1 : 0;
+  }
+  if (s != seq) {
+    return 0;
+  }
+  uint16_t crc = crc16(salt, &s, 4);
+  while (size) {
+    uint8_t* p = dst ? dst : buf;
+    uint16_t m = dst || size < sizeof(buf) ? size : sizeof(buf);
+    n = file->read(p, m);
+    if (n != m) {
+      return n < 0 ? -1 : 0;
+    }
+    crc = crc16(crc, p, m);
+    if (dst) {
+      dst += m;
+    }
+    size -= m;
+  }
+  n = file->read(&check, 2);
+  if (n != 2) {
+    return n < 0 ? -1 : 0;
+  }
+  return check == crc;
+}
+//------------------------------------------------------------------------------
+// Open the newest segment and look for records past the size in its
+// directory entry.  A segment that was closed had the rest of its
+// allocation freed and gets no more records, a segment that still has
+// all of it was in use at a power loss and appends continue in it.
+uint8_t SdRecordLog::recover(void) {
+  record_log_header_t header;
+  uint32_t bgnBlock;
+  uint32_t endBlock;
+  uint32_t allocated;
+  uint32_t fileSize;
+  uint32_t count;
+  uint32_t end;
+  char name[13];
+  int8_t n;
+  uint16_t size = recordBytes();
+  for (;;) {
+    segmentName(lastSegment_, name);
+    if (!file_.open(dir_, name, O_RDWR)) {
+      return false;
+    }
+    n = file_.read(&header, sizeof(header));
+    if (n < 0) {
+      goto fail;
+    }
+    if (n == sizeof(header) && headerValid(&header, lastSegment_)) {
+      break;
+    }
+    // The power went while the segment was started, before its header
+    // was synced, so it has no records.  Go on from the one before it.
+    // The directory entry may have reached the card before the FAT, only
+    // free the clusters if their chain is whole.
+    if (!file_.contiguousRange(&bgnBlock, &endBlock)) {
+      file_.firstCluster_ = 0;
+      file_.fileSize_ = 0;
+    }
+    if (!file_.remove()) {
+      goto fail;
+    }
+    if (lastSegment_ == firstSegment_) {
+      firstSegment_ = lastSegment_ = 0;
+      return true;
+    }
+    lastSegment_--;
+  }
+  n = 0;
+  if (header.recordSize != recordSize_) {
+    goto fail;
+  }
+  salt_ = header.salt;
+  fileSize = file_.fileSize();
+  count = (fileSize - sizeof(header)) / size;
+  end = sizeof(header) + count * size;
+  nextSeq_ = header.firstSeq + count;
+
+  if (!file_.contiguousRange(&bgnBlock, &endBlock)) {
+    goto fail;
+  }
+  allocated = (endBlock - bgnBlock + 1) << 9;
+  if (allocated < segmentSize_) {
+    syncedSeq_ = nextSeq_;
+    return file_.close();
+  }
+  // read past the size in the directory entry
+  file_.fileSize_ = allocated;
+  if (!file_.seekSet(end)) {
+    goto fail;
+  }
+  while (end + size <= segmentSize_
+         && (n = readRecord(&file_, recordSize_, salt_, nextSeq_, 0)) > 0) {
+    end += size;
+    nextSeq_++;
+    recovered_++;
+  }
+  file_.fileSize_ = fileSize;
+  if (n < 0) {
+    goto fail;
+  }
+  if (end != fileSize) {
+    file_.fileSize_ = end;
+    file_.flags_ |= SdFile::F_FILE_DIR_DIRTY;
+  }
+  // appends stream to the rest of the allocation
+  file_.contiguousEnd_ = allocated;
+  syncedSeq_ = nextSeq_;
+  if (!file_.seekSet(end) || !file_.sync()) {
+    goto fail;
+  }
+  // the next append starts a new segment
+  if (end + size > segmentSize_) {
+    return file_.close();
+  }
+  return true;
+
+fail:
+  file_.close();
+  return false;
+}
+//------------------------------------------------------------------------------
+/**
+   Format the name of a segment file.
+
+   \param[in] segment The segment number.
+   \param[out] name At least 13 bytes for the 8.3 name, such as
+   LOG00001.LOG for prefix LOG.
+*/
+void SdRecordLog::segmentName(uint32_t segment, char* name) const {
+  uint8_t i;
+  for (i = 0; prefix_[i]; i++) {
+    name[i] = prefix_[i];
+  }
+  for (uint8_t k = 5; k-- > 0;) {
+    name[i + k] = '0' + segment % 10;
+    segment /= 10;
+  }
+  i += 5;
+  name[i++] = '.';
+  name[i++] = 'L';
+  name[i++] = 'O';
+  name[i++] = 'G';
+  name[i] = 0;
+}
+//------------------------------------------------------------------------------
+// segment number for a directory entry name, zero if it is another file
+uint32_t SdRecordLog::segmentNumber(const uint8_t* name) const {
+  uint32_t segment = 0;
+  uint8_t i;
+  for (i = 0; prefix_[i]; i++) {
+    if (name[i] != prefix_[i]) {
+      return 0;
+    }
+  }
+  for (uint8_t k = 0; k < 5; k++, i++) {
+    if (name[i] < '0' || name[i] > '9') {
+      return 0;
+    }
+    segment = 10 * segment + name[i] - '0';
+  }
+  for (; i < 8; i++) {
+    if (name[i] != ' ') {
+      return 0;
+    }
+  }
+  return name[8] == 'L' && name[9] == 'O' && name[10] == 'G' ? segment : 0;
+}
+//------------------------------------------------------------------------------
+// Create the next segment with all its space and write the header.  The
+// space is erased if the card can, and each segment has a new salt, so
+// that neither erased blocks nor records an older log left in them pass
+// for records in recover().
+uint8_t SdRecordLog::startSegment(void) {
+  record_log_header_t header;
+  record_log_header_t old;
+  char name[13];
+  uint32_t seed[3];
+  uint16_t salt;
+  if (lastSegment_ == RECORD_LOG_MAX_SEGMENT) {
+    return false;
+  }
+  uint32_t segment = lastSegment_ + 1;
+  segmentName(segment, name);
+  if (!file_.open(dir_, name, O_CREAT | O_EXCL | O_RDWR)) {
+    return false;
+  }
+  if (!file_.preAllocate(segmentSize_, true)
+      && !file_.preAllocate(segmentSize_)) {
+    goto fail;
+  }
+  // Mix in what the space held before, a segment that lands on an older
+  // one without an erase gets another salt even if millis() is the same
+  // as for the older one after a reset.
+  file_.fileSize_ = sizeof(old);
+  if (file_.read(&old, sizeof(old)) != sizeof(old)) {
+    goto fail;
+  }
+  file_.fileSize_ = 0;
+  file_.rewind();
+  seed[0] = segment;
+  seed[1] = nextSeq_;
+  seed[2] = millis();
+  header.magic = RECORD_LOG_MAGIC;
+  header.recordSize = recordSize_;
+  // a zero salt would let a block of zeros pass
+  salt = crc16(0XFFFF, seed, sizeof(seed));
+  header.salt = crc16(salt, &old, sizeof(old)) | 1;
+  header.segment = segment;
+  header.firstSeq = nextSeq_;
+  header.reserved = 0;
+  header.crc = crc16(0, &header, sizeof(header) - 2);
+  if (file_.write(&header, sizeof(header)) != sizeof(header)
+      || !file_.sync()) {
+    goto fail;
+  }
+  salt_ = header.salt;
+  lastSegment_ = segment;
+  if (firstSegment_ == 0) {
+    firstSegment_ = segment;
+  }
+  return true;
+
+fail:
+  // never leave a segment without a header open for append()
+  if (!file_.remove()) {
+    file_.close();
+  }
+  return false;
+}
+//------------------------------------------------------------------------------
+/**
+   Write the directory entry of the newest segment so that its records
+   survive a power loss without a scan and show up for readers.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+   Reasons for failure include the log is not open or an I/O error.
+*/
+uint8_t SdRecordLog::sync(void) {
+  if (!isOpen() || (file_.isOpen() && !syncRecords())) {
+    return false;
+  }
+  syncedSeq_ = nextSeq_;
+  return true;
+}
+//------------------------------------------------------------------------------
+// Sync file_ with its records on the card before the directory entry.  The
+// cache writes its blocks in the order of its ways, a power loss in
+// between could otherwise leave a size that covers records the card never
+// got, and recover() only checks records past the size.
+uint8_t SdRecordLog::syncRecords(void) {
+  uint8_t dirty = file_.flags_ & SdFile::F_FILE_DIR_DIRTY;
+  file_.flags_ &= ~SdFile::F_FILE_DIR_DIRTY;
+  if (!file_.sync()) {
+    file_.flags_ |= dirty;
+    return false;
+  }
+  file_.flags_ |= dirty;
+  return file_.sync();
+}
+//==============================================================================
+// SdRecordReader
+//------------------------------------------------------------------------------
+/**
+   Start reading a log.
+
+   \param[in] log An open log.  It must stay open while the reader is used.
+   \param[in] seq The first record to read, see seek().
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+   Reasons for failure include \a log is not open or an I/O error.
+*/
+uint8_t SdRecordReader::begin(SdRecordLog* log, uint32_t seq) {
+  if (!log->isOpen()) {
+    return false;
+  }
+  log_ = log;
+  return seek(seq);
+}
+//------------------------------------------------------------------------------
+// open a segment of the log and take the values from its header
+uint8_t SdRecordReader::openSegment(uint32_t segment) {
+  record_log_header_t header;
+  if (file_.isOpen()) {
+    file_.close();
+  }
+  if (!log_->openSegment(&file_, segment, O_READ, &header)) {
+    return false;
+  }
+  segment_ = segment;
+  firstSeq_ = header.firstSeq;
+  salt_ = header.salt;
+  return true;
+}
+//------------------------------------------------------------------------------
+/**
+   Read the next record.
+
+   \param[out] record Space for recordSize bytes, or zero to skip the
+   record.
+   \param[out] seq Set to the sequence number of the record if not zero.
+
+   \return One if a record was read, zero if there are no more synced
+   records yet and -1 for an error.  Errors include a record that does
+   not have the expected sequence number or a bad CRC, the reader stays
+   at that record.
+*/
+int8_t SdRecordReader::read(void* record, uint32_t* seq) {
+  if (!log_) {
+    return -1;
+  }
+  uint16_t size = log_->recordBytes();
+  if (!file_.isOpen()) {
+    // the log had no segment at the last seek()
+    if (log_->lastSegment_ == 0) {
+      return 0;
+    }
+    if (!seek(seq_)) {
+      return -1;
+    }
+  }
+  uint32_t pos = file_.curPosition();
+  if (pos + size > file_.fileSize()) {
+    if (seq_ >= log_->syncedSeq_) {
+      return 0;
+    }
+    // open the segment again for records synced since
+    if (!openSegment(segment_) || !file_.seekSet(pos)) {
+      return -1;
+    }
+    // else go on to the next segment with records, a power loss can
+    // leave one with only its header
+    while (pos + size > file_.fileSize()) {
+      if (segment_ == log_->lastSegment_) {
+        return 0;
+      }
+      if (!openSegment(segment_ + 1) || firstSeq_ != seq_) {
+        return -1;
+      }
+      pos = file_.curPosition();
+    }
+  }
+  if (SdRecordLog::readRecord(&file_, log_->recordSize_, salt_, seq_,
+                              record) <= 0) {
+    file_.seekSet(pos);
+    return -1;
+  }
+  if (seq) {
+    *seq = seq_;
+  }
+  seq_++;
+  return 1;
+}
+//------------------------------------------------------------------------------
+/**
+   Move to a record.  The segment is found with a binary search over the
+   segment headers, the record by its position in the segment.
+
+   \param[in] seq The record read() returns next.  A record that was
+   discarded is replaced by the oldest one, a record that was not synced
+   yet by the next one to be synced.
+
+   \return The value one, true, is returned for success and
+   the value zero, false, is returned for failure.
+   Reasons for failure include the reader is not open, a segment is
+   missing or an I/O error.
+*/
+uint8_t SdRecordReader::seek(uint32_t seq) {
+  record_log_header_t header;
+  if (!log_) {
+    return false;
+  }
+  if (file_.isOpen()) {
+    file_.close();
+  }
+  seq_ = seq;
+  uint32_t lo = log_->firstSegment_;
+  uint32_t hi = log_->lastSegment_;
+  if (lo == 0) {
+    return true;
+  }
+  // the last segment that starts at or before seq
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo + 1) / 2;
+    if (!log_->openSegment(&file_, mid, O_READ, &header)) {
+      return false;
+    }
+    file_.close();
+    if (header.firstSeq <= seq) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  if (!openSegment(lo)) {
+    return false;
+  }
+  uint16_t size = log_->recordBytes();
+  uint32_t count = (file_.fileSize() - sizeof(header)) / size;
+  if (seq < firstSeq_) {
+    seq = firstSeq_;
+  } else if (seq - firstSeq_ > count) {
+    seq = firstSeq_ + count;
+  }
+  seq_ = seq;
+  return file_.seekSet(sizeof(header) + (seq - firstSeq_) * size);
+}
@@ -0,0 +1,188 @@
+/* Arduino SdFat Library
+
+   This file is part of the Arduino SdFat Library
+
+   This Library is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This Library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with the Arduino SdFat Library.  If not, see
+   <http://www.gnu.org/licenses/>.
+*/
+#ifndef SdRecordLog_h
+#define SdRecordLog_h
+/**
+   \file
+   SdRecordLog and SdRecordReader classes
+*/
+#include "SdFat.h"
+//------------------------------------------------------------------------------
+/** "SLOG", first field of every segment */
+uint32_t const RECORD_LOG_MAGIC = 0X474F4C53;
+/** Highest segment number, segment names have five digits */
+uint32_t const RECORD_LOG_MAX_SEGMENT = 99999;
+//------------------------------------------------------------------------------
+/**
+   \struct record_log_header_t
+   \brief Start of each segment file of an SdRecordLog.
+
+   The records follow the header.  Each record is the 32-bit sequence
+   number, recordSize bytes of data and a CRC-16/XMODEM of both, started
+   with the segment's salt instead of zero.
+*/
+struct record_log_header_t {
+  /** RECORD_LOG_MAGIC */
+  uint32_t magic;
+  /** bytes of data in each record */
+  uint16_t recordSize;
+  /** random start value for the record CRCs of this segment */
+  uint16_t salt;
+  /** segment number, also part of the file name */
+  uint32_t segment;
+  /** sequence number of the first record in the segment */
+  uint32_t firstSeq;
+  /** zero */
+  uint16_t reserved;
+  /** CRC-16/XMODEM of the fields above */
+  uint16_t crc;
+};
+//------------------------------------------------------------------------------
+/**
+   \class SdRecordLog
+   \brief Append-only log of fixed size binary records on an SD card.
+
+   The records go to segment files in a directory.  Each segment is
+   named after a prefix and its number, such as LOG00001.LOG, and holds
+   up to segmentSize bytes.  A new segment is allocated with
+   SdFile::preAllocate() and erased if the card can, so appends stream to
+   the card without FAT updates.  The directory entry is only written by
+   sync(), rotation to a new segment and close().
+
+   After a power loss begin() scans the last segment past the size in its
+   directory entry.  Records that reached the card are kept as long as
+   their sequence numbers follow on and their CRCs are good, the first
+   torn or missing record ends the log.  A segment whose header never
+   reached the card is removed and the log goes on from the one before.
+
+   Records are visible to an SdRecordReader once sync() wrote them.
+*/
+class SdRecordLog {
+  public:
+    /** Create an SdRecordLog that is not open. */
+    SdRecordLog(void) : dir_(0) {}
+    uint8_t append(const void* record);
+    uint8_t begin(SdFile* dir, const char* prefix, uint16_t recordSize,
+                  uint32_t segmentSize);
+    uint8_t close(void);
+    uint8_t discard(uint32_t seq);
+    /** \return The number of the oldest segment, zero if there is none. */
+    uint32_t firstSegment(void) const {
+      return firstSegment_;
+    }
+    /** \return True if begin() succeeded and close() was not called. */
+    uint8_t isOpen(void) const {
+      return dir_ != 0;
+    }
+    /** \return The number of the newest segment, zero if there is none. */
+    uint32_t lastSegment(void) const {
+      return lastSegment_;
+    }
+    /** \return The sequence number the next append() gives its record. */
+    uint32_t nextSeq(void) const {
+      return nextSeq_;
+    }
+    /** \return Bytes of data in each record. */
+    uint16_t recordSize(void) const {
+      return recordSize_;
+    }
+    /**
+       \return The number of records begin() found past the size in the
+       directory entry of the last segment, written after the last sync()
+       before a power loss.
+    */
+    uint32_t recovered(void) const {
+      return recovered_;
+    }
+    void segmentName(uint32_t segment, char* name) const;
+    uint8_t sync(void);
+    /** \return The sequence number after the last record sync() wrote. */
+    uint32_t syncedSeq(void) const {
+      return syncedSeq_;
+    }
+
+  private:
+    friend class SdRecordReader;
+    // bytes per record with sequence number and CRC
+    uint16_t recordBytes(void) const {
+      return recordSize_ + 6;
+    }
+    static uint16_t crc16(uint16_t crc, const void* buf, uint16_t n);
+    static uint8_t headerValid(const record_log_header_t* header,
+                               uint32_t segment);
+    uint8_t openSegment(SdFile* file, uint32_t segment, uint8_t oflag,
+                        record_log_header_t* header);
+    static int8_t readRecord(SdFile* file, uint16_t size, uint16_t salt,
+                             uint32_t seq, void* record);
+    uint8_t recover(void);
+    uint32_t segmentNumber(const uint8_t* name) const;
+    uint8_t startSegment(void);
+    uint8_t syncRecords(void);
+
+    SdFile*  dir_;           // directory with the segments, zero if closed
+    SdFile   file_;          // newest segment, open while it has room
+    char     prefix_[4];     // first part of the segment names
+    uint16_t recordSize_;    // bytes of data per record
+    uint16_t salt_;          // CRC start value for records in file_
+    uint32_t segmentSize_;   // bytes per segment with header
+    uint32_t firstSegment_;  // oldest segment, zero if none
+    uint32_t lastSegment_;   // newest segment, zero if none
+    uint32_t nextSeq_;       // sequence number of the next record
+    uint32_t syncedSeq_;     // records before this one are on the card
+    uint32_t recovered_;     // records found past the synced size
+};
+//------------------------------------------------------------------------------
+/**
+   \class SdRecordReader
+   \brief Reads the records of an SdRecordLog in order, for replay or
+   upload.
+
+   A reader follows the log across segments and finds a sequence number
+   with a binary search over the segment headers and a seek, it does not
+   read the records before it.  It may be used while the log is appended
+   to, records show up once the log's sync() wrote them.
+*/
+class SdRecordReader {
+  public:
+    /** Create an SdRecordReader that is not open. */
+    SdRecordReader(void) : log_(0) {}
+    uint8_t begin(SdRecordLog* log, uint32_t seq = 0);
+    /** Stop reading. */
+    void close(void) {
+      file_.close();
+      log_ = 0;
+    }
+    /** \return The sequence number of the record read() returns next. */
+    uint32_t nextSeq(void) const {
+      return seq_;
+    }
+    int8_t read(void* record, uint32_t* seq = 0);
+    uint8_t seek(uint32_t seq);
+
+  private:
+    uint8_t openSegment(uint32_t segment);
+
+    SdRecordLog* log_;  // log to read, zero if closed
+    SdFile file_;       // segment being read
+    uint32_t segment_;  // number of that segment
+    uint32_t firstSeq_; // sequence number of its first record
+    uint32_t seq_;      // sequence number of the next record
+    uint16_t salt_;     // CRC start value for its records
+};
+#endif  // SdRecordLog_h
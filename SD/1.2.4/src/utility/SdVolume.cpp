@@ -20,12 +20,16 @@
 #include "SdFat.h"
 //------------------------------------------------------------------------------
 // raw block cache
-// init cacheBlockNumber_to invalid SD block number
-uint32_t SdVolume::cacheBlockNumber_ = 0XFFFFFFFF;
-cache_t  SdVolume::cacheBuffer_;     // 512 byte cache for Sd2Card
+cache_t  SdVolume::cacheBuffer_[SD_CACHE_WAYS];       // blocks for Sd2Card
+uint32_t SdVolume::cacheBlockNumber_[SD_CACHE_WAYS];  // set by cacheInit()
+uint32_t SdVolume::cacheMirrorBlock_[SD_CACHE_WAYS];  // mirror blocks for second FAT
+uint8_t  SdVolume::cacheStatus_[SD_CACHE_WAYS];       // dirty, kind and pinned bits
+uint8_t  SdVolume::cacheRank_[SD_CACHE_WAYS];         // LRU order of the ways
+uint8_t  SdVolume::cacheCurrent_ = 0;                 // way of the last block cached
+uint8_t  SdVolume::cachePin_ = CACHE_PIN_FAT | CACHE_PIN_DIR;
 Sd2Card* SdVolume::sdCard_;          // pointer to SD card object
-uint8_t  SdVolume::cacheDirty_ = 0;  // cacheFlush() will write block if true
-uint32_t SdVolume::cacheMirrorBlock_ = 0;  // mirror  block for second FAT
+uint32_t SdVolume::blockReads_ = 0;
+uint32_t SdVolume::blockWrites_ = 0;
 //------------------------------------------------------------------------------
 // find a contiguous group of clusters
 uint8_t SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
@@ -109,60 +113,183 @@ uint8_t SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
 }
 //------------------------------------------------------------------------------
 uint8_t SdVolume::cacheFlush(uint8_t blocking) {
-  if (cacheDirty_) {
-    if (!sdCard_->writeBlock(cacheBlockNumber_, cacheBuffer_.data, blocking)) {
-      return false;
+  for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+    if (cacheStatus_[i] & CACHE_FOR_WRITE) {
+      if (!writeBlock(cacheBlockNumber_[i], cacheBuffer_[i].data, blocking)) {
+        return false;
+      }
+
+      // only start one write
+      if (!blocking) {
+        return true;
+      }
+      cacheStatus_[i] &= ~CACHE_FOR_WRITE;
     }
-
-    if (!blocking) {
-      return true;
+  }
+  // mirror FAT tables
+  return cacheMirrorBlockFlush(blocking);
+}
+//------------------------------------------------------------------------------
+// empty all ways, forget dirty blocks of a previous card
+void SdVolume::cacheInit(void) {
+  for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+    cacheBlockNumber_[i] = 0XFFFFFFFF;
+    cacheMirrorBlock_[i] = 0;
+    cacheStatus_[i] = 0;
+    cacheRank_[i] = i;
+  }
+  cacheCurrent_ = 0;
+}
+//------------------------------------------------------------------------------
+// drop a block that is written to the card without the cache
+void SdVolume::cacheInvalidate(uint32_t blockNumber) {
+  uint8_t i = cacheWay(blockNumber);
+  if (i != SD_CACHE_WAYS) {
+    cacheBlockNumber_[i] = 0XFFFFFFFF;
+    cacheStatus_[i] = 0;
+  }
+}
+//------------------------------------------------------------------------------
+uint8_t SdVolume::cacheMirrorBlockFlush(uint8_t blocking) {
+  for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+    if (cacheMirrorBlock_[i]) {
+      if (!writeBlock(cacheMirrorBlock_[i], cacheBuffer_[i].data, blocking)) {
+        return false;
+      }
+      cacheMirrorBlock_[i] = 0;
+      if (!blocking) {
+        return true;
+      }
     }
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+/**
+   Select the blocks that stay in the cache while file data passes
+   through it.  Pinned blocks are only replaced by blocks of the same
+   kind, and at most half the ways are pinned, so pinning needs
+   SD_CACHE_WAYS of two or more.  FAT and directory blocks are pinned
+   by default.
 
-    // mirror FAT tables
-    if (!cacheMirrorBlockFlush(blocking)) {
-      return false;
+   \param[in] flags Zero or more of CACHE_PIN_FAT and CACHE_PIN_DIR.
+*/
+void SdVolume::cachePin(uint8_t flags) {
+  cachePin_ = flags & (CACHE_PIN_FAT | CACHE_PIN_DIR);
+  for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+    cacheStatus_[i] &= ~CACHE_STATUS_PINNED;
+  }
+}
+//------------------------------------------------------------------------------
+// return the way holding blockNumber, loading it if needed
+// action is CACHE_FOR_READ or CACHE_FOR_WRITE, with CACHE_OPTION_NO_READ
+// and the CACHE_PIN_ kind of the block
+cache_t* SdVolume::cacheRawBlock(uint32_t blockNumber, uint8_t action) {
+  uint8_t way = cacheCurrent_;
+  if (cacheBlockNumber_[way] != blockNumber) {
+    way = cacheWay(blockNumber);
+    if (way == SD_CACHE_WAYS) {
+      way = cacheVictim(action & (CACHE_PIN_FAT | CACHE_PIN_DIR));
+      if (!cacheWayFlush(way)) {
+        return NULL;
+      }
+      if (!(action & CACHE_OPTION_NO_READ)) {
+        if (!readBlock(blockNumber, cacheBuffer_[way].data)) {
+          cacheBlockNumber_[way] = 0XFFFFFFFF;
+          return NULL;
+        }
+      }
+      cacheBlockNumber_[way] = blockNumber;
+    }
+    // move way to the front of the LRU order
+    for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+      if (cacheRank_[i] < cacheRank_[way]) {
+        cacheRank_[i]++;
+      }
     }
-    cacheDirty_ = 0;
+    cacheRank_[way] = 0;
+    cacheCurrent_ = way;
   }
-  return true;
+  cacheStatus_[way] |= action & CACHE_FOR_WRITE;
+  return &cacheBuffer_[way];
 }
 //------------------------------------------------------------------------------
-uint8_t SdVolume::cacheMirrorBlockFlush(uint8_t blocking) {
-  if (cacheMirrorBlock_) {
-    if (!sdCard_->writeBlock(cacheMirrorBlock_, cacheBuffer_.data, blocking)) {
-      return false;
+// choose the way for a new block of a kind, least recently used first
+// A block of a pinned kind takes an unpinned way while less than half the
+// ways are pinned, after that it replaces a pinned block of its kind.  FAT
+// blocks may also replace pinned directory blocks, appends need them more.
+uint8_t SdVolume::cacheVictim(uint8_t kind) {
+  uint8_t pin = kind & cachePin_ ? CACHE_STATUS_PINNED : 0;
+  uint8_t pinned = 0;
+  for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+    if (cacheStatus_[i] & CACHE_STATUS_PINNED) {
+      pinned++;
     }
-    cacheMirrorBlock_ = 0;
   }
-  return true;
+  uint8_t victim = SD_CACHE_WAYS;
+  if (pin && pinned >= SD_CACHE_WAYS / 2) {
+    for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+      if ((cacheStatus_[i] & CACHE_STATUS_PINNED)
+          && (cacheStatus_[i] & (CACHE_PIN_FAT | CACHE_PIN_DIR)) >= kind
+          && (victim == SD_CACHE_WAYS || cacheRank_[i] > cacheRank_[victim])) {
+        victim = i;
+      }
+    }
+  }
+  if (victim == SD_CACHE_WAYS) {
+    if (pinned >= SD_CACHE_WAYS / 2) {
+      pin = 0;
+    }
+    for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+      if (!(cacheStatus_[i] & CACHE_STATUS_PINNED)
+          && (victim == SD_CACHE_WAYS || cacheRank_[i] > cacheRank_[victim])) {
+        victim = i;
+      }
+    }
+  }
+  // flags for the new block, dirty is kept for cacheWayFlush()
+  cacheStatus_[victim] = (cacheStatus_[victim] & CACHE_FOR_WRITE) | kind | pin;
+  return victim;
+}
+//------------------------------------------------------------------------------
+// return the way holding blockNumber or SD_CACHE_WAYS if none
+uint8_t SdVolume::cacheWay(uint32_t blockNumber) {
+  for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+    if (cacheBlockNumber_[i] == blockNumber) {
+      return i;
+    }
+  }
+  return SD_CACHE_WAYS;
 }
 //------------------------------------------------------------------------------
-uint8_t SdVolume::cacheRawBlock(uint32_t blockNumber, uint8_t action) {
-  if (cacheBlockNumber_ != blockNumber) {
-    if (!cacheFlush()) {
+// write a way and its FAT mirror block before it is reused
+uint8_t SdVolume::cacheWayFlush(uint8_t way) {
+  if (cacheStatus_[way] & CACHE_FOR_WRITE) {
+    if (!writeBlock(cacheBlockNumber_[way], cacheBuffer_[way].data)) {
       return false;
     }
-    if (!sdCard_->readBlock(blockNumber, cacheBuffer_.data)) {
+    cacheStatus_[way] &= ~CACHE_FOR_WRITE;
+  }
+  if (cacheMirrorBlock_[way]) {
+    if (!writeBlock(cacheMirrorBlock_[way], cacheBuffer_[way].data)) {
       return false;
     }
-    cacheBlockNumber_ = blockNumber;
+    cacheMirrorBlock_[way] = 0;
   }
-  cacheDirty_ |= action;
   return true;
 }
 //------------------------------------------------------------------------------
 // cache a zero block for blockNumber
 uint8_t SdVolume::cacheZeroBlock(uint32_t blockNumber) {
-  if (!cacheFlush()) {
+  cache_t* pc = cacheRawBlock(blockNumber, CACHE_RESERVE_FOR_WRITE);
+  if (!pc) {
     return false;
   }
 
-  // loop take less flash than memset(cacheBuffer_.data, 0, 512);
+  // loop take less flash than memset(pc->data, 0, 512);
   for (uint16_t i = 0; i < 512; i++) {
-    cacheBuffer_.data[i] = 0;
+    pc->data[i] = 0;
   }
-  cacheBlockNumber_ = blockNumber;
-  cacheSetDirty();
   return true;
 }
 //------------------------------------------------------------------------------
@@ -179,6 +306,18 @@ uint8_t SdVolume::chainSize(uint32_t cluster, uint32_t* size) const {
   return true;
 }
 //------------------------------------------------------------------------------
+// erase a range of blocks on the card, cached copies are dropped
+uint8_t SdVolume::eraseBlocks(uint32_t firstBlock, uint32_t lastBlock) {
+  for (uint8_t i = 0; i < SD_CACHE_WAYS; i++) {
+    if (cacheBlockNumber_[i] >= firstBlock
+        && cacheBlockNumber_[i] <= lastBlock) {
+      cacheBlockNumber_[i] = 0XFFFFFFFF;
+      cacheStatus_[i] = 0;
+    }
+  }
+  return sdCard_->erase(firstBlock, lastBlock);
+}
+//------------------------------------------------------------------------------
 // Fetch a FAT entry
 uint8_t SdVolume::fatGet(uint32_t cluster, uint32_t* value) const {
   if (cluster > (clusterCount_ + 1)) {
@@ -186,15 +325,14 @@ uint8_t SdVolume::fatGet(uint32_t cluster, uint32_t* value) const {
   }
   uint32_t lba = fatStartBlock_;
   lba += fatType_ == 16 ? cluster >> 8 : cluster >> 7;
-  if (lba != cacheBlockNumber_) {
-    if (!cacheRawBlock(lba, CACHE_FOR_READ)) {
-      return false;
-    }
+  cache_t* pc = cacheRawBlock(lba, CACHE_FOR_READ | CACHE_PIN_FAT);
+  if (!pc) {
+    return false;
   }
   if (fatType_ == 16) {
-    *value = cacheBuffer_.fat16[cluster & 0XFF];
+    *value = pc->fat16[cluster & 0XFF];
   } else {
-    *value = cacheBuffer_.fat32[cluster & 0X7F] & FAT32MASK;
+    *value = pc->fat32[cluster & 0X7F] & FAT32MASK;
   }
   return true;
 }
@@ -215,22 +353,20 @@ uint8_t SdVolume::fatPut(uint32_t cluster, uint32_t value) {
   uint32_t lba = fatStartBlock_;
   lba += fatType_ == 16 ? cluster >> 8 : cluster >> 7;
 
-  if (lba != cacheBlockNumber_) {
-    if (!cacheRawBlock(lba, CACHE_FOR_READ)) {
-      return false;
-    }
+  cache_t* pc = cacheRawBlock(lba, CACHE_FOR_WRITE | CACHE_PIN_FAT);
+  if (!pc) {
+    return false;
   }
   // store entry
   if (fatType_ == 16) {
-    cacheBuffer_.fat16[cluster & 0XFF] = value;
+    pc->fat16[cluster & 0XFF] = value;
   } else {
-    cacheBuffer_.fat32[cluster & 0X7F] = value;
+    pc->fat32[cluster & 0X7F] = value;
   }
-  cacheSetDirty();
 
   // mirror second FAT
   if (fatCount_ > 1) {
-    cacheMirrorBlock_ = lba + blocksPerFat_;
+    cacheMirrorBlock_[cacheCurrent_] = lba + blocksPerFat_;
   }
   return true;
 }
@@ -257,6 +393,35 @@ uint8_t SdVolume::freeChain(uint32_t cluster) {
   return true;
 }
 //------------------------------------------------------------------------------
+// read whole blocks for the caller with one multiple block read, continuing
+// the open one if it stopped just before block
+uint8_t SdVolume::readBlocks(uint32_t block, uint8_t* dst, uint16_t count) {
+  if (sdCard_->readNextBlock() != block && !sdCard_->readStart(block)) {
+    return false;
+  }
+  for (; count > 0; count--, dst += 512) {
+    blockReads_++;
+    if (!sdCard_->readData(dst)) {
+      return false;
+    }
+  }
+  return true;
+}
+//------------------------------------------------------------------------------
+// write a block of a pre-allocated contiguous file, continuing the open
+// multiple block write if it stopped just before this block
+uint8_t SdVolume::writeContiguous(uint32_t block, const uint8_t* src,
+                                  uint32_t endBlock) {
+  if (sdCard_->writeNextBlock() != block) {
+    // pre-erase the rest of the allocation
+    if (!sdCard_->writeStart(block, endBlock - block)) {
+      return false;
+    }
+  }
+  blockWrites_++;
+  return sdCard_->writeData(src);
+}
+//------------------------------------------------------------------------------
 /**
    Initialize a FAT volume.
 
@@ -275,16 +440,18 @@ uint8_t SdVolume::freeChain(uint32_t cluster) {
 uint8_t SdVolume::init(Sd2Card* dev, uint8_t part) {
   uint32_t volumeStartBlock = 0;
   sdCard_ = dev;
+  cacheInit();
   // if part == 0 assume super floppy with FAT boot sector in block zero
   // if part > 0 assume mbr volume with partition table
   if (part) {
     if (part > 4) {
       return false;
     }
-    if (!cacheRawBlock(volumeStartBlock, CACHE_FOR_READ)) {
+    cache_t* pc = cacheRawBlock(volumeStartBlock, CACHE_FOR_READ);
+    if (!pc) {
       return false;
     }
-    part_t* p = &cacheBuffer_.mbr.part[part - 1];
+    part_t* p = &pc->mbr.part[part - 1];
     if ((p->boot & 0X7F) != 0  ||
         p->totalSectors < 100 ||
         p->firstSector == 0) {
@@ -293,10 +460,11 @@ uint8_t SdVolume::init(Sd2Card* dev, uint8_t part) {
     }
     volumeStartBlock = p->firstSector;
   }
-  if (!cacheRawBlock(volumeStartBlock, CACHE_FOR_READ)) {
+  cache_t* pc = cacheRawBlock(volumeStartBlock, CACHE_FOR_READ);
+  if (!pc) {
     return false;
   }
-  bpb_t* bpb = &cacheBuffer_.fbs.bpb;
+  bpb_t* bpb = &pc->fbs.bpb;
   if (bpb->bytesPerSector != 512 ||
       bpb->fatCount == 0 ||
       bpb->reservedSectorCount == 0 ||
@@ -0,0 +1,158 @@
+// This sketch demonstrates queueing timestamped telemetry while the
+// GSM link is down and sending it in batches using ThingsBoard SDK
+//
+// Hardware:
+//  - Arduino Uno
+//  - SIM900 Arduino shield connected to Arduino Uno
+//  - SD card module, chip select on pin 4
+
+// Select your modem:
+#define TINY_GSM_MODEM_SIM800
+// #define TINY_GSM_MODEM_SIM808
+// #define TINY_GSM_MODEM_SIM900
+// #define TINY_GSM_MODEM_UBLOX
+// #define TINY_GSM_MODEM_BG96
+
+#include <TinyGsmClient.h>
+#include <SoftwareSerial.h>
+#include <TimeLib.h>
+#include "ThingsBoard.h"
+#include "ThingsBoardBatch.h"
+#include "ThingsBoardSdSpill.h"
+
+// Your GPRS credentials
+// Leave empty, if missing user or pass
+const char apn[]  = "internet";
+const char user[] = "";
+const char pass[] = "";
+
+// See https://thingsboard.io/docs/getting-started-guides/helloworld/
+// to understand how to obtain an access token
+#define TOKEN               "YOUR_ACCESS_TOKEN"
+#define THINGSBOARD_SERVER  "demo.thingsboard.io"
+
+// Baud rate for debug serial
+#define SERIAL_DEBUG_BAUD   115200
+
+// SD card chip select pin
+#define SD_CS_PIN           4
+
+// Seconds between readings and between upload attempts
+#define SAMPLE_INTERVAL     60
+#define UPLOAD_INTERVAL     900
+
+// Serial port for GSM shield
+SoftwareSerial serialGsm(7, 8); // RX, TX pins for communicating with modem
+
+// Initialize GSM modem
+TinyGsm modem(serialGsm);
+
+// Initialize GSM client
+TinyGsmClient client(modem);
+
+// Initialize ThingsBoard instance
+ThingsBoard tb(client);
+
+// Telemetry keys that can be queued
+const char *keys[] = { "temperature", "humidity" };
+
+// Queue of 16 readings in RAM, older ones go to the SD card
+ThingsBoardBatch<16, ThingsBoardSdSpill> batch(keys, 2, ThingsBoardSdSpill("tb.bin"));
+
+time_t lastSample = 0;
+time_t lastUpload = 0;
+
+// Clock source for TimeLib: the network time of the modem, in UTC
+time_t modemTime() {
+  int year, month, day, hour, minute, second;
+  float timezone;
+  if (!modem.getNetworkTime(&year, &month, &day, &hour, &minute, &second, &timezone)) {
+    return 0;
+  }
+  tmElements_t tm;
+  tm.Year = CalendarYrToTm(year);
+  tm.Month = month;
+  tm.Day = day;
+  tm.Hour = hour;
+  tm.Minute = minute;
+  tm.Second = second;
+  return makeTime(tm) - (long)(timezone * SECS_PER_HOUR);
+}
+
+// Brings up GPRS and the ThingsBoard connection, returns true on success
+bool uplink() {
+  if (!modem.isGprsConnected()) {
+    Serial.print(F("Connecting to "));
+    Serial.print(apn);
+    if (!modem.waitForNetwork() || !modem.gprsConnect(apn, user, pass)) {
+      Serial.println(F(" fail"));
+      return false;
+    }
+    Serial.println(F(" OK"));
+  }
+  if (!tb.connected() && !tb.connect(THINGSBOARD_SERVER, TOKEN)) {
+    Serial.println(F("Failed to connect"));
+    return false;
+  }
+  return true;
+}
+
+void setup() {
+  // Set console baud rate
+  Serial.begin(SERIAL_DEBUG_BAUD);
+
+  // Set GSM module baud rate
+  serialGsm.begin(115200);
+  delay(3000);
+
+  // Lower baud rate of the modem.
+  // This is highly practical for Uno board, since SoftwareSerial there
+  // works too slow to receive a modem data.
+  serialGsm.write("AT+IPR=9600\r\n");
+  serialGsm.end();
+  serialGsm.begin(9600);
+
+  Serial.println(F("Initializing modem..."));
+  modem.restart();
+
+  // Readings spilled before a reset are sent with the next batch
+  if (SD.begin(SD_CS_PIN)) {
+    batch.spill().begin();
+  } else {
+    Serial.println(F("No SD card, keeping readings in RAM only"));
+  }
+
+  setSyncProvider(modemTime);
+}
+
+void loop() {
+  delay(1000);
+
+  if (timeStatus() == timeNotSet) {
+    // Timestamps are needed before anything can be queued
+    now();
+    return;
+  }
+
+  if (now() - lastSample >= SAMPLE_INTERVAL) {
+    lastSample = now();
+    batch.add(Telemetry("temperature", 22.5f));
+    batch.add(Telemetry("humidity", 42));
+  }
+
+  if (now() - lastUpload >= UPLOAD_INTERVAL) {
+    lastUpload = now();
+    Serial.print(F("Sending "));
+    Serial.print(batch.size());
+    Serial.println(F(" readings..."));
+
+    // Everything queued goes out in as few publishes as possible
+    if (uplink() && tb.sendTelemetryBatch(batch)) {
+      Serial.println(F("Done"));
+    }
+    tb.loop();
+
+    // Radio off until the next upload
+    modem.gprsDisconnect();
+  }
+}
@@ -29,26 +29,69 @@ bool Telemetry::serializeKeyval(JsonVariant &jsonObj) const {
       break;
     }
   } else {
-    switch (m_type) {
-      case TYPE_BOOL:
-        return jsonObj.set(m_value.boolean);
-      break;
-      case TYPE_INT:
-        return jsonObj.set(m_value.integer);
-      break;
-      case TYPE_REAL:
-        return jsonObj.set(m_value.real);
-      break;
-      case TYPE_STR:
-        return jsonObj.set(m_value.str);
-      break;
-      default:
-      break;
-    }
+    return serializeValue(jsonObj);
+  }
+  return true;
+}
+
+bool Telemetry::serializeValue(JsonVariant &jsonObj) const {
+  switch (m_type) {
+    case TYPE_BOOL:
+      return jsonObj.set(m_value.boolean);
+    break;
+    case TYPE_INT:
+      return jsonObj.set(m_value.integer);
+    break;
+    case TYPE_REAL:
+      return jsonObj.set(m_value.real);
+    break;
+    case TYPE_STR:
+      return jsonObj.set(m_value.str);
+    break;
+    default:
+    break;
   }
   return true;
 }
 
+size_t Telemetry::serializeKeyval(Print *out) const {
+  // The document only ever holds one scalar, so its size does not depend
+  // on how many fields the caller streams.
+  StaticJsonDocument<JSON_OBJECT_SIZE(1)> jsonBuffer;
+  JsonVariant value = jsonBuffer.to<JsonVariant>();
+  size_t len = 0;
+
+  if (m_key) {
+    // Going through ArduinoJson keeps the key escaped exactly as before
+    value.set(m_key);
+    len += out ? serializeJson(value, *out) : measureJson(value);
+    len += out ? out->write(':') : 1;
+  }
+  if (serializeValue(value) == false) {
+    return 0;
+  }
+  len += out ? serializeJson(value, *out) : measureJson(value);
+  return len;
+}
+
+size_t Telemetry::serializeKeyvalMsgPack(Print *out, int key_id) const {
+  StaticJsonDocument<JSON_OBJECT_SIZE(1)> jsonBuffer;
+  JsonVariant value = jsonBuffer.to<JsonVariant>();
+  size_t len = 0;
+
+  if (key_id >= 0) {
+    value.set(key_id);
+  } else {
+    value.set(m_key);
+  }
+  len += out ? serializeMsgPack(value, *out) : measureMsgPack(value);
+  if (serializeValue(value) == false) {
+    return 0;
+  }
+  len += out ? serializeMsgPack(value, *out) : measureMsgPack(value);
+  return len;
+}
+
 void ThingsBoardDefaultLogger::log(const char *msg) {
   Serial.print(F("[TB] "));
   Serial.println(msg);
@@ -17,21 +17,40 @@
 
 #define Default_Payload 64
 #define Default_Fields_Amt 8
+#define Default_Write_Chunk 32
+#define Default_Batch_Payload 1024
 
 class ThingsBoardDefaultLogger;
+class ThingsBoardJson;
+
+// Default template arguments may not appear on friend declarations, so the
+// client classes are declared with them up front.
+template <size_t PayloadSize = Default_Payload,
+          size_t MaxFieldsAmt = Default_Fields_Amt,
+          typename Logger = ThingsBoardDefaultLogger,
+          typename Encoding = ThingsBoardJson>
+class ThingsBoardSized;
+#ifndef ESP8266
+template <size_t PayloadSize = Default_Payload,
+          size_t MaxFieldsAmt = Default_Fields_Amt,
+          typename Logger = ThingsBoardDefaultLogger>
+class ThingsBoardHttpSized;
+#endif
+template <size_t Records, typename Spill>
+class ThingsBoardBatch;
 
 // Telemetry record class, allows to store different data using common interface.
 class Telemetry {
-  template <size_t PayloadSize = Default_Payload,
-            size_t MaxFieldsAmt = Default_Fields_Amt,
-            typename Logger = ThingsBoardDefaultLogger>
+  template <size_t PayloadSize, size_t MaxFieldsAmt, typename Logger, typename Encoding>
   friend class ThingsBoardSized;
 #ifndef ESP8266
-  template <size_t PayloadSize = Default_Payload,
-            size_t MaxFieldsAmt = Default_Fields_Amt,
-            typename Logger = ThingsBoardDefaultLogger>
+  template <size_t PayloadSize, size_t MaxFieldsAmt, typename Logger>
   friend class ThingsBoardHttpSized;
 #endif
+  template <size_t Records, typename Spill>
+  friend class ThingsBoardBatch;
+  friend class ThingsBoardJson;
+  friend class ThingsBoardMsgPack;
 public:
   inline Telemetry()
     :m_type(TYPE_NONE), m_key(NULL), m_value() { }
@@ -81,6 +100,17 @@ private:
 
   // Serializes key-value pair in a generic way.
   bool serializeKeyval(JsonVariant &jsonObj) const;
+
+  // Writes the pair as JSON text ("key":value) to out, or only measures it
+  // if out is NULL. Returns the length, 0 if the value cannot be serialized.
+  size_t serializeKeyval(Print *out) const;
+
+  // Same as above, but writes the pair as MessagePack. The key goes out as
+  // the integer key_id instead of the string, unless key_id is negative.
+  size_t serializeKeyvalMsgPack(Print *out, int key_id) const;
+
+  // Serializes the value alone.
+  bool serializeValue(JsonVariant &jsonObj) const;
 };
 
 // Convenient aliases
@@ -92,7 +122,7 @@ using RPC_Data = JsonVariant;
 
 // RPC callback wrapper
 class RPC_Callback {
-  template <size_t PayloadSize, size_t MaxFieldsAmt, typename Logger>
+  template <size_t PayloadSize, size_t MaxFieldsAmt, typename Logger, typename Encoding>
   friend class ThingsBoardSized;
 public:
 
@@ -119,13 +149,162 @@ public:
   static void log(const char *msg);
 };
 
+// Collects small writes into a chunk before passing them on. PubSubClient
+// hands every write() of a streamed publish straight to the network client,
+// so JSON written a few characters at a time would otherwise become that
+// many socket (or modem) sends.
+template <size_t ChunkSize = Default_Write_Chunk>
+class ThingsBoardChunkWriter : public Print
+{
+public:
+  inline ThingsBoardChunkWriter(Print &out)
+    :m_out(out), m_len(0), m_written(0) { }
+
+  size_t write(uint8_t c) {
+    if (m_len == ChunkSize) {
+      sendChunk();
+    }
+    m_chunk[m_len++] = c;
+    return 1;
+  }
+
+  size_t write(const uint8_t *buffer, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      write(buffer[i]);
+    }
+    return size;
+  }
+
+  // Passes on what is left, returns the total amount the output accepted.
+  size_t finish() {
+    sendChunk();
+    return m_written;
+  }
+
+private:
+  void sendChunk() {
+    if (m_len) {
+      m_written += m_out.write(m_chunk, m_len);
+      m_len = 0;
+    }
+  }
+
+  Print   &m_out;                // Destination
+  uint8_t m_chunk[ChunkSize];    // Pending bytes
+  size_t  m_len;                 // Amount of pending bytes
+  size_t  m_written;             // Bytes accepted by the destination
+};
+
+// Telemetry and attribute encodings, passed as the fourth parameter of
+// ThingsBoardSized. An encoding writes the fields as one object to out, or
+// only measures it if out is NULL, and returns the length, 0 if a field
+// cannot be serialized. keys is the table set with setKeyDictionary(),
+// NULL if there is none.
+
+// JSON text, as the ThingsBoard MQTT API expects. The key table is not used.
+class ThingsBoardJson
+{
+public:
+  static size_t serialize(Print *out, const Telemetry *data, size_t data_count,
+                          const char *const * /*keys*/, size_t /*key_count*/) {
+    size_t len = out ? out->write('{') : 1;
+    bool first = true;
+    for (size_t i = 0; i < data_count; ++i) {
+      // Same fields as a JsonObject would keep: no keyless or empty entries
+      if (!isField(data[i])) {
+        continue;
+      }
+      if (!first) {
+        len += out ? out->write(',') : 1;
+      }
+      first = false;
+      size_t field = data[i].serializeKeyval(out);
+      if (!field) {
+        return 0;
+      }
+      len += field;
+    }
+    len += out ? out->write('}') : 1;
+    return len;
+  }
+
+  static bool isField(const Telemetry &t) {
+    return t.m_key && t.m_type != Telemetry::TYPE_NONE;
+  }
+};
+
+// MessagePack (msgpack.org): a map of the same fields, numbers sent in
+// binary instead of as text. A key found in the table goes out as its index
+// (one byte, for the first 128 keys) instead of the string. ThingsBoard
+// itself only parses JSON, so this is meant for a broker-side converter or
+// gateway that decodes the map with the same key table.
+class ThingsBoardMsgPack
+{
+public:
+  static size_t serialize(Print *out, const Telemetry *data, size_t data_count,
+                          const char *const *keys, size_t key_count) {
+    size_t fields = 0;
+    for (size_t i = 0; i < data_count; ++i) {
+      if (ThingsBoardJson::isField(data[i])) {
+        ++fields;
+      }
+    }
+    if (fields > 0xFFFF) {
+      return 0;
+    }
+
+    size_t len;
+    if (fields < 16) {
+      // fixmap
+      len = out ? out->write((uint8_t)(0x80 | fields)) : 1;
+    } else {
+      // map 16
+      uint8_t header[3] = { 0xDE, (uint8_t)(fields >> 8), (uint8_t)fields };
+      len = out ? out->write(header, sizeof(header)) : sizeof(header);
+    }
+
+    for (size_t i = 0; i < data_count; ++i) {
+      if (!ThingsBoardJson::isField(data[i])) {
+        continue;
+      }
+      size_t field = data[i].serializeKeyvalMsgPack(out,
+                       keyId(data[i].m_key, keys, key_count));
+      if (!field) {
+        return 0;
+      }
+      len += field;
+    }
+    return len;
+  }
+
+  // Index of key in the table, -1 if it is not among the first 128 entries.
+  static int keyId(const char *key, const char *const *keys, size_t key_count) {
+    if (key_count > 128) {
+      key_count = 128;
+    }
+    // Keys usually come from the table itself, so compare pointers first
+    for (size_t i = 0; i < key_count; ++i) {
+      if (keys[i] == key) {
+        return i;
+      }
+    }
+    for (size_t i = 0; i < key_count; ++i) {
+      if (strcmp(keys[i], key) == 0) {
+        return i;
+      }
+    }
+    return -1;
+  }
+};
+
 // ThingsBoardSized client class
-template <size_t PayloadSize, size_t MaxFieldsAmt, typename Logger>
+template <size_t PayloadSize, size_t MaxFieldsAmt, typename Logger, typename Encoding>
 class ThingsBoardSized
 {
 public:
   // Initializes ThingsBoardSized class with network client.
-  inline ThingsBoardSized(Client &client) :m_client(client) { }
+  inline ThingsBoardSized(Client &client)
+    :m_client(client), m_keys(NULL), m_keyCount(0) { }
 
   // Destroys ThingsBoardSized class with network client.
   inline ~ThingsBoardSized() { }
@@ -157,6 +336,14 @@ public:
     m_client.loop();
   }
 
+  // Sets the key table the encoding may use to shorten keys. Only the
+  // pointer is kept, so the table must outlive the client. Pass NULL to
+  // send every key in full again.
+  inline void setKeyDictionary(const char *const *keys, size_t key_count) {
+    m_keys = keys;
+    m_keyCount = keys ? key_count : 0;
+  }
+
   //----------------------------------------------------------------------------
   // Telemetry API
 
@@ -185,6 +372,38 @@ public:
     return sendDataArray(data, data_count);
   }
 
+  // Sends the readings queued in a ThingsBoardBatch, oldest first, as
+  // JSON arrays of at most maxLen bytes. Readings are taken off the queue
+  // once their publish went out. Returns true if the queue was emptied.
+  template <typename Batch>
+  bool sendTelemetryBatch(Batch &batch, size_t maxLen = Default_Batch_Payload) {
+    while (batch.size()) {
+      size_t len;
+      uint32_t count = batch.fit(maxLen, len);
+      if (!count) {
+        Logger::log("unable to read queued data");
+        return false;
+      }
+      if (!m_client.beginPublish("v1/devices/me/telemetry", len, false)) {
+        return false;
+      }
+      ThingsBoardChunkWriter<> out(m_client);
+      batch.serialize(&out, count);
+      if (out.finish() != len) {
+        // Same as in sendDataArray(): the packet is cut short, so drop the
+        // connection. The readings stay queued for the next call.
+        Logger::log("unable to send data");
+        m_client.disconnect();
+        return false;
+      }
+      if (!m_client.endPublish()) {
+        return false;
+      }
+      batch.drop(count);
+    }
+    return true;
+  }
+
   // Sends custom JSON telemetry string to the ThingsBoard.
   inline bool sendTelemetryJson(const char *json) {
     return m_client.publish("v1/devices/me/telemetry", json);
@@ -259,24 +478,8 @@ private:
   template<typename T>
   bool sendKeyval(const char *key, T value, bool telemetry = true) {
     Telemetry t(key, value);
-
-    char payload[PayloadSize];
-    {
-      Telemetry t(key, value);
-      StaticJsonDocument<JSON_OBJECT_SIZE(1)>jsonBuffer;
-      JsonVariant object = jsonBuffer.template to<JsonVariant>();
-      if (t.serializeKeyval(object) == false){
-        Logger::log("unable to serialize data");
-        return false;
-      }
-
-      if (measureJson(jsonBuffer) > PayloadSize - 1) {
-        Logger::log("too small buffer for JSON data");
-        return false;
-      }
-      serializeJson(object, payload, sizeof(payload));
-    }
-    return telemetry ? sendTelemetryJson(payload) : sendAttributeJSON(payload);
+    return publishDataArray(telemetry ? "v1/devices/me/telemetry"
+                                      : "v1/devices/me/attributes", &t, 1);
   }
 
   // Processes RPC message
@@ -326,12 +529,12 @@ private:
 
       if (r.serializeKeyval(resp_obj) == false) {
         Logger::log("unable to serialize data");
-        return false;
+        return;
       }
 
       if (measureJson(respBuffer) > PayloadSize - 1) {
         Logger::log("too small buffer for JSON data");
-        return false;
+        return;
       }
       serializeJson(resp_obj, payload, sizeof(payload));
 
@@ -344,34 +547,40 @@ private:
   }
 
   // Sends array of attributes or telemetry to ThingsBoard
-  bool sendDataArray(const Telemetry *data, size_t data_count, bool telemetry = true) {
-    if (MaxFieldsAmt < data_count) {
-      Logger::log("too much JSON fields passed");
+  inline bool sendDataArray(const Telemetry *data, size_t data_count, bool telemetry = true) {
+    return publishDataArray(telemetry ? "v1/devices/me/telemetry"
+                                      : "v1/devices/me/attributes", data, data_count);
+  }
+
+  // Streams the fields straight into an MQTT publish. The payload length is
+  // measured first for the packet header, then the payload is written
+  // through a small chunk buffer, so neither a payload buffer nor a JSON
+  // document grows with the number of fields.
+  bool publishDataArray(const char *topic, const Telemetry *data, size_t data_count) {
+    size_t len = Encoding::serialize(NULL, data, data_count, m_keys, m_keyCount);
+    if (!len) {
+      Logger::log("unable to serialize data");
       return false;
     }
-    char payload[PayloadSize];
-    {
-      StaticJsonDocument<JSON_OBJECT_SIZE(MaxFieldsAmt)> jsonBuffer;
-      JsonVariant object = jsonBuffer.template to<JsonVariant>();
-
-      for (size_t i = 0; i < data_count; ++i) {
-        if (data[i].serializeKeyval(object) == false) {
-          Logger::log("unable to serialize data");
-          return false;
-        }
-      }
-      if (measureJson(jsonBuffer) > PayloadSize - 1) {
-        Logger::log("too small buffer for JSON data");
-        return false;
-      }
-      serializeJson(object, payload, sizeof(payload));
+    if (!m_client.beginPublish(topic, len, false)) {
+      return false;
     }
-
-    return telemetry ? sendTelemetryJson(payload) : sendAttributeJSON(payload);
+    ThingsBoardChunkWriter<> out(m_client);
+    Encoding::serialize(&out, data, data_count, m_keys, m_keyCount);
+    if (out.finish() != len) {
+      // The broker still waits for the rest of the packet, anything sent
+      // after it would be misframed, so drop the connection.
+      Logger::log("unable to send data");
+      m_client.disconnect();
+      return false;
+    }
+    return m_client.endPublish();
   }
 
   PubSubClient m_client;              // PubSub MQTT client instance.
   RPC_Callback m_rpcCallbacks[8];     // RPC callbacks array
+  const char * const *m_keys;         // Key dictionary for the encoding
+  size_t m_keyCount;                  // Amount of keys in the dictionary
 
   // PubSub client cannot call a method when message arrives on subscribed topic.
   // Only free-standing function is allowed.
@@ -388,8 +597,8 @@ private:
   }
 };
 
-template<size_t PayloadSize, size_t MaxFieldsAmt, typename Logger>
-ThingsBoardSized<PayloadSize, MaxFieldsAmt, Logger> *ThingsBoardSized<PayloadSize, MaxFieldsAmt, Logger>::m_subscribedInstance;
+template<size_t PayloadSize, size_t MaxFieldsAmt, typename Logger, typename Encoding>
+ThingsBoardSized<PayloadSize, MaxFieldsAmt, Logger, Encoding> *ThingsBoardSized<PayloadSize, MaxFieldsAmt, Logger, Encoding>::m_subscribedInstance;
 
 #ifndef ESP8266
 
@@ -0,0 +1,308 @@
+/*
+  ThingsBoardBatch.h - Timestamped telemetry queue for the ThingsBoard
+  client. Readings are kept as compact binary records while the link is
+  down and published as few JSON arrays once it is up again.
+  Released into the public domain.
+*/
+#ifndef ThingsBoardBatch_h
+#define ThingsBoardBatch_h
+
+#include <TimeLib.h>
+#include "ThingsBoard.h"
+
+// One queued reading, as it is kept in RAM and in the spill storage.
+struct ThingsBoardRecord {
+  uint32_t ts;        // Seconds since Jan 1 1970
+  uint8_t  key;       // Index into the key table of the batch
+  uint8_t  type;      // Telemetry data type
+  union {
+    int32_t  integer;
+    float    real;
+  } value;
+};
+
+// Spill storage that keeps nothing: when RAM is full the oldest reading is
+// dropped. Spill classes provide the same five methods, see
+// ThingsBoardEepromSpill.h and ThingsBoardSdSpill.h.
+class ThingsBoardNoSpill
+{
+public:
+  // Records that can be stored at most
+  inline uint16_t capacity() const { return 0; }
+  // Records stored
+  inline uint16_t size() const { return 0; }
+  // Stores count records after the newest one, returns true on success
+  inline bool append(const ThingsBoardRecord *, uint16_t) { return false; }
+  // Reads the index-th oldest record
+  inline bool read(uint16_t, ThingsBoardRecord &) { return false; }
+  // Discards the count oldest records
+  inline void drop(uint16_t) { }
+};
+
+// Telemetry queue. Records is the amount of readings kept in RAM; when it
+// fills up they are moved to the Spill storage in one go. The spill always
+// holds older readings than RAM, so both are read back oldest first.
+//
+// Keys are stored as an index into a table given to the constructor, so a
+// record stays valid in EEPROM or on SD card across a reset as long as the
+// table does not change. String values cannot be queued.
+template <size_t Records, typename Spill = ThingsBoardNoSpill>
+class ThingsBoardBatch
+{
+  template <size_t PayloadSize, size_t MaxFieldsAmt, typename Logger, typename Encoding>
+  friend class ThingsBoardSized;
+public:
+  // Creates a queue for the telemetry keys in keys.
+  inline ThingsBoardBatch(const char *const *keys, uint8_t keyCount,
+                          const Spill &spill = Spill())
+    :m_keys(keys), m_keyCount(keyCount), m_spill(spill),
+     m_head(0), m_count(0), m_dropped(0) { }
+
+  // Queues a reading stamped with the current time. Returns false if the
+  // key is not in the table, the value is a string or the clock has never
+  // been set.
+  inline bool add(const Telemetry &data) {
+    if (timeStatus() == timeNotSet) {
+      return false;
+    }
+    return add(data, now());
+  }
+
+  // Queues a reading with the given time, in seconds since Jan 1 1970.
+  bool add(const Telemetry &data, uint32_t ts) {
+    ThingsBoardRecord r;
+    if (!encode(data, ts, r)) {
+      return false;
+    }
+    if (m_count == Records && !spillRam()) {
+      // Nowhere to put the RAM contents, lose the oldest reading
+      m_head = (m_head + 1) % Records;
+      m_count--;
+      m_dropped++;
+    }
+    m_ram[(m_head + m_count) % Records] = r;
+    m_count++;
+    return true;
+  }
+
+  // Queued readings, in RAM and in the spill storage.
+  inline uint32_t size() const {
+    return (uint32_t)m_spill.size() + m_count;
+  }
+
+  // Readings lost because all storage was full.
+  inline uint32_t dropped() const {
+    return m_dropped;
+  }
+
+  // Spill storage, e.g. to begin() it once the medium is ready.
+  inline Spill &spill() {
+    return m_spill;
+  }
+
+  // Discards every queued reading.
+  void clear() {
+    m_spill.drop(m_spill.size());
+    m_head = 0;
+    m_count = 0;
+  }
+
+private:
+  bool encode(const Telemetry &data, uint32_t ts, ThingsBoardRecord &r) const {
+    uint8_t key = 0;
+    while (key < m_keyCount && m_keys[key] != data.m_key &&
+           (!data.m_key || strcmp(m_keys[key], data.m_key))) {
+      key++;
+    }
+    if (key == m_keyCount) {
+      return false;
+    }
+    r.ts = ts;
+    r.key = key;
+    r.type = data.m_type;
+    switch (data.m_type) {
+      case Telemetry::TYPE_BOOL:
+        r.value.integer = data.m_value.boolean;
+      break;
+      case Telemetry::TYPE_INT:
+        r.value.integer = data.m_value.integer;
+      break;
+      case Telemetry::TYPE_REAL:
+        r.value.real = data.m_value.real;
+      break;
+      default:
+        return false;
+    }
+    return true;
+  }
+
+  // Moves the RAM contents to the spill storage, oldest first. Returns
+  // false if RAM is still full afterwards.
+  bool spillRam() {
+    uint16_t capacity = m_spill.capacity();
+    if (capacity < m_count) {
+      return false;
+    }
+    uint16_t room = capacity - m_spill.size();
+    if (room < m_count) {
+      // Keep the newest readings
+      m_spill.drop(m_count - room);
+      m_dropped += m_count - room;
+    }
+    while (m_count) {
+      uint16_t run = m_count < Records - m_head ? m_count : Records - m_head;
+      if (!m_spill.append(&m_ram[m_head], run)) {
+        return false;
+      }
+      m_head = (m_head + run) % Records;
+      m_count -= run;
+    }
+    m_head = 0;
+    return true;
+  }
+
+  // Reads the index-th oldest reading.
+  bool read(uint32_t index, ThingsBoardRecord &r) {
+    uint16_t spilled = m_spill.size();
+    if (index < spilled) {
+      return m_spill.read(index, r);
+    }
+    index -= spilled;
+    if (index >= m_count) {
+      return false;
+    }
+    r = m_ram[(m_head + index) % Records];
+    return true;
+  }
+
+  // Discards the count oldest readings.
+  void drop(uint32_t count) {
+    uint16_t spilled = m_spill.size();
+    if (count > spilled) {
+      m_spill.drop(spilled);
+      count -= spilled;
+      if (count > m_count) {
+        count = m_count;
+      }
+      m_head = (m_head + count) % Records;
+      m_count -= count;
+    } else {
+      m_spill.drop(count);
+    }
+  }
+
+  // Writes the readings from index first that share its timestamp as one
+  // {"ts":...,"values":{...}} object to out, or only measures it if out is
+  // NULL. next gets the index after them. Returns the length.
+  size_t serializeGroup(Print *out, uint32_t first, uint32_t &next) {
+    ThingsBoardRecord r;
+    if (!read(first, r)) {
+      next = first;
+      return 0;
+    }
+    uint32_t ts = r.ts;
+    size_t len = writeText(out, "{\"ts\":");
+    len += writeTimestamp(out, ts);
+    len += writeText(out, ",\"values\":{");
+    next = first;
+    do {
+      if (next != first) {
+        len += writeText(out, ",");
+      }
+      len += serializeRecord(out, r);
+      next++;
+    } while (read(next, r) && r.ts == ts);
+    len += writeText(out, "}}");
+    return len;
+  }
+
+  // Writes the count oldest readings as a JSON array, or only measures it
+  // if out is NULL. Returns the length.
+  size_t serialize(Print *out, uint32_t count) {
+    size_t len = writeText(out, "[");
+    uint32_t i = 0;
+    while (i < count) {
+      if (i) {
+        len += writeText(out, ",");
+      }
+      uint32_t next;
+      len += serializeGroup(out, i, next);
+      if (next == i) {
+        break;
+      }
+      i = next;
+    }
+    len += writeText(out, "]");
+    return len;
+  }
+
+  // Amount of oldest readings, in whole timestamp groups, whose JSON array
+  // is no longer than maxLen; at least one group. len gets the length.
+  uint32_t fit(size_t maxLen, size_t &len) {
+    uint32_t count = 0;
+    uint32_t total = size();
+    len = 2;
+    while (count < total) {
+      uint32_t next;
+      size_t group = serializeGroup(NULL, count, next) + (count ? 1 : 0);
+      if (next == count || (count && len + group > maxLen)) {
+        break;
+      }
+      len += group;
+      count = next;
+    }
+    return count;
+  }
+
+  size_t serializeRecord(Print *out, const ThingsBoardRecord &r) const {
+    Telemetry t;
+    t.m_key = r.key < m_keyCount ? m_keys[r.key] : "?";
+    t.m_type = (Telemetry::dataType)r.type;
+    switch (t.m_type) {
+      case Telemetry::TYPE_BOOL:
+        t.m_value.boolean = r.value.integer;
+      break;
+      case Telemetry::TYPE_INT:
+        t.m_value.integer = r.value.integer;
+      break;
+      case Telemetry::TYPE_REAL:
+        t.m_value.real = r.value.real;
+      break;
+      default:
+        // Unknown record, keep the JSON valid
+        t.m_type = Telemetry::TYPE_INT;
+        t.m_value.integer = 0;
+      break;
+    }
+    return t.serializeKeyval(out);
+  }
+
+  static size_t writeText(Print *out, const char *text) {
+    return out ? out->write(text) : strlen(text);
+  }
+
+  // ThingsBoard wants milliseconds
+  static size_t writeTimestamp(Print *out, uint32_t ts) {
+    char buf[14];
+    char *p = buf + sizeof(buf);
+    *--p = '\0';
+    *--p = '0';
+    *--p = '0';
+    *--p = '0';
+    do {
+      *--p = '0' + ts % 10;
+      ts /= 10;
+    } while (ts);
+    return writeText(out, p);
+  }
+
+  const char *const *m_keys;          // Key table
+  uint8_t           m_keyCount;       // Amount of keys
+  Spill             m_spill;          // Older readings
+  ThingsBoardRecord m_ram[Records];   // Newer readings, a ring
+  uint16_t          m_head;           // Oldest reading in m_ram
+  uint16_t          m_count;          // Readings in m_ram
+  uint32_t          m_dropped;        // Readings lost
+};
+
+#endif // ThingsBoardBatch_h
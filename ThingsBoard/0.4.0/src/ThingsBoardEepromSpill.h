@@ -0,0 +1,99 @@
+/*
+  ThingsBoardEepromSpill.h - EEPROM spill storage for ThingsBoardBatch.
+  Released into the public domain.
+*/
+#ifndef ThingsBoardEepromSpill_h
+#define ThingsBoardEepromSpill_h
+
+#include <EEPROM.h>
+#include "ThingsBoardBatch.h"
+
+// Keeps queued readings in a ring inside the EEPROM area [address,
+// address + length). The position of the ring is stored in front of it, so
+// the readings survive a reset. Writes go through EEPROM.put(), which skips
+// bytes that already hold the value. Call begin() before the batch is used.
+class ThingsBoardEepromSpill
+{
+public:
+  inline ThingsBoardEepromSpill(int address, int length)
+    :m_address(address),
+     m_capacity((length - (int)sizeof(Header)) / (int)sizeof(ThingsBoardRecord)),
+     m_head(0), m_count(0) { }
+
+  // Picks up the readings left from before a reset, if any.
+  void begin() {
+    Header h;
+    EEPROM.get(m_address, h);
+    if (h.magic == Magic && h.recordSize == sizeof(ThingsBoardRecord) &&
+        h.head < m_capacity && h.count <= m_capacity) {
+      m_head = h.head;
+      m_count = h.count;
+    } else {
+      m_head = 0;
+      m_count = 0;
+      save();
+    }
+  }
+
+  inline uint16_t capacity() const { return m_capacity; }
+  inline uint16_t size() const { return m_count; }
+
+  bool append(const ThingsBoardRecord *records, uint16_t count) {
+    if (count > m_capacity - m_count) {
+      return false;
+    }
+    for (uint16_t i = 0; i < count; ++i) {
+      EEPROM.put(recordAddress(m_count + i), records[i]);
+    }
+    m_count += count;
+    save();
+    return true;
+  }
+
+  bool read(uint16_t index, ThingsBoardRecord &r) {
+    if (index >= m_count) {
+      return false;
+    }
+    EEPROM.get(recordAddress(index), r);
+    return true;
+  }
+
+  void drop(uint16_t count) {
+    if (!count) {
+      return;
+    }
+    if (count > m_count) {
+      count = m_count;
+    }
+    m_head = (m_head + count) % m_capacity;
+    m_count -= count;
+    save();
+  }
+
+private:
+  static const uint8_t Magic = 0xB7;
+
+  struct Header {
+    uint8_t  magic;
+    uint8_t  recordSize;
+    uint16_t head;
+    uint16_t count;
+  };
+
+  int recordAddress(uint16_t index) const {
+    return m_address + sizeof(Header) +
+      ((m_head + index) % m_capacity) * sizeof(ThingsBoardRecord);
+  }
+
+  void save() {
+    Header h = { Magic, sizeof(ThingsBoardRecord), m_head, m_count };
+    EEPROM.put(m_address, h);
+  }
+
+  int      m_address;   // Start of the area
+  uint16_t m_capacity;  // Records that fit
+  uint16_t m_head;      // Oldest record
+  uint16_t m_count;     // Records stored
+};
+
+#endif // ThingsBoardEepromSpill_h
@@ -0,0 +1,119 @@
+/*
+  ThingsBoardSdSpill.h - SD card spill storage for ThingsBoardBatch.
+  Released into the public domain.
+*/
+#ifndef ThingsBoardSdSpill_h
+#define ThingsBoardSdSpill_h
+
+#include <SD.h>
+#include "ThingsBoardBatch.h"
+
+#define Default_Spill_Cache 8
+
+// Keeps queued readings in a file on the SD card. Spilled records are
+// appended to it; records taken off the queue are only skipped, and the
+// file is removed once the queue has been emptied. After a reset all
+// records in the file are sent again, which ThingsBoard takes as the same
+// readings since key and timestamp match.
+//
+// The file is closed between calls so the sketch can use the card too.
+// Reads fetch Cache records at a time, since the queue is read in order.
+// Call begin() after SD.begin().
+template <size_t Cache = Default_Spill_Cache>
+class ThingsBoardSdSpillSized
+{
+public:
+  inline ThingsBoardSdSpillSized(const char *path)
+    :m_path(path), m_head(0), m_count(0), m_cacheFirst(0), m_cacheCount(0) { }
+
+  // Picks up the readings left from before a reset, if any.
+  void begin() {
+    m_head = 0;
+    m_count = 0;
+    m_cacheCount = 0;
+    File f = SD.open(m_path, FILE_READ);
+    if (f) {
+      uint32_t records = f.size() / sizeof(ThingsBoardRecord);
+      m_count = records > capacity() ? capacity() : records;
+      m_head = records - m_count;
+      f.close();
+    }
+  }
+
+  inline uint16_t capacity() const { return 0xFFFF; }
+  inline uint16_t size() const { return m_count; }
+
+  bool append(const ThingsBoardRecord *records, uint16_t count) {
+    if (count > capacity() - m_count) {
+      return false;
+    }
+    File f = SD.open(m_path, FILE_WRITE);
+    if (!f) {
+      return false;
+    }
+    size_t len = count * sizeof(ThingsBoardRecord);
+    size_t written = f.write((const uint8_t *)records, len);
+    f.close();
+    if (written != len) {
+      return false;
+    }
+    m_count += count;
+    return true;
+  }
+
+  bool read(uint16_t index, ThingsBoardRecord &r) {
+    if (index >= m_count) {
+      return false;
+    }
+    if (index < m_cacheFirst || index >= m_cacheFirst + m_cacheCount) {
+      if (!fill(index)) {
+        return false;
+      }
+    }
+    r = m_cache[index - m_cacheFirst];
+    return true;
+  }
+
+  void drop(uint16_t count) {
+    if (count > m_count) {
+      count = m_count;
+    }
+    m_head += count;
+    m_count -= count;
+    m_cacheCount = 0;
+    if (!m_count) {
+      SD.remove(m_path);
+      m_head = 0;
+    }
+  }
+
+private:
+  bool fill(uint16_t index) {
+    m_cacheCount = 0;
+    File f = SD.open(m_path, FILE_READ);
+    if (!f) {
+      return false;
+    }
+    uint16_t count = m_count - index < Cache ? m_count - index : Cache;
+    bool ok = f.seek((m_head + index) * sizeof(ThingsBoardRecord)) &&
+      f.read(m_cache, count * sizeof(ThingsBoardRecord)) ==
+        (int)(count * sizeof(ThingsBoardRecord));
+    f.close();
+    if (ok) {
+      m_cacheFirst = index;
+      m_cacheCount = count;
+    }
+    return ok;
+  }
+
+  const char        *m_path;           // Spill file
+  uint32_t          m_head;            // Records skipped at the file start
+  uint16_t          m_count;           // Records queued in the file
+  ThingsBoardRecord m_cache[Cache];    // Records read ahead
+  uint16_t          m_cacheFirst;      // Index of m_cache[0]
+  uint16_t          m_cacheCount;      // Valid records in m_cache
+};
+
+using ThingsBoardSdSpill = ThingsBoardSdSpillSized<>;
+
+#endif // ThingsBoardSdSpill_h
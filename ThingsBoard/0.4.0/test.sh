@@ -8,6 +8,7 @@ EXAMPLES_ARDUINO_UNO=(
     "examples/0002-arduino_rpc"
     "examples/0004-arduino-sim900_send_telemetry"
     "examples/0005-arduino-sim900_send_telemetry_http"
+    "examples/0006-arduino-sim900_send_batch"
 )
 
 EXAMPLES_ESP8266=(
@@ -43,6 +44,9 @@ do_link() {
     do
         ln -sf "$(pwd)/src/ThingsBoard.h" "${path}/ThingsBoard.h"
         ln -sf "$(pwd)/src/ThingsBoard.cpp" "${path}/ThingsBoard.cpp"
+        ln -sf "$(pwd)/src/ThingsBoardBatch.h" "${path}/ThingsBoardBatch.h"
+        ln -sf "$(pwd)/src/ThingsBoardSdSpill.h" "${path}/ThingsBoardSdSpill.h"
+        ln -sf "$(pwd)/src/ThingsBoardEepromSpill.h" "${path}/ThingsBoardEepromSpill.h"
     done
 }
 
@@ -57,5 +61,6 @@ do_link
 "${ARDUINO_CLI}" lib install ArduinoJson || true
 "${ARDUINO_CLI}" lib install TinyGSM || true
 "${ARDUINO_CLI}" lib install ArduinoHttpClient || true
+"${ARDUINO_CLI}" lib install Time || true
 
 do_test
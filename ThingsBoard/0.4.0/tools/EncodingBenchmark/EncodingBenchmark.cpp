@@ -0,0 +1,343 @@
+/*
+  EncodingBenchmark.cpp - Compares the telemetry encodings of
+  ThingsBoardSized: JSON text, MessagePack, and MessagePack with a key
+  dictionary, for a growing number of fields.
+
+  For each field count it prints:
+    - the payload and wire (MQTT packet) sizes of one telemetry frame,
+    - the time to serialize the frame the way a publish does (measure the
+      length, then write it), averaged over many runs on this PC. Only the
+      ratios between the encodings carry over to a microcontroller.
+  Every MessagePack frame is decoded back to JSON with the same key table,
+  as a converter on the server side would, and must give the JSON frame.
+
+  Build and run from this directory:
+    g++ -O2 -DESP8266 -DARDUINOJSON_ENABLE_ARDUINO_PRINT=1 \
+        -I../TelemetryBenchmark/host -I../../src \
+        -I../../../../PubSubClient/2.8.0/src \
+        -I../../../../ArduinoJson/6.17.3/src \
+        EncodingBenchmark.cpp ../../src/ThingsBoard.cpp \
+        ../../../../PubSubClient/2.8.0/src/PubSubClient.cpp \
+        -o EncodingBenchmark && ./EncodingBenchmark
+
+  ESP8266 is defined only to leave out the HTTP client, which is not needed
+  here.
+*/
+
+#include <chrono>
+#include <string>
+
+#include "ThingsBoard.h"
+
+HostSerial Serial;
+
+uint32_t millis(void) {
+  return 0;
+}
+
+// Records what PubSubClient sends. Answers a CONNECT with a CONNACK and
+// stays silent otherwise.
+class CapturingClient : public Client {
+public:
+  CapturingClient() :m_open(false), m_reply(NULL), m_replyLen(0) { }
+
+  void clear() { m_wire.clear(); }
+  const std::string &wire() const { return m_wire; }
+
+  size_t write(uint8_t c) {
+    return write(&c, 1);
+  }
+  size_t write(const uint8_t *buf, size_t size) {
+    m_wire.append((const char *)buf, size);
+    return size;
+  }
+
+  int connect(IPAddress, uint16_t) { return accept(); }
+  int connect(const char *, uint16_t) { return accept(); }
+  int available() { return m_replyLen; }
+  int read() {
+    if (!m_replyLen) {
+      return -1;
+    }
+    m_replyLen--;
+    return *m_reply++;
+  }
+  int read(uint8_t *buf, size_t size) {
+    size_t n = 0;
+    while (n < size && m_replyLen) {
+      buf[n++] = read();
+    }
+    return n;
+  }
+  int peek() { return m_replyLen ? *m_reply : -1; }
+  void flush() { }
+  void stop() { m_open = false; }
+  uint8_t connected() { return m_open; }
+  operator bool() { return m_open; }
+
+private:
+  int accept() {
+    static const uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    m_reply = connack;
+    m_replyLen = sizeof(connack);
+    m_open = true;
+    return 1;
+  }
+
+  bool m_open;
+  const uint8_t *m_reply;
+  size_t m_replyLen;
+  std::string m_wire;
+};
+
+// Throws the bytes away, for timing the serialization alone.
+class NullPrint : public Print {
+public:
+  size_t write(uint8_t) { return 1; }
+  size_t write(const uint8_t *, size_t size) { return size; }
+};
+
+//------------------------------------------------------------------------------
+// Stand-in for the server side converter: turns a MessagePack map back into
+// a JSON document, looking integer keys up in the key table. ArduinoJson's
+// deserializeMsgPack() only takes string keys, hence a decoder of its own.
+// It handles what ThingsBoardMsgPack writes, nothing more.
+
+class MsgPackDecoder {
+public:
+  MsgPackDecoder(const char *const *keys, size_t key_count)
+    :m_keys(keys), m_keyCount(key_count), m_p(NULL), m_end(NULL) { }
+
+  bool decode(const std::string &in, JsonDocument &doc) {
+    m_p = (const uint8_t *)in.data();
+    m_end = m_p + in.size();
+    JsonObject obj = doc.to<JsonObject>();
+
+    uint32_t fields;
+    uint8_t type = next();
+    if ((type & 0xF0) == 0x80) {
+      fields = type & 0x0F;
+    } else if (type == 0xDE) {
+      fields = bigEndian(2);
+    } else {
+      return false;
+    }
+    while (fields--) {
+      std::string key;
+      if (!decodeKey(key) || !decodeValue(obj[key].to<JsonVariant>())) {
+        return false;
+      }
+    }
+    return m_p == m_end;
+  }
+
+private:
+  uint8_t next() {
+    return m_p < m_end ? *m_p++ : 0xC1;  // 0xC1 is never used
+  }
+
+  uint64_t bigEndian(size_t size) {
+    uint64_t value = 0;
+    while (size--) {
+      value = (value << 8) | next();
+    }
+    return value;
+  }
+
+  bool decodeString(uint8_t type, std::string &out) {
+    size_t len;
+    if ((type & 0xE0) == 0xA0) {
+      len = type & 0x1F;
+    } else if (type == 0xD9) {
+      len = bigEndian(1);
+    } else if (type == 0xDA) {
+      len = bigEndian(2);
+    } else {
+      return false;
+    }
+    if ((size_t)(m_end - m_p) < len) {
+      return false;
+    }
+    out.assign((const char *)m_p, len);
+    m_p += len;
+    return true;
+  }
+
+  bool decodeKey(std::string &key) {
+    uint8_t type = next();
+    if (type < 0x80) {
+      if (type >= m_keyCount) {
+        return false;
+      }
+      key = m_keys[type];
+      return true;
+    }
+    return decodeString(type, key);
+  }
+
+  bool decodeValue(JsonVariant value) {
+    uint8_t type = next();
+    if (type < 0x80) {
+      return value.set(type);
+    }
+    if (type >= 0xE0) {
+      return value.set((int8_t)type);
+    }
+    switch (type) {
+      case 0xC2: return value.set(false);
+      case 0xC3: return value.set(true);
+      case 0xCC: return value.set((uint8_t)bigEndian(1));
+      case 0xCD: return value.set((uint16_t)bigEndian(2));
+      case 0xCE: return value.set((uint32_t)bigEndian(4));
+      case 0xD0: return value.set((int8_t)bigEndian(1));
+      case 0xD1: return value.set((int16_t)bigEndian(2));
+      case 0xD2: return value.set((int32_t)bigEndian(4));
+      case 0xCA: {
+        uint32_t bits = bigEndian(4);
+        float real;
+        memcpy(&real, &bits, sizeof(real));
+        return value.set(real);
+      }
+      case 0xCB: {
+        uint64_t bits = bigEndian(8);
+        double real;
+        memcpy(&real, &bits, sizeof(real));
+        return value.set(real);
+      }
+      default: {
+        std::string str;
+        return decodeString(type, str) && value.set(str);
+      }
+    }
+  }
+
+  const char *const *m_keys;
+  size_t m_keyCount;
+  const uint8_t *m_p;
+  const uint8_t *m_end;
+};
+
+//------------------------------------------------------------------------------
+
+// A typical field device: a few sensors, a counter, a flag and a status.
+static const char *Keys[] = {
+  "temperature", "humidity", "pressure", "battery",
+  "rssi", "uptime", "door_open", "status",
+  "co2", "pm25", "pm10", "lux",
+  "wind_speed", "wind_dir", "rain", "soil_moisture",
+};
+static const size_t Key_Count = sizeof(Keys) / sizeof(Keys[0]);
+
+static void fillFrame(Telemetry *data, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    const char *key = Keys[i % Key_Count];
+    switch (i % 4) {
+      case 0: data[i] = Telemetry(key, 21.5f + (float)i * 0.75f); break;
+      case 1: data[i] = Telemetry(key, (int)(i * 1000) - 90); break;
+      case 2: data[i] = Telemetry(key, (i & 4) != 0); break;
+      default: data[i] = Telemetry(key, "ok"); break;
+    }
+  }
+}
+
+template <typename Encoding>
+static std::string publishFrame(const Telemetry *data, size_t count, bool dictionary) {
+  CapturingClient client;
+  ThingsBoardSized<Default_Payload, Default_Fields_Amt, ThingsBoardDefaultLogger, Encoding> tb(client);
+  tb.connect("localhost", "token");
+  if (dictionary) {
+    tb.setKeyDictionary(Keys, Key_Count);
+  }
+  client.clear();
+  if (!tb.sendTelemetry(data, count)) {
+    return std::string();
+  }
+  return client.wire();
+}
+
+// Nanoseconds to measure and write one frame.
+template <typename Encoding>
+static double serializeTime(const Telemetry *data, size_t count, bool dictionary) {
+  static const unsigned Runs = 20000;
+  NullPrint out;
+  const char *const *keys = dictionary ? Keys : NULL;
+  size_t key_count = dictionary ? Key_Count : 0;
+  volatile size_t sink = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < Runs; ++i) {
+    sink += Encoding::serialize(NULL, data, count, keys, key_count);
+    sink += Encoding::serialize(&out, data, count, keys, key_count);
+  }
+  std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+  return (double)elapsed.count() / Runs;
+}
+
+// The MQTT header is the same for every encoding apart from the length
+// field, so the payload follows the topic.
+static std::string payloadOf(const std::string &wire) {
+  static const size_t Topic_Len = strlen("v1/devices/me/telemetry");
+  size_t pos = 1;
+  while (wire[pos] & 0x80) {
+    ++pos;
+  }
+  return wire.substr(pos + 1 + 2 + Topic_Len);
+}
+
+static bool failed = false;
+
+static void runCase(size_t count) {
+  Telemetry data[Key_Count];
+  fillFrame(data, count);
+
+  std::string json = publishFrame<ThingsBoardJson>(data, count, false);
+  std::string msgpack = publishFrame<ThingsBoardMsgPack>(data, count, false);
+  std::string dict = publishFrame<ThingsBoardMsgPack>(data, count, true);
+  if (json.empty() || msgpack.empty() || dict.empty()) {
+    printf("%3u fields: publish failed\n", (unsigned)count);
+    failed = true;
+    return;
+  }
+
+  // Both MessagePack frames must decode to the JSON frame
+  std::string jsonPayload = payloadOf(json);
+  const std::string *frames[] = { &msgpack, &dict };
+  for (size_t i = 0; i < 2; ++i) {
+    DynamicJsonDocument doc(4096);
+    MsgPackDecoder decoder(Keys, Key_Count);
+    std::string decoded;
+    if (!decoder.decode(payloadOf(*frames[i]), doc)) {
+      printf("%3u fields: %s frame does not decode\n", (unsigned)count,
+             i ? "dictionary" : "MessagePack");
+      failed = true;
+      return;
+    }
+    serializeJson(doc, decoded);
+    if (decoded != jsonPayload) {
+      printf("%3u fields: %s frame decodes to %s\n", (unsigned)count,
+             i ? "dictionary" : "MessagePack", decoded.c_str());
+      failed = true;
+      return;
+    }
+  }
+
+  printf("%3u | %5u %5u %7.0f | %5u %5u %7.0f | %5u %5u %7.0f\n",
+         (unsigned)count,
+         (unsigned)jsonPayload.size(), (unsigned)json.size(),
+         serializeTime<ThingsBoardJson>(data, count, false),
+         (unsigned)payloadOf(msgpack).size(), (unsigned)msgpack.size(),
+         serializeTime<ThingsBoardMsgPack>(data, count, false),
+         (unsigned)payloadOf(dict).size(), (unsigned)dict.size(),
+         serializeTime<ThingsBoardMsgPack>(data, count, true));
+}
+
+int main() {
+  printf("    | JSON                | MessagePack         | MessagePack + keys\n");
+  printf("  N | bytes  wire      ns | bytes  wire      ns | bytes  wire      ns\n");
+  // Up to one field per key, a JSON object cannot repeat a key
+  runCase(1);
+  runCase(4);
+  runCase(8);
+  runCase(16);
+  return failed ? 1 : 0;
+}
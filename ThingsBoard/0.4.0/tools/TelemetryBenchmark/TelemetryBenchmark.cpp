@@ -0,0 +1,269 @@
+/*
+  TelemetryBenchmark.cpp - Compares the way telemetry used to be published
+  (JSON document -> payload buffer -> PubSubClient buffer -> client) with
+  the streaming publish (measure, then beginPublish()/write()/endPublish()
+  through a small chunk buffer), for a growing number of fields.
+
+  For each field count it prints:
+    - the JSON and wire (MQTT packet) sizes,
+    - bytes copied into RAM buffers before reaching the client: the old
+      path serializes into payload[] and then assembles the whole packet
+      in the PubSubClient buffer, the streaming path only passes the JSON
+      through the chunk buffer,
+    - the PubSubClient buffer the send needs,
+    - the number of Client::write() calls,
+    - the stack high-water of the send, found by running it on a painted
+      stack of its own.
+  Both paths must put the same bytes on the wire.
+
+  Build and run from this directory:
+    g++ -O2 -DESP8266 -DARDUINOJSON_ENABLE_ARDUINO_PRINT=1 -Ihost \
+        -I../../src -I../../../../PubSubClient/2.8.0/src \
+        -I../../../../ArduinoJson/6.17.3/src \
+        TelemetryBenchmark.cpp ../../src/ThingsBoard.cpp \
+        ../../../../PubSubClient/2.8.0/src/PubSubClient.cpp \
+        -o TelemetryBenchmark && ./TelemetryBenchmark
+
+  ESP8266 is defined only to leave out the HTTP client, which is not needed
+  here.
+*/
+
+#include <string>
+#include <string.h>
+#include <ucontext.h>
+
+#include "ThingsBoard.h"
+
+HostSerial Serial;
+
+uint32_t millis(void) {
+  return 0;
+}
+
+// Records what PubSubClient sends. Answers a CONNECT with a CONNACK and
+// stays silent otherwise.
+class CountingClient : public Client {
+public:
+  CountingClient() :m_open(false), m_reply(NULL), m_replyLen(0), m_writes(0) { }
+
+  void clear() {
+    m_wire.clear();
+    m_writes = 0;
+  }
+
+  const std::string &wire() const { return m_wire; }
+  size_t writes() const { return m_writes; }
+
+  size_t write(uint8_t c) {
+    return write(&c, 1);
+  }
+  size_t write(const uint8_t *buf, size_t size) {
+    m_wire.append((const char *)buf, size);
+    m_writes++;
+    return size;
+  }
+
+  int connect(IPAddress, uint16_t) { return accept(); }
+  int connect(const char *, uint16_t) { return accept(); }
+  int available() { return m_replyLen; }
+  int read() {
+    if (!m_replyLen) {
+      return -1;
+    }
+    m_replyLen--;
+    return *m_reply++;
+  }
+  int read(uint8_t *buf, size_t size) {
+    size_t n = 0;
+    while (n < size && m_replyLen) {
+      buf[n++] = read();
+    }
+    return n;
+  }
+  int peek() { return m_replyLen ? *m_reply : -1; }
+  void flush() { }
+  void stop() { m_open = false; }
+  uint8_t connected() { return m_open; }
+  operator bool() { return m_open; }
+
+private:
+  int accept() {
+    static const uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+    m_reply = connack;
+    m_replyLen = sizeof(connack);
+    m_open = true;
+    return 1;
+  }
+
+  bool m_open;
+  const uint8_t *m_reply;
+  size_t m_replyLen;
+  std::string m_wire;
+  size_t m_writes;
+};
+
+//------------------------------------------------------------------------------
+// Stack painting. A job runs on a stack of its own, filled with a known byte
+// beforehand; the stack grows down, so the lowest byte that changed marks
+// how deep the job went. Each send runs once on the normal stack before it
+// is measured, the dynamic linker resolving a symbol on first use needs a
+// lot of stack.
+
+static const size_t Job_Stack_Size = 65536;
+static const uint8_t Paint_Byte = 0xA5;
+
+static uint8_t jobStack[Job_Stack_Size];
+static ucontext_t mainContext;
+static ucontext_t jobContext;
+static void (*jobFn)(void *);
+static void *jobArg;
+
+static void runJob() {
+  jobFn(jobArg);
+}
+
+// Runs fn(arg) on the painted stack, returns the bytes of it used
+static size_t stackUsed(void (*fn)(void *), void *arg) {
+  memset(jobStack, Paint_Byte, sizeof(jobStack));
+  jobFn = fn;
+  jobArg = arg;
+  getcontext(&jobContext);
+  jobContext.uc_stack.ss_sp = jobStack;
+  jobContext.uc_stack.ss_size = sizeof(jobStack);
+  jobContext.uc_link = &mainContext;
+  makecontext(&jobContext, runJob, 0);
+  swapcontext(&mainContext, &jobContext);
+
+  size_t i = 0;
+  while (i < sizeof(jobStack) && jobStack[i] == Paint_Byte) {
+    ++i;
+  }
+  return sizeof(jobStack) - i;
+}
+
+// Stack overhead of the measurement itself
+static void emptyJob(void *) {
+}
+
+//------------------------------------------------------------------------------
+
+static const char *Topic = "v1/devices/me/telemetry";
+
+struct Field {
+  char  key[12];
+  float value;
+};
+
+// The old ThingsBoardSized::sendDataArray(), sized for the field count
+template <size_t PayloadSize, size_t MaxFieldsAmt>
+__attribute__((noinline)) static bool bufferedSend(PubSubClient &mqtt,
+    const Field *fields, size_t count) {
+  char payload[PayloadSize];
+  {
+    StaticJsonDocument<JSON_OBJECT_SIZE(MaxFieldsAmt)> jsonBuffer;
+    JsonObject object = jsonBuffer.template to<JsonObject>();
+    for (size_t i = 0; i < count; ++i) {
+      object[fields[i].key] = fields[i].value;
+    }
+    if (measureJson(jsonBuffer) > PayloadSize - 1) {
+      return false;
+    }
+    serializeJson(object, payload, sizeof(payload));
+  }
+  return mqtt.publish(Topic, payload);
+}
+
+__attribute__((noinline)) static bool streamingSend(ThingsBoard &tb,
+    const Telemetry *data, size_t count) {
+  return tb.sendTelemetry(data, count);
+}
+
+struct BufferedJob {
+  PubSubClient *mqtt;
+  const Field *fields;
+  size_t count;
+  bool ok;
+};
+
+template <size_t PayloadSize, size_t MaxFieldsAmt>
+static void bufferedJob(void *arg) {
+  BufferedJob *job = (BufferedJob *)arg;
+  job->ok = bufferedSend<PayloadSize, MaxFieldsAmt>(*job->mqtt, job->fields,
+                                                    job->count);
+}
+
+struct StreamingJob {
+  ThingsBoard *tb;
+  const Telemetry *data;
+  size_t count;
+  bool ok;
+};
+
+static void streamingJob(void *arg) {
+  StreamingJob *job = (StreamingJob *)arg;
+  job->ok = streamingSend(*job->tb, job->data, job->count);
+}
+
+static bool failed = false;
+
+template <size_t N>
+static void runCase() {
+  Field fields[N];
+  Telemetry data[N];
+  for (size_t i = 0; i < N; ++i) {
+    snprintf(fields[i].key, sizeof(fields[i].key), "sensor_%02u", (unsigned)i);
+    fields[i].value = (float)i * 1.25f - 7.5f;
+    data[i] = Telemetry(fields[i].key, fields[i].value);
+  }
+
+  // Old path; the PubSubClient buffer has to hold the whole packet
+  CountingClient bufferedClient;
+  PubSubClient mqtt(bufferedClient);
+  mqtt.setBufferSize(1024);
+  mqtt.setServer("localhost", 1883);
+  mqtt.connect("TbDev", "token", NULL);
+  bufferedSend<24 * N + 8, N>(mqtt, fields, N);  // warm up lazy binding
+  bufferedClient.clear();
+  BufferedJob buffered = { &mqtt, fields, N, false };
+  size_t bufferedStack = stackUsed(bufferedJob<24 * N + 8, N>, &buffered);
+
+  // Streaming path, with the default ThingsBoard sizes
+  CountingClient streamingClient;
+  ThingsBoard tb(streamingClient);
+  tb.connect("localhost", "token");
+  streamingSend(tb, data, N);
+  streamingClient.clear();
+  StreamingJob streaming = { &tb, data, N, false };
+  size_t streamingStack = stackUsed(streamingJob, &streaming);
+
+  size_t baseStack = stackUsed(emptyJob, NULL);
+  bool ok = buffered.ok && streaming.ok;
+
+  const std::string &wire = streamingClient.wire();
+  size_t header = wire.find('{');
+  size_t json = wire.size() - header;
+
+  if (!ok || bufferedClient.wire() != wire) {
+    printf("%3u fields: outputs differ\n", (unsigned)N);
+    failed = true;
+    return;
+  }
+  printf("%3u %6u %6u | %7u %7u %7u %7u | %7u %7u %7u %7u\n",
+         (unsigned)N, (unsigned)json, (unsigned)wire.size(),
+         (unsigned)(json + wire.size()), (unsigned)wire.size(),
+         (unsigned)bufferedClient.writes(),
+         (unsigned)(bufferedStack - baseStack),
+         (unsigned)json, (unsigned)header, (unsigned)streamingClient.writes(),
+         (unsigned)(streamingStack - baseStack));
+}
+
+int main() {
+  printf("                  | buffered                        | streaming\n");
+  printf("  N   json   wire |  copied  mqtbuf  writes   stack |  copied  mqtbuf  writes   stack\n");
+  runCase<1>();
+  runCase<4>();
+  runCase<8>();
+  runCase<16>();
+  runCase<32>();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,55 @@
+/*
+  Arduino.h - Just enough of the Arduino core to build ThingsBoard and
+  PubSubClient on a PC, for the host side tools. Client.h, IPAddress.h
+  and Stream.h next to it cover the rest of what PubSubClient includes.
+*/
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include "Print.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define pgm_read_byte_near(x) *(x)
+#define pgm_read_byte(x) *(x)
+#define pgm_read_ptr(x) *(x)
+#define memcpy_P memcpy
+#define yield(x) {}
+
+uint32_t millis(void);
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+class String {
+public:
+  String(const char *s = "") :m_s(s) { }
+  const char *c_str() const { return m_s.c_str(); }
+  unsigned int length() const { return m_s.size(); }
+  void replace(const char *from, const char *to) {
+    size_t p = m_s.find(from);
+    if (p != std::string::npos) {
+      m_s.replace(p, strlen(from), to);
+    }
+  }
+
+private:
+  std::string m_s;
+};
+
+class HostSerial : public Print {
+public:
+  size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+};
+
+extern HostSerial Serial;
+
+#endif
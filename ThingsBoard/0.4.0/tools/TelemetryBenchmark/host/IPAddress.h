@@ -0,0 +1,20 @@
+/*
+  IPAddress.h - Host stand-in, PubSubClient only stores and passes it on.
+*/
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include <stdint.h>
+
+class IPAddress {
+public:
+  IPAddress() :m_addr() { }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    m_addr[0] = a; m_addr[1] = b; m_addr[2] = c; m_addr[3] = d;
+  }
+
+private:
+  uint8_t m_addr[4];
+};
+
+#endif
@@ -0,0 +1,48 @@
+/*
+  Print.h - Host version of the Arduino Print class. Unlike the
+  PubSubClient test shim it has the buffer write() that ArduinoJson and
+  the streaming publish use.
+*/
+#ifndef Print_h
+#define Print_h
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+class __FlashStringHelper;
+
+class Print {
+public:
+  virtual ~Print() { }
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (size-- && write(*buffer++)) {
+      n++;
+    }
+    return n;
+  }
+  size_t write(const char *str) {
+    return str ? write((const uint8_t *)str, strlen(str)) : 0;
+  }
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(const __FlashStringHelper *str) {
+    return write(reinterpret_cast<const char *>(str));
+  }
+  size_t print(unsigned long n) {
+    char buf[12];
+    snprintf(buf, sizeof(buf), "%lu", n);
+    return write(buf);
+  }
+  size_t println(const char *str) { return print(str) + write("\r\n"); }
+  size_t println(float f) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%.2f", f);
+    return println(buf);
+  }
+};
+
+#endif
@@ -515,7 +515,7 @@ class TinyGsmA6 : public TinyGsmModem<TinyGsmA6>,
             } else {
               DBG("### Got: ", len, "->", sockets[mux]->rx.free());
             }
-            while (len--) { moveCharFromStreamToFifo(mux); }
+            moveBytesFromStreamToFifo(mux, len);
             // TODO(?) Deal with missing characters
             if (len_orig > sockets[mux]->available()) {
               DBG("### Fewer characters received than expected: ",
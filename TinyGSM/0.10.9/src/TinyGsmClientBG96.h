@@ -14,6 +14,7 @@
 
 #define TINY_GSM_MUX_COUNT 12
 #define TINY_GSM_BUFFER_READ_AND_CHECK_SIZE
+#define TINY_GSM_URC_PARSER
 
 #include "TinyGsmBattery.tpp"
 #include "TinyGsmCalling.tpp"
@@ -24,6 +25,8 @@
 #include "TinyGsmTCP.tpp"
 #include "TinyGsmTemperature.tpp"
 #include "TinyGsmTime.tpp"
+#include "TinyGsmMatcher.h"
+#include "TinyGsmUrc.h"
 
 #define GSM_NL "\r\n"
 static const char GSM_OK[] TINY_GSM_PROGMEM    = "OK" GSM_NL;
@@ -33,6 +36,14 @@ static const char GSM_CME_ERROR[] TINY_GSM_PROGMEM = GSM_NL "+CME ERROR:";
 static const char GSM_CMS_ERROR[] TINY_GSM_PROGMEM = GSM_NL "+CMS ERROR:";
 #endif
 
+// URCs picked out of the stream by TinyGsmUrcParser, prefixes sorted
+static const char BG96_QIURC[] TINY_GSM_PROGMEM = "+QIURC:";
+static const char* const BG96_URC_PREFIXES[] TINY_GSM_PROGMEM = {BG96_QIURC};
+
+enum BG96Urc {
+  BG96_URC_QIURC = 0,
+};
+
 enum RegStatus {
   REG_NO_RESULT    = -1,
   REG_UNREGISTERED = 0,
@@ -152,7 +163,8 @@ class TinyGsmBG96 : public TinyGsmModem<TinyGsmBG96>,
    * Constructor
    */
  public:
-  explicit TinyGsmBG96(Stream& stream) : stream(stream) {
+  explicit TinyGsmBG96(Stream& stream)
+      : stream(stream), urc(BG96_URC_PREFIXES, 1) {
     memset(sockets, 0, sizeof(sockets));
   }
 
@@ -532,7 +544,7 @@ class TinyGsmBG96 : public TinyGsmModem<TinyGsmBG96>,
     if (waitResponse(GF("+QIRD:")) != 1) { return 0; }
     int16_t len = streamGetIntBefore('\n');
 
-    for (int i = 0; i < len; i++) { moveCharFromStreamToFifo(mux); }
+    moveBytesFromStreamToFifo(mux, len);
     waitResponse();
     // DBG("### READ:", len, "from", mux);
     sockets[mux]->sock_available = modemGetAvailable(mux);
@@ -588,74 +600,8 @@ class TinyGsmBG96 : public TinyGsmModem<TinyGsmBG96>,
                       GsmConstStr r3 = NULL, GsmConstStr r4 = NULL,
 #endif
                       GsmConstStr r5 = NULL) {
-    /*String r1s(r1); r1s.trim();
-    String r2s(r2); r2s.trim();
-    String r3s(r3); r3s.trim();
-    String r4s(r4); r4s.trim();
-    String r5s(r5); r5s.trim();
-    DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
     data.reserve(64);
-    uint8_t  index       = 0;
-    uint32_t startMillis = millis();
-    do {
-      TINY_GSM_YIELD();
-      while (stream.available() > 0) {
-        TINY_GSM_YIELD();
-        int8_t a = stream.read();
-        if (a <= 0) continue;  // Skip 0x00 bytes, just in case
-        data += static_cast<char>(a);
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
-          goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-#if defined TINY_GSM_DEBUG
-          if (r3 == GFP(GSM_CME_ERROR)) {
-            streamSkipUntil('\n');  // Read out the error
-          }
-#endif
-          index = 3;
-          goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
-          goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
-          goto finish;
-        } else if (data.endsWith(GF(GSM_NL "+QIURC:"))) {
-          streamSkipUntil('\"');
-          String urc = stream.readStringUntil('\"');
-          streamSkipUntil(',');
-          if (urc == "recv") {
-            int8_t mux = streamGetIntBefore('\n');
-            DBG("### URC RECV:", mux);
-            if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
-              sockets[mux]->got_data = true;
-            }
-          } else if (urc == "closed") {
-            int8_t mux = streamGetIntBefore('\n');
-            DBG("### URC CLOSE:", mux);
-            if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
-              sockets[mux]->sock_connected = false;
-            }
-          } else {
-            streamSkipUntil('\n');
-          }
-          data = "";
-        }
-      }
-    } while (millis() - startMillis < timeout_ms);
-  finish:
-    if (!index) {
-      data.trim();
-      if (data.length()) { DBG("### Unhandled:", data); }
-      data = "";
-    }
-    // data.replace(GSM_NL, "/");
-    // DBG('<', index, '>', data);
-    return index;
+    return readResponse(timeout_ms, &data, r1, r2, r3, r4, r5);
   }
 
   int8_t waitResponse(uint32_t timeout_ms, GsmConstStr r1 = GFP(GSM_OK),
@@ -667,8 +613,13 @@ class TinyGsmBG96 : public TinyGsmModem<TinyGsmBG96>,
                       GsmConstStr r3 = NULL, GsmConstStr r4 = NULL,
 #endif
                       GsmConstStr r5 = NULL) {
+#if defined TINY_GSM_DEBUG
+    // keep the text for the "### Unhandled" log
     String data;
     return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+#else
+    return readResponse(timeout_ms, NULL, r1, r2, r3, r4, r5);
+#endif
   }
 
   int8_t waitResponse(GsmConstStr r1 = GFP(GSM_OK),
@@ -683,12 +634,82 @@ class TinyGsmBG96 : public TinyGsmModem<TinyGsmBG96>,
     return waitResponse(1000, r1, r2, r3, r4, r5);
   }
 
+ protected:
+  // Reads until the stream ends with one of r1..r5, handing URCs to the
+  // parser on the way. The text is only collected if data is given.
+  int8_t readResponse(uint32_t timeout_ms, String* data, GsmConstStr r1,
+                      GsmConstStr r2, GsmConstStr r3, GsmConstStr r4,
+                      GsmConstStr r5) {
+    TinyGsmMatcher match(r1, r2, r3, r4, r5);
+    int8_t         index       = 0;
+    uint32_t       startMillis = millis();
+    do {
+      TINY_GSM_YIELD();
+      while (stream.available() > 0) {
+        TINY_GSM_YIELD();
+        int8_t a = stream.read();
+        if (a <= 0) continue;  // Skip 0x00 bytes, just in case
+        if (data) { *data += static_cast<char>(a); }
+        index = match.feed(a);
+        if (index) {
+#if defined TINY_GSM_DEBUG
+          if (index == 3 && r3 == GFP(GSM_CME_ERROR)) {
+            streamSkipUntil('\n');  // Read out the error
+          }
+#endif
+          goto finish;
+        }
+        if (feedUrc(a)) {
+          match.reset();
+          if (data) { *data = ""; }
+        }
+      }
+    } while (millis() - startMillis < timeout_ms);
+  finish:
+    if (!index) {
+      if (data) {
+        data->trim();
+        if (data->length()) { DBG("### Unhandled:", *data); }
+        *data = "";
+      }
+    } else {
+      // the rest of the matched line is read by the caller
+      urc.reset();
+    }
+    // data.replace(GSM_NL, "/");
+    // DBG('<', index, '>', data);
+    return index;
+  }
+
+  // Passes one byte to the URC parser and acts on a completed URC line
+  bool feedUrc(char c) {
+    int8_t id = urc.feed(c);
+    if (id < 0) { return false; }
+    if (id == BG96_URC_QIURC) {
+      // +QIURC: "<event>",<connectID>[,...]
+      const char* event = strchr(urc.args(), '\"');
+      int8_t      mux   = TinyGsmUrcParser::intField(urc.args(), 1);
+      if (!event || mux < 0 || mux >= TINY_GSM_MUX_COUNT || !sockets[mux]) {
+        return true;
+      }
+      if (!strncmp(event, "\"recv\"", 6)) {
+        DBG("### URC RECV:", mux);
+        sockets[mux]->got_data = true;
+      } else if (!strncmp(event, "\"closed\"", 8)) {
+        DBG("### URC CLOSE:", mux);
+        sockets[mux]->sock_connected = false;
+      }
+    }
+    return true;
+  }
+
  public:
   Stream& stream;
 
  protected:
-  GsmClientBG96* sockets[TINY_GSM_MUX_COUNT];
-  const char*    gsmNL = GSM_NL;
+  GsmClientBG96*   sockets[TINY_GSM_MUX_COUNT];
+  const char*      gsmNL = GSM_NL;
+  TinyGsmUrcParser urc;
 };
 
 #endif  // SRC_TINYGSMCLIENTBG96_H_
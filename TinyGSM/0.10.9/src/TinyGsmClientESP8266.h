@@ -397,7 +397,7 @@ class TinyGsmESP8266 : public TinyGsmModem<TinyGsmESP8266>,
             } else {
               // DBG("### Got Data: ", len, "on", mux);
             }
-            while (len--) { moveCharFromStreamToFifo(mux); }
+            moveBytesFromStreamToFifo(mux, len);
             // TODO(SRGDamia1): deal with buffer overflow/missed characters
             if (len_orig > sockets[mux]->available()) {
               DBG("### Fewer characters received than expected: ",
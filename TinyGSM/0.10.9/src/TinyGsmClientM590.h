@@ -407,7 +407,7 @@ class TinyGsmM590 : public TinyGsmModem<TinyGsmM590>,
             } else {
               DBG("### Got: ", len, "->", sockets[mux]->rx.free());
             }
-            while (len--) { moveCharFromStreamToFifo(mux); }
+            moveBytesFromStreamToFifo(mux, len);
             // TODO(?): Handle lost characters
             if (len_orig > sockets[mux]->available()) {
               DBG("### Fewer characters received than expected: ",
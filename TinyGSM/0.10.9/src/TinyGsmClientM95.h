@@ -472,12 +472,10 @@ class TinyGsmM95 : public TinyGsmModem<TinyGsmM95>,
       // that much there. In that case, make sure we make sure we re-set the
       // amount of data available.
       if (len < size) { sockets[mux]->sock_available = len; }
-      for (uint16_t i = 0; i < len; i++) {
-        moveCharFromStreamToFifo(mux);
-        sockets[mux]->sock_available--;
-        // ^^ One less character available after moving from modem's FIFO to our
-        // FIFO
-      }
+      moveBytesFromStreamToFifo(mux, len);
+      sockets[mux]->sock_available -= len;
+      // ^^ Characters moved from modem's FIFO to our FIFO are no longer
+      // available there
       waitResponse();  // ends with an OK
       // DBG("### READ:", len, "from", mux);
       return len;
@@ -15,6 +15,7 @@
 
 #define TINY_GSM_MUX_COUNT 5
 #define TINY_GSM_BUFFER_READ_AND_CHECK_SIZE
+#define TINY_GSM_URC_PARSER
 
 #include "TinyGsmBattery.tpp"
 #include "TinyGsmCalling.tpp"
@@ -25,6 +26,8 @@
 #include "TinyGsmSSL.tpp"
 #include "TinyGsmTCP.tpp"
 #include "TinyGsmTime.tpp"
+#include "TinyGsmMatcher.h"
+#include "TinyGsmUrc.h"
 
 #define GSM_NL "\r\n"
 static const char GSM_OK[] TINY_GSM_PROGMEM    = "OK" GSM_NL;
@@ -34,6 +37,30 @@ static const char GSM_CME_ERROR[] TINY_GSM_PROGMEM = GSM_NL "+CME ERROR:";
 static const char GSM_CMS_ERROR[] TINY_GSM_PROGMEM = GSM_NL "+CMS ERROR:";
 #endif
 
+// URCs picked out of the stream by TinyGsmUrcParser, prefixes sorted
+static const char SIM800_PSNWID[] TINY_GSM_PROGMEM   = "*PSNWID:";
+static const char SIM800_PSUTTZ[] TINY_GSM_PROGMEM   = "*PSUTTZ:";
+static const char SIM800_CIPRXGET[] TINY_GSM_PROGMEM = "+CIPRXGET:";
+static const char SIM800_CTZV[] TINY_GSM_PROGMEM     = "+CTZV:";
+static const char SIM800_RECEIVE[] TINY_GSM_PROGMEM  = "+RECEIVE:";
+static const char SIM800_DST[] TINY_GSM_PROGMEM      = "DST:";
+static const char SIM800_CLOSED[] TINY_GSM_PROGMEM   = "CLOSED";
+static const char* const SIM800_URC_PREFIXES[] TINY_GSM_PROGMEM = {
+    SIM800_PSNWID, SIM800_PSUTTZ,  SIM800_CIPRXGET,
+    SIM800_CTZV,   SIM800_RECEIVE, SIM800_DST};
+static const char* const SIM800_URC_SUFFIXES[] TINY_GSM_PROGMEM = {
+    SIM800_CLOSED};
+
+enum Sim800Urc {
+  SIM800_URC_PSNWID = 0,
+  SIM800_URC_PSUTTZ,
+  SIM800_URC_CIPRXGET,
+  SIM800_URC_CTZV,
+  SIM800_URC_RECEIVE,
+  SIM800_URC_DST,
+  SIM800_URC_CLOSED,
+};
+
 enum RegStatus {
   REG_NO_RESULT    = -1,
   REG_UNREGISTERED = 0,
@@ -146,7 +173,12 @@ class TinyGsmSim800 : public TinyGsmModem<TinyGsmSim800>,
    * Constructor
    */
  public:
-  explicit TinyGsmSim800(Stream& stream) : stream(stream) {
+  explicit TinyGsmSim800(Stream& stream)
+      : stream(stream),
+        urc(SIM800_URC_PREFIXES,
+            sizeof(SIM800_URC_PREFIXES) / sizeof(SIM800_URC_PREFIXES[0]),
+            SIM800_URC_SUFFIXES,
+            sizeof(SIM800_URC_SUFFIXES) / sizeof(SIM800_URC_SUFFIXES[0])) {
     memset(sockets, 0, sizeof(sockets));
   }
 
@@ -633,101 +665,8 @@ class TinyGsmSim800 : public TinyGsmModem<TinyGsmSim800>,
                       GsmConstStr r3 = NULL, GsmConstStr r4 = NULL,
 #endif
                       GsmConstStr r5 = NULL) {
-    /*String r1s(r1); r1s.trim();
-    String r2s(r2); r2s.trim();
-    String r3s(r3); r3s.trim();
-    String r4s(r4); r4s.trim();
-    String r5s(r5); r5s.trim();
-    DBG("### ..:", r1s, ",", r2s, ",", r3s, ",", r4s, ",", r5s);*/
     data.reserve(64);
-    uint8_t  index       = 0;
-    uint32_t startMillis = millis();
-    do {
-      TINY_GSM_YIELD();
-      while (stream.available() > 0) {
-        TINY_GSM_YIELD();
-        int8_t a = stream.read();
-        if (a <= 0) continue;  // Skip 0x00 bytes, just in case
-        data += static_cast<char>(a);
-        if (r1 && data.endsWith(r1)) {
-          index = 1;
-          goto finish;
-        } else if (r2 && data.endsWith(r2)) {
-          index = 2;
-          goto finish;
-        } else if (r3 && data.endsWith(r3)) {
-#if defined TINY_GSM_DEBUG
-          if (r3 == GFP(GSM_CME_ERROR)) {
-            streamSkipUntil('\n');  // Read out the error
-          }
-#endif
-          index = 3;
-          goto finish;
-        } else if (r4 && data.endsWith(r4)) {
-          index = 4;
-          goto finish;
-        } else if (r5 && data.endsWith(r5)) {
-          index = 5;
-          goto finish;
-        } else if (data.endsWith(GF(GSM_NL "+CIPRXGET:"))) {
-          int8_t mode = streamGetIntBefore(',');
-          if (mode == 1) {
-            int8_t mux = streamGetIntBefore('\n');
-            if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
-              sockets[mux]->got_data = true;
-            }
-            data = "";
-            // DBG("### Got Data:", mux);
-          } else {
-            data += mode;
-          }
-        } else if (data.endsWith(GF(GSM_NL "+RECEIVE:"))) {
-          int8_t  mux = streamGetIntBefore(',');
-          int16_t len = streamGetIntBefore('\n');
-          if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
-            sockets[mux]->got_data = true;
-            if (len >= 0 && len <= 1024) { sockets[mux]->sock_available = len; }
-          }
-          data = "";
-          // DBG("### Got Data:", len, "on", mux);
-        } else if (data.endsWith(GF("CLOSED" GSM_NL))) {
-          int8_t nl   = data.lastIndexOf(GSM_NL, data.length() - 8);
-          int8_t coma = data.indexOf(',', nl + 2);
-          int8_t mux  = data.substring(nl + 2, coma).toInt();
-          if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
-            sockets[mux]->sock_connected = false;
-          }
-          data = "";
-          DBG("### Closed: ", mux);
-        } else if (data.endsWith(GF("*PSNWID:"))) {
-          streamSkipUntil('\n');  // Refresh network name by network
-          data = "";
-          DBG("### Network name updated.");
-        } else if (data.endsWith(GF("*PSUTTZ:"))) {
-          streamSkipUntil('\n');  // Refresh time and time zone by network
-          data = "";
-          DBG("### Network time and time zone updated.");
-        } else if (data.endsWith(GF("+CTZV:"))) {
-          streamSkipUntil('\n');  // Refresh network time zone by network
-          data = "";
-          DBG("### Network time zone updated.");
-        } else if (data.endsWith(GF("DST:"))) {
-          streamSkipUntil(
-              '\n');  // Refresh Network Daylight Saving Time by network
-          data = "";
-          DBG("### Daylight savings time state updated.");
-        }
-      }
-    } while (millis() - startMillis < timeout_ms);
-  finish:
-    if (!index) {
-      data.trim();
-      if (data.length()) { DBG("### Unhandled:", data); }
-      data = "";
-    }
-    // data.replace(GSM_NL, "/");
-    // DBG('<', index, '>', data);
-    return index;
+    return readResponse(timeout_ms, &data, r1, r2, r3, r4, r5);
   }
 
   int8_t waitResponse(uint32_t timeout_ms, GsmConstStr r1 = GFP(GSM_OK),
@@ -739,8 +678,13 @@ class TinyGsmSim800 : public TinyGsmModem<TinyGsmSim800>,
                       GsmConstStr r3 = NULL, GsmConstStr r4 = NULL,
 #endif
                       GsmConstStr r5 = NULL) {
+#if defined TINY_GSM_DEBUG
+    // keep the text for the "### Unhandled" log
     String data;
     return waitResponse(timeout_ms, data, r1, r2, r3, r4, r5);
+#else
+    return readResponse(timeout_ms, NULL, r1, r2, r3, r4, r5);
+#endif
   }
 
   int8_t waitResponse(GsmConstStr r1 = GFP(GSM_OK),
@@ -755,12 +699,111 @@ class TinyGsmSim800 : public TinyGsmModem<TinyGsmSim800>,
     return waitResponse(1000, r1, r2, r3, r4, r5);
   }
 
+ protected:
+  // Reads until the stream ends with one of r1..r5, handing URCs to the
+  // parser on the way. The text is only collected if data is given.
+  int8_t readResponse(uint32_t timeout_ms, String* data, GsmConstStr r1,
+                      GsmConstStr r2, GsmConstStr r3, GsmConstStr r4,
+                      GsmConstStr r5) {
+    TinyGsmMatcher match(r1, r2, r3, r4, r5);
+    int8_t         index       = 0;
+    uint32_t       startMillis = millis();
+    do {
+      TINY_GSM_YIELD();
+      while (stream.available() > 0) {
+        TINY_GSM_YIELD();
+        int8_t a = stream.read();
+        if (a <= 0) continue;  // Skip 0x00 bytes, just in case
+        if (data) { *data += static_cast<char>(a); }
+        index = match.feed(a);
+        if (index) {
+#if defined TINY_GSM_DEBUG
+          if (index == 3 && r3 == GFP(GSM_CME_ERROR)) {
+            streamSkipUntil('\n');  // Read out the error
+          }
+#endif
+          goto finish;
+        }
+        if (feedUrc(a)) {
+          match.reset();
+          if (data) { *data = ""; }
+        }
+      }
+    } while (millis() - startMillis < timeout_ms);
+  finish:
+    if (!index) {
+      if (data) {
+        data->trim();
+        if (data->length()) { DBG("### Unhandled:", *data); }
+        *data = "";
+      }
+    } else {
+      // the rest of the matched line is read by the caller
+      urc.reset();
+    }
+    // data.replace(GSM_NL, "/");
+    // DBG('<', index, '>', data);
+    return index;
+  }
+
+  // Passes one byte to the URC parser and acts on a completed URC line
+  bool feedUrc(char c) {
+    int8_t id = urc.feed(c);
+    if (id < 0) { return false; }
+    const char* args = urc.args();
+    switch (id) {
+      case SIM800_URC_CIPRXGET: {
+        // mode 1 announces new data, the other modes answer a command
+        if (TinyGsmUrcParser::intField(args, 0) != 1) { break; }
+        int8_t mux = TinyGsmUrcParser::intField(args, 1);
+        if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
+          sockets[mux]->got_data = true;
+        }
+        // DBG("### Got Data:", mux);
+        break;
+      }
+      case SIM800_URC_RECEIVE: {
+        int8_t  mux = TinyGsmUrcParser::intField(args, 0);
+        int16_t len = TinyGsmUrcParser::intField(args, 1);
+        if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
+          sockets[mux]->got_data = true;
+          if (len >= 0 && len <= 1024) { sockets[mux]->sock_available = len; }
+        }
+        // DBG("### Got Data:", len, "on", mux);
+        break;
+      }
+      case SIM800_URC_CLOSED: {
+        // "<mux>, CLOSED"
+        int8_t mux = TinyGsmUrcParser::intField(args, 0);
+        if (mux >= 0 && mux < TINY_GSM_MUX_COUNT && sockets[mux]) {
+          sockets[mux]->sock_connected = false;
+        }
+        DBG("### Closed: ", mux);
+        break;
+      }
+      case SIM800_URC_PSNWID:
+        DBG("### Network name updated.");
+        break;
+      case SIM800_URC_PSUTTZ:
+        DBG("### Network time and time zone updated.");
+        break;
+      case SIM800_URC_CTZV:
+        DBG("### Network time zone updated.");
+        break;
+      case SIM800_URC_DST:
+        DBG("### Daylight savings time state updated.");
+        break;
+    }
+    return true;
+  }
+
  public:
   Stream& stream;
 
  protected:
   GsmClientSim800* sockets[TINY_GSM_MUX_COUNT];
   const char*      gsmNL = GSM_NL;
+  TinyGsmUrcParser urc;
 };
 
 #endif  // SRC_TINYGSMCLIENTSIM800_H_
@@ -719,7 +719,7 @@ class TinyGsmSaraR4 : public TinyGsmModem<TinyGsmSaraR4>,
     int16_t len = streamGetIntBefore(',');
     streamSkipUntil('\"');
 
-    for (int i = 0; i < len; i++) { moveCharFromStreamToFifo(mux); }
+    moveBytesFromStreamToFifo(mux, len);
     streamSkipUntil('\"');
     waitResponse();
     // DBG("### READ:", len, "from", mux);
@@ -660,7 +660,7 @@ class TinyGsmUBLOX : public TinyGsmModem<TinyGsmUBLOX>,
     int16_t len = streamGetIntBefore(',');
     streamSkipUntil('\"');
 
-    for (int i = 0; i < len; i++) { moveCharFromStreamToFifo(mux); }
+    moveBytesFromStreamToFifo(mux, len);
     streamSkipUntil('\"');
     waitResponse();
     // DBG("### READ:", len, "from", mux);
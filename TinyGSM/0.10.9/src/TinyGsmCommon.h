@@ -46,11 +46,19 @@
 typedef const __FlashStringHelper* GsmConstStr;
 #define GFP(x) (reinterpret_cast<GsmConstStr>(x))
 #define GF(x) F(x)
+#define TINY_GSM_PGM_BYTE(p) pgm_read_byte(p)
+#define TINY_GSM_PGM_PTR(p) (reinterpret_cast<const char*>(pgm_read_word(p)))
+#define TINY_GSM_STRLEN_P(s) strlen_P(s)
+#define TINY_GSM_STRCMP_P(a, b) strcmp_P(a, b)
 #else
 #define TINY_GSM_PROGMEM
 typedef const char* GsmConstStr;
 #define GFP(x) x
 #define GF(x) x
+#define TINY_GSM_PGM_BYTE(p) (*(p))
+#define TINY_GSM_PGM_PTR(p) (*(p))
+#define TINY_GSM_STRLEN_P(s) strlen(s)
+#define TINY_GSM_STRCMP_P(a, b) strcmp(a, b)
 #endif
 
 #ifdef TINY_GSM_DEBUG
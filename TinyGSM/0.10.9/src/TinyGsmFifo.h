@@ -1,9 +1,28 @@
 #ifndef TinyGsmFifo_h
 #define TinyGsmFifo_h
 
+// Largest power of two not above n, for sizing a TinyGsmFifo from a user
+// supplied buffer length without taking more RAM than was asked for;
+// capped at the largest fifo size
+constexpr unsigned TinyGsmFifoSize(unsigned n, unsigned p = 1)
+{
+    return p > n / 2 || p == 16384 ? p : TinyGsmFifoSize(n, p << 1);
+}
+
+// Single producer / single consumer ring buffer. N must be a power of two:
+// the read and write counters run freely and are masked on access, so all
+// N slots are usable and no division is needed. Besides the copying API the
+// fifo hands out contiguous spans of its storage, so a producer can fill it
+// in place (writeSpan()/commit()) and a consumer can use the data where it
+// lies (readSpan()/consume()). Every span ends at the wrap point; a transfer
+// of any length costs at most two memcpy calls. Counts are returned as int,
+// so N stays within a 16 bit int.
 template <class T, unsigned N>
 class TinyGsmFifo
 {
+    static_assert(N && !(N & (N - 1)) && N <= 16384,
+                  "TinyGsmFifo size must be a power of two <= 16384");
+
 public:
     TinyGsmFifo()
     {
@@ -26,47 +45,57 @@ public:
 
     int free(void)
     {
-        int s = _r - _w;
-        if (s <= 0)
-            s += N;
-        return s - 1;
+        return N - size();
     }
 
     bool put(const T& c)
     {
-        int i = _w;
-        int j = i;
-        i = _inc(i);
-        if (i == _r) // !writeable()
+        unsigned w = _w;
+        if ((unsigned)(w - _r) == N) // !writeable()
             return false;
-        _b[j] = c;
-        _w = i;
+        _b[w & (N - 1)] = c;
+        _w = w + 1;
         return true;
     }
 
+    // Copies up to n elements in and returns how many were stored. With t
+    // set it waits, without limit, for another context to make room.
     int put(const T* p, int n, bool t = false)
     {
-        int c = n;
-        while (c)
+        int c = _copyIn(p, n);
+        while (t && c < n)
+        {
+            c += _copyIn(p + c, n - c);
+        }
+        return c;
+    }
+
+    // Same as put(), waiting at most timeout_ms for room
+    int putFor(const T* p, int n, uint32_t timeout_ms)
+    {
+        int c = _copyIn(p, n);
+        uint32_t start = millis();
+        while (c < n && millis() - start < timeout_ms)
         {
-            int f;
-            while ((f = free()) == 0) // wait for space
-            {
-                if (!t) return n - c; // no more space and not blocking
-                /* nothing / just wait */;
-            }
-            // check free space
-            if (c < f) f = c;
-            int w = _w;
-            int m = N - w;
-            // check wrap
-            if (f > m) f = m;
-            memcpy(&_b[w], p, f);
-            _w = _inc(w, f);
-            c -= f;
-            p += f;
+            c += _copyIn(p + c, n - c);
         }
-        return n - c;
+        return c;
+    }
+
+    // Free contiguous storage at the write position; store up to n
+    // elements there, then commit() them.
+    T* writeSpan(size_t& n)
+    {
+        unsigned w = _w & (N - 1);
+        size_t m = N - w;
+        n = free();
+        if (n > m) n = m;
+        return &_b[w];
+    }
+
+    void commit(size_t n)
+    {
+        _w += n;
     }
 
     // reading thread/context API
@@ -79,61 +108,112 @@ public:
 
     size_t size(void)
     {
-        int s = _w - _r;
-        if (s < 0)
-            s += N;
-        return s;
+        return (unsigned)(_w - _r);
     }
 
     bool get(T* p)
     {
-        int r = _r;
+        unsigned r = _r;
         if (r == _w) // !readable()
             return false;
-        *p = _b[r];
-        _r = _inc(r);
+        *p = _b[r & (N - 1)];
+        _r = r + 1;
         return true;
     }
 
+    // Copies up to n elements out and returns how many were taken. With t
+    // set it waits, without limit, for another context to deliver the rest.
     int get(T* p, int n, bool t = false)
     {
-        int c = n;
-        while (c)
+        int c = _copyOut(p, n);
+        while (t && c < n)
+        {
+            c += _copyOut(p + c, n - c);
+        }
+        return c;
+    }
+
+    // Same as get(), waiting at most timeout_ms for data
+    int getFor(T* p, int n, uint32_t timeout_ms)
+    {
+        int c = _copyOut(p, n);
+        uint32_t start = millis();
+        while (c < n && millis() - start < timeout_ms)
         {
-            int f;
-            for (;;) // wait for data
-            {
-                f = size();
-                if (f)  break;        // free space
-                if (!t) return n - c; // no space and not blocking
-                /* nothing / just wait */;
-            }
-            // check available data
-            if (c < f) f = c;
-            int r = _r;
-            int m = N - r;
-            // check wrap
-            if (f > m) f = m;
-            memcpy(p, &_b[r], f);
-            _r = _inc(r, f);
-            c -= f;
-            p += f;
+            c += _copyOut(p + c, n - c);
         }
-        return n - c;
+        return c;
+    }
+
+    bool peek(T* p)
+    {
+        if (_r == _w)
+            return false;
+        *p = _b[_r & (N - 1)];
+        return true;
+    }
+
+    // Contiguous stored data at the read position; use up to n elements
+    // in place, then consume() them.
+    const T* readSpan(size_t& n)
+    {
+        unsigned r = _r & (N - 1);
+        size_t m = N - r;
+        n = size();
+        if (n > m) n = m;
+        return &_b[r];
+    }
+
+    void consume(size_t n)
+    {
+        _r += n;
     }
 
 private:
-    int _inc(int i, int n = 1)
+    size_t _copyIn(const T* p, size_t n)
+    {
+        size_t f = free();
+        if (n > f) n = f;
+        unsigned w = _w & (N - 1);
+        size_t m = N - w;
+        if (n <= m)
+        {
+            memcpy(&_b[w], p, n * sizeof(T));
+        }
+        else
+        {
+            memcpy(&_b[w], p, m * sizeof(T));
+            memcpy(&_b[0], p + m, (n - m) * sizeof(T));
+        }
+        _w += n;
+        return n;
+    }
+
+    size_t _copyOut(T* p, size_t n)
     {
-        return (i + n) % N;
+        size_t s = size();
+        if (n > s) n = s;
+        unsigned r = _r & (N - 1);
+        size_t m = N - r;
+        if (n <= m)
+        {
+            memcpy(p, &_b[r], n * sizeof(T));
+        }
+        else
+        {
+            memcpy(p, &_b[r], m * sizeof(T));
+            memcpy(p + m, &_b[0], (n - m) * sizeof(T));
+        }
+        _r += n;
+        return n;
     }
 
-    T    _b[N];
-    int  _w;
-    int  _r;
+    T        _b[N];
+    unsigned _w;
+    unsigned _r;
 };
 
 #endif
 
-//Added by Sloeber 
+//Added by Sloeber
 #pragma once
@@ -0,0 +1,76 @@
+/**
+ * @file       TinyGsmMatcher.h
+ * @author     Volodymyr Shymanskyy
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2016 Volodymyr Shymanskyy
+ * @date       Oct 2026
+ */
+
+#ifndef SRC_TINYGSMMATCHER_H_
+#define SRC_TINYGSMMATCHER_H_
+
+#include "TinyGsmCommon.h"
+
+// Watches the incoming bytes for up to five expected responses, like the
+// data.endsWith(r1) ... data.endsWith(r5) chain in waitResponse(), without
+// keeping the data around.
+//
+// Each candidate has a KMP state: how many of its leading characters the
+// stream currently ends with. A byte either extends that match or falls
+// back to the longest border of the token that still fits. The border is
+// worked out from the token itself, so no failure table is stored and the
+// tokens can stay in flash; it only happens on a mismatch after a partial
+// match, and response tokens are short. Five bytes of state in total, no
+// heap.
+class TinyGsmMatcher {
+ public:
+  TinyGsmMatcher(GsmConstStr r1, GsmConstStr r2 = NULL, GsmConstStr r3 = NULL,
+                 GsmConstStr r4 = NULL, GsmConstStr r5 = NULL) {
+    _r[0] = reinterpret_cast<const char*>(r1);
+    _r[1] = reinterpret_cast<const char*>(r2);
+    _r[2] = reinterpret_cast<const char*>(r3);
+    _r[3] = reinterpret_cast<const char*>(r4);
+    _r[4] = reinterpret_cast<const char*>(r5);
+    reset();
+  }
+
+  void reset() {
+    memset(_k, 0, sizeof(_k));
+  }
+
+  // Returns the 1-based index of the first candidate the stream now ends
+  // with, 0 if none
+  int8_t feed(char c) {
+    int8_t index = 0;
+    for (uint8_t i = 0; i < 5; i++) {
+      const char* t = _r[i];
+      if (!t) { continue; }
+      _k[i] = step(t, _k[i], c);
+      if (!TINY_GSM_PGM_BYTE(t + _k[i]) && !index) { index = i + 1; }
+    }
+    return index;
+  }
+
+ protected:
+  // Next state after c, with t[0..k) being the current match
+  static uint8_t step(const char* t, uint8_t k, char c) {
+    if (TINY_GSM_PGM_BYTE(t + k) == c) { return k + 1; }
+    // The stream ends with t[0..k) c; find the longest t[0..j) it ends with
+    for (uint8_t j = k; j > 0; j--) {
+      if (TINY_GSM_PGM_BYTE(t + j - 1) != c) { continue; }
+      uint8_t off = k - j + 1;
+      uint8_t n   = 0;
+      while (n < j - 1 &&
+             TINY_GSM_PGM_BYTE(t + n) == TINY_GSM_PGM_BYTE(t + off + n)) {
+        n++;
+      }
+      if (n == j - 1) { return j; }
+    }
+    return 0;
+  }
+
+  const char* _r[5];
+  uint8_t     _k[5];
+};
+
+#endif  // SRC_TINYGSMMATCHER_H_
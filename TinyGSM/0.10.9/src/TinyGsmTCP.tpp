@@ -40,6 +40,9 @@
 // // Data is stored in a buffer and we can both read and check the size
 // // of the buffer
 // #define TINY_GSM_BUFFER_READ_AND_CHECK_SIZE
+// // URCs are read incrementally by a TinyGsmUrcParser; the modem provides
+// // feedUrc(char) and maintain() no longer waits on the stream
+// #define TINY_GSM_URC_PARSER
 
 template <class modemType, uint8_t muxCount>
 class TinyGsmTCP {
@@ -69,7 +72,8 @@ class TinyGsmTCP {
   class GsmClient : public Client {
     // Make all classes created from the modem template friends
     friend class TinyGsmTCP<modemType, muxCount>;
-    typedef TinyGsmFifo<uint8_t, TINY_GSM_RX_BUFFER> RxFifo;
+    // TINY_GSM_RX_BUFFER is rounded down to a power of two
+    typedef TinyGsmFifo<uint8_t, TinyGsmFifoSize(TINY_GSM_RX_BUFFER)> RxFifo;
 
    public:
     // bool init(modemType* modem, uint8_t);
@@ -162,9 +166,8 @@ class TinyGsmTCP {
       // from the modem for new data if there's nothing in the fifo.
       uint32_t _startMillis = millis();
       while (cnt < size && millis() - _startMillis < _timeout) {
-        size_t chunk = TinyGsmMin(size - cnt, rx.size());
+        size_t chunk = rx.get(buf, size - cnt);
         if (chunk > 0) {
-          rx.get(buf, chunk);
           buf += chunk;
           cnt += chunk;
           continue;
@@ -178,9 +181,8 @@ class TinyGsmTCP {
       // internal fifo if avaiable.
       at->maintain();
       while (cnt < size) {
-        size_t chunk = TinyGsmMin(size - cnt, rx.size());
+        size_t chunk = rx.get(buf, size - cnt);
         if (chunk > 0) {
-          rx.get(buf, chunk);
           buf += chunk;
           cnt += chunk;
           continue;
@@ -202,9 +204,8 @@ class TinyGsmTCP {
       // data has arrived without issuing a UURC.
       at->maintain();
       while (cnt < size) {
-        size_t chunk = TinyGsmMin(size - cnt, rx.size());
+        size_t chunk = rx.get(buf, size - cnt);
         if (chunk > 0) {
-          rx.get(buf, chunk);
           buf += chunk;
           cnt += chunk;
           continue;
@@ -305,6 +306,12 @@ class TinyGsmTCP {
 #if defined TINY_GSM_BUFFER_READ_AND_CHECK_SIZE
     // Keep listening for modem URC's and proactively iterate through
     // sockets asking if any data is avaiable
+#if defined TINY_GSM_URC_PARSER
+    // Only what has already arrived is parsed, this never waits
+    while (thisModem().stream.available()) {
+      thisModem().feedUrc(thisModem().stream.read());
+    }
+#endif
     for (int mux = 0; mux < muxCount; mux++) {
       GsmClient* sock = thisModem().sockets[mux];
       if (sock && sock->got_data) {
@@ -312,9 +319,11 @@ class TinyGsmTCP {
         sock->sock_available = thisModem().modemGetAvailable(mux);
       }
     }
+#if !defined TINY_GSM_URC_PARSER
     while (thisModem().stream.available()) {
       thisModem().waitResponse(15, NULL, NULL);
     }
+#endif
 
 #elif defined TINY_GSM_NO_MODEM_BUFFER || defined TINY_GSM_BUFFER_READ_NO_CHECK
     // Just listen for any URC's
@@ -341,6 +350,31 @@ class TinyGsmTCP {
     char c = thisModem().stream.read();
     thisModem().sockets[mux]->rx.put(c);
   }
+
+  // Moves len characters from the stream into the mux FIFO, reading straight
+  // into the FIFO's free space in runs of whatever the stream has buffered.
+  // Characters that do not fit are read and dropped, as with
+  // moveCharFromStreamToFifo, so the AT stream stays in step.
+  inline void moveBytesFromStreamToFifo(uint8_t mux, int len) {
+    GsmClient* sock = thisModem().sockets[mux];
+    if (!sock) return;
+    while (len > 0) {
+      size_t   n;
+      uint8_t* span  = sock->rx.writeSpan(n);
+      int      avail = thisModem().stream.available();
+      if (!n || avail <= 0) {
+        // FIFO full or nothing buffered yet, go one character at a time
+        moveCharFromStreamToFifo(mux);
+        len--;
+        continue;
+      }
+      n = TinyGsmMin(TinyGsmMin(n, static_cast<size_t>(len)),
+                     static_cast<size_t>(avail));
+      n = thisModem().stream.readBytes(reinterpret_cast<char*>(span), n);
+      sock->rx.commit(n);
+      len -= n;
+    }
+  }
 };
 
 #endif  // SRC_TINYGSMTCP_H_
@@ -0,0 +1,145 @@
+/**
+ * @file       TinyGsmUrc.h
+ * @author     Volodymyr Shymanskyy
+ * @license    LGPL-3.0
+ * @copyright  Copyright (c) 2016 Volodymyr Shymanskyy
+ * @date       Oct 2026
+ */
+
+#ifndef SRC_TINYGSMURC_H_
+#define SRC_TINYGSMURC_H_
+
+#include "TinyGsmCommon.h"
+
+#if !defined(TINY_GSM_URC_LINE)
+#define TINY_GSM_URC_LINE 32
+#endif
+
+// Incremental parser for unsolicited result codes.
+//
+// Bytes are fed one at a time as they come off the serial stream, so the
+// parser never waits and never rescans. URCs are recognised per line:
+//
+//  - prefix tokens ("+CIPRXGET:", "+QIURC:", ...) are matched from the
+//    start of the line by walking a trie. The trie is the token table
+//    itself, sorted in ascending (strcmp) order: the entries sharing the
+//    bytes seen so far form one contiguous range, and each byte narrows
+//    that range, so the walk keeps just two indices and a depth.
+//  - suffix tokens ("CLOSED") are compared against the end of the line,
+//    for the few URCs that put their arguments first ("0, CLOSED").
+//
+// A line is complete at '\n'. feed() then returns the id of the matching
+// token (prefixes count from 0 in table order, suffixes follow them) and
+// args() gives the rest of the line: the text after the prefix, or the
+// whole line for a suffix token. Lines longer than TINY_GSM_URC_LINE are
+// truncated. Both tables live in TINY_GSM_PROGMEM.
+class TinyGsmUrcParser {
+ public:
+  TinyGsmUrcParser(const char* const* prefixes, uint8_t prefixCount,
+                   const char* const* suffixes = NULL,
+                   uint8_t            suffixCount = 0)
+      : _prefixes(prefixes),
+        _suffixes(suffixes),
+        _prefixCount(prefixCount),
+        _suffixCount(suffixCount) {
+    _args = _line;
+    reset();
+  }
+
+  // Start over at the beginning of a line, e.g. after a command response
+  // was read directly from the stream.
+  void reset() {
+    _len   = 0;
+    _lo    = 0;
+    _hi    = _prefixCount;
+    _match = -1;
+  }
+
+  int8_t feed(char c) {
+    if (c == '\n') { return endLine(); }
+    if (c == '\r' || c == '\0') { return -1; }
+    if (_len >= TINY_GSM_URC_LINE - 1) { return -1; }
+    _line[_len] = c;
+    if (_match < 0 && _lo < _hi) { walk(c); }
+    _len++;
+    return -1;
+  }
+
+  const char* args() const {
+    return _args;
+  }
+
+  // Start of the n-th comma separated field of args, NULL if missing
+  static const char* field(const char* args, uint8_t n) {
+    while (n--) {
+      args = strchr(args, ',');
+      if (!args) { return NULL; }
+      args++;
+    }
+    return args;
+  }
+
+  // Integer value of the n-th field, -9999 if missing like
+  // streamGetIntBefore()
+  static int16_t intField(const char* args, uint8_t n) {
+    const char* f = field(args, n);
+    return f ? atoi(f) : -9999;
+  }
+
+ protected:
+  // Narrows the range of prefixes that still match the line so far
+  void walk(char c) {
+    uint8_t lo = _lo;
+    while (lo < _hi && TINY_GSM_PGM_BYTE(token(_prefixes, lo) + _len) != c) {
+      lo++;
+    }
+    uint8_t hi = lo;
+    while (hi < _hi && TINY_GSM_PGM_BYTE(token(_prefixes, hi) + _len) == c) {
+      hi++;
+    }
+    _lo = lo;
+    _hi = hi;
+    // Shorter tokens sort first, so a completed one is at the range start
+    if (lo < hi && !TINY_GSM_PGM_BYTE(token(_prefixes, lo) + _len + 1)) {
+      _match = lo;
+    }
+  }
+
+  int8_t endLine() {
+    uint8_t len = _len;
+    _line[len]  = '\0';
+    int8_t id   = _match;
+    if (id >= 0) {
+      _args = _line + TINY_GSM_STRLEN_P(token(_prefixes, id));
+    } else {
+      _args = _line;
+      for (uint8_t i = 0; i < _suffixCount; i++) {
+        const char* t  = token(_suffixes, i);
+        uint8_t     tl = TINY_GSM_STRLEN_P(t);
+        if (len >= tl && !TINY_GSM_STRCMP_P(_line + len - tl, t)) {
+          id = _prefixCount + i;
+          break;
+        }
+      }
+    }
+    reset();
+    return id;
+  }
+
+  static const char* token(const char* const* table, uint8_t i) {
+    return TINY_GSM_PGM_PTR(&table[i]);
+  }
+
+  const char* const* _prefixes;
+  const char* const* _suffixes;
+  uint8_t            _prefixCount;
+  uint8_t            _suffixCount;
+  char               _line[TINY_GSM_URC_LINE];
+  const char*        _args;
+  uint8_t            _len;
+  uint8_t            _lo;
+  uint8_t            _hi;
+  int8_t             _match;
+};
+
+#endif  // SRC_TINYGSMURC_H_
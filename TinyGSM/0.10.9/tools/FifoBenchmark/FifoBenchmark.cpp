@@ -0,0 +1,100 @@
+/**************************************************************
+ *
+ *  Host side throughput benchmark for TinyGsmFifo.
+ *  This is NOT an example for use of this library!
+ *
+ *  Build and run on a PC:
+ *    g++ -O2 -std=c++11 -I../../src FifoBenchmark.cpp -o FifoBenchmark
+ *    ./FifoBenchmark
+ *
+ *  For payloads from 1 B to 1 KB it moves the same amount of data
+ *  through a 1 KB fifo three ways:
+ *    byte  - put(c) / get(p) one element at a time
+ *    copy  - put(p, n) / get(p, n), at most two memcpy each
+ *    span  - writeSpan()/commit() and readSpan()/consume() in place
+ *
+ **************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+static uint32_t millis() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch())
+      .count();
+}
+
+#include "TinyGsmFifo.h"
+
+typedef TinyGsmFifo<uint8_t, 1024> Fifo;
+
+static const size_t TOTAL = 16UL * 1024 * 1024;
+
+static uint8_t  src[1024];
+static uint8_t  dst[1024];
+static uint32_t sink;
+
+static void runByte(Fifo& fifo, size_t len) {
+  for (size_t done = 0; done < TOTAL; done += len) {
+    for (size_t i = 0; i < len; i++) { fifo.put(src[i]); }
+    for (size_t i = 0; i < len; i++) { fifo.get(&dst[i]); }
+    sink += dst[len - 1];
+  }
+}
+
+static void runCopy(Fifo& fifo, size_t len) {
+  for (size_t done = 0; done < TOTAL; done += len) {
+    fifo.put(src, len);
+    fifo.get(dst, len);
+    sink += dst[len - 1];
+  }
+}
+
+static void runSpan(Fifo& fifo, size_t len) {
+  for (size_t done = 0; done < TOTAL; done += len) {
+    size_t left = len;
+    while (left) {
+      size_t   n;
+      uint8_t* w = fifo.writeSpan(n);
+      if (n > left) n = left;
+      memcpy(w, src + len - left, n);
+      fifo.commit(n);
+      left -= n;
+    }
+    left = len;
+    while (left) {
+      size_t         n;
+      const uint8_t* r = fifo.readSpan(n);
+      if (n > left) n = left;
+      sink += r[n - 1];
+      fifo.consume(n);
+      left -= n;
+    }
+  }
+}
+
+static double measure(void (*run)(Fifo&, size_t), size_t len) {
+  Fifo fifo;
+  // start off the wrap point so runs straddle it
+  fifo.put(src, 3);
+  fifo.get(dst, 3);
+  auto start = std::chrono::steady_clock::now();
+  run(fifo, len);
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() -
+      start;
+  return TOTAL / secs.count() / (1024 * 1024);
+}
+
+int main() {
+  for (size_t i = 0; i < sizeof(src); i++) { src[i] = i; }
+
+  printf("%8s %12s %12s %12s\n", "payload", "byte MB/s", "copy MB/s",
+         "span MB/s");
+  for (size_t len = 1; len <= 1024; len <<= 1) {
+    printf("%8zu %12.1f %12.1f %12.1f\n", len, measure(runByte, len),
+           measure(runCopy, len), measure(runSpan, len));
+  }
+  return sink == 0xFFFFFFFF;  // keep the copies alive
+}
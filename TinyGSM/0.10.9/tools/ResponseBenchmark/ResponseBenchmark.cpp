@@ -0,0 +1,130 @@
+/**************************************************************
+ *
+ *  Host side benchmark of waitResponse() matching: the String
+ *  accumulate-and-endsWith() scan used by most modems against
+ *  the TinyGsmMatcher used by SIM800 and BG96.
+ *  This is NOT an example for use of this library!
+ *
+ *  Build and run on a PC:
+ *    g++ -O2 -std=c++11 -I../UrcReplay/host -I../../src \
+ *        ResponseBenchmark.cpp -o ResponseBenchmark
+ *    ./ResponseBenchmark
+ *
+ *  Heap use is measured by counting operator new; the host
+ *  String is backed by std::string, so treat it as a lower
+ *  bound for the AVR String, which also fragments.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <chrono>
+#include <new>
+
+uint32_t hostMillis = 0;
+
+#include <TinyGsmMatcher.h>
+
+static size_t heapNow  = 0;
+static size_t heapPeak = 0;
+
+void* operator new(size_t n) {
+  size_t* p = static_cast<size_t*>(malloc(n + sizeof(size_t)));
+  if (!p) { throw std::bad_alloc(); }
+  *p = n;
+  heapNow += n;
+  if (heapNow > heapPeak) { heapPeak = heapNow; }
+  return p + 1;
+}
+void operator delete(void* ptr) noexcept {
+  if (!ptr) { return; }
+  size_t* p = static_cast<size_t*>(ptr) - 1;
+  heapNow -= *p;
+  free(p);
+}
+
+#define GSM_NL "\r\n"
+static const char GSM_OK[]        = "OK" GSM_NL;
+static const char GSM_ERROR[]     = "ERROR" GSM_NL;
+static const char GSM_CME_ERROR[] = GSM_NL "+CME ERROR:";
+static const char GSM_CMS_ERROR[] = GSM_NL "+CMS ERROR:";
+
+// One pass of typical SIM800 answers, each ends one waitResponse()
+static const char TRANSCRIPT[] =
+    "\r\nSIM800 R14.18\r\n\r\nOK\r\n"
+    "\r\n+CSQ: 21,0\r\n\r\nOK\r\n"
+    "\r\n+COPS: 0,0,\"Vodafone DE\"\r\n\r\nOK\r\n"
+    "\r\n+CME ERROR: 10\r\n"
+    "\r\n+CMGR: \"REC UNREAD\",\"+491701234567\",\"\",\"26/10/17,09:30:00+08\""
+    "\r\nThe quick brown fox jumps over the lazy dog. The quick brown fox "
+    "jumps over the lazy dog. The quick brown fox jumps over the lazy "
+    "dog.\r\n\r\nOK\r\n"
+    "\r\n+CIPRXGET: 4,0,1460\r\n\r\nOK\r\n"
+    "\r\nERROR\r\n";
+
+static const unsigned ROUNDS = 20000;
+
+// What waitResponse() does in most TinyGsmClient*.h
+static int8_t legacyWait(const char*& p, const char* r1, const char* r2,
+                         const char* r3, const char* r4, const char* r5) {
+  String data;
+  data.reserve(64);
+  while (*p) {
+    data += *p++;
+    if (r1 && data.endsWith(r1)) {
+      return 1;
+    } else if (r2 && data.endsWith(r2)) {
+      return 2;
+    } else if (r3 && data.endsWith(r3)) {
+      return 3;
+    } else if (r4 && data.endsWith(r4)) {
+      return 4;
+    } else if (r5 && data.endsWith(r5)) {
+      return 5;
+    }
+  }
+  return 0;
+}
+
+static int8_t matcherWait(const char*& p, const char* r1, const char* r2,
+                          const char* r3, const char* r4, const char* r5) {
+  TinyGsmMatcher match(r1, r2, r3, r4, r5);
+  while (*p) {
+    int8_t index = match.feed(*p++);
+    if (index) { return index; }
+  }
+  return 0;
+}
+
+typedef int8_t (*WaitFn)(const char*&, const char*, const char*, const char*,
+                         const char*, const char*);
+
+static unsigned run(const char* name, WaitFn wait) {
+  unsigned sum = 0;
+  heapNow = heapPeak = 0;
+  auto start         = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < ROUNDS; i++) {
+    const char* p = TRANSCRIPT;
+    while (*p) {
+      sum = sum * 7 + wait(p, GSM_OK, GSM_ERROR, GSM_CME_ERROR, GSM_CMS_ERROR,
+                           NULL);
+    }
+  }
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() -
+      start;
+  double bytes = (double)ROUNDS * (sizeof(TRANSCRIPT) - 1);
+  printf("%-10s %10.1f MB/s %10zu B peak heap\n", name,
+         bytes / secs.count() / 1e6, heapPeak);
+  return sum;
+}
+
+int main() {
+  printf("%zu byte transcript x %u\n", sizeof(TRANSCRIPT) - 1, ROUNDS);
+  unsigned legacy  = run("endsWith", legacyWait);
+  unsigned matcher = run("matcher", matcherWait);
+  printf("matcher state: %zu B on the stack\n", sizeof(TinyGsmMatcher));
+  if (legacy != matcher) {
+    printf("results differ!\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,110 @@
+/**************************************************************
+ *
+ *  A scripted modem on the other end of the serial line.
+ *
+ *  The script is a captured transcript: each step pairs the AT
+ *  command TinyGSM is expected to send with what the modem sent
+ *  back. Steps without a command are unsolicited output (URCs);
+ *  they stay queued until deliver() is called, so a test decides
+ *  when they arrive, even in the middle of a line.
+ *
+ *  Waiting for data is what costs time: every poll of an empty
+ *  line advances the simulated clock by 1 ms, so the time a call
+ *  spends blocked on the modem shows up in millis().
+ *
+ **************************************************************/
+
+#ifndef FAKEMODEM_H_
+#define FAKEMODEM_H_
+
+#include <Arduino.h>
+#include <string>
+
+struct FakeStep {
+  const char* command;  // NULL for unsolicited output
+  const char* reply;
+};
+
+class FakeModem : public Stream {
+ public:
+  FakeModem(const FakeStep* steps, size_t count)
+      : _steps(steps), _count(count), _next(0), _pos(0), _commands(0),
+        _unexpected(0) {}
+
+  // Queues the next unsolicited step, false when a command is due
+  bool deliver() {
+    if (_next >= _count || _steps[_next].command) { return false; }
+    _rx += _steps[_next++].reply;
+    return true;
+  }
+
+  // Queues raw modem output outside of the script
+  void push(const char* text) {
+    _rx += text;
+  }
+
+  bool done() const {
+    return _next == _count;
+  }
+  unsigned commands() const {
+    return _commands;
+  }
+  unsigned unexpected() const {
+    return _unexpected;
+  }
+
+  int available() override {
+    int n = static_cast<int>(_rx.size() - _pos);
+    if (!n) { delay(1); }
+    return n;
+  }
+  int read() override {
+    if (_pos == _rx.size()) {
+      delay(1);
+      return -1;
+    }
+    int c = static_cast<uint8_t>(_rx[_pos++]);
+    if (_pos == _rx.size()) {
+      _rx.clear();
+      _pos = 0;
+    }
+    return c;
+  }
+  int peek() override {
+    return _pos < _rx.size() ? static_cast<uint8_t>(_rx[_pos]) : -1;
+  }
+
+  size_t write(uint8_t c) override {
+    if (c == '\n') {
+      command();
+    } else if (c != '\r') {
+      _tx += static_cast<char>(c);
+    }
+    return 1;
+  }
+  using Print::write;
+
+ private:
+  void command() {
+    _commands++;
+    if (_next < _count && _steps[_next].command &&
+        _tx == _steps[_next].command) {
+      _rx += _steps[_next++].reply;
+    } else {
+      if (!_unexpected++) { printf("  unexpected command: %s\n", _tx.c_str()); }
+      _rx += "\r\nERROR\r\n";
+    }
+    _tx.clear();
+  }
+
+  const FakeStep* _steps;
+  size_t          _count;
+  size_t          _next;
+  std::string     _rx;
+  size_t          _pos;
+  std::string     _tx;
+  unsigned        _commands;
+  unsigned        _unexpected;
+};
+
+#endif  // FAKEMODEM_H_
@@ -0,0 +1,148 @@
+/**************************************************************
+ *
+ *  Host side replay of captured modem sessions through TinyGSM,
+ *  checking URC handling and measuring its cost.
+ *  This is NOT an example for use of this library!
+ *
+ *  Build and run on a PC, once per modem:
+ *    g++ -O2 -std=c++11 -DTINY_GSM_MODEM_SIM800 -Ihost -I../../src \
+ *        UrcReplay.cpp -o UrcReplay && ./UrcReplay
+ *    g++ -O2 -std=c++11 -DTINY_GSM_MODEM_BG96 -Ihost -I../../src \
+ *        UrcReplay.cpp -o UrcReplay && ./UrcReplay
+ *
+ *  Exits non-zero when a check fails.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <chrono>
+
+#include "FakeModem.h"
+
+uint32_t hostMillis = 0;
+
+#include <TinyGsmClient.h>
+
+#if defined(TINY_GSM_MODEM_SIM800)
+#define MODEM_NAME "SIM800"
+static const FakeStep SESSION[] = {
+    {"AT+CIPCLOSE=0,1", "\r\nERROR\r\n"},
+    {"AT+CIPSSL=0", "\r\nOK\r\n"},
+    {"AT+CIPSTART=0,\"TCP\",\"example.com\",80",
+     "\r\nOK\r\n\r\n0, CONNECT OK\r\n"},
+    // data arrives, the URC is split across two serial reads
+    {NULL, "\r\n+CIPRX"},
+    {NULL, "GET: 1,0\r\n"},
+    {"AT+CIPRXGET=4,0", "\r\n+CIPRXGET: 4,0,12\r\n\r\nOK\r\n"},
+    {"AT+CIPRXGET=2,0,12", "\r\n+CIPRXGET: 2,0,12,0\r\nHello world!\r\nOK\r\n"},
+    // network noise that must be swallowed, then the peer hangs up
+    {NULL, "\r\n*PSUTTZ: 2026,10,17,9,30,0,\"+8\",0\r\n\r\nDST: 0\r\n"},
+    {NULL, "\r\n0, CLOSED\r\n"},
+};
+// a URC the modem handles without a command round trip
+static const char NOISE[] = "\r\nDST: 1\r\n\r\n+CTZV: +8,0\r\n";
+
+#elif defined(TINY_GSM_MODEM_BG96)
+#define MODEM_NAME "BG96"
+static const FakeStep SESSION[] = {
+    {"AT+QICLOSE=0", "\r\nOK\r\n"},
+    {"AT+QIOPEN=1,0,\"TCP\",\"example.com\",80,0,0",
+     "\r\nOK\r\n\r\n+QIOPEN: 0,0\r\n"},
+    {NULL, "\r\n+QIURC: \"re"},
+    {NULL, "cv\",0\r\n"},
+    {"AT+QIRD=0,0", "\r\n+QIRD: 12,0,12\r\n\r\nOK\r\n"},
+    {"AT+QIRD=0,12", "\r\n+QIRD: 12\r\nHello world!\r\n\r\nOK\r\n"},
+    {"AT+QIRD=0,0", "\r\n+QIRD: 12,12,0\r\n\r\nOK\r\n"},
+    {"AT+QISTATE=1,0",
+     "\r\n+QISTATE: 0,\"TCP\",\"93.184.216.34\",80,5087,2,1,0,0,\"uart1\"\r\n"
+     "\r\nOK\r\n"},
+    {NULL, "\r\n+QIURC: \"pdpdeact\",1\r\n"},
+    {NULL, "\r\n+QIURC: \"closed\",0\r\n"},
+};
+static const char NOISE[] = "\r\n+QIURC: \"pdpdeact\",1\r\n\r\nRDY\r\n";
+
+#else
+#error Select TINY_GSM_MODEM_SIM800 or TINY_GSM_MODEM_BG96
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond)                                                  \
+  do {                                                               \
+    if (!(cond)) {                                                   \
+      printf("  FAILED line %d: %s\n", __LINE__, #cond);             \
+      failures++;                                                    \
+    }                                                                \
+  } while (0)
+
+static void replaySession() {
+  printf("%s session replay\n", MODEM_NAME);
+  FakeModem     fake(SESSION, sizeof(SESSION) / sizeof(SESSION[0]));
+  TinyGsm       modem(fake);
+  TinyGsmClient client(modem, 0);
+
+  CHECK(client.connect("example.com", 80) == 1);
+
+  // half a URC: nothing to report yet, and no waiting for the rest
+  CHECK(fake.deliver());
+  unsigned commands = fake.commands();
+  uint32_t start    = millis();
+  CHECK(client.available() == 0);
+  CHECK(fake.commands() == commands);
+  printf("  available() on a partial URC: %lu ms\n",
+         (unsigned long)(millis() - start));
+
+  CHECK(fake.deliver());
+  start = millis();
+  CHECK(client.available() == 12);
+  printf("  available() after the data URC: %lu ms\n",
+         (unsigned long)(millis() - start));
+
+  uint8_t buf[64];
+  int     n = client.read(buf, sizeof(buf));
+  CHECK(n == 12);
+  CHECK(n == 12 && !memcmp(buf, "Hello world!", 12));
+
+  while (fake.deliver()) {}
+  start = millis();
+  CHECK(!client.connected());
+  printf("  connected() after the close URC: %lu ms\n",
+         (unsigned long)(millis() - start));
+
+  CHECK(fake.done());
+  CHECK(fake.unexpected() == 0);
+}
+
+static void benchmark() {
+  printf("%s URC throughput\n", MODEM_NAME);
+  FakeModem fake(NULL, 0);
+  TinyGsm   modem(fake);
+
+  const unsigned rounds   = 200000;
+  size_t         bytes    = 0;
+  auto           start    = std::chrono::steady_clock::now();
+  uint32_t       simStart = millis();
+  for (unsigned i = 0; i < rounds; i++) {
+    fake.push(NOISE);
+    bytes += sizeof(NOISE) - 1;
+    modem.maintain();
+  }
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() -
+      start;
+  // every maintain() polls the empty line once when it is done
+  uint32_t blocked = millis() - simStart - rounds;
+  printf("  %zu bytes in %.3f s: %.1f MB/s, %.0f ns per maintain()\n",
+         bytes, secs.count(), bytes / secs.count() / 1e6,
+         secs.count() * 1e9 / rounds);
+  printf("  simulated time blocked on the modem: %lu ms\n",
+         (unsigned long)blocked);
+  CHECK(fake.commands() == 0);
+  CHECK(blocked == 0);
+}
+
+int main() {
+  replaySession();
+  benchmark();
+  printf(failures ? "%d check(s) failed\n" : "all checks passed\n", failures);
+  return failures != 0;
+}
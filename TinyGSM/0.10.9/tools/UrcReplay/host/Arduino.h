@@ -0,0 +1,295 @@
+/**************************************************************
+ *
+ *  Just enough of the Arduino core to build TinyGSM on a PC,
+ *  for the host side tools. Time is simulated: millis() only
+ *  moves when delay() is called, which TINY_GSM_YIELD() does
+ *  in every wait loop, so timeouts expire deterministically.
+ *
+ **************************************************************/
+
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define HEX 16
+#define DEC 10
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+
+extern uint32_t hostMillis;
+
+inline uint32_t millis() {
+  return hostMillis;
+}
+inline void delay(uint32_t ms) {
+  hostMillis += ms ? ms : 1;
+}
+inline void yield() {}
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline bool isDigit(int c) {
+  return isdigit(c);
+}
+template <class T, class L, class H>
+T constrain(T v, L lo, H hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+class String {
+ public:
+  String(const char* s = "") : _s(s) {}
+  String(const std::string& s) : _s(s) {}
+  String(char c) : _s(1, c) {}
+  String(int v, int base = DEC) : _s(num(v, base)) {}
+  String(unsigned v, int base = DEC) : _s(num(v, base)) {}
+  String(long v, int base = DEC) : _s(num(v, base)) {}
+  String(unsigned long v, int base = DEC) : _s(num(v, base)) {}
+  String(double v, int = 2) : _s(std::to_string(v)) {}
+
+  const char* c_str() const {
+    return _s.c_str();
+  }
+  unsigned int length() const {
+    return _s.size();
+  }
+  void reserve(unsigned int n) {
+    _s.reserve(n);
+  }
+  char charAt(unsigned int i) const {
+    return i < _s.size() ? _s[i] : 0;
+  }
+  char operator[](unsigned int i) const {
+    return charAt(i);
+  }
+  bool endsWith(const char* t) const {
+    size_t n = strlen(t);
+    return _s.size() >= n && !_s.compare(_s.size() - n, n, t);
+  }
+  bool endsWith(const String& t) const {
+    return endsWith(t.c_str());
+  }
+  bool startsWith(const char* t) const {
+    return !_s.compare(0, strlen(t), t);
+  }
+  int indexOf(char c, unsigned int from = 0) const {
+    return pos(_s.find(c, from));
+  }
+  int indexOf(const char* t, unsigned int from = 0) const {
+    return pos(_s.find(t, from));
+  }
+  int lastIndexOf(const char* t, unsigned int from) const {
+    return pos(_s.rfind(t, from));
+  }
+  String substring(unsigned int from) const {
+    return from < _s.size() ? String(_s.substr(from)) : String();
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < _s.size() ? String(_s.substr(from, to - from)) : String();
+  }
+  long toInt() const {
+    return atol(_s.c_str());
+  }
+  float toFloat() const {
+    return atof(_s.c_str());
+  }
+  void trim() {
+    size_t b = _s.find_first_not_of(" \t\r\n");
+    size_t e = _s.find_last_not_of(" \t\r\n");
+    _s = b == std::string::npos ? "" : _s.substr(b, e - b + 1);
+  }
+  void replace(const char* from, const char* to) {
+    size_t n = strlen(from);
+    for (size_t p = _s.find(from); n && p != std::string::npos;
+         p = _s.find(from, p + strlen(to))) {
+      _s.replace(p, n, to);
+    }
+  }
+  void remove(unsigned int i) {
+    if (i < _s.size()) { _s.erase(i); }
+  }
+  void remove(unsigned int i, unsigned int n) {
+    if (i < _s.size()) { _s.erase(i, n); }
+  }
+  void toUpperCase() {
+    for (size_t i = 0; i < _s.size(); i++) { _s[i] = toupper(_s[i]); }
+  }
+  void toCharArray(char* buf, unsigned int n) const {
+    strncpy(buf, _s.c_str(), n);
+  }
+  unsigned char concat(char c) {
+    _s += c;
+    return 1;
+  }
+  String& operator+=(const String& o) {
+    _s += o._s;
+    return *this;
+  }
+  String& operator+=(const char* o) {
+    _s += o;
+    return *this;
+  }
+  String& operator+=(char c) {
+    _s += c;
+    return *this;
+  }
+  String& operator+=(int v) {
+    _s += num(v, DEC);
+    return *this;
+  }
+  bool operator==(const char* o) const {
+    return _s == o;
+  }
+  bool operator!=(const char* o) const {
+    return _s != o;
+  }
+  friend String operator+(const String& a, const String& b) {
+    return String(a._s + b._s);
+  }
+
+ private:
+  static int pos(size_t p) {
+    return p == std::string::npos ? -1 : static_cast<int>(p);
+  }
+  template <class T>
+  static std::string num(T v, int base) {
+    if (base != HEX) { return std::to_string(v); }
+    char buf[20];
+    snprintf(buf, sizeof(buf), "%lX", static_cast<unsigned long>(v));
+    return buf;
+  }
+  std::string _s;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t n) {
+    for (size_t i = 0; i < n; i++) { write(buf[i]); }
+    return n;
+  }
+  size_t write(const char* s) {
+    return write(reinterpret_cast<const uint8_t*>(s), strlen(s));
+  }
+  virtual void flush() {}
+
+  size_t print(const char* s) {
+    return write(s);
+  }
+  size_t print(const String& s) {
+    return write(s.c_str());
+  }
+  size_t print(char c) {
+    return write(static_cast<uint8_t>(c));
+  }
+  template <class T>
+  size_t print(T v, int base = DEC) {
+    return print(String(v, base));
+  }
+  size_t print(double v, int digits = 2) {
+    return print(String(v, digits));
+  }
+  template <class T>
+  size_t println(T v) {
+    return print(v) + print("\r\n");
+  }
+  size_t println() {
+    return print("\r\n");
+  }
+};
+
+class Stream : public Print {
+ public:
+  Stream() : _timeout(1000) {}
+  virtual int available() = 0;
+  virtual int read()      = 0;
+  virtual int peek()      = 0;
+
+  void setTimeout(unsigned long ms) {
+    _timeout = ms;
+  }
+  size_t readBytes(char* buf, size_t n) {
+    size_t i = 0;
+    for (int c; i < n && (c = timedRead()) >= 0; i++) { buf[i] = c; }
+    return i;
+  }
+  size_t readBytes(uint8_t* buf, size_t n) {
+    return readBytes(reinterpret_cast<char*>(buf), n);
+  }
+  size_t readBytesUntil(char end, char* buf, size_t n) {
+    size_t i = 0;
+    for (int c; i < n && (c = timedRead()) >= 0 && c != end; i++) {
+      buf[i] = c;
+    }
+    return i;
+  }
+  String readStringUntil(char end) {
+    String s;
+    for (int c; (c = timedRead()) >= 0 && c != end;) { s += (char)c; }
+    return s;
+  }
+  String readString() {
+    String s;
+    for (int c; (c = timedRead()) >= 0;) { s += (char)c; }
+    return s;
+  }
+
+ protected:
+  int timedRead() {
+    uint32_t start = millis();
+    do {
+      int c = read();
+      if (c >= 0) { return c; }
+      delay(1);
+    } while (millis() - start < _timeout);
+    return -1;
+  }
+  unsigned long _timeout;
+};
+
+class IPAddress {
+ public:
+  IPAddress() {
+    memset(_b, 0, sizeof(_b));
+  }
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    _b[0] = a;
+    _b[1] = b;
+    _b[2] = c;
+    _b[3] = d;
+  }
+  uint8_t operator[](int i) const {
+    return _b[i];
+  }
+  bool operator==(const IPAddress& o) const {
+    return !memcmp(_b, o._b, sizeof(_b));
+  }
+  bool operator!=(const IPAddress& o) const {
+    return !(*this == o);
+  }
+  bool fromString(const String& s) {
+    unsigned a, b, c, d;
+    if (sscanf(s.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) != 4) {
+      return false;
+    }
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+
+ private:
+  uint8_t _b[4];
+};
+
+#endif  // HOST_ARDUINO_H_
@@ -1,6 +1,10 @@
 #include <Arduino.h>
 #include <avr/eeprom.h>
+#include "hx711_fixed.h"
+#include "hx711_tempcomp.h"
 
 extern uint32_t calibationOffsetEeprom;
 extern float calibationSlopeEeprom;
+extern Hx711Calibration calibrationTableEeprom;
+extern Hx711TemperatureTable temperatureTableEeprom;
 extern uint8_t debugData EEMEM;
@@ -9,13 +9,13 @@
 #include <stdlib.h>
 #include "eeprom_content.hpp"
 #include "pindefs.h"
+#include <PinChangeInterrupt.h>
 
-#define FIXED_POINT_FRACTIONAL_BITS 4
+Hx711 *Hx711::_active = NULL;
 
-
-Hx711::Hx711()
+Hx711::Hx711() : _sampler(_pins), _samples(HX711_SAMPLES_PER_POLARITY)
 {
-
+	_cal.clear();
 }
 
 Hx711::~Hx711()
@@ -30,6 +30,7 @@ void Hx711::init()
 	posExcitation();
 	pinMode(HX711_CLK, OUTPUT);
 	pinMode(HX711_DT, INPUT);
+	_pins.begin(HX711_CLK, HX711_DT);
 
 	digitalWrite(HX711_CLK, HIGH);
 	delayMicroseconds(100);
@@ -37,18 +38,29 @@ void Hx711::init()
 
 	averageValue();
 
+	eeprom_read_block(&_cal, &calibrationTableEeprom, sizeof(_cal));
+	if (!_cal.valid())
 	{
+		// migrate the single point float calibration
 		int32_t offset = eeprom_read_dword((uint32_t*)&calibationOffsetEeprom);
-//		EEPROM.get<int32_t>(100, offset);
+		float slope = eeprom_read_float(&calibationSlopeEeprom);
+		if (!(slope > 0.f))
+		{
+			slope = 742.f; // erased EEPROM
+		}
+		_cal.clear();
 		setOffset(offset);
-		Serial.println(offset);
+		setScale(slope);
+		saveCalibration();
 	}
+	Serial.println(_cal.zero());
+	Serial.println(_cal.slope());
 
+	eeprom_read_block(&_tempComp, &temperatureTableEeprom, sizeof(_tempComp));
+	if (!_tempComp.valid())
 	{
-		float slope = eeprom_read_float(&calibationSlopeEeprom);
-//		EEPROM.get<float>(104, slope);
-		setScale(slope);
-		Serial.println(slope);
+		_tempComp.clear(HX711_TEMP_FULL_SCALE_MG);
+		saveTemperatureTable();
 	}
 	Serial.println(F("Hx711 Init Complete"));
 }
@@ -66,112 +78,167 @@ uint32_t Hx711::averageValue(byte times)
 	return sum;
 }
 
-uint32_t Hx711::calibrate(int32_t weight, bool enableAcExcitation)
+uint32_t Hx711::measure(bool enableAcExcitation)
 {
 	uint32_t valp, valn;
+	Hx711DefaultFilter filter;
 
 	powerOn();
-	delay(5000);
 	if (enableAcExcitation)
 	{
+		// the conversion in flight straddles the excitation switch
 		posExcitation();
-		delay(10);
-		valp = averageValue(15);
+		_sampler.discard(1);
+		valp = filteredValue(filter, _samples);
 
 		negExcitation();
-		delay(10);
-		valn = averageValue(15);
+		_sampler.discard(1);
+		valn = filteredValue(filter, _samples);
 	}
 	else
 	{
-		valn = averageValue(15) << 1;
+		valn = filteredValue(filter, _samples) << 1;
 		valp = 0;
 	}
 	powerOff();
-	uint32_t val = (valn - valp)>>1;
-	Serial.print('C'); Serial.println(weight);
+	return (valn - valp) >> 1;
+}
+
+uint32_t Hx711::calibrate(int32_t weight, bool enableAcExcitation)
+{
+	return calibrateMilligram(weight * 1000L, enableAcExcitation);
+}
+
+/*
+ * Weight 0 re-zeroes the whole curve, any other weight adds or replaces a
+ * point of the piecewise-linear calibration.
+ */
+uint32_t Hx711::calibrateMilligram(int32_t weightMg, bool enableAcExcitation)
+{
+	powerOn();
+	delay(5000);
+	uint32_t val = measure(enableAcExcitation);
+	Serial.print('C'); Serial.println(weightMg);
 	Serial.println(val);
-	if (weight == 0)
+
+	_cal.addPoint(val, weightMg);
+	if (weightMg == 0)
 	{
 		eeprom_write_dword(&calibationOffsetEeprom, val);
-		setOffset(val);
-		Serial.println(val);
-//		EEPROM.put<uint32_t>(100, average);
-//		uint32_t marker = 0xC0FFEE0C;
-//		EEPROM.put<uint32_t>(108, marker);
-	}
-	else
-	{
-	    float slope = ((double)((double)val - (double)getOffset())/(double)weight);
-
-		eeprom_write_float(&calibationSlopeEeprom, slope);
-		Serial.println(slope);
-		setScale(slope);
-//		EEPROM.put<float>(104, slope);
-//		uint32_t marker = 0xC0FFEE0D;
-//		EEPROM.put<uint32_t>(108, marker);
 	}
+	saveCalibration();
+	Serial.println(_cal.slope());
 	return val;
 }
 
+void Hx711::tare(bool enableAcExcitation)
+{
+	_cal.tare(measure(enableAcExcitation));
+	saveCalibration();
+}
+
+void Hx711::saveCalibration()
+{
+	eeprom_update_block(&_cal, &calibrationTableEeprom, sizeof(_cal));
+}
+
+/*
+ * Weighs the reference weight of table row weightPoint at the current
+ * temperature and stores the deviation from the calibrated value.
+ */
+int32_t Hx711::learnTemperature(uint8_t weightPoint, int16_t temperature, bool enableAcExcitation)
+{
+	int32_t error = getMilligram(enableAcExcitation) - _tempComp.weight(weightPoint);
+	_tempComp.learn(weightPoint, temperature, error);
+	saveTemperatureTable();
+	return error;
+}
+
+void Hx711::saveTemperatureTable()
+{
+	eeprom_update_block(&_tempComp, &temperatureTableEeprom, sizeof(_tempComp));
+}
+
 uint32_t Hx711::getValue(const uint32_t timeout)
 {
-	byte data[3];
-	const uint32_t startTime = millis();
-	while (digitalRead(HX711_DT))
+	uint32_t value;
+	bool settled;
+	do
 	{
-		if ((millis() - startTime) > timeout)
+		const uint32_t startTime = millis();
+		while (!_pins.isReady())
 		{
-			Serial.print(F("HX timeout"));
-//			return 0xFFFF;
+			if ((millis() - startTime) > timeout)
+			{
+				Serial.print(F("HX timeout"));
+//				return 0xFFFF;
+			}
 		}
-	}
 
-	for (byte j = 3; j--;)
-	{
-		for (char i = 8; i--;)
-		{
-			digitalWrite(HX711_CLK, HIGH);
-			bitWrite(data[j], i, digitalRead(HX711_DT));
-			digitalWrite(HX711_CLK, LOW);
-		}
-	}
-	digitalWrite(HX711_CLK, HIGH);
-	digitalWrite(HX711_CLK, LOW);
+		// PD_SCK high for more than 60us powers the chip down, keep ISRs out
+		uint8_t oldSREG = SREG;
+		cli();
+		settled = _sampler.shift(value);
+		SREG = oldSREG;
+	} while (!settled);
 
-	data[2] ^= 0x80;
+	return value;
+}
 
-	return ((uint32_t) data[2] << 16) | ((uint32_t) data[1] << 8)
-			| (uint32_t) data[0];
+void Hx711::setGain(uint8_t gain)
+{
+	_sampler.setPulses(gain);
 }
 
-float Hx711::getGram(bool enableAcExcitation)
+void Hx711::setRate(bool fast)
 {
-	uint32_t valp, valn;
-	powerOn();
+#ifdef HX711_RATE
+	pinMode(HX711_RATE, OUTPUT);
+	digitalWrite(HX711_RATE, fast ? HIGH : LOW);
+	_sampler.discard(1 + HX711_SETTLE_CONVERSIONS);
+#else
+	(void)fast; // RATE strapped on the board
+#endif
+}
 
-	if (enableAcExcitation)
-	{
-		posExcitation();
-		delay(10);
-		valp = averageValue(15);
+void Hx711::setBurst(bool burst)
+{
+	setRate(burst);
+	_samples = burst ? HX711_BURST_SAMPLES : HX711_SAMPLES_PER_POLARITY;
+}
 
-		negExcitation();
-		delay(10);
-		valn = averageValue(15);
-	}
-	else
+void Hx711::startSampling()
+{
+	_active = this;
+	_sampler.start();
+	attachPCINT(digitalPinToPCINT(HX711_DT), onDataReadyIsr, FALLING);
+}
+
+void Hx711::stopSampling()
+{
+	detachPCINT(digitalPinToPCINT(HX711_DT));
+	_sampler.stop();
+}
+
+void Hx711::onDataReadyIsr()
+{
+	if (_active)
 	{
-		valn = averageValue(15)<<1;
-		valp = 0;
+		_active->_sampler.onDataReady();
 	}
+}
 
-	powerOff();
-	long val = (((valn - valp)>>1) - _offset);
-	return (float) val / _scale;
+int32_t Hx711::getMilligram(bool enableAcExcitation)
+{
+	return _cal.toMilligram(measure(enableAcExcitation));
 }
 
-uint16_t Hx711::float_to_fixed(double input)
+int32_t Hx711::getCompensatedMilligram(int16_t temperature, bool enableAcExcitation)
+{
+	return _tempComp.compensate(getMilligram(enableAcExcitation), temperature);
+}
+
+float Hx711::getGram(bool enableAcExcitation)
 {
-    return (uint16_t)(input * (1 << FIXED_POINT_FRACTIONAL_BITS));
+	return getMilligram(enableAcExcitation) * 0.001f;
 }
@@ -16,6 +16,146 @@
 #define HX711_H_
 
 #include "Arduino.h"
+#include "hx711_sampler.h"
+#include "hx711_filter.h"
+#include "hx711_fixed.h"
+#include "hx711_tempcomp.h"
+#include "hx711_array.h"
+
+#ifndef HX711_SAMPLES_PER_POLARITY
+#define HX711_SAMPLES_PER_POLARITY 8
+#endif
+
+#ifndef HX711_BURST_SAMPLES
+#define HX711_BURST_SAMPLES 4
+#endif
+
+#ifndef HX711_RING_SIZE
+#define HX711_RING_SIZE 16
+#endif
+
+/*
+ * Direct port access to the clock and data lines. The registers are looked
+ * up once in begin() so the shift-in loop costs a few cycles per bit
+ * instead of a digitalWrite()/digitalRead() table walk.
+ */
+class Hx711PortPins
+{
+public:
+	void begin(uint8_t clkPin, uint8_t dtPin)
+	{
+		_clkOut = portOutputRegister(digitalPinToPort(clkPin));
+		_clkMask = digitalPinToBitMask(clkPin);
+		_dtIn = portInputRegister(digitalPinToPort(dtPin));
+		_dtMask = digitalPinToBitMask(dtPin);
+	}
+
+	inline void clockHigh()
+	{
+		*_clkOut |= _clkMask;
+		delayMicroseconds(1); // PD_SCK high time >= 0.2us, DOUT valid after 0.1us
+	}
+
+	inline void clockLow()
+	{
+		*_clkOut &= ~_clkMask;
+	}
+
+	inline uint8_t readData()
+	{
+		return (*_dtIn & _dtMask) ? 1 : 0;
+	}
+
+	inline bool isReady()
+	{
+		return !(*_dtIn & _dtMask);
+	}
+
+private:
+	volatile uint8_t *_clkOut;
+	volatile uint8_t *_dtIn;
+	uint8_t _clkMask;
+	uint8_t _dtMask;
+};
+
+class Hx711ArrayPortPins
+{
+public:
+	void begin(uint8_t clkPin, volatile uint8_t *dtIn)
+	{
+		_clkOut = portOutputRegister(digitalPinToPort(clkPin));
+		_clkMask = digitalPinToBitMask(clkPin);
+		_dtIn = dtIn;
+	}
+
+	inline void clockHigh()
+	{
+		*_clkOut |= _clkMask;
+		delayMicroseconds(1);
+	}
+
+	inline void clockLow()
+	{
+		*_clkOut &= ~_clkMask;
+	}
+
+	inline uint8_t readPort()
+	{
+		return *_dtIn;
+	}
+
+private:
+	volatile uint8_t *_clkOut;
+	volatile uint8_t *_dtIn;
+	uint8_t _clkMask;
+};
+
+/*
+ * N load cells on one shared clock line, read in parallel. All data pins
+ * must be on the same port, begin() returns false otherwise.
+ */
+template <uint8_t N>
+class Hx711Array : public Hx711ArrayCore<N, Hx711ArrayPortPins>
+{
+public:
+	bool begin(uint8_t clkPin, const uint8_t (&dtPins)[N])
+	{
+		uint8_t port = digitalPinToPort(dtPins[0]);
+		uint8_t masks[N];
+		for (uint8_t c = 0; c < N; c++)
+		{
+			if (digitalPinToPort(dtPins[c]) != port)
+			{
+				return false;
+			}
+			pinMode(dtPins[c], INPUT);
+			masks[c] = digitalPinToBitMask(dtPins[c]);
+		}
+		pinMode(clkPin, OUTPUT);
+		digitalWrite(clkPin, LOW);
+		this->pins().begin(clkPin, portInputRegister(port));
+		this->setMasks(masks);
+		return true;
+	}
+
+	// waits for all channels, false on timeout
+	bool read(uint32_t (&values)[N], int32_t &total, const uint32_t timeout = 3000)
+	{
+		const uint32_t startTime = millis();
+		while (!this->isReady())
+		{
+			if ((millis() - startTime) > timeout)
+			{
+				return false;
+			}
+		}
+		uint8_t oldSREG = SREG;
+		cli();
+		bool ok = Hx711ArrayCore<N, Hx711ArrayPortPins>::read(values, total);
+		SREG = oldSREG;
+		return ok;
+	}
+};
 
 class Hx711
 {
@@ -26,33 +166,100 @@ public:
 	void init();
 
 	uint32_t getValue(const uint32_t timeout = 3000);
+
+	/*
+	 * HX711_CHANNEL_A_GAIN_128 (default), HX711_CHANNEL_A_GAIN_64 or
+	 * HX711_CHANNEL_B_GAIN_32. Unsettled conversions after a change are
+	 * dropped by getValue() and the sampler. The calibration is only valid
+	 * for the gain it was taken with.
+	 */
+	void setGain(uint8_t gain = HX711_CHANNEL_A_GAIN_128);
+	uint8_t getGain()
+	{
+		return _sampler.pulses();
+	}
+	// 80 SPS when true, needs HX711_RATE in pindefs.h
+	void setRate(bool fast);
+	// 80 SPS and HX711_BURST_SAMPLES per polarity, e.g. for a quick tare
+	void setBurst(bool burst);
 	uint32_t averageValue(byte times = 2); // 32
+	template <class Filter>
+	uint32_t filteredValue(Filter &filter, byte times);
 	float getGram(bool enableAcExcitation = true);
+	int32_t getMilligram(bool enableAcExcitation = true);
+	int32_t toMilligram(uint32_t value)
+	{
+		return _cal.toMilligram(value);
+	}
 	uint32_t calibrate(int32_t weight, bool enableAcExcitation = true);
+	uint32_t calibrateMilligram(int32_t weightMg, bool enableAcExcitation = true);
+	void tare(bool enableAcExcitation = true);
+
+	// temperature in 1/100 degC, see hx711_tempcomp.h
+	int32_t getCompensatedMilligram(int16_t temperature, bool enableAcExcitation = true);
+	int32_t learnTemperature(uint8_t weightPoint, int16_t temperature, bool enableAcExcitation = true);
+
+	// interrupt driven acquisition, DOUT falling edge via PinChangeInterrupt
+	void startSampling();
+	void stopSampling();
+	uint8_t available()
+	{
+		return _sampler.available();
+	}
+	bool read(uint32_t &value)
+	{
+		return _sampler.read(value);
+	}
+	uint8_t overruns()
+	{
+		return _sampler.overruns();
+	}
 
 
 	void setOffset(uint32_t offset)
 	{
-		_offset = offset;
+		_cal.addPoint(offset, 0);
 	}
 
 	uint32_t getOffset()
 	{
-		return _offset;
+		return _cal.zero();
 	}
+
+	// counts per gram, converted to the fixed point slope once
 	void setScale(float scale = 742.f)
 	{
-		_scale = scale;
+		_cal.setLinear(_cal.count() ? _cal.zero() : 0,
+				(int32_t)(1000.f * (1UL << HX711_CAL_FRAC_BITS) / scale));
 	}
 	float getScale()
 	{
-		return _scale;
+		return 1000.f * (1UL << HX711_CAL_FRAC_BITS) / _cal.slope();
 	}
-    uint16_t float_to_fixed(double input);
+
+	Hx711Calibration &calibration()
+	{
+		return _cal;
+	}
+	void saveCalibration();
+
+	Hx711TemperatureTable &temperatureTable()
+	{
+		return _tempComp;
+	}
+	void saveTemperatureTable();
 
 private:
-	long _offset;
-	float _scale;
+	Hx711Calibration _cal;
+	Hx711TemperatureTable _tempComp;
+	Hx711PortPins _pins;
+	Hx711Sampler<Hx711PortPins, HX711_RING_SIZE> _sampler;
+	byte _samples;
+
+	uint32_t measure(bool enableAcExcitation);
+
+	static Hx711 *_active;
+	static void onDataReadyIsr();
 
 	inline void powerOn()
 	{
@@ -75,4 +282,31 @@ private:
 	}
 };
 
+/*
+ * Feeds `times` conversions through a filter chain and returns its last
+ * output, or the last raw conversion if every sample was rejected.
+ */
+template <class Filter>
+uint32_t Hx711::filteredValue(Filter &filter, byte times)
+{
+	int32_t value = 0;
+	bool valid = false;
+	filter.reset();
+	for (byte i = 0; i < times; i++)
+	{
+		int32_t raw = getValue();
+		int32_t out;
+		if (filter.update(raw, out))
+		{
+			value = out;
+			valid = true;
+		}
+		else if (!valid)
+		{
+			value = raw;
+		}
+	}
+	return value;
+}
+
 #endif /* HX711_H_ */
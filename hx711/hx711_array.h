@@ -0,0 +1,99 @@
+/*
+ * hx711_array.h
+ *
+ * N HX711 chips sharing one PD_SCK line, with their DOUT lines on the same
+ * port. Every clock edge shifts one bit out of all chips at once, so a
+ * reading of all channels takes as long as a reading of one, and each bit
+ * costs a single port read. Hx711Array<N> in hx711.h binds this to the
+ * AVR ports.
+ *
+ * A Pins policy provides:
+ *	void clockHigh();
+ *	void clockLow();
+ *	uint8_t readPort();	// input register holding all DOUT lines
+ */
+
+#ifndef HX711_ARRAY_H_
+#define HX711_ARRAY_H_
+
+#include <stdint.h>
+#include "hx711_sampler.h"
+
+template <uint8_t N, class Pins>
+class Hx711ArrayCore
+{
+public:
+	Hx711ArrayCore() : _readyMask(0)
+	{
+	}
+
+	// DOUT bit of every channel within the port read by Pins::readPort()
+	void setMasks(const uint8_t (&masks)[N])
+	{
+		_readyMask = 0;
+		for (uint8_t c = 0; c < N; c++)
+		{
+			_mask[c] = masks[c];
+			_readyMask |= masks[c];
+		}
+	}
+
+	Pins &pins()
+	{
+		return _pins;
+	}
+
+	// every chip has a conversion waiting
+	bool isReady()
+	{
+		return !(_pins.readPort() & _readyMask);
+	}
+
+	/*
+	 * Clocks one conversion out of every channel, offset binary as in
+	 * Hx711::getValue(). total is the sum of the signed channel values,
+	 * i.e. the whole platform. Returns false when a chip is not ready.
+	 */
+	bool read(uint32_t (&values)[N], int32_t &total, uint8_t pulses = HX711_PULSES_DEFAULT)
+	{
+		if (!isReady())
+		{
+			return false;
+		}
+		for (uint8_t c = 0; c < N; c++)
+		{
+			values[c] = 0;
+		}
+		for (uint8_t i = 24; i--;)
+		{
+			_pins.clockHigh();
+			uint8_t port = _pins.readPort();
+			_pins.clockLow();
+			for (uint8_t c = 0; c < N; c++)
+			{
+				values[c] = (values[c] << 1) | ((port & _mask[c]) ? 1 : 0);
+			}
+		}
+		for (uint8_t i = pulses - 24; i--;)
+		{
+			_pins.clockHigh();
+			_pins.clockLow();
+		}
+
+		total = 0;
+		for (uint8_t c = 0; c < N; c++)
+		{
+			// sign extend the two's complement 24 bit value
+			total += (int32_t)(values[c] << 8) >> 8;
+			values[c] ^= 0x800000UL;
+		}
+		return true;
+	}
+
+private:
+	Pins _pins;
+	uint8_t _mask[N];
+	uint8_t _readyMask;
+};
+
+#endif /* HX711_ARRAY_H_ */
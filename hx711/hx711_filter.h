@@ -0,0 +1,314 @@
+/*
+ * hx711_filter.h
+ *
+ * Fixed memory streaming filters for load cell samples. Every stage has
+ *	void reset();
+ *	bool update(int32_t in, int32_t &out);	// false: no output yet / rejected
+ * and stages are chained at compile time with Hx711FilterChain<...>, e.g.
+ *
+ *	Hx711FilterChain<Hx711MadGate<8, 3>, Hx711MedianFilter<5> > filter;
+ *
+ * Nothing here allocates; sizeof() of a chain is its whole RAM cost.
+ */
+
+#ifndef HX711_FILTER_H_
+#define HX711_FILTER_H_
+
+#include <stdint.h>
+
+/*
+ * Last N samples kept both in arrival order and sorted, so median and
+ * trimmed statistics cost one O(N) insertion per sample.
+ */
+template <uint8_t N>
+class Hx711SortedWindow
+{
+public:
+	Hx711SortedWindow()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		_count = 0;
+		_next = 0;
+	}
+
+	void insert(int32_t value)
+	{
+		uint8_t pos;
+		if (_count == N)
+		{
+			// drop the oldest sample from the sorted array
+			int32_t oldest = _fifo[_next];
+			for (pos = 0; _sorted[pos] != oldest; pos++)
+				;
+			for (; pos < N - 1; pos++)
+			{
+				_sorted[pos] = _sorted[pos + 1];
+			}
+			_count--;
+		}
+		_fifo[_next] = value;
+		_next = (_next + 1) % N;
+
+		for (pos = _count; pos && _sorted[pos - 1] > value; pos--)
+		{
+			_sorted[pos] = _sorted[pos - 1];
+		}
+		_sorted[pos] = value;
+		_count++;
+	}
+
+	uint8_t count() const
+	{
+		return _count;
+	}
+
+	bool full() const
+	{
+		return _count == N;
+	}
+
+	int32_t median() const
+	{
+		return _sorted[_count >> 1];
+	}
+
+	// mean of the sorted samples with `trim` dropped at each end
+	int32_t trimmedMean(uint8_t trim) const
+	{
+		if (2 * trim >= _count)
+		{
+			return median();
+		}
+		int32_t sum = 0;
+		int32_t base = _sorted[trim];
+		for (uint8_t i = trim; i < _count - trim; i++)
+		{
+			sum += _sorted[i] - base; // relative to keep 24 bit values from overflowing
+		}
+		return base + sum / (int32_t)(_count - 2 * trim);
+	}
+
+	// median of |x - median|, the median absolute deviation
+	uint32_t mad() const
+	{
+		int32_t m = median();
+		uint8_t lo = _count >> 1, hi = lo + 1;
+		uint32_t d = 0;
+		// merge outwards from the median, the (count/2)th step is the MAD
+		for (uint8_t i = 0; i <= (_count >> 1); i++)
+		{
+			uint32_t dl = lo < _count ? (uint32_t)(m - _sorted[lo]) : 0xFFFFFFFFUL;
+			uint32_t dh = hi < _count ? (uint32_t)(_sorted[hi] - m) : 0xFFFFFFFFUL;
+			if (dl <= dh)
+			{
+				d = dl;
+				lo--; // wraps past 0 to 0xFF which reads as exhausted
+			}
+			else
+			{
+				d = dh;
+				hi++;
+			}
+		}
+		return d;
+	}
+
+private:
+	static_assert(N > 0 && N < 128, "Hx711SortedWindow size must be 1..127");
+
+	int32_t _fifo[N];
+	int32_t _sorted[N];
+	uint8_t _count;
+	uint8_t _next;
+};
+
+// running median over the last N samples
+template <uint8_t N>
+class Hx711MedianFilter
+{
+public:
+	void reset()
+	{
+		_window.reset();
+	}
+
+	bool update(int32_t in, int32_t &out)
+	{
+		_window.insert(in);
+		out = _window.median();
+		return true;
+	}
+
+private:
+	Hx711SortedWindow<N> _window;
+};
+
+// mean of the last N samples without the Trim smallest and largest
+template <uint8_t N, uint8_t Trim>
+class Hx711TrimmedMean
+{
+public:
+	void reset()
+	{
+		_window.reset();
+	}
+
+	bool update(int32_t in, int32_t &out)
+	{
+		_window.insert(in);
+		out = _window.trimmedMean(Trim);
+		return true;
+	}
+
+private:
+	static_assert(2 * Trim < N, "Hx711TrimmedMean trims the whole window");
+
+	Hx711SortedWindow<N> _window;
+};
+
+/*
+ * First order IIR, y += (x - y) / 2^Shift. The state carries Shift extra
+ * fractional bits so small steps are not lost to truncation.
+ * Assumes 24 bit samples, signed or offset binary.
+ */
+template <uint8_t Shift>
+class Hx711IirFilter
+{
+public:
+	Hx711IirFilter() : _primed(false)
+	{
+	}
+
+	void reset()
+	{
+		_primed = false;
+	}
+
+	bool update(int32_t in, int32_t &out)
+	{
+		int32_t x = in * ((int32_t)1 << Shift);
+		if (!_primed)
+		{
+			_state = x;
+			_primed = true;
+		}
+		else
+		{
+			_state += (x - _state) >> Shift;
+		}
+		out = (int32_t)(_state >> Shift);
+		return true;
+	}
+
+private:
+	static_assert(Shift <= 6, "Hx711IirFilter state must fit 24 bit samples in 32 bits");
+
+	int32_t _state;
+	bool _primed;
+};
+
+/*
+ * Outlier gate: drops samples further than K * MAD from the median of the
+ * last N accepted samples. A run of N/2 rejections is taken as a real load
+ * change (a bee colony does not land all at once, but a person lifting the
+ * roof does) and restarts the window from the new level.
+ */
+template <uint8_t N, uint8_t K, uint16_t MinMad = 16>
+class Hx711MadGate
+{
+public:
+	Hx711MadGate() : _rejected(0)
+	{
+	}
+
+	void reset()
+	{
+		_window.reset();
+		_rejected = 0;
+	}
+
+	bool update(int32_t in, int32_t &out)
+	{
+		if (_window.count() >= (N >> 1))
+		{
+			uint32_t mad = _window.mad();
+			if (mad < MinMad)
+			{
+				mad = MinMad;
+			}
+			int32_t d = in - _window.median();
+			uint32_t dev = d < 0 ? (uint32_t)-d : (uint32_t)d;
+			if (dev > mad * K)
+			{
+				if (++_rejected < (N >> 1))
+				{
+					return false;
+				}
+				_window.reset();
+			}
+		}
+		_rejected = 0;
+		_window.insert(in);
+		out = in;
+		return true;
+	}
+
+private:
+	Hx711SortedWindow<N> _window;
+	uint8_t _rejected;
+};
+
+/*
+ * Compile time composition: the output of each stage feeds the next, a
+ * stage returning false stops the sample there.
+ */
+template <class... Stages>
+class Hx711FilterChain;
+
+template <>
+class Hx711FilterChain<>
+{
+public:
+	void reset()
+	{
+	}
+
+	bool update(int32_t in, int32_t &out)
+	{
+		out = in;
+		return true;
+	}
+};
+
+template <class First, class... Rest>
+class Hx711FilterChain<First, Rest...>
+{
+public:
+	void reset()
+	{
+		_first.reset();
+		_rest.reset();
+	}
+
+	bool update(int32_t in, int32_t &out)
+	{
+		int32_t mid;
+		return _first.update(in, mid) && _rest.update(mid, out);
+	}
+
+private:
+	First _first;
+	Hx711FilterChain<Rest...> _rest;
+};
+
+#ifndef HX711_DEFAULT_FILTER
+#define HX711_DEFAULT_FILTER Hx711FilterChain<Hx711MadGate<8, 4>, Hx711TrimmedMean<8, 2> >
+#endif
+
+typedef HX711_DEFAULT_FILTER Hx711DefaultFilter;
+
+#endif /* HX711_FILTER_H_ */
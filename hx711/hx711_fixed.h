@@ -0,0 +1,208 @@
+/*
+ * hx711_fixed.h
+ *
+ * Integer only raw count -> milligram conversion. The calibration is a
+ * short piecewise-linear table of (raw, mg) points sorted by raw count,
+ * each with the slope of the segment above it in milligram per count as a
+ * signed Q(31 - FracBits).FracBits fixed point number. Slopes are computed
+ * once at calibration time, so a reading costs one 32x32 multiply and a
+ * shift, no float division and no libm.
+ *
+ * The class is a plain struct of integers so it can be stored in EEPROM
+ * with eeprom_read_block()/eeprom_update_block() as is.
+ */
+
+#ifndef HX711_FIXED_H_
+#define HX711_FIXED_H_
+
+#include <stdint.h>
+
+#ifndef HX711_CAL_POINTS
+#define HX711_CAL_POINTS 4
+#endif
+
+#ifndef HX711_CAL_FRAC_BITS
+#define HX711_CAL_FRAC_BITS 16
+#endif
+
+template <uint8_t Points, uint8_t FracBits>
+class Hx711FixedCal
+{
+public:
+	static const uint8_t MAGIC = 0xCA;
+
+	void clear()
+	{
+		_magic = MAGIC;
+		_count = 0;
+		_tare = 0;
+	}
+
+	// false for erased (0xFF) or foreign EEPROM content
+	bool valid() const
+	{
+		return _magic == MAGIC && _count <= Points;
+	}
+
+	uint8_t count() const
+	{
+		return _count;
+	}
+
+	// single segment through (offset, 0 mg) with the given slope
+	void setLinear(int32_t offset, int32_t slope)
+	{
+		clear();
+		_raw[0] = offset;
+		_mg[0] = 0;
+		_slope[0] = slope;
+		_count = 1;
+	}
+
+	/*
+	 * Adds a calibration point. Re-calibrating zero shifts the whole curve,
+	 * as the offset of a load cell drifts while its span stays put. A point
+	 * with a known weight replaces the previous one of the same weight, or
+	 * the closest one when the table is full.
+	 */
+	void addPoint(int32_t raw, int32_t mg)
+	{
+		uint8_t i = find(mg);
+		if (i < _count && mg == 0)
+		{
+			int32_t shift = raw - _raw[i];
+			for (uint8_t j = 0; j < _count; j++)
+			{
+				_raw[j] += shift;
+			}
+			return;
+		}
+		if (i < _count || _count == Points)
+		{
+			i = i < _count ? i : closest(mg);
+			remove(i);
+		}
+		for (i = _count; i && _raw[i - 1] > raw; i--)
+		{
+			_raw[i] = _raw[i - 1];
+			_mg[i] = _mg[i - 1];
+			_slope[i] = _slope[i - 1];
+		}
+		_raw[i] = raw;
+		_mg[i] = mg;
+		_slope[i] = _count ? _slope[i ? i - 1 : 1] : 0;
+		_count++;
+		updateSlopes();
+	}
+
+	int32_t toMilligram(int32_t raw) const
+	{
+		if (!_count)
+		{
+			return 0;
+		}
+		uint8_t i = 0;
+		while (i + 1 < _count && raw >= _raw[i + 1])
+		{
+			i++;
+		}
+		int64_t d = (int64_t)(raw - _raw[i]) * _slope[i];
+		return _mg[i] + (int32_t)((d + (1L << (FracBits - 1))) >> FracBits) - _tare;
+	}
+
+	// zero of the displayed weight (e.g. the empty hive), kept apart from
+	// the calibration points but saved with the table
+	void tare(int32_t raw)
+	{
+		_tare = 0;
+		_tare = toMilligram(raw);
+	}
+
+	int32_t tareMilligram() const
+	{
+		return _tare;
+	}
+
+	// raw count of the 0 mg point, or of the lowest point
+	int32_t zero() const
+	{
+		uint8_t i = find(0);
+		return i < _count ? _raw[i] : _raw[0];
+	}
+
+	// slope of the segment above zero, mg per count in Q format
+	int32_t slope() const
+	{
+		uint8_t i = find(0);
+		return _slope[i < _count ? i : 0];
+	}
+
+private:
+	static_assert(Points >= 1 && Points < 32, "Hx711FixedCal needs 1..31 points");
+	static_assert(FracBits >= 1 && FracBits <= 30, "Hx711FixedCal FracBits must be 1..30");
+
+	uint8_t find(int32_t mg) const
+	{
+		uint8_t i = 0;
+		while (i < _count && _mg[i] != mg)
+		{
+			i++;
+		}
+		return i;
+	}
+
+	uint8_t closest(int32_t mg) const
+	{
+		uint8_t best = 0;
+		uint32_t bestDist = 0xFFFFFFFFUL;
+		for (uint8_t i = 0; i < _count; i++)
+		{
+			int32_t d = _mg[i] - mg;
+			uint32_t dist = d < 0 ? (uint32_t)-d : (uint32_t)d;
+			if (_mg[i] != 0 && dist < bestDist)
+			{
+				best = i;
+				bestDist = dist;
+			}
+		}
+		return best;
+	}
+
+	void remove(uint8_t i)
+	{
+		for (_count--; i < _count; i++)
+		{
+			_raw[i] = _raw[i + 1];
+			_mg[i] = _mg[i + 1];
+			_slope[i] = _slope[i + 1];
+		}
+	}
+
+	void updateSlopes()
+	{
+		for (uint8_t i = 0; i + 1 < _count; i++)
+		{
+			int32_t dr = _raw[i + 1] - _raw[i];
+			if (dr)
+			{
+				_slope[i] = (int32_t)((int64_t)(_mg[i + 1] - _mg[i]) * ((int64_t)1 << FracBits) / dr);
+			}
+		}
+		// extrapolate above the last point with the last segment
+		if (_count > 1)
+		{
+			_slope[_count - 1] = _slope[_count - 2];
+		}
+	}
+
+	uint8_t _magic;
+	uint8_t _count;
+	int32_t _tare;
+	int32_t _raw[Points];
+	int32_t _mg[Points];
+	int32_t _slope[Points];
+};
+
+typedef Hx711FixedCal<HX711_CAL_POINTS, HX711_CAL_FRAC_BITS> Hx711Calibration;
+
+#endif /* HX711_FIXED_H_ */
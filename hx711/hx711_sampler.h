@@ -0,0 +1,242 @@
+/*
+ * hx711_sampler.h
+ *
+ * Hardware independent part of the Hx711 acquisition engine: the 24 bit
+ * shift-in sequence, a lock-free ring buffer and the DOUT driven sampler
+ * state machine. Pin access goes through a small "Pins" policy so the same
+ * code runs on the AVR (direct port access) and against a simulated chip
+ * on the host (see tests/).
+ *
+ * A Pins policy provides:
+ *	void clockHigh();
+ *	void clockLow();
+ *	uint8_t readData();	// 1 when DOUT is high
+ *	bool isReady();		// DOUT low, conversion available
+ */
+
+#ifndef HX711_SAMPLER_H_
+#define HX711_SAMPLER_H_
+
+#include <stdint.h>
+
+/*
+ * Pulses after a conversion select channel and gain of the next one.
+ * Channel B has a fixed gain of 32.
+ */
+enum
+{
+	HX711_CHANNEL_A_GAIN_128 = 25,
+	HX711_CHANNEL_B_GAIN_32 = 26,
+	HX711_CHANNEL_A_GAIN_64 = 27
+};
+
+#define HX711_PULSES_DEFAULT HX711_CHANNEL_A_GAIN_128
+
+/*
+ * Conversions started after a channel, gain or rate change that are not
+ * yet settled: the datasheet gives 4 output periods (400 ms at 10 SPS,
+ * 50 ms at 80 SPS) including the conversion in flight during the switch.
+ */
+#ifndef HX711_SETTLE_CONVERSIONS
+#define HX711_SETTLE_CONVERSIONS 3
+#endif
+
+/*
+ * Clocks one conversion out of the chip. The result is returned in the
+ * offset binary form used by Hx711::getValue(), i.e. 0x800000 is zero.
+ * Extra pulses beyond 24 select gain/channel of the next conversion.
+ */
+template <class Pins>
+inline uint32_t hx711ShiftIn(Pins &pins, uint8_t pulses = HX711_PULSES_DEFAULT)
+{
+	uint32_t value = 0;
+	for (uint8_t i = 24; i--;)
+	{
+		pins.clockHigh();
+		value = (value << 1) | pins.readData();
+		pins.clockLow();
+	}
+	for (uint8_t i = pulses - 24; i--;)
+	{
+		pins.clockHigh();
+		pins.clockLow();
+	}
+	return value ^ 0x800000UL;
+}
+
+/*
+ * Single producer (ISR) / single consumer (loop) ring buffer. Size must be
+ * a power of two no larger than 128 so indices stay in one byte and can be
+ * read atomically on the AVR.
+ */
+template <uint8_t Size>
+class Hx711Ring
+{
+public:
+	Hx711Ring() : _head(0), _tail(0), _overruns(0)
+	{
+	}
+
+	bool put(uint32_t value)
+	{
+		uint8_t head = _head;
+		if ((uint8_t)(head - _tail) == Size)
+		{
+			_overruns++;
+			return false;
+		}
+		_data[head & (Size - 1)] = value;
+		_head = head + 1;
+		return true;
+	}
+
+	bool get(uint32_t &value)
+	{
+		uint8_t tail = _tail;
+		if (tail == _head)
+		{
+			return false;
+		}
+		value = _data[tail & (Size - 1)];
+		_tail = tail + 1;
+		return true;
+	}
+
+	uint8_t available() const
+	{
+		return _head - _tail;
+	}
+
+	uint8_t overruns() const
+	{
+		return _overruns;
+	}
+
+	void clear()
+	{
+		_tail = _head;
+		_overruns = 0;
+	}
+
+private:
+	static_assert(Size && !(Size & (Size - 1)) && Size <= 128,
+			"Hx711Ring size must be a power of two <= 128");
+
+	volatile uint32_t _data[Size];
+	volatile uint8_t _head;
+	volatile uint8_t _tail;
+	volatile uint8_t _overruns;
+};
+
+/*
+ * Non blocking acquisition. onDataReady() is meant to be called from the
+ * DOUT falling edge interrupt; it clocks the conversion out and queues it.
+ * The main loop polls available() / read() and never waits on the chip.
+ */
+template <class Pins, uint8_t Size>
+class Hx711Sampler
+{
+public:
+	Hx711Sampler(Pins &pins) : _pins(pins), _running(false),
+			_pulses(HX711_PULSES_DEFAULT), _discard(0)
+	{
+	}
+
+	// channel/gain for the following conversions, drops unsettled ones
+	void setPulses(uint8_t pulses)
+	{
+		if (pulses != _pulses)
+		{
+			_pulses = pulses;
+			discard(1 + HX711_SETTLE_CONVERSIONS);
+		}
+	}
+
+	uint8_t pulses() const
+	{
+		return _pulses;
+	}
+
+	// drop the next n conversions, e.g. after the excitation was switched
+	void discard(uint8_t n)
+	{
+		if (n > _discard)
+		{
+			_discard = n;
+		}
+	}
+
+	bool isSettling() const
+	{
+		return _discard != 0;
+	}
+
+	/*
+	 * Clocks the waiting conversion out. Returns false while conversions
+	 * are being discarded; the chip is read anyway to start the next one.
+	 */
+	bool shift(uint32_t &value)
+	{
+		value = hx711ShiftIn(_pins, _pulses);
+		if (_discard)
+		{
+			_discard--;
+			return false;
+		}
+		return true;
+	}
+
+	void start()
+	{
+		_ring.clear();
+		_running = true;
+	}
+
+	void stop()
+	{
+		_running = false;
+	}
+
+	bool isRunning() const
+	{
+		return _running;
+	}
+
+	void onDataReady()
+	{
+		// DOUT also toggles while bits are clocked out, ignore those edges
+		if (!_running || !_pins.isReady())
+		{
+			return;
+		}
+		uint32_t value;
+		if (shift(value))
+		{
+			_ring.put(value);
+		}
+	}
+
+	uint8_t available() const
+	{
+		return _ring.available();
+	}
+
+	bool read(uint32_t &value)
+	{
+		return _ring.get(value);
+	}
+
+	uint8_t overruns() const
+	{
+		return _ring.overruns();
+	}
+
+private:
+	Pins &_pins;
+	Hx711Ring<Size> _ring;
+	volatile bool _running;
+	volatile uint8_t _pulses;
+	volatile uint8_t _discard;
+};
+
+#endif /* HX711_SAMPLER_H_ */
@@ -0,0 +1,164 @@
+/*
+ * hx711_tempcomp.h
+ *
+ * Temperature compensation of the load cell reading. A small 2D table
+ * holds the measured error at WeightPoints reference weights times
+ * TempBins equally spaced temperatures; a reading is corrected by bilinear
+ * interpolation between the four surrounding cells. The temperature bin
+ * is found with one division by a compile time constant and the weight
+ * segment by a walk over at most WeightPoints entries, so a lookup costs
+ * the same at any temperature. All math is integer.
+ *
+ * Temperatures are in 1/100 degC, as int16_t, e.g. from the HTU2xD or
+ * HDC1080 libraries: (int16_t)(sensor.readTemperature() * 100).
+ * Errors are stored as int16_t in units of UnitMg milligram.
+ */
+
+#ifndef HX711_TEMPCOMP_H_
+#define HX711_TEMPCOMP_H_
+
+#include <stdint.h>
+
+#ifndef HX711_TEMP_WEIGHT_POINTS
+#define HX711_TEMP_WEIGHT_POINTS 4
+#endif
+
+#ifndef HX711_TEMP_BINS
+#define HX711_TEMP_BINS 9 // -20 .. 60 degC
+#endif
+
+#ifndef HX711_TEMP_MIN
+#define HX711_TEMP_MIN -2000
+#endif
+
+#ifndef HX711_TEMP_STEP
+#define HX711_TEMP_STEP 1000
+#endif
+
+#ifndef HX711_TEMP_UNIT_MG
+#define HX711_TEMP_UNIT_MG 10
+#endif
+
+#ifndef HX711_TEMP_FULL_SCALE_MG
+#define HX711_TEMP_FULL_SCALE_MG 150000000L
+#endif
+
+template <uint8_t WeightPoints, uint8_t TempBins, int16_t TempMin, int16_t TempStep, uint16_t UnitMg>
+class Hx711TempComp
+{
+public:
+	static const uint8_t MAGIC = 0x7C;
+
+	// all corrections zero, reference weights spread up to fullScaleMg
+	void clear(int32_t fullScaleMg)
+	{
+		_magic = MAGIC;
+		for (uint8_t w = 0; w < WeightPoints; w++)
+		{
+			_weight[w] = WeightPoints > 1 ? fullScaleMg / (WeightPoints - 1) * w : 0;
+			for (uint8_t t = 0; t < TempBins; t++)
+			{
+				_error[w][t] = 0;
+			}
+		}
+	}
+
+	bool valid() const
+	{
+		return _magic == MAGIC;
+	}
+
+	void setWeight(uint8_t w, int32_t mg)
+	{
+		_weight[w] = mg;
+	}
+
+	int32_t weight(uint8_t w) const
+	{
+		return _weight[w];
+	}
+
+	static int16_t binTemperature(uint8_t t)
+	{
+		return TempMin + (int16_t)t * TempStep;
+	}
+
+	/*
+	 * Records the error seen while weighing reference weight w at the given
+	 * temperature, i.e. measured - true, in the nearest temperature bin.
+	 */
+	void learn(uint8_t w, int16_t temperature, int32_t errorMg)
+	{
+		int32_t t = ((int32_t)temperature - TempMin + TempStep / 2) / TempStep;
+		t = t < 0 ? 0 : (t >= TempBins ? TempBins - 1 : t);
+		int32_t e = (errorMg + (errorMg < 0 ? -(int32_t)UnitMg : (int32_t)UnitMg) / 2) / (int32_t)UnitMg;
+		_error[w][t] = e > 32767 ? 32767 : (e < -32768 ? -32768 : e);
+	}
+
+	// interpolated error in mg for a reading at the given temperature
+	int32_t error(int32_t mg, int16_t temperature) const
+	{
+		// temperature bin and position in it, clamped to the table
+		int32_t dt = (int32_t)temperature - TempMin;
+		uint8_t t;
+		int16_t ft;
+		if (dt <= 0)
+		{
+			t = 0;
+			ft = 0;
+		}
+		else if (dt >= (int32_t)(TempBins - 1) * TempStep)
+		{
+			t = TempBins - 2;
+			ft = TempStep;
+		}
+		else
+		{
+			t = dt / TempStep;
+			ft = dt - (int32_t)t * TempStep;
+		}
+
+		// weight segment, extrapolated flat outside the reference weights
+		uint8_t w = 0;
+		while (w + 2 < WeightPoints && mg >= _weight[w + 1])
+		{
+			w++;
+		}
+		int32_t span = _weight[w + 1] - _weight[w];
+		int32_t dw = mg - _weight[w];
+		dw = dw < 0 ? 0 : (dw > span ? span : dw);
+		// 0..256 weight fraction keeps the products below 2^31
+		int32_t unit = span >> 8;
+		int32_t fw = unit ? dw / unit : (span ? (dw << 8) / span : 0);
+		fw = fw > 256 ? 256 : fw;
+
+		int32_t lo = lerp(_error[w][t], _error[w][t + 1], ft);
+		int32_t hi = lerp(_error[w + 1][t], _error[w + 1][t + 1], ft);
+		return (lo * 256 + (hi - lo) * fw) / 256 * (int32_t)UnitMg / 16;
+	}
+
+	int32_t compensate(int32_t mg, int16_t temperature) const
+	{
+		return mg - error(mg, temperature);
+	}
+
+private:
+	static_assert(WeightPoints >= 2 && TempBins >= 2, "Hx711TempComp needs a 2x2 table at least");
+	static_assert(TempStep > 0, "Hx711TempComp temperature step must be positive");
+
+	// interpolation between two bins, in 1/16 units for rounding headroom;
+	// the products pass 2^31 for steps above about 20 degC
+	static int32_t lerp(int16_t a, int16_t b, int16_t f)
+	{
+		return (int32_t)(((int64_t)a * 16 * TempStep + ((int64_t)b - a) * 16 * f) / TempStep);
+	}
+
+	uint8_t _magic;
+	int32_t _weight[WeightPoints];
+	int16_t _error[WeightPoints][TempBins];
+};
+
+typedef Hx711TempComp<HX711_TEMP_WEIGHT_POINTS, HX711_TEMP_BINS, HX711_TEMP_MIN,
+		HX711_TEMP_STEP, HX711_TEMP_UNIT_MG> Hx711TemperatureTable;
+
+#endif /* HX711_TEMPCOMP_H_ */
@@ -0,0 +1,97 @@
+#include "hx711_array.h"
+#include "Hx711Sim.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+// four simulated chips on one clock, DOUT on port bits 1, 3, 4 and 6
+class SimPort {
+public:
+    SimPort() : reads(0) {}
+    void clockHigh() { for (int c = 0; c < 4; c++) chip[c].clockHigh(); }
+    void clockLow() { for (int c = 0; c < 4; c++) chip[c].clockLow(); }
+    uint8_t readPort() {
+        reads++;
+        uint8_t port = 0xA5 & ~MASK_ALL; // unrelated pins on the port
+        for (int c = 0; c < 4; c++) {
+            port |= chip[c].readData() ? masks[c] : 0;
+        }
+        return port;
+    }
+
+    static const uint8_t MASK_ALL = 0x5A;
+    static const uint8_t masks[4];
+    Hx711Sim chip[4];
+    uint32_t reads;
+};
+const uint8_t SimPort::masks[4] = { 0x02, 0x08, 0x10, 0x40 };
+
+typedef Hx711ArrayCore<4, SimPort> SimArray;
+
+int test_not_ready() {
+    IT("waits until every channel has a conversion");
+    SimArray array;
+    array.setMasks(SimPort::masks);
+    uint32_t values[4];
+    int32_t total;
+
+    IS_FALSE(array.isReady());
+    array.pins().chip[0].convert(1);
+    array.pins().chip[1].convert(2);
+    array.pins().chip[2].convert(3);
+    IS_FALSE(array.read(values, total));
+    IS_EQUAL(array.pins().chip[0].clockEdges(), 0UL);
+
+    END_IT
+}
+
+int test_parallel_read() {
+    IT("reads all channels on the same clock edges");
+    SimArray array;
+    array.setMasks(SimPort::masks);
+    const int32_t raw[4] = { 120000, -5000, 0x7FFFFF, -0x800000 };
+    for (int c = 0; c < 4; c++) {
+        array.pins().chip[c].convert(raw[c]);
+    }
+
+    uint32_t values[4];
+    int32_t total;
+    IS_TRUE(array.read(values, total));
+    for (int c = 0; c < 4; c++) {
+        IS_EQUAL(values[c], (uint32_t)(raw[c] + 0x800000));
+        IS_EQUAL(array.pins().chip[c].pulses(), 25);
+    }
+    IS_EQUAL(total, 120000 - 5000 + 0x7FFFFF - 0x800000);
+    // one port read per bit plus the ready check
+    IS_EQUAL(array.pins().reads, 24UL + 1);
+    IS_EQUAL(array.pins().chip[0].clockEdges(), 25UL);
+
+    END_IT
+}
+
+int test_gain_pulses() {
+    IT("passes gain pulses to every chip");
+    SimArray array;
+    array.setMasks(SimPort::masks);
+    for (int c = 0; c < 4; c++) {
+        array.pins().chip[c].convert(c);
+    }
+    uint32_t values[4];
+    int32_t total;
+    IS_TRUE(array.read(values, total, 27));
+    IS_EQUAL(total, 0 + 1 + 2 + 3);
+    for (int c = 0; c < 4; c++) {
+        IS_EQUAL(array.pins().chip[c].pulses(), 27);
+    }
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Array");
+    test_not_ready();
+    test_parallel_read();
+    test_gain_pulses();
+
+    FINISH
+}
@@ -0,0 +1,120 @@
+/*
+ * Compares filter chains on a sample trace: conversions needed until the
+ * output settles within +-TOLERANCE counts of the true level, the error
+ * after a full weighing and the RAM each chain costs.
+ *
+ *	$ bin/filter_bench [trace.txt]
+ *
+ * A trace file holds one raw conversion per line, e.g. captured from
+ * Hx711::getValue() over Serial, with the reference level on the first
+ * line. Without a file a synthetic hive trace is used: gaussian-ish noise,
+ * occasional spikes (bees landing, wind) and no drift.
+ */
+
+#include "hx711_filter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#define TOLERANCE 20
+
+// plain mean, what Hx711::averageValue() does
+class MeanFilter {
+public:
+    MeanFilter() { reset(); }
+    void reset() { _sum = 0; _n = 0; }
+    bool update(int32_t in, int32_t &out) {
+        _sum += in;
+        _n++;
+        out = (int32_t)(_sum / _n);
+        return true;
+    }
+private:
+    int64_t _sum;
+    int32_t _n;
+};
+
+static uint32_t lcg = 12345;
+static int32_t uniform(int32_t range) {
+    lcg = lcg * 1103515245 + 12345;
+    return (int32_t)((lcg >> 8) % (2 * range + 1)) - range;
+}
+
+static void syntheticTrace(std::vector<int32_t> &trace, int32_t &level, int windows) {
+    level = 0x800000 + 250000;
+    for (int w = 0; w < windows; w++) {
+        for (int i = 0; i < 16; i++) {
+            int32_t noise = uniform(40) + uniform(40) + uniform(40);
+            if (uniform(100) > 88) {
+                noise += uniform(1) ? 6000 : -4000;
+            }
+            trace.push_back(level + noise);
+        }
+    }
+}
+
+template <class Filter>
+void bench(const char *name, const std::vector<int32_t> &trace, int32_t level) {
+    Filter filter;
+    int windows = 0, settledSum = 0, unsettled = 0;
+    int64_t errSum = 0;
+    for (size_t start = 0; start + 16 <= trace.size(); start += 16) {
+        filter.reset();
+        int32_t out = trace[start];
+        int settled = -1;
+        for (int i = 0; i < 16; i++) {
+            if (filter.update(trace[start + i], out)) {
+                if (abs(out - level) <= TOLERANCE) {
+                    if (settled < 0) {
+                        settled = i + 1;
+                    }
+                } else {
+                    settled = -1;
+                }
+            }
+        }
+        if (settled < 0) {
+            unsettled++;
+        } else {
+            settledSum += settled;
+        }
+        errSum += abs(out - level);
+        windows++;
+    }
+    printf("%-40s %4u B  settle %5.1f conv  unsettled %3d/%d  final err %6.1f\n", name,
+            (unsigned)sizeof(Filter), windows > unsettled ? (double)settledSum / (windows - unsettled) : 0.0,
+            unsettled, windows, (double)errSum / windows);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<int32_t> trace;
+    int32_t level;
+    if (argc > 1) {
+        FILE *f = fopen(argv[1], "r");
+        long v;
+        if (!f || fscanf(f, "%ld", &v) != 1) {
+            fprintf(stderr, "cannot read %s\n", argv[1]);
+            return 1;
+        }
+        level = v;
+        while (fscanf(f, "%ld", &v) == 1) {
+            trace.push_back(v);
+        }
+        fclose(f);
+    } else {
+        syntheticTrace(trace, level, 200);
+    }
+    printf("%u conversions in windows of 16, tolerance +-%d counts\n\n", (unsigned)trace.size(), TOLERANCE);
+
+    bench<MeanFilter>("mean (averageValue)", trace, level);
+    bench<Hx711MedianFilter<5> >("median<5>", trace, level);
+    bench<Hx711MedianFilter<9> >("median<9>", trace, level);
+    bench<Hx711TrimmedMean<8, 2> >("trimmed<8,2>", trace, level);
+    bench<Hx711FilterChain<Hx711IirFilter<2> > >("iir<2>", trace, level);
+    bench<Hx711FilterChain<Hx711MadGate<8, 4>, Hx711IirFilter<2> > >("mad<8,4> + iir<2>", trace, level);
+    bench<Hx711FilterChain<Hx711MedianFilter<3>, Hx711IirFilter<2> > >("median<3> + iir<2>", trace, level);
+    bench<Hx711DefaultFilter>("default: mad<8,4> + trimmed<8,2>", trace, level);
+
+    return 0;
+}
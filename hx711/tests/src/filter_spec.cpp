@@ -0,0 +1,131 @@
+#include "hx711_filter.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+template <class Filter>
+int32_t feed(Filter &filter, const int32_t *samples, int count, int *outputs = 0) {
+    int32_t out = 0;
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (filter.update(samples[i], out)) {
+            n++;
+        }
+    }
+    if (outputs) {
+        *outputs = n;
+    }
+    return out;
+}
+
+int test_median() {
+    IT("tracks the median of the window");
+    Hx711MedianFilter<5> filter;
+    const int32_t samples[] = { 10, 50, 20, 90000, 30, 40, -70000 };
+
+    IS_EQUAL(feed(filter, samples, 4), 50);
+    filter.reset();
+    IS_EQUAL(feed(filter, samples, 5), 30);
+    IS_EQUAL(feed(filter, samples + 5, 2), 30);
+
+    END_IT
+}
+
+int test_sorted_window_eviction() {
+    IT("evicts samples in arrival order");
+    Hx711SortedWindow<3> window;
+    window.insert(5);
+    window.insert(5);
+    window.insert(1);
+    window.insert(9);
+    window.insert(9);
+    IS_EQUAL(window.count(), 3);
+    IS_EQUAL(window.median(), 9);
+    window.insert(-3);
+    IS_EQUAL(window.median(), 9);
+    window.insert(-3);
+    IS_EQUAL(window.median(), -3);
+
+    END_IT
+}
+
+int test_trimmed_mean() {
+    IT("drops the extremes before averaging");
+    Hx711TrimmedMean<6, 1> filter;
+    const int32_t samples[] = { 8388000, 8388010, 16000000, 8388020, 8388030, 0 };
+
+    IS_EQUAL(feed(filter, samples, 6), 8388015);
+
+    END_IT
+}
+
+int test_iir() {
+    IT("converges to a step without truncation stall");
+    Hx711IirFilter<3> filter;
+    int32_t out;
+    filter.update(-1000, out);
+    IS_EQUAL(out, -1000);
+    for (int i = 0; i < 200; i++) {
+        filter.update(1000, out);
+    }
+    IS_EQUAL(out, 999);
+
+    END_IT
+}
+
+int test_mad() {
+    IT("computes the median absolute deviation");
+    Hx711SortedWindow<7> window;
+    const int32_t samples[] = { 1, 1, 2, 2, 4, 6, 9 };
+    for (int i = 0; i < 7; i++) {
+        window.insert(samples[i]);
+    }
+    IS_EQUAL(window.median(), 2);
+    IS_EQUAL(window.mad(), 1UL);
+
+    END_IT
+}
+
+int test_mad_gate() {
+    IT("rejects spikes and follows real load changes");
+    Hx711MadGate<8, 3, 4> gate;
+    const int32_t samples[] = { 100, 102, 98, 101, 99, 5000, 100, -4000, 103 };
+    int outputs;
+    IS_EQUAL(feed(gate, samples, 9, &outputs), 103);
+    IS_EQUAL(outputs, 7);
+
+    const int32_t step[] = { 2000, 2001, 1999, 2002, 2000 };
+    feed(gate, step, 5, &outputs);
+    IS_EQUAL(outputs, 2);
+
+    END_IT
+}
+
+int test_chain() {
+    IT("chains stages and stops on rejection");
+    Hx711FilterChain<Hx711MadGate<8, 3, 4>, Hx711MedianFilter<3>, Hx711IirFilter<1> > chain;
+    const int32_t samples[] = { 100, 100, 100, 100, 90000 };
+    int outputs;
+    IS_EQUAL(feed(chain, samples, 5, &outputs), 100);
+    IS_EQUAL(outputs, 4);
+
+    Hx711FilterChain<> empty;
+    int32_t out;
+    IS_TRUE(empty.update(42, out));
+    IS_EQUAL(out, 42);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Filter");
+    test_median();
+    test_sorted_window_eviction();
+    test_trimmed_mean();
+    test_iir();
+    test_mad();
+    test_mad_gate();
+    test_chain();
+
+    FINISH
+}
@@ -0,0 +1,148 @@
+#include "hx711_fixed.h"
+#include "BDDTest.h"
+#include "trace.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef Hx711FixedCal<4, 16> Cal;
+
+// worst case error in mg of the fixed point path against double math
+double maxError(Cal &cal, double offset, double countsPerGram, int32_t lo, int32_t hi) {
+    double worst = 0;
+    srand(1);
+    for (int i = 0; i < 20000; i++) {
+        int32_t raw = lo + (int32_t)((double)rand() / RAND_MAX * (hi - lo));
+        double ref = (raw - offset) / countsPerGram * 1000.0;
+        double err = fabs(cal.toMilligram(raw) - ref);
+        if (err > worst) {
+            worst = err;
+        }
+    }
+    return worst;
+}
+
+int test_linear() {
+    IT("matches the float reference within the slope quantisation");
+    Cal cal;
+    // typical hive scale: 742 counts per gram, 24 bit offset binary
+    const int32_t offset = 0x800000 + 12345;
+    cal.setLinear(offset, (int32_t)lround(1000.0 * 65536 / 742.0));
+
+    double err = maxError(cal, offset, 742.0, offset - 1000000, 0xFFFFFF);
+    TRACE("max error " << err << " mg\n");
+    // slope quantisation is 1/65536 mg per count, 8.4M counts -> 128 mg worst
+    IS_TRUE(err < 130.0);
+
+    END_IT
+}
+
+int test_two_point() {
+    IT("derives the slope from two calibration points");
+    Cal cal;
+    cal.clear();
+    const int32_t offset = 0x800000 - 5000;
+    const double countsPerGram = 742.37;
+    cal.addPoint(offset, 0);
+    cal.addPoint(offset + (int32_t)lround(countsPerGram * 50000), 50000000L);
+    IS_EQUAL(cal.count(), 2);
+    IS_EQUAL(cal.toMilligram(offset), 0);
+    IS_EQUAL(cal.toMilligram(offset + (int32_t)lround(countsPerGram * 50000)), 50000000L);
+
+    // 0..100 kg with 1 mg + 3 ppm of full scale allowed
+    double err = maxError(cal, offset, countsPerGram, offset, offset + (int32_t)(countsPerGram * 100000));
+    TRACE("max error " << err << " mg\n");
+    IS_TRUE(err < 1.0 + 100000000.0 * 3e-6);
+
+    END_IT
+}
+
+int test_piecewise() {
+    IT("interpolates between points of a non linear cell");
+    Cal cal;
+    cal.clear();
+    cal.addPoint(1000, 0);
+    cal.addPoint(201000, 20000000L);
+    cal.addPoint(101000, 10500000L);
+
+    IS_EQUAL(cal.count(), 3);
+    IS_EQUAL(cal.toMilligram(1000), 0);
+    IS_EQUAL(cal.toMilligram(51000), 5250000L);
+    IS_EQUAL(cal.toMilligram(101000), 10500000L);
+    IS_EQUAL(cal.toMilligram(151000), 15250000L);
+    // extrapolation uses the outer segments
+    IS_EQUAL(cal.toMilligram(251000), 24750000L);
+    IS_EQUAL(cal.toMilligram(-99000), -10500000L);
+
+    END_IT
+}
+
+int test_rezero() {
+    IT("shifts the whole curve when zero is recalibrated");
+    Cal cal;
+    cal.clear();
+    cal.addPoint(1000, 0);
+    cal.addPoint(11000, 1000000L);
+    cal.addPoint(1500, 0);
+
+    IS_EQUAL(cal.count(), 2);
+    IS_EQUAL(cal.zero(), 1500);
+    IS_EQUAL(cal.toMilligram(11500), 1000000L);
+
+    END_IT
+}
+
+int test_full_table() {
+    IT("replaces the closest weight when the table is full");
+    Cal cal;
+    cal.clear();
+    cal.addPoint(0, 0);
+    cal.addPoint(1000, 1000);
+    cal.addPoint(2000, 2000);
+    cal.addPoint(3000, 3000);
+    cal.addPoint(2200, 2100);
+
+    IS_EQUAL(cal.count(), 4);
+    IS_EQUAL(cal.toMilligram(2200), 2100);
+    IS_EQUAL(cal.toMilligram(0), 0);
+    IS_EQUAL(cal.toMilligram(3000), 3000);
+
+    END_IT
+}
+
+int test_tare() {
+    IT("subtracts the tare weight");
+    Cal cal;
+    cal.setLinear(1000, 65536);
+    cal.tare(1500);
+    IS_EQUAL(cal.tareMilligram(), 500);
+    IS_EQUAL(cal.toMilligram(1500), 0);
+    IS_EQUAL(cal.toMilligram(2500), 1000);
+
+    END_IT
+}
+
+int test_erased() {
+    IT("rejects erased EEPROM content");
+    Cal cal;
+    memset((void *)&cal, 0xFF, sizeof(cal));
+    IS_FALSE(cal.valid());
+    cal.clear();
+    IS_TRUE(cal.valid());
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Fixed point");
+    test_linear();
+    test_two_point();
+    test_piecewise();
+    test_rezero();
+    test_full_table();
+    test_tare();
+    test_erased();
+
+    FINISH
+}
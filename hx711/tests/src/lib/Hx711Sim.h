@@ -0,0 +1,72 @@
+#ifndef hx711sim_h
+#define hx711sim_h
+
+#include <stdint.h>
+
+/*
+ * Host side model of the HX711 serial interface, usable as a Pins policy.
+ * convert() finishes a conversion: DOUT goes low and the value is shifted
+ * out MSB first on the rising clock edges. The number of pulses clocked
+ * for a conversion selects channel/gain of the following one.
+ */
+class Hx711Sim {
+public:
+    Hx711Sim() : _value(0), _bit(0), _clock(false), _dout(1), _pulses(0), _clockEdges(0) {}
+
+    // a new signed 24 bit conversion is available, returns DOUT falling
+    bool convert(int32_t value) {
+        latch();
+        _value = (uint32_t)value & 0xFFFFFF;
+        _dout = 0;
+        return true;
+    }
+
+    void clockHigh() {
+        _clock = true;
+        _clockEdges++;
+        if (_bit < 24) {
+            _dout = (_value >> (23 - _bit)) & 1;
+        } else {
+            _dout = 1;
+        }
+        _bit++;
+    }
+
+    void clockLow() {
+        _clock = false;
+    }
+
+    uint8_t readData() {
+        return _dout;
+    }
+
+    bool isReady() {
+        return _dout == 0;
+    }
+
+    // pulses clocked during the last complete transfer
+    uint8_t pulses() {
+        latch();
+        return _pulses;
+    }
+
+    uint32_t clockEdges() { return _clockEdges; }
+    bool clockIsLow() { return !_clock; }
+
+private:
+    void latch() {
+        if (_bit) {
+            _pulses = _bit;
+            _bit = 0;
+        }
+    }
+
+    uint32_t _value;
+    uint8_t _bit;
+    bool _clock;
+    uint8_t _dout;
+    uint8_t _pulses;
+    uint32_t _clockEdges;
+};
+
+#endif
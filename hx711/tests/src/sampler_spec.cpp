@@ -0,0 +1,192 @@
+#include "hx711_sampler.h"
+#include "Hx711Sim.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+typedef Hx711Sampler<Hx711Sim, 8> SimSampler;
+
+int test_shift_in() {
+    IT("shifts out a conversion as offset binary");
+    Hx711Sim sim;
+
+    sim.convert(0);
+    IS_EQUAL(hx711ShiftIn(sim), 0x800000UL);
+    sim.convert(-1);
+    IS_EQUAL(hx711ShiftIn(sim), 0x7FFFFFUL);
+    sim.convert(0x123456);
+    IS_EQUAL(hx711ShiftIn(sim), 0x923456UL);
+    sim.convert(-0x800000);
+    IS_EQUAL(hx711ShiftIn(sim), 0UL);
+
+    IS_EQUAL(sim.pulses(), 25);
+    IS_TRUE(sim.clockIsLow());
+    IS_FALSE(sim.isReady());
+
+    END_IT
+}
+
+int test_idle_sampler() {
+    IT("ignores data ready while stopped");
+    Hx711Sim sim;
+    SimSampler sampler(sim);
+
+    sampler.onDataReady();
+    IS_EQUAL(sampler.available(), 0);
+    IS_EQUAL(sim.clockEdges(), 0UL);
+
+    END_IT
+}
+
+int test_sampling() {
+    IT("queues one sample per DOUT falling edge");
+    Hx711Sim sim;
+    SimSampler sampler(sim);
+    sampler.start();
+
+    for (int32_t i = 0; i < 5; i++) {
+        if (sim.convert(i * 1000 - 2000)) {
+            sampler.onDataReady();
+        }
+        // edges from DOUT toggling during the transfer must be ignored
+        sampler.onDataReady();
+    }
+    IS_EQUAL(sampler.available(), 5);
+    IS_EQUAL(sim.clockEdges(), 5UL * 25);
+
+    uint32_t value;
+    for (int32_t i = 0; i < 5; i++) {
+        IS_TRUE(sampler.read(value));
+        IS_EQUAL(value, (uint32_t)(0x800000 + i * 1000 - 2000));
+    }
+    IS_FALSE(sampler.read(value));
+    IS_EQUAL(sampler.available(), 0);
+
+    END_IT
+}
+
+int test_overrun() {
+    IT("counts overruns when the loop does not keep up");
+    Hx711Sim sim;
+    SimSampler sampler(sim);
+    sampler.start();
+
+    for (int32_t i = 0; i < 11; i++) {
+        sim.convert(i);
+        sampler.onDataReady();
+    }
+    IS_EQUAL(sampler.available(), 8);
+    IS_EQUAL(sampler.overruns(), 3);
+
+    // oldest samples are kept, the chip is still read to rearm DOUT
+    uint32_t value;
+    IS_TRUE(sampler.read(value));
+    IS_EQUAL(value, 0x800000UL);
+    IS_FALSE(sim.isReady());
+
+    sampler.start();
+    IS_EQUAL(sampler.available(), 0);
+    IS_EQUAL(sampler.overruns(), 0);
+
+    END_IT
+}
+
+int test_wraparound() {
+    IT("keeps order across index wraparound");
+    Hx711Sim sim;
+    SimSampler sampler(sim);
+    sampler.start();
+
+    uint32_t value;
+    for (int32_t i = 0; i < 1000; i++) {
+        sim.convert(i);
+        sampler.onDataReady();
+        if (i % 3 == 2) {
+            for (int32_t j = i - 2; j <= i; j++) {
+                IS_TRUE(sampler.read(value));
+                IS_EQUAL(value, (uint32_t)(0x800000 + j));
+            }
+        }
+    }
+    IS_EQUAL(sampler.overruns(), 0);
+
+    END_IT
+}
+
+int test_gain() {
+    IT("clocks the gain pulses and drops unsettled conversions");
+    Hx711Sim sim;
+    SimSampler sampler(sim);
+    sampler.start();
+
+    sim.convert(1);
+    sampler.onDataReady();
+    IS_EQUAL(sim.pulses(), HX711_CHANNEL_A_GAIN_128);
+
+    sampler.setPulses(HX711_CHANNEL_B_GAIN_32);
+    IS_TRUE(sampler.isSettling());
+    for (int32_t i = 2; i < 2 + 1 + HX711_SETTLE_CONVERSIONS; i++) {
+        sim.convert(i);
+        sampler.onDataReady();
+        IS_EQUAL(sim.pulses(), HX711_CHANNEL_B_GAIN_32);
+    }
+    IS_FALSE(sampler.isSettling());
+    sim.convert(100);
+    sampler.onDataReady();
+
+    uint32_t value;
+    IS_EQUAL(sampler.available(), 2);
+    IS_TRUE(sampler.read(value));
+    IS_EQUAL(value, 0x800001UL);
+    IS_TRUE(sampler.read(value));
+    IS_EQUAL(value, 0x800064UL);
+
+    // same setting again costs nothing
+    sampler.setPulses(HX711_CHANNEL_B_GAIN_32);
+    IS_FALSE(sampler.isSettling());
+
+    END_IT
+}
+
+int test_discard() {
+    IT("drops conversions on request without shortening a running discard");
+    Hx711Sim sim;
+    SimSampler sampler(sim);
+    uint32_t value;
+
+    sampler.setPulses(HX711_CHANNEL_A_GAIN_64);
+    sampler.discard(1);
+    int dropped = 0;
+    for (int32_t i = 0; i < 10; i++) {
+        sim.convert(i);
+        if (!sampler.shift(value)) {
+            dropped++;
+        }
+    }
+    IS_EQUAL(dropped, 1 + HX711_SETTLE_CONVERSIONS);
+    IS_EQUAL(sim.pulses(), HX711_CHANNEL_A_GAIN_64);
+
+    sampler.discard(2);
+    sim.convert(5);
+    IS_FALSE(sampler.shift(value));
+    sim.convert(6);
+    IS_FALSE(sampler.shift(value));
+    sim.convert(7);
+    IS_TRUE(sampler.shift(value));
+    IS_EQUAL(value, 0x800007UL);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Sampler");
+    test_shift_in();
+    test_idle_sampler();
+    test_sampling();
+    test_overrun();
+    test_wraparound();
+    test_gain();
+    test_discard();
+
+    FINISH
+}
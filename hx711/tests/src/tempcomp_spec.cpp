@@ -0,0 +1,101 @@
+#include "hx711_tempcomp.h"
+#include "BDDTest.h"
+#include "trace.h"
+
+// 0, 50 and 100 kg at -20, -10 .. 60 degC, 10 mg units
+typedef Hx711TempComp<3, 9, -2000, 1000, 10> Table;
+
+int test_empty() {
+    IT("leaves readings alone while the table is empty");
+    Table table;
+    table.clear(100000000L);
+    IS_TRUE(table.valid());
+    IS_EQUAL(table.weight(1), 50000000L);
+    IS_EQUAL(table.compensate(42000000L, 2500), 42000000L);
+    IS_EQUAL(Table::binTemperature(3), 1000);
+
+    END_IT
+}
+
+int test_cells() {
+    IT("returns the learned error on the grid points");
+    Table table;
+    table.clear(100000000L);
+    table.learn(0, 1000, 2000);     // zero drifts +2 g at 10 degC
+    table.learn(2, 3980, -15000);   // rounds to the 40 degC bin
+
+    IS_EQUAL(table.error(0, 1000), 2000);
+    IS_EQUAL(table.error(100000000L, 4000), -15000);
+    IS_EQUAL(table.error(100000000L, 3000), 0);
+
+    END_IT
+}
+
+int test_bilinear() {
+    IT("interpolates between temperatures and weights");
+    Table table;
+    table.clear(100000000L);
+    table.learn(0, 2000, 1000);
+    table.learn(0, 3000, 3000);
+    table.learn(1, 2000, 5000);
+    table.learn(1, 3000, 7000);
+
+    IS_EQUAL(table.error(0, 2500), 2000);
+    IS_EQUAL(table.error(50000000L, 2500), 6000);
+    IS_EQUAL(table.error(25000000L, 2500), 4000);
+    IS_EQUAL(table.error(25000000L, 2000), 3000);
+    IS_EQUAL(table.compensate(25000000L, 2750), 25000000L - 4500);
+
+    END_IT
+}
+
+int test_clamp() {
+    IT("clamps outside the table");
+    Table table;
+    table.clear(100000000L);
+    table.learn(0, -2000, 500);
+    table.learn(2, 6000, 900);
+
+    IS_EQUAL(table.error(-1000000L, -4000), 500);
+    IS_EQUAL(table.error(200000000L, 8000), 900);
+
+    END_IT
+}
+
+int test_saturate() {
+    IT("saturates errors beyond the int16 cell range");
+    Table table;
+    table.clear(100000000L);
+    table.learn(1, 0, 10000000L);
+    IS_EQUAL(table.error(50000000L, 0), 327670);
+
+    END_IT
+}
+
+int test_wide_step() {
+    IT("interpolates over a wide temperature step");
+    // 0 and 50 degC only
+    Hx711TempComp<2, 2, 0, 5000, 10> table;
+    table.clear(100000000L);
+    table.learn(0, 0, 300000L);
+    table.learn(0, 5000, -300000L);
+
+    IS_EQUAL(table.error(0, 1000), 180000L);
+    IS_EQUAL(table.error(0, 4000), -180000L);
+
+    END_IT
+}
+
+int main()
+{
+    SUITE("Temperature compensation");
+    TRACE("table size " << sizeof(Table) << " bytes\n");
+    test_empty();
+    test_cells();
+    test_bilinear();
+    test_clamp();
+    test_saturate();
+    test_wide_step();
+
+    FINISH
+}
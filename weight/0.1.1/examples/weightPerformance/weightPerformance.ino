@@ -10,6 +10,7 @@
 #include "weight.h"
 
 volatile float val, test;
+volatile int32_t ival, itest;
 float stone, lbs, ounce, kilo, kg;
 
 uint32_t start, stop;
@@ -22,6 +23,7 @@ void setup()
   Serial.println("\nFUNCTION:\tTIME (us)");
   // measure_1();
   measure_2();
+  measure_3();
 }
 
 void loop()
@@ -139,3 +141,63 @@ void measure_2()
 
   Serial.println("\nDone...");
 }
+
+
+// float helpers against the typed units, cycles per conversion
+void report(const char * name)
+{
+  Serial.print(name);
+  Serial.println((stop - start) * (F_CPU / 1000000UL) / 1000.0, 1);
+  delay(100);
+}
+
+void measure_3()
+{
+  typedef Weight<weight_unit::kilogram, float> KiloF;
+  typedef Weight<weight_unit::pound, float>    PoundF;
+
+  test = random(20) * 0.12345;
+  itest = random(20000);
+
+  Serial.println("\nCONVERSION:\tCYCLES");
+
+  start = micros();
+  for (int i = 0; i < 1000; i++) val = lbs2kilo(test);
+  stop = micros();
+  report("lbs2kilo:\t");
+
+  start = micros();
+  for (int i = 0; i < 1000; i++) val = weight_cast<KiloF>(PoundF(test)).value();
+  stop = micros();
+  report("Pounds->Kilo f:\t");
+
+  start = micros();
+  for (int i = 0; i < 1000; i++) val = kilo2gram(test);
+  stop = micros();
+  report("kilo2gram:\t");
+
+  start = micros();
+  for (int i = 0; i < 1000; i++) ival = weight_cast<Grams>(Kilograms(itest)).value();
+  stop = micros();
+  report("Kilo->Grams i:\t");
+
+  start = micros();
+  for (int i = 0; i < 1000; i++) ival = weight_cast<Kilograms>(Grams(itest)).value();
+  stop = micros();
+  report("Grams->Kilo i:\t");
+
+  start = micros();
+  for (int i = 0; i < 1000; i++) ival = weight_cast<Grams>(Pounds(itest)).value();
+  stop = micros();
+  report("Pounds->Grams i:\t");
+
+  start = micros();
+  for (int i = 0; i < 1000; i++) ival = weight_cast<Grams>(Grams(itest)).value();
+  stop = micros();
+  report("Grams->Grams i:\t");
+
+  start = micros();
+  for (int i = 0; i < 1000; i++) ival = weight_cast<Grams>(Kilograms(20)).value();
+  stop = micros();
+  report("constant:\t");
+}
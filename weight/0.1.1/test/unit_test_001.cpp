@@ -137,6 +137,73 @@ unittest(test_US2metric)
 }
 
 
+unittest(test_typed_same_unit)
+{
+  Grams g(1234);
+  assertEqual(1234, weight_cast<Grams>(g).value());
+  assertEqual(1234, (g + Grams(0)).value());
+  assertTrue(Grams(1) < Grams(2));
+  assertEqual(sizeof(int32_t), sizeof(Grams));
+}
+
+
+unittest(test_typed_compile_time)
+{
+  // resolved by the compiler, no runtime conversion code
+  static_assert(weight_cast<Grams>(Kilograms(2)).value() == 2000, "kilo2gram");
+  static_assert(weight_cast<Ounces>(Pounds(3)).value() == 48, "lbs2ounce");
+  static_assert(weight_cast<Pounds>(Stone(2)).value() == 28, "stone2lbs");
+  static_assert(weight_cast<Grams>(Pounds(1)).value() == 454, "lbs2gram");
+  static_assert(weight_cast<Milligrams>(Stone(3)).value() == 19050880, "stone2milligram");
+  assertTrue(true);
+}
+
+
+unittest(test_typed_rounding)
+{
+  assertEqual(2, weight_cast<Kilograms>(Grams(1500)).value());
+  assertEqual(1, weight_cast<Kilograms>(Grams(1499)).value());
+  assertEqual(-2, weight_cast<Kilograms>(Grams(-1500)).value());
+  // near the int32 limit
+  assertEqual(2147, weight_cast<Kilograms>(Milligrams(2147000000)).value());
+  assertEqual(-2147, weight_cast<Kilograms>(Milligrams(-2147000000)).value());
+  assertEqual(2147484, weight_cast<Grams>(Milligrams(2147483647)).value());
+  assertEqual(1400, weight_cast<Grams>(Weight<weight_unit::kilogram, float>(1.4)).value());
+  assertEqual(-3, weight_cast<Grams>(Weight<weight_unit::gram, float>(-2.6)).value());
+}
+
+
+unittest(test_typed_vs_float)
+{
+  typedef Weight<weight_unit::kilogram, float> KiloF;
+  typedef Weight<weight_unit::pound, float>    PoundF;
+  typedef Weight<weight_unit::ounce, float>    OunceF;
+  typedef Weight<weight_unit::gram, float>     GramF;
+  typedef Weight<weight_unit::stone, float>    StoneF;
+
+  for (int i = 0; i < 10; i++)
+  {
+    float val = random(10000) * 0.01;
+    assertEqualFloat(lbs2kilo(val),   weight_cast<KiloF>(PoundF(val)).value(), 0.0001);
+    assertEqualFloat(kilo2lbs(val),   weight_cast<PoundF>(KiloF(val)).value(), 0.001);
+    assertEqualFloat(ounce2gram(val), weight_cast<GramF>(OunceF(val)).value(), 0.001);
+    assertEqualFloat(stone2kilo(val), weight_cast<KiloF>(StoneF(val)).value(), 0.001);
+    assertEqualFloat(kilo2stone(val), weight_cast<StoneF>(KiloF(val)).value(), 0.0001);
+  }
+}
+
+
+unittest(test_typed_integer_vs_float)
+{
+  for (int i = 0; i < 10; i++)
+  {
+    int32_t val = random(1000);
+    assertEqual((int32_t)(ounce2gram(val) + 0.5), weight_cast<Grams>(Ounces(val)).value());
+    assertEqual((int32_t)(kilo2gram(val)), weight_cast<Grams>(Kilograms(val)).value());
+  }
+}
+
+
 unittest_main()
 
 // --------
@@ -12,32 +12,33 @@
 
 
 #include "Arduino.h"
+#include <stdint.h>
 
 
 #define WEIGHT_LIB_VERSION        (F("0.1.1"))
 
 
-float lbs2kilo(float lbs)     { return lbs   * 0.45359237; };
-float kilo2lbs(float kilos)   { return kilos * 2.20462262; };
+inline float lbs2kilo(float lbs)     { return lbs   * 0.45359237; };
+inline float kilo2lbs(float kilos)   { return kilos * 2.20462262; };
 
-float ounce2gram(float ounce) { return ounce * 28.3495231; };
-float gram2ounce(float gram)  { return gram  * 0.03527396195; };
+inline float ounce2gram(float ounce) { return ounce * 28.3495231; };
+inline float gram2ounce(float gram)  { return gram  * 0.03527396195; };
 
-float gram2kilo(float gram)   { return gram  * 0.001; };
-float kilo2gram( float kilo)  { return kilo  * 1000; };
+inline float gram2kilo(float gram)   { return gram  * 0.001; };
+inline float kilo2gram( float kilo)  { return kilo  * 1000; };
 
-float lbs2ounce(float lbs)    { return lbs   * 16; };
-float ounce2lbs(float ounce)  { return ounce * 0.0625; };
+inline float lbs2ounce(float lbs)    { return lbs   * 16; };
+inline float ounce2lbs(float ounce)  { return ounce * 0.0625; };
 
-float stone2lbs(float stone)  { return stone * 14; };
-float lbs2stone(float lbs)    { return lbs   * 0.0714285714; };
+inline float stone2lbs(float stone)  { return stone * 14; };
+inline float lbs2stone(float lbs)    { return lbs   * 0.0714285714; };
 
-float stone2kilo(float stone) { return stone * 6.35029318; };
-float kilo2stone(float kilo)  { return kilo  * 0.157473044; };
+inline float stone2kilo(float stone) { return stone * 6.35029318; };
+inline float kilo2stone(float kilo)  { return kilo  * 0.157473044; };
 
 
 // returns kilo
-float US2metric(float stone, float lbs, float ounce)
+inline float US2metric(float stone, float lbs, float ounce)
 {
   float kilo = stone * 6.35029318;
   kilo += lbs * 0.45359237;
@@ -47,7 +48,7 @@ float US2metric(float stone, float lbs, float ounce)
 
 
 // returns lbs;
-float metric2US(float kilo, float &stone, float &lbs, float &ounce)
+inline float metric2US(float kilo, float &stone, float &lbs, float &ounce)
 {
   float val = kilo * 2.20462262;
   lbs = val;
@@ -58,6 +59,199 @@ float metric2US(float kilo, float &stone, float &lbs, float &ounce)
   return val;
 }
 
+
+////////////////////////////////////////////////////////////
+//
+// TYPED UNITS
+//
+// Weight<Unit, T> holds a value of one unit in storage T, integer
+// (default int32_t), fixed point or float. Units are exact ratios to
+// the gram, a conversion multiplies by the reduced ratio From/To which
+// is computed at compile time; same unit conversion is a no-op.
+//
+//   Grams g(1500);
+//   Kilograms kg = weight_cast<Kilograms>(g);   // 2 (rounded)
+//   Weight<weight_unit::kilogram, float> f = weight_cast<Weight<weight_unit::kilogram, float> >(g);
+//
+
+namespace weight_unit
+{
+  template <uint64_t Num, uint64_t Den>
+  struct ratio
+  {
+    static constexpr uint64_t num = Num;
+    static constexpr uint64_t den = Den;
+  };
+
+  // grams per unit, exact by definition of the avoirdupois pound
+  typedef ratio<1, 1000>                    milligram;
+  typedef ratio<1, 1>                       gram;
+  typedef ratio<1000, 1>                    kilogram;
+  typedef ratio<45359237, 100000>           pound;
+  typedef ratio<45359237, 1600000>          ounce;
+  typedef ratio<45359237ULL * 14, 100000>   stone;
+
+  constexpr uint64_t gcd(uint64_t a, uint64_t b)
+  {
+    return b == 0 ? a : gcd(b, a % b);
+  }
+
+  // From -> To factor as a reduced fraction
+  template <class From, class To>
+  struct factor
+  {
+    static constexpr uint64_t n = From::num * To::den;
+    static constexpr uint64_t d = From::den * To::num;
+    static constexpr uint64_t num = n / gcd(n, d);
+    static constexpr uint64_t den = d / gcd(n, d);
+  };
+
+  template <typename T>
+  struct is_float
+  {
+    static constexpr bool value = (T(1) / T(2)) != T(0);
+  };
+
+  enum { SAME, MULTIPLY, DIVIDE, FRACTION };
+
+  template <class F>
+  struct mode
+  {
+    static constexpr int value = F::num == 1 ? (F::den == 1 ? SAME : DIVIDE) : (F::den == 1 ? MULTIPLY : FRACTION);
+  };
+
+  // integer storage: exact fraction with round to nearest
+  template <class F, typename T, bool Integral, int Mode>
+  struct convert
+  {
+    static constexpr T apply(T v)
+    {
+      return (T)(((int64_t)v * (int64_t)F::num + (v < 0 ? -(int64_t)(F::den / 2) : (int64_t)(F::den / 2))) / (int64_t)F::den);
+    }
+  };
+
+  template <class F, typename T>
+  struct convert<F, T, true, MULTIPLY>
+  {
+    static constexpr T apply(T v) { return v * (T)F::num; }
+  };
+
+  template <class F, typename T>
+  struct convert<F, T, true, DIVIDE>
+  {
+    // quotient and remainder, so no sum near the limit of T can overflow
+    static constexpr T apply(T v)
+    {
+      return round(v / (T)F::den, v % (T)F::den);
+    }
+
+    // the remainder has the sign of v: round half away from zero
+    static constexpr T round(T q, T r)
+    {
+      return r < 0 ? (-r >= (T)(F::den - F::den / 2) ? q - 1 : q)
+                   : (r >= (T)(F::den - F::den / 2) ? q + 1 : q);
+    }
+  };
+
+  // floating point storage: one multiply by a compile time constant
+  template <class F, typename T, int Mode>
+  struct convert<F, T, false, Mode>
+  {
+    static constexpr T apply(T v) { return v * ((T)F::num / (T)F::den); }
+  };
+
+  template <class F, typename T>
+  struct convert<F, T, true, SAME>
+  {
+    static constexpr T apply(T v) { return v; }
+  };
+
+  template <class F, typename T>
+  struct convert<F, T, false, SAME>
+  {
+    static constexpr T apply(T v) { return v; }
+  };
+
+  template <class From, class To, typename T>
+  constexpr T convert_value(T v)
+  {
+    typedef factor<From, To> F;
+    return convert<F, T, (!is_float<T>::value), mode<F>::value>::apply(v);
+  }
+
+  // storage a conversion is done in, floating point if either side is
+  template <typename T, typename T2, bool Float = is_float<T>::value, bool Float2 = is_float<T2>::value>
+  struct work
+  {
+    typedef T type;
+  };
+
+  template <typename T, typename T2>
+  struct work<T, T2, false, true>
+  {
+    typedef T2 type;
+  };
+
+  // floating point to integer storage rounds to nearest
+  template <typename T, typename W>
+  constexpr T store(W v)
+  {
+    return (is_float<W>::value && !is_float<T>::value) ? (T)(v < 0 ? v - W(0.5) : v + W(0.5)) : (T)v;
+  }
+}
+
+
+template <class Unit, typename T = int32_t>
+class Weight
+{
+public:
+  typedef Unit unit;
+  typedef T    rep;
+
+  constexpr Weight() : _value(0) {};
+  constexpr explicit Weight(T value) : _value(value) {};
+
+  // conversion from another unit or storage, see weight_cast
+  template <class U2, typename T2>
+  constexpr explicit Weight(const Weight<U2, T2> &w)
+  : _value(weight_unit::store<T>(weight_unit::convert_value<U2, Unit, typename weight_unit::work<T, T2>::type>(w.value()))) {};
+
+  constexpr T value() const { return _value; };
+
+  constexpr Weight operator + (const Weight &w) const { return Weight(_value + w._value); };
+  constexpr Weight operator - (const Weight &w) const { return Weight(_value - w._value); };
+  constexpr Weight operator - () const                { return Weight(-_value); };
+  constexpr Weight operator * (T f) const             { return Weight(_value * f); };
+  constexpr Weight operator / (T f) const             { return Weight(_value / f); };
+  Weight & operator += (const Weight &w)              { _value += w._value; return *this; };
+  Weight & operator -= (const Weight &w)              { _value -= w._value; return *this; };
+
+  constexpr bool operator == (const Weight &w) const  { return _value == w._value; };
+  constexpr bool operator != (const Weight &w) const  { return _value != w._value; };
+  constexpr bool operator <  (const Weight &w) const  { return _value <  w._value; };
+  constexpr bool operator >  (const Weight &w) const  { return _value >  w._value; };
+  constexpr bool operator <= (const Weight &w) const  { return _value <= w._value; };
+  constexpr bool operator >= (const Weight &w) const  { return _value >= w._value; };
+
+private:
+  T _value;
+};
+
+
+template <class To, class Unit, typename T>
+constexpr To weight_cast(const Weight<Unit, T> &w)
+{
+  return To(w);
+}
+
+
+typedef Weight<weight_unit::milligram>  Milligrams;
+typedef Weight<weight_unit::gram>       Grams;
+typedef Weight<weight_unit::kilogram>   Kilograms;
+typedef Weight<weight_unit::pound>      Pounds;
+typedef Weight<weight_unit::ounce>      Ounces;
+typedef Weight<weight_unit::stone>      Stone;
+
 // -- END OF FILE --
 
 //Added by Sloeber 